@@ -0,0 +1,2885 @@
+#include <sys/resource.h>
+#include <dlfcn.h>
+#include <sys/wait.h>
+#include <pty.h>
+#include <csignal>
+#include <cstdarg>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <new>
+#include <random>
+#include <vector>
+#include <boost/array.hpp>
+#include <boost/thread.hpp>
+#include <control/flightReplay.hpp>
+#include <control/quadControlTask.hpp>
+#include <core/baseClient.hpp>
+#include <core/baseServer.hpp>
+#include <core/deviceTask.hpp>
+#include <core/flightRecorder.hpp>
+#include <core/latencyTrace.hpp>
+#include <core/metrics.hpp>
+#include <core/shmRing.hpp>
+#include <core/statsServer.hpp>
+#include <core/subscription.hpp>
+#include <device/edgeSource.hpp>
+#include <device/i2c.hpp>
+#include <sensor/gpsTask.hpp>
+#include <sensor/imuTask.hpp>
+#include <sensor/mpu9250Sim.hpp>
+#include <sim/monteCarlo.hpp>
+#include <sim/quadSimulator.hpp>
+#include <stream/ewma.hpp>
+#include <stream/filter.hpp>
+#include <stream/rateIntegral.hpp>
+
+#define BENCH_FETCH_MICROSECONDS    2000            // simulated time spent on the bus inside fetch()
+#define BENCH_DEVICE_RATE           1000            // the IMU task rate
+#define BENCH_DEVICE_FETCH_MICROS   300             // an MPU9250 FIFO burst over 400 kHz I2C, held under the mutex
+#define BENCH_DEVICE_READS          5000            // reads per reader
+#define BENCH_DEVICE_READ_SPACING   137             // us from one read to the next, so reads land all over a period
+#define BENCH_DEVICE_BLOCKED_NANOS  10000           // a read slower than this waited for fetch()
+#define BENCH_SCHEDULER_FREQUENCY   100             // frequency in Hz
+#define BENCH_SCHEDULER_SECONDS     2
+#define BENCH_IMU_SAMPLES           200000          // samples pushed through the driver and filters
+#define BENCH_IMU_RATE              1000            // IMU sample rate in Hz for the end to end run
+#define BENCH_IMU_SECONDS           2
+#define BENCH_I2C_BUS               250             // /dev/i2c-250 is served by the mock adapter below
+#define BENCH_I2C_PATH              "/dev/i2c-250"
+#define BENCH_I2C_SAMPLES           21000           // IMU samples read through I2CDevice per path
+#define BENCH_SERVER_PORT           5901
+#define BENCH_SERVER_CLIENTS        32              // client i asks for 10 * (i + 1) Hz
+#define BENCH_SERVER_SECONDS        3
+#define BENCH_ACCEPT_PORT           5910
+#define BENCH_WIRE_FRAMES           20000           // frames encoded per format
+#define BENCH_WIRE_PORT             5902
+#define BENCH_JSON_FRAMES           20000           // randomized frames compared against json::dump()
+#define BENCH_SHM_NAME              "/quadcopter.benchmark"
+#define BENCH_SHM_PORT              5903
+#define BENCH_SHM_RATE              1000            // publish rate in Hz
+#define BENCH_SHM_SAMPLES           2000            // samples received per transport
+#define BENCH_UDP_PORT              5904
+#define BENCH_UDP_GROUP             "239.255.0.1"
+#define BENCH_UDP_RATE              1000            // publish rate in Hz
+#define BENCH_UDP_SECONDS           2
+#define BENCH_FRAMER_FRAMES         100000          // frames pushed through the framer per run
+#define BENCH_FRAMER_PORT           5905
+#define BENCH_SUBSCRIPTION_PORT     5906
+#define BENCH_SUBSCRIPTION_CLIENTS  16
+#define BENCH_SUBSCRIPTION_K        10              // history depth of the synthetic IMU task
+#define BENCH_SUBSCRIPTION_SECONDS  2
+#define BENCH_SUBSCRIPTION_FRAMES   1000            // frames per selection for the allocation count of getFrame()
+#define BENCH_BACKPRESSURE_PORT     5907
+#define BENCH_BACKPRESSURE_TIMEOUT  2000            // write timeout of the server in ms
+#define BENCH_RECORDER_PATH         "/tmp/quadcopter-benchmark.qdr"
+#define BENCH_RECORDER_RATE         1000            // IMU values per second; control at a tenth, GPS at a hundredth
+#define BENCH_RECORDER_SECONDS      2
+#define BENCH_RECORDER_BURST        200000          // values pushed back to back into a large queue
+#define BENCH_REPLAY_CONTROL_RATE   100             // control loop in Hz while recording, IMU at BENCH_IMU_RATE
+#define BENCH_REPLAY_SECONDS        3
+#define BENCH_SIMULATOR_SECONDS     20              // simulated flight time
+#define BENCH_SIMULATOR_SETTLING    5               // seconds the default gains may take to settle the tilt
+#define BENCH_MONTE_CARLO_FLIGHTS   32              // flights per parameter set
+#define BENCH_MONTE_CARLO_SECONDS   MONTE_CARLO_SECONDS     // simulated time per flight; wind takes seconds to settle
+#define BENCH_LATENCY_RECORDS       1000000         // durations recorded into one histogram
+#define BENCH_LATENCY_CONTROL_RATE  100             // control and motor loops in Hz, IMU at BENCH_IMU_RATE
+#define BENCH_LATENCY_SECONDS       3
+#define BENCH_STATS_PORT            5908
+#define BENCH_METRICS_UPDATES       10000000        // counter increments timed back to back
+#define BENCH_METRICS_PORT          5909
+#define BENCH_METRICS_SECONDS       2
+#define BENCH_MICRO_BATCH_NANOS     2000000         // a timed batch of one case runs for about 2 ms
+#define BENCH_MICRO_BATCHES         31              // timed batches per case, the median is reported
+#define BENCH_MICRO_INPUTS          256             // random inputs cycled through, a power of two
+#define BENCH_MICRO_SEED            20181103
+#define BENCH_MICRO_TOLERANCE       0.10            // slower than the baseline by more than this is a regression
+#define BENCH_NMEA_EPOCHS           20000           // epochs of 8 sentences in the recorded stream
+#define BENCH_NMEA_CORRUPT_EVERY    97              // every 97th sentence gets a flipped byte
+#define BENCH_UART_BAUD             921600
+#define BENCH_UART_RATE             20              // GPS epochs per second written into the pseudo terminal
+#define BENCH_UART_SECONDS          2
+#define BENCH_UART_CHUNK            32              // bytes written at a time, paced at the baud rate
+#define BENCH_UBX_EPOCHS            20000           // epochs of NAV-PVT, NAV-STATUS and a GGA in the generated stream
+#define BENCH_UBX_CORRUPT_EVERY     97              // every 97th frame gets a flipped byte
+#define BENCH_MICRO_GPS_BLOCK       "$GPGLL,3720.61633,N,12200.67448,W,050105.00,A,D*70\r\n" \
+                                    "$GPRMC,050105.00,A,3720.61633,N,12200.67448,W,0.045,,301018,,,D*63\r\n" \
+                                    "$GPVTG,,T,,M,0.045,N,0.083,K,D*2C\r\n" \
+                                    "$GPGGA,050105.00,3720.61633,N,12200.67448,W,2,11,0.86,48.8,M,-30.0,M,,0000*57\r\n" \
+                                    "$GPGSA,A,3,05,13,15,18,20,21,24,26,29,,,,1.53,0.86,1.27*0D\r\n"
+
+using namespace std;
+
+typedef chrono::steady_clock benchClock;
+
+// checks that failed; main() exits with 1 if there are any
+int benchFailures = 0;
+
+/**
+ * Record a correctness check. A failure is reported on stderr and makes the benchmark exit with 1.
+ */
+void expect(bool ok, const string &what) {
+    if (!ok) {
+        cerr << "CHECK FAILED: " << what << endl;
+        benchFailures++;
+    }
+}
+
+// every allocation in the process, to check that a code path does not allocate
+atomic<long long> allocationCount(0);
+
+void *operator new(size_t size) {
+    allocationCount++;
+    void *p = malloc(size == 0 ? 1 : size);
+    if (!p) {
+        throw bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+struct BenchValue {
+    static const uint8_t wireType = WIRE_TYPE_UNKNOWN;
+
+    long long timestamp = 0;
+    double payload[16] = {};
+
+    json toJson() {
+        json j;
+        j["timestamp"] = timestamp;
+        return j;
+    }
+
+    static const vector<string> &fieldNames() {
+        static const vector<string> names;
+        return names;
+    }
+
+    void writeJson(JsonWriter &writer, uint32_t fields = WIRE_ALL_FIELDS) {
+        writer.beginObject();
+        writer.field("timestamp", timestamp);
+        writer.endObject();
+    }
+
+    void toBinary(BinaryWriter &writer, uint32_t fields = WIRE_ALL_FIELDS) {
+        writer.putI64(timestamp);
+    }
+
+    void fromBinary(BinaryReader &reader, uint32_t fields = WIRE_ALL_FIELDS) {
+        timestamp = reader.getI64();
+    }
+};
+
+/**
+ * Device task that keeps the producer busy in every fetch, like an I2C FIFO read.
+ */
+class BusyDeviceTask : public DeviceTask<BenchValue> {
+private:
+    const int fetchMicroseconds;
+
+public:
+    explicit BusyDeviceTask(const int &samplingFrequency = 1000000,
+                            const int fetchMicroseconds = BENCH_FETCH_MICROSECONDS)
+        : DeviceTask(samplingFrequency, 1), fetchMicroseconds(fetchMicroseconds) {
+    }
+
+    BenchValue getDataLocked() {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        return *result->getCurrentValue();
+    }
+
+    /**
+     * A frame built under the task mutex, as the servers used to.
+     */
+    string getBinaryLocked() {
+        string buffer;
+        boost::lock_guard<boost::mutex> lk(mtx);
+        result->toBinary(buffer);
+        return buffer;
+    }
+
+protected:
+    void fetch() override {
+        DeviceTask::fetch();
+        auto *value = result->getCurrentValue();
+        auto end = benchClock::now() + chrono::microseconds(fetchMicroseconds);
+        do {
+            value->timestamp++;
+            for (double &p : value->payload) {
+                p = value->timestamp;
+            }
+        } while (benchClock::now() < end);
+    }
+};
+
+void report(const string &name, vector<double> &nanos) {
+    sort(nanos.begin(), nanos.end());
+    size_t n = nanos.size();
+    cout << name << ": reads=" << n
+         << " p50=" << nanos[n / 2] << "ns"
+         << " p99=" << nanos[n * 99 / 100] << "ns"
+         << " p99.9=" << nanos[n * 999 / 1000] << "ns"
+         << " max=" << nanos[n - 1] << "ns" << endl;
+}
+
+/**
+ * Time count reads, starting one every spacingMicros; a reader returns something derived from what it read. The
+ * reader sleeps in between, as a server thread does, so the producer also gets a single core.
+ */
+template<class Reader>
+vector<double> measureReads(int count, int spacingMicros, Reader reader) {
+    vector<double> nanos;
+    nanos.reserve(count);
+    long long checksum = 0;
+    auto next = boost::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        next += boost::chrono::microseconds(spacingMicros);
+        auto start = benchClock::now();
+        checksum += reader();
+        auto end = benchClock::now();
+        nanos.push_back(chrono::duration<double, nano>(end - start).count());
+        boost::this_thread::sleep_until(next);
+    }
+    if (checksum < 0) {
+        cout << "checksum " << checksum << endl;
+    }
+    return nanos;
+}
+
+/**
+ * report() and the share of reads that waited for fetch().
+ */
+void reportBlocked(const string &name, vector<double> &nanos) {
+    long blocked = count_if(nanos.begin(), nanos.end(), [](double n) {
+        return n > BENCH_DEVICE_BLOCKED_NANOS;
+    });
+    report(name, nanos);
+    cout << "  blocked (>" << BENCH_DEVICE_BLOCKED_NANOS / 1000 << "us): " << blocked << " = "
+         << 100.0 * blocked / nanos.size() << "%" << endl;
+}
+
+/**
+ * Readers of a task at the IMU rate whose fetch() holds the mutex for a FIFO burst: getData() from the seqlock and
+ * the server frames from the published snapshots, against the same reads under the mutex. Reads are spread over the
+ * whole period, so the tail shows how long a reader can be held up by fetch().
+ */
+void benchmarkDeviceTask() {
+    BusyDeviceTask task(BENCH_DEVICE_RATE, BENCH_DEVICE_FETCH_MICROS);
+    boost::thread producer(boost::bind(&BusyDeviceTask::run, &task));
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(10));
+
+    vector<double> seqLockNanos = measureReads(BENCH_DEVICE_READS, BENCH_DEVICE_READ_SPACING, [&task]() {
+        return task.getData().timestamp;
+    });
+    reportBlocked("deviceTask.getData (seqlock)", seqLockNanos);
+
+    vector<double> mutexNanos = measureReads(BENCH_DEVICE_READS, BENCH_DEVICE_READ_SPACING, [&task]() {
+        return task.getDataLocked().timestamp;
+    });
+    reportBlocked("deviceTask.getData (mutex)", mutexNanos);
+
+    // the frames the servers send
+    vector<double> historyNanos = measureReads(BENCH_DEVICE_READS, BENCH_DEVICE_READ_SPACING, [&task]() {
+        return static_cast<long long>(task.getBinary().size());
+    });
+    reportBlocked("deviceTask.getBinary (history snapshot)", historyNanos);
+
+    vector<double> latestNanos = measureReads(BENCH_DEVICE_READS, BENCH_DEVICE_READ_SPACING, [&task]() {
+        return static_cast<long long>(task.getBinary(WIRE_ALL_FIELDS, true).size());
+    });
+    reportBlocked("deviceTask.getBinary latest (seqlock)", latestNanos);
+
+    vector<double> lockedFrameNanos = measureReads(BENCH_DEVICE_READS, BENCH_DEVICE_READ_SPACING, [&task]() {
+        return static_cast<long long>(task.getBinaryLocked().size());
+    });
+    reportBlocked("deviceTask.getBinary (mutex)", lockedFrameNanos);
+
+    task.shutdown();
+    producer.join();
+    cout << "  producer " << task.getStats().toString() << endl;
+}
+
+/**
+ * Achieved rate of a 100 Hz task whose fetch() takes 2 ms, with sleep-after-work versus absolute deadlines.
+ */
+void benchmarkScheduler() {
+    BusyDeviceTask task(BENCH_SCHEDULER_FREQUENCY);
+    boost::thread producer(boost::bind(&BusyDeviceTask::run, &task));
+    boost::this_thread::sleep_for(boost::chrono::seconds(BENCH_SCHEDULER_SECONDS));
+    cout << "scheduler (absolute deadline): " << task.getStats().toString() << endl;
+    task.shutdown();
+    producer.join();
+
+    int iterations = 0;
+    auto start = benchClock::now();
+    auto end = start + chrono::seconds(BENCH_SCHEDULER_SECONDS);
+    while (benchClock::now() < end) {
+        auto busy = benchClock::now() + chrono::microseconds(BENCH_FETCH_MICROSECONDS);
+        while (benchClock::now() < busy) {
+        }
+        boost::this_thread::sleep_for(boost::chrono::microseconds(1000000 / BENCH_SCHEDULER_FREQUENCY));
+        iterations++;
+    }
+    double seconds = chrono::duration<double>(benchClock::now() - start).count();
+    cout << "scheduler (sleep after work): iterations=" << iterations << " rate=" << iterations / seconds << "Hz"
+         << endl;
+}
+
+/**
+ * Scheduling setup available to this process. Without CAP_SYS_NICE the threads fall back to the default scheduler.
+ */
+void benchmarkRealtime() {
+    boost::thread thread = launchThread(ThreadConfig("bench-rt", 50, vector<int>{0}, true), []() {
+        PeriodicTimer timer(1000);
+        for (int i = 0; i < 1000; ++i) {
+            timer.wait();
+        }
+        cout << "realtime 1 kHz loop: " << timer.getStats().toString() << endl;
+    });
+    thread.join();
+}
+
+/**
+ * Wakeup latency of a task blocked on a data ready edge. A polling loop with a 1 ms interval adds 0.5 ms on average.
+ */
+void benchmarkEdgeSource() {
+    FakeEdgeSource edge;
+    const int count = 2000;
+    vector<double> nanos;
+    nanos.reserve(count);
+    std::atomic<long long> triggerTime(0);
+
+    boost::thread waiter([&]() {
+        for (int i = 0; i < count; ++i) {
+            edge.wait(1000);
+            long long now = chrono::duration_cast<chrono::nanoseconds>(benchClock::now().time_since_epoch()).count();
+            nanos.push_back(now - triggerTime.load());
+        }
+    });
+    for (int i = 0; i < count; ++i) {
+        boost::this_thread::sleep_for(boost::chrono::microseconds(500));
+        triggerTime = chrono::duration_cast<chrono::nanoseconds>(benchClock::now().time_since_epoch()).count();
+        edge.trigger();
+    }
+    waiter.join();
+    report("edgeSource wakeup", nanos);
+}
+
+/**
+ * MPU9250::read() and IMU::applyFilters() against a simulated chip that always has a full burst queued, then
+ * IMUSensorTask end to end against a simulated chip sampling in real time.
+ */
+void benchmarkIMU() {
+    SimulatedMPU9250Config config;
+    config.realTime = false;
+    config.samplesPerPoll = MPU9250_FIFO_BURST_SAMPLES;
+    SimulatedMPU9250 chip(config);
+    MPU9250<IMUValue> imu(&chip);
+    imu.setSampleRate(BENCH_IMU_RATE);
+    if (!imu.discover() || !imu.imuInit()) {
+        cout << "imu: simulated MPU9250 init failed" << endl;
+        return;
+    }
+
+    IMUValue imuData;
+    double delta_t = 0.0;
+    I2CStats before = chip.getStats();
+    double readNanos = 0.0, filterNanos = 0.0;
+    for (int i = 0; i < BENCH_IMU_SAMPLES; ++i) {
+        auto start = benchClock::now();
+        while (!imu.read(delta_t, &imuData)) {
+        }
+        auto read = benchClock::now();
+        imu.applyFilters(delta_t, &imuData);
+        auto end = benchClock::now();
+        readNanos += chrono::duration<double, nano>(read - start).count();
+        filterNanos += chrono::duration<double, nano>(end - read).count();
+    }
+    I2CStats after = chip.getStats();
+    cout << "imu.read: " << readNanos / BENCH_IMU_SAMPLES << "ns/sample, "
+         << double(after.transactions - before.transactions) / BENCH_IMU_SAMPLES << " bus transactions/sample"
+         << endl;
+    cout << "imu.applyFilters: " << filterNanos / BENCH_IMU_SAMPLES << "ns/sample" << endl;
+
+    SimulatedMPU9250 realTimeChip;
+    IMUSensorTask task(BENCH_IMU_RATE, 1, BENCH_IMU_RATE, &realTimeChip);
+    TimerEdgeSource dataReady(task.getSampleRate());
+    task.setDataReadySource(&dataReady);
+    SimulatedMPU9250Counters countersBefore = realTimeChip.getCounters();
+    I2CStats statsBefore = realTimeChip.getStats();
+    boost::thread producer(boost::bind(&IMUSensorTask::run, &task));
+    boost::this_thread::sleep_for(boost::chrono::seconds(BENCH_IMU_SECONDS));
+    task.shutdown();
+    producer.join();
+    SimulatedMPU9250Counters counters = realTimeChip.getCounters();
+    I2CStats stats = realTimeChip.getStats();
+    long long samples = counters.samplesRead - countersBefore.samplesRead;
+    cout << "imuSensorTask at " << task.getSampleRate() << "Hz: samples=" << samples
+         << " generated=" << counters.samplesGenerated - countersBefore.samplesGenerated
+         << " overflows=" << counters.overflows
+         << " bus transactions/sample=" << double(stats.transactions - statsBefore.transactions) / samples << endl;
+}
+
+/**
+ * Mock I2C adapter behind /dev/i2c-BENCH_I2C_BUS. The benchmark interposes open, ioctl, read and write: calls on the
+ * mock descriptor are counted here and the register accesses they carry go to a SimulatedMPU9250, every other
+ * descriptor goes to libc. This way the real I2CDevice code is measured, with its own I2CStats checked against the
+ * calls that actually arrived.
+ */
+struct MockI2CAdapter {
+    atomic<int> fd{-1};
+    bool combined = true;               // report I2C_FUNC_I2C, i.e. I2C_RDWR support
+    I2CBus *chip = nullptr;
+    unsigned char slave = 0;
+    unsigned char pointer = 0;          // register address of the last write
+    long long syscalls = 0;
+    long long transactions = 0;         // START ... STOP on the bus; an I2C_RDWR is one however many messages
+
+    bool isMock(int descriptor) {
+        return descriptor >= 0 && descriptor == fd.load();
+    }
+
+    int ioctl(unsigned long request, void *arg) {
+        syscalls++;
+        switch (request) {
+            case I2C_FUNCS:
+                *static_cast<unsigned long *>(arg) = combined ? I2C_FUNC_I2C : 0;
+                return 0;
+            case I2C_SLAVE:
+                slave = static_cast<unsigned char>(reinterpret_cast<uintptr_t>(arg) & 0x7f);
+                return 0;
+            case I2C_RDWR: {
+                if (!combined) {
+                    errno = EOPNOTSUPP;
+                    return -1;
+                }
+                transactions++;
+                auto *transfer = static_cast<i2c_rdwr_ioctl_data *>(arg);
+                for (__u32 i = 0; i < transfer->nmsgs; ++i) {
+                    i2c_msg &message = transfer->msgs[i];
+                    auto address = static_cast<unsigned char>(message.addr);
+                    bool acknowledged = true;
+                    if (message.flags & I2C_M_RD) {
+                        acknowledged = chip->deviceRead(address, pointer, message.buf, "",
+                                                        static_cast<unsigned char>(message.len));
+                    } else if (message.len > 0) {
+                        pointer = message.buf[0];
+                        if (message.len > 1) {
+                            acknowledged = chip->deviceWrite(address, pointer, message.buf + 1, "",
+                                                             static_cast<unsigned char>(message.len - 1));
+                        }
+                    }
+                    if (!acknowledged) {
+                        errno = EIO;
+                        return -1;
+                    }
+                }
+                return static_cast<int>(transfer->nmsgs);
+            }
+            default:
+                errno = ENOTTY;
+                return -1;
+        }
+    }
+
+    ssize_t read(void *buffer, size_t count) {
+        syscalls++;
+        transactions++;
+        if (!chip->deviceRead(slave, pointer, static_cast<unsigned char *>(buffer), "",
+                              static_cast<unsigned char>(count))) {
+            errno = EIO;
+            return -1;
+        }
+        return static_cast<ssize_t>(count);
+    }
+
+    ssize_t write(const void *buffer, size_t count) {
+        syscalls++;
+        transactions++;
+        const auto *bytes = static_cast<const unsigned char *>(buffer);
+        pointer = bytes[0];
+        if (count > 1 && !chip->deviceWrite(slave, pointer, bytes + 1, "", static_cast<unsigned char>(count - 1))) {
+            errno = EIO;
+            return -1;
+        }
+        return static_cast<ssize_t>(count);
+    }
+};
+
+MockI2CAdapter mockI2C;
+
+template<class F>
+F libcFunction(const char *name) {
+    return reinterpret_cast<F>(dlsym(RTLD_NEXT, name));
+}
+
+typedef int (*OpenFunction)(const char *, int, ...);
+
+int openFile(OpenFunction real, const char *path, int flags, va_list args) {
+    if (strcmp(path, BENCH_I2C_PATH) == 0) {
+        int fd = real("/dev/null", O_RDWR | O_CLOEXEC);
+        mockI2C.chip->deviceOpen();
+        mockI2C.fd = fd;
+        return fd;
+    }
+    mode_t mode = (flags & (O_CREAT | O_TMPFILE)) ? static_cast<mode_t>(va_arg(args, int)) : 0;
+    return real(path, flags, mode);
+}
+
+extern "C" int benchOpen(const char *path, int flags, ...) __asm__("open");
+extern "C" int benchOpen64(const char *path, int flags, ...) __asm__("open64");
+extern "C" int benchIoctl(int fd, unsigned long request, ...) __asm__("ioctl");
+extern "C" ssize_t benchRead(int fd, void *buffer, size_t count) __asm__("read");
+extern "C" ssize_t benchReadChk(int fd, void *buffer, size_t count, size_t size) __asm__("__read_chk");
+extern "C" ssize_t benchWrite(int fd, const void *buffer, size_t count) __asm__("write");
+
+int benchOpen(const char *path, int flags, ...) {
+    static OpenFunction real = libcFunction<OpenFunction>("open");
+    va_list args;
+    va_start(args, flags);
+    int fd = openFile(real, path, flags, args);
+    va_end(args);
+    return fd;
+}
+
+int benchOpen64(const char *path, int flags, ...) {
+    static OpenFunction real = libcFunction<OpenFunction>("open64");
+    va_list args;
+    va_start(args, flags);
+    int fd = openFile(real, path, flags, args);
+    va_end(args);
+    return fd;
+}
+
+int benchIoctl(int fd, unsigned long request, ...) {
+    static auto real = libcFunction<int (*)(int, unsigned long, ...)>("ioctl");
+    va_list args;
+    va_start(args, request);
+    void *arg = va_arg(args, void *);
+    va_end(args);
+    return mockI2C.isMock(fd) ? mockI2C.ioctl(request, arg) : real(fd, request, arg);
+}
+
+ssize_t benchRead(int fd, void *buffer, size_t count) {
+    static auto real = libcFunction<ssize_t (*)(int, void *, size_t)>("read");
+    return mockI2C.isMock(fd) ? mockI2C.read(buffer, count) : real(fd, buffer, count);
+}
+
+ssize_t benchReadChk(int fd, void *buffer, size_t count, size_t size) {
+    static auto real = libcFunction<ssize_t (*)(int, void *, size_t, size_t)>("__read_chk");
+    return mockI2C.isMock(fd) ? mockI2C.read(buffer, count) : real(fd, buffer, count, size);
+}
+
+ssize_t benchWrite(int fd, const void *buffer, size_t count) {
+    static auto real = libcFunction<ssize_t (*)(int, const void *, size_t)>("write");
+    return mockI2C.isMock(fd) ? mockI2C.write(buffer, count) : real(fd, buffer, count);
+}
+
+/**
+ * MPU9250 driver on I2CDevice over the mock adapter, with I2C_RDWR and with the split write and read of adapters
+ * without it: system calls and bus transactions per sample, for one sample per FIFO burst (the IMU task at the
+ * sample rate) and for full bursts.
+ */
+void benchmarkI2C() {
+    for (int samplesPerBurst : {1, MPU9250_FIFO_BURST_SAMPLES}) {
+        for (bool combined : {true, false}) {
+            SimulatedMPU9250Config config;
+            config.realTime = false;
+            config.samplesPerPoll = samplesPerBurst;
+            SimulatedMPU9250 chip(config);
+            mockI2C.chip = &chip;
+            mockI2C.combined = combined;
+            bool dataMatches = true;
+            long long syscalls, transactions;
+            I2CStats counted;
+            {
+                I2CDevice bus;
+                bus.i2CBus = BENCH_I2C_BUS;
+                MPU9250<IMUValue> imu(&bus);
+                imu.setSampleRate(BENCH_IMU_RATE);
+                if (!imu.discover() || !imu.imuInit()) {
+                    cout << "i2c: MPU9250 init over the mock adapter failed" << endl;
+                    mockI2C.fd = -1;
+                    return;
+                }
+                long long syscallsBefore = mockI2C.syscalls, transactionsBefore = mockI2C.transactions;
+                I2CStats countedBefore = bus.getStats();
+                IMUValue imuData;
+                double delta_t = 0.0;
+                for (int i = 0; i < BENCH_I2C_SAMPLES; ++i) {
+                    while (!imu.read(delta_t, &imuData)) {
+                    }
+                    // at rest the accelerometer sees about 1 g
+                    dataMatches = dataMatches && fabs(imuData.accelRaw.z() - 1.0) < 0.1;
+                }
+                syscalls = mockI2C.syscalls - syscallsBefore;
+                transactions = mockI2C.transactions - transactionsBefore;
+                counted = bus.getStats();
+                counted.syscalls -= countedBefore.syscalls;
+                counted.transactions -= countedBefore.transactions;
+            }
+            // the descriptor is closed with the bus; its number may come back for something else
+            mockI2C.fd = -1;
+            cout << "i2c " << (combined ? "I2C_RDWR" : "write+read") << " burst=" << samplesPerBurst << ": "
+                 << double(syscalls) / BENCH_I2C_SAMPLES << " syscalls/sample, "
+                 << double(syscalls) * samplesPerBurst / BENCH_I2C_SAMPLES << " per burst, "
+                 << double(transactions) / BENCH_I2C_SAMPLES << " transactions/sample, I2CStats "
+                 << (counted.syscalls == syscalls && counted.transactions == transactions ? "agrees" : "differs")
+                 << ", data "
+                 << (dataMatches ? "ok" : "wrong") << endl;
+        }
+    }
+}
+
+double threadCpuSeconds() {
+    timespec t{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/**
+ * Subscriber that counts delimited frames and bytes.
+ */
+struct BenchClient {
+    tcp::socket socket;
+    int frequency;
+    long long frames = 0;
+    long long bytes = 0;
+    char buffer[4096];
+    string request;
+
+    BenchClient(boost::asio::io_context &io, int frequency)
+        : socket(io), frequency(frequency), request(to_string(frequency) + "\n") {
+    }
+
+    BenchClient(boost::asio::io_context &io, const Subscription &subscription, const vector<string> &fieldNames)
+        : socket(io), frequency(subscription.frequency), request(subscription.toRequest(fieldNames) + "\n") {
+    }
+
+    void start(const tcp::endpoint &endpoint) {
+        socket.async_connect(endpoint, [this](const boost::system::error_code &ec) {
+            if (ec) {
+                return;
+            }
+            boost::asio::async_write(socket, boost::asio::buffer(request),
+                                     [this](const boost::system::error_code &ec, size_t) {
+                                         if (!ec) {
+                                             receive();
+                                         }
+                                     });
+        });
+    }
+
+    void receive() {
+        socket.async_read_some(boost::asio::buffer(buffer), [this](const boost::system::error_code &ec, size_t n) {
+            if (ec) {
+                return;
+            }
+            frames += count(buffer, buffer + n, '\n');
+            bytes += n;
+            receive();
+        });
+    }
+};
+
+/**
+ * Many subscribers at independent rates on one server thread: delivered rate per client and server CPU use.
+ */
+void benchmarkServer() {
+    BusyDeviceTask task(1000, 0);
+    boost::thread producer(boost::bind(&BusyDeviceTask::run, &task));
+
+    boost::asio::io_context serverIO;
+    BaseServer<BenchValue> server("localhost", BENCH_SERVER_PORT, task);
+    server.start(serverIO);
+    double serverCpu = 0.0;
+    boost::thread serverThread([&]() {
+        double start = threadCpuSeconds();
+        serverIO.run();
+        serverCpu = threadCpuSeconds() - start;
+    });
+
+    boost::asio::io_context clientIO;
+    vector<unique_ptr<BenchClient>> clients;
+    tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), BENCH_SERVER_PORT);
+    for (int i = 0; i < BENCH_SERVER_CLIENTS; ++i) {
+        clients.emplace_back(new BenchClient(clientIO, 10 * (i + 1)));
+        clients.back()->start(endpoint);
+    }
+    boost::thread clientThread([&]() {
+        clientIO.run();
+    });
+
+    boost::this_thread::sleep_for(boost::chrono::seconds(BENCH_SERVER_SECONDS));
+    server.shutdown();
+    serverThread.join();
+    clientIO.stop();
+    clientThread.join();
+    task.shutdown();
+    producer.join();
+
+    double worst = 1e9, total = 0.0;
+    for (auto &client : clients) {
+        double ratio = client->frames / double(client->frequency * BENCH_SERVER_SECONDS);
+        worst = min(worst, ratio);
+        total += ratio;
+    }
+    cout << "server: clients=" << BENCH_SERVER_CLIENTS << " delivered/requested mean="
+         << total / BENCH_SERVER_CLIENTS << " worst=" << worst << " server cpu="
+         << 100.0 * serverCpu / BENCH_SERVER_SECONDS << "%" << endl;
+    for (auto &client : clients) {
+        cout << "  " << client->frequency << "Hz: " << client->frames / double(BENCH_SERVER_SECONDS) << "Hz" << endl;
+    }
+}
+
+/**
+ * A client connecting while the server is out of file descriptors: the accept fails with EMFILE, and the server
+ * should still serve the client once descriptors are available again.
+ */
+void checkAcceptRetry() {
+    BusyDeviceTask task(100, 0);
+    boost::thread producer(boost::bind(&BusyDeviceTask::run, &task));
+    boost::asio::io_context serverIO;
+    BaseServer<BenchValue> server("localhost", BENCH_ACCEPT_PORT, task);
+    server.start(serverIO);
+    boost::thread serverThread([&]() {
+        serverIO.run();
+    });
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+
+    boost::asio::io_context clientIO;
+    tcp::socket client(clientIO);
+    client.open(tcp::v4());
+    rlimit limit{};
+    getrlimit(RLIMIT_NOFILE, &limit);
+    rlimit lowered = limit;
+    int lowestFree = dup(0);
+    close(lowestFree);
+    lowered.rlim_cur = static_cast<rlim_t>(lowestFree);
+    setrlimit(RLIMIT_NOFILE, &lowered);
+    boost::system::error_code ec;
+    client.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), BENCH_ACCEPT_PORT), ec);
+    boost::asio::write(client, boost::asio::buffer(string("0\n")), ec);
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(3 * SERVER_ACCEPT_RETRY_MS));
+    size_t whileExhausted = client.available(ec);
+    setrlimit(RLIMIT_NOFILE, &limit);
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(3 * SERVER_ACCEPT_RETRY_MS));
+    size_t afterwards = client.available(ec);
+
+    server.shutdown();
+    serverThread.join();
+    task.shutdown();
+    producer.join();
+    cout << "server accept retry: " << whileExhausted << " bytes while out of descriptors, " << afterwards
+         << " bytes after, " << (whileExhausted == 0 && afterwards > 0 ? "served" : "not served") << endl;
+}
+
+/**
+ * Encode cost and size of a DeviceData frame as json and as binary.
+ */
+template<class T>
+void benchmarkEncoding(const string &name, DeviceData<T> &data) {
+    size_t jsonBytes = 0, binaryBytes = 0;
+    auto start = benchClock::now();
+    for (int i = 0; i < BENCH_WIRE_FRAMES; ++i) {
+        jsonBytes += data.toString().size() + 1;
+    }
+    auto middle = benchClock::now();
+    string buffer;
+    for (int i = 0; i < BENCH_WIRE_FRAMES; ++i) {
+        buffer.clear();
+        data.toBinary(buffer);
+        binaryBytes += buffer.size();
+    }
+    auto end = benchClock::now();
+
+    // decode the last frame back and compare the most recent value
+    WireHeader header;
+    int currentIndex = -1;
+    vector<T> values;
+    bool decoded = header.parse(buffer.data()) && header.type == T::wireType &&
+                   decodeDeviceData(header.type, buffer.data() + WIRE_HEADER_SIZE, header.payloadLength, currentIndex,
+                                    values) &&
+                   currentIndex == data.currentIndex &&
+                   values[currentIndex].toJson() == data.getCurrentValue()->toJson();
+
+    cout << "wire " << name << " k=" << data.k
+         << ": json " << jsonBytes / BENCH_WIRE_FRAMES << " bytes/frame "
+         << chrono::duration<double, nano>(middle - start).count() / BENCH_WIRE_FRAMES << "ns/frame"
+         << ", binary " << binaryBytes / BENCH_WIRE_FRAMES << " bytes/frame "
+         << chrono::duration<double, nano>(end - middle).count() / BENCH_WIRE_FRAMES << "ns/frame"
+         << ", round trip " << (decoded ? "ok" : "FAILED") << endl;
+    expect(decoded, "wire " + name + " k=" + to_string(data.k) + " round trip");
+}
+
+/**
+ * Json versus binary frames for every value type, then a binary stream through BaseServer and BaseClient.
+ */
+void benchmarkWire() {
+    for (unsigned int k : {1u, 10u}) {
+        DeviceData<IMUValue> imuData(k);
+        DeviceData<GPSValue> gpsData(k);
+        DeviceData<ControlValue> controlData(k);
+        for (unsigned int i = 0; i < k; ++i) {
+            imuData.values[i]->gyroRaw = Vector3(0.01 * i, -0.02, 0.03);
+            imuData.values[i]->accelRaw = Vector3(0.1, 0.2, 9.81);
+            imuData.values[i]->thetaCompFilter = Quaternion(0.99, 0.01 * i, 0.02, 0.03);
+            gpsData.values[i]->latitude = 3723.2475;
+            gpsData.values[i]->longitude = 12158.3416;
+            gpsData.values[i]->altitude = 12.5 + i;
+            controlData.values[i]->attitudeControl = Vector3(0.1, -0.1 * i, 0.0);
+            controlData.values[i]->altitudeControl = 7.5 + 0.1 * i;
+            controlData.values[i]->referenceAttitude = Vector3(0.0, 0.05, -0.05);
+            controlData.values[i]->referenceAltitude = 2.0;
+        }
+        imuData.currentIndex = gpsData.currentIndex = controlData.currentIndex = 0;
+        benchmarkEncoding("imu", imuData);
+        benchmarkEncoding("gps", gpsData);
+        benchmarkEncoding("control", controlData);
+    }
+
+    BusyDeviceTask task(1000, 0);
+    boost::thread producer(boost::bind(&BusyDeviceTask::run, &task));
+    boost::asio::io_context serverIO;
+    BaseServer<BenchValue> server("localhost", BENCH_WIRE_PORT, task);
+    server.start(serverIO);
+    boost::thread serverThread([&]() {
+        serverIO.run();
+    });
+
+    boost::asio::io_context clientIO;
+    BaseClient client(clientIO, "localhost", BENCH_WIRE_PORT);
+    tcp::socket *socket = client.connect(200, WireFormat::BINARY);
+    int frames = 0, currentIndex = -1;
+    long long lastTimestamp = 0;
+    bool ordered = true;
+    vector<BenchValue> values;
+    while (socket && frames < 100 && client.readValues(*socket, currentIndex, values)) {
+        ordered = ordered && values[currentIndex].timestamp >= lastTimestamp;
+        lastTimestamp = values[currentIndex].timestamp;
+        frames++;
+    }
+    cout << "wire stream: binary frames=" << frames << " timestamps " << (ordered ? "ordered" : "NOT ordered") << endl;
+    expect(frames == 100 && ordered, "wire stream of 100 ordered binary frames");
+
+    server.shutdown();
+    serverThread.join();
+    task.shutdown();
+    producer.join();
+}
+
+/**
+ * DeviceData serialized through a json document, the way toString() used to do it.
+ */
+template<class T>
+string jsonDump(DeviceData<T> &data) {
+    json j;
+    j["currentIndex"] = data.currentIndex;
+    for (size_t i = 0; i < data.values.size(); ++i) {
+        j["values"].emplace_back(data.values[i]->toJson());
+    }
+    return j.dump();
+}
+
+double randomDouble(mt19937 &rng) {
+    // mostly ordinary readings, with some values that exercise the number formatting
+    static const double special[] = {0.0, -0.0, 1e-7, 123456789012345678.0, 1e300, -2.5e-300, NAN, INFINITY};
+    uniform_int_distribution<int> pick(0, 19);
+    int i = pick(rng);
+    if (i < 8) {
+        return special[i];
+    }
+    uniform_real_distribution<double> value(-1000.0, 1000.0);
+    return i < 14 ? value(rng) : value(rng) / 1e6;
+}
+
+Vector3 randomVector(mt19937 &rng) {
+    double x = randomDouble(rng), y = randomDouble(rng), z = randomDouble(rng);
+    return Vector3(x, y, z);
+}
+
+Quaternion randomQuaternion(mt19937 &rng) {
+    double scalar = randomDouble(rng), x = randomDouble(rng), y = randomDouble(rng), z = randomDouble(rng);
+    return Quaternion(scalar, x, y, z);
+}
+
+void randomize(IMUValue &value, mt19937 &rng) {
+    value.timestamp = rng();
+    value.gyroRaw = randomVector(rng);
+    value.accelRaw = randomVector(rng);
+    value.compassRaw = randomVector(rng);
+    value.gyroAngle = randomQuaternion(rng);
+    value.accelAngle = randomQuaternion(rng);
+    value.thetaCompFilter = randomQuaternion(rng);
+}
+
+void randomize(GPSValue &value, mt19937 &rng) {
+    value.timestamp = -static_cast<long long>(rng());
+    value.latitude = randomDouble(rng);
+    value.latitudeHemisphere = rng() % 2 ? 'N' : 'S';
+    value.longitude = randomDouble(rng);
+    value.longitudeHemisphere = rng() % 2 ? 'E' : 'W';
+    value.numSatellites = rng() % 16;
+    value.altitude = randomDouble(rng);
+}
+
+void randomize(ControlValue &value, mt19937 &rng) {
+    value.timestamp = rng();
+    value.imuTimestamp = rng();
+    value.attitudeControl = randomVector(rng);
+    value.altitudeControl = randomDouble(rng);
+    value.referenceAttitude = randomVector(rng);
+    value.referenceAltitude = randomDouble(rng);
+}
+
+/**
+ * JsonWriter output against json::dump() on randomized frames, time per frame for both, and allocations per frame
+ * once the output buffer is warm.
+ */
+template<class T>
+void benchmarkJsonWriter(const string &name, unsigned int k) {
+    mt19937 rng(k);
+    DeviceData<T> data(k);
+    int mismatches = 0;
+    string buffer;
+    for (int i = 0; i < BENCH_JSON_FRAMES; ++i) {
+        for (auto *value : data.values) {
+            randomize(*value, rng);
+        }
+        data.currentIndex = static_cast<int>(rng() % k);
+        buffer.clear();
+        data.toJson(buffer);
+        if (buffer != jsonDump(data)) {
+            if (mismatches++ == 0) {
+                cout << "  expected " << jsonDump(data) << endl << "  written  " << buffer << endl;
+            }
+        }
+    }
+
+    size_t length = 0;
+    auto start = benchClock::now();
+    for (int i = 0; i < BENCH_JSON_FRAMES; ++i) {
+        length += jsonDump(data).size();
+    }
+    auto middle = benchClock::now();
+    long long allocationsBefore = allocationCount;
+    for (int i = 0; i < BENCH_JSON_FRAMES; ++i) {
+        buffer.clear();
+        data.toJson(buffer);
+        length += buffer.size();
+    }
+    auto end = benchClock::now();
+    long long allocations = allocationCount - allocationsBefore;
+
+    if (length == 0) {
+        cout << "empty frames" << endl;
+    }
+
+    cout << "json " << name << " k=" << k << ": "
+         << (mismatches == 0 ? string("identical") : to_string(mismatches) + " MISMATCHES")
+         << ", dump " << chrono::duration<double, nano>(middle - start).count() / BENCH_JSON_FRAMES << "ns/frame"
+         << ", writer " << chrono::duration<double, nano>(end - middle).count() / BENCH_JSON_FRAMES << "ns/frame "
+         << double(allocations) / BENCH_JSON_FRAMES << " allocations/frame" << endl;
+}
+
+void benchmarkJson() {
+    for (unsigned int k : {1u, 10u}) {
+        benchmarkJsonWriter<IMUValue>("imu", k);
+        benchmarkJsonWriter<GPSValue>("gps", k);
+        benchmarkJsonWriter<ControlValue>("control", k);
+    }
+}
+
+long long monotonicNanos() {
+    timespec t{};
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+/**
+ * Device task that stamps every value with CLOCK_MONOTONIC, which is shared between processes.
+ */
+class ClockDeviceTask : public DeviceTask<BenchValue> {
+public:
+    explicit ClockDeviceTask(const int &samplingFrequency) : DeviceTask(samplingFrequency, 1) {
+    }
+
+protected:
+    void fetch() override {
+        DeviceTask::fetch();
+        result->getCurrentValue()->timestamp = monotonicNanos();
+    }
+};
+
+/**
+ * Reader process for the shared memory ring: latency from publish to read, and values lost.
+ */
+void runShmReader() {
+    ShmRingReader<BenchValue> reader(BENCH_SHM_NAME);
+    while (!reader.open()) {
+        usleep(1000);
+    }
+    vector<double> nanos;
+    BenchValue value;
+    while (nanos.size() < BENCH_SHM_SAMPLES) {
+        if (!reader.wait(100)) {
+            continue;
+        }
+        while (reader.read(value)) {
+            nanos.push_back(double(monotonicNanos() - value.timestamp));
+        }
+    }
+    report("shm ring (reader process)", nanos);
+    cout << "  received=" << reader.getReceived() << " dropped=" << reader.getDropped() << endl;
+}
+
+/**
+ * Age of each value on arrival over TCP loopback, in either encoding.
+ */
+void runTCPReader(WireFormat format) {
+    ClockDeviceTask task(BENCH_SHM_RATE);
+    boost::thread producer(boost::bind(&ClockDeviceTask::run, &task));
+    boost::asio::io_context serverIO;
+    BaseServer<BenchValue> server("localhost", BENCH_SHM_PORT, task);
+    server.start(serverIO);
+    boost::thread serverThread([&]() {
+        serverIO.run();
+    });
+
+    boost::asio::io_context clientIO;
+    BaseClient client(clientIO, "localhost", BENCH_SHM_PORT);
+    tcp::socket *socket = client.connect(BENCH_SHM_RATE, format);
+    vector<double> nanos;
+    int currentIndex;
+    vector<BenchValue> values;
+    while (socket && nanos.size() < BENCH_SHM_SAMPLES) {
+        long long timestamp;
+        if (format == WireFormat::BINARY) {
+            if (!client.readValues(*socket, currentIndex, values)) {
+                break;
+            }
+            timestamp = values[currentIndex].timestamp;
+        } else {
+            FrameView frame;
+            if (!client.readView(*socket, frame)) {
+                break;
+            }
+            json j = json::parse(frame.data, frame.data + frame.length);
+            timestamp = j["values"][j["currentIndex"].get<int>()]["timestamp"];
+        }
+        nanos.push_back(double(monotonicNanos() - timestamp));
+    }
+    report(string("tcp loopback (") + wireFormatName(format) + ")", nanos);
+
+    server.shutdown();
+    serverThread.join();
+    task.shutdown();
+    producer.join();
+}
+
+/**
+ * Publish to read latency of the shared memory ring, read by a separate process, against the TCP path.
+ * TCP latency includes up to one period of server sampling on top of the transport itself.
+ */
+void benchmarkShm() {
+    ShmRingWriter<BenchValue> ring(BENCH_SHM_NAME);
+    if (!ring.open()) {
+        return;
+    }
+    cout.flush();
+    pid_t child = fork();
+    if (child == 0) {
+        runShmReader();
+        cout.flush();
+        _exit(0);
+    }
+    ClockDeviceTask task(BENCH_SHM_RATE);
+    task.setShmRing(&ring);
+    boost::thread producer(boost::bind(&ClockDeviceTask::run, &task));
+    int status;
+    waitpid(child, &status, 0);
+    task.shutdown();
+    producer.join();
+    cout << "  publishes=" << ring.getSequence() << " wakeups=" << ring.getWakeups() << endl;
+
+    // the reader has exited, so publish() is only a store into the mapping
+    long long wakeups = ring.getWakeups();
+    BenchValue value;
+    long long start = monotonicNanos();
+    for (int i = 0; i < BENCH_SHM_SAMPLES; ++i) {
+        value.timestamp = i;
+        ring.publish(value);
+    }
+    cout << "shm ring publish without waiters: " << double(monotonicNanos() - start) / BENCH_SHM_SAMPLES
+         << "ns each, wakeups=" << ring.getWakeups() - wakeups << endl;
+    ring.close();
+
+    runTCPReader(WireFormat::JSON);
+    runTCPReader(WireFormat::BINARY);
+}
+
+/**
+ * Hand made datagrams over loopback in the given order, to check the receiver statistics.
+ */
+void checkUdpStats(const string &name, const vector<uint64_t> &order, long long lost, long long reordered,
+                   long long duplicates) {
+    boost::asio::io_context io;
+    BaseClient client(io, "localhost", 0);
+    if (!client.listen(BENCH_UDP_PORT)) {
+        return;
+    }
+    udp::socket sender(io, udp::v4());
+    udp::endpoint destination(boost::asio::ip::address_v4::loopback(), BENCH_UDP_PORT);
+    for (uint64_t sequence : order) {
+        string data;
+        BinaryWriter writer(data);
+        beginDatagram(writer, BenchValue::wireType, sequence);
+        BenchValue value;
+        value.timestamp = static_cast<long long>(sequence);
+        value.toBinary(writer);
+        endDatagram(writer, 1);
+        sender.send_to(boost::asio::buffer(data), destination);
+    }
+    vector<BenchValue> values;
+    while (client.receiveValues(values, 100)) {
+    }
+    UdpStats stats = client.getUdpStats();
+    bool ok = stats.datagrams == static_cast<long long>(order.size()) && stats.lost == lost &&
+              stats.reordered == reordered && stats.duplicates == duplicates;
+    cout << "udp stats check (" << name << "): " << stats.toString();
+    if (ok) {
+        cout << " ok" << endl;
+    } else {
+        cout << " UNEXPECTED (want lost=" << lost << " reordered=" << reordered << " duplicates=" << duplicates
+             << ")" << endl;
+    }
+    expect(ok, "udp stats (" + name + ")");
+}
+
+/**
+ * One publisher at BENCH_UDP_RATE, one receiver: delivered samples, loss and age of the newest sample on arrival.
+ */
+void benchmarkUdpPublisher(const string &address, const string &group, int batchSize) {
+    ClockDeviceTask task(BENCH_UDP_RATE);
+    boost::thread producer(boost::bind(&ClockDeviceTask::run, &task));
+
+    boost::asio::io_context clientIO;
+    BaseClient client(clientIO, "localhost", 0);
+    if (!client.listen(BENCH_UDP_PORT, group)) {
+        task.shutdown();
+        producer.join();
+        return;
+    }
+
+    boost::asio::io_context publisherIO;
+    UdpPublisher<BenchValue> publisher(task, address, BENCH_UDP_PORT, BENCH_UDP_RATE, batchSize);
+    if (!publisher.start(publisherIO)) {
+        task.shutdown();
+        producer.join();
+        return;
+    }
+    boost::thread publisherThread([&]() {
+        publisherIO.run();
+    });
+
+    vector<double> nanos;
+    vector<BenchValue> values;
+    long long newest = 0;
+    auto end = benchClock::now() + chrono::seconds(BENCH_UDP_SECONDS);
+    while (benchClock::now() < end) {
+        if (client.receiveValues(values, 100) && !values.empty()) {
+            nanos.push_back(double(monotonicNanos() - values.back().timestamp));
+            newest = values.back().timestamp;
+        }
+    }
+
+    // the task stops first: a partial batch has to go out without more samples behind it
+    task.shutdown();
+    producer.join();
+    while (client.receiveValues(values, 100)) {
+        if (!values.empty()) {
+            newest = values.back().timestamp;
+        }
+    }
+    publisher.shutdown();
+    publisherThread.join();
+
+    UdpStats stats = client.getUdpStats();
+    cout << "udp " << address << " batch=" << batchSize << ": " << stats.toString()
+         << " samples/s=" << stats.samples / double(BENCH_UDP_SECONDS)
+         << " publisher sent=" << publisher.getSent() << " dropped=" << publisher.getDropped() << endl;
+    if (!nanos.empty()) {
+        report("  newest sample age", nanos);
+    }
+    expect(newest == task.getData().timestamp,
+           "udp " + address + " batch=" + to_string(batchSize) + " delivers the last sample");
+}
+
+void benchmarkUdp() {
+    checkUdpStats("out of order, duplicated, with a gap", {0, 1, 3, 2, 2, 5, 7, 6, 8}, 1, 2, 1);
+    // older than the first datagram received: reordered, but it was never counted as lost
+    checkUdpStats("before the first", {10, 9, 11, 9}, 0, 1, 1);
+    // past the 64 datagram window: reordered, but it stays counted as lost
+    checkUdpStats("older than the window", {0, 70, 5}, 69, 1, 0);
+    benchmarkUdpPublisher("127.0.0.1", "", 1);
+    benchmarkUdpPublisher("127.0.0.1", "", 10);
+    benchmarkUdpPublisher(BENCH_UDP_GROUP, BENCH_UDP_GROUP, 1);
+}
+
+/**
+ * Stream that returns what it holds in randomly sized pieces, from a single byte to several frames at once.
+ */
+struct ChunkedStream {
+    const string &data;
+    size_t position = 0;
+    mt19937 rng;
+
+    ChunkedStream(const string &data, unsigned int seed) : data(data), rng(seed) {
+    }
+
+    template<class MutableBuffers>
+    size_t read_some(const MutableBuffers &buffers, boost::system::error_code &ec) {
+        if (position == data.size()) {
+            ec = boost::asio::error::eof;
+            return 0;
+        }
+        size_t chunk = uniform_int_distribution<size_t>(1, 3000)(rng);
+        chunk = min(chunk, data.size() - position);
+        size_t length = boost::asio::buffer_copy(buffers, boost::asio::buffer(data.data() + position, chunk));
+        position += length;
+        return length;
+    }
+};
+
+/**
+ * Delimited frames of varying length, e.g. json of different sizes.
+ */
+vector<string> makeFrames(int count, unsigned int seed) {
+    mt19937 rng(seed);
+    vector<string> frames;
+    for (int i = 0; i < count; ++i) {
+        size_t length = uniform_int_distribution<size_t>(0, 600)(rng);
+        string frame = "{\"i\":" + to_string(i) + ",\"pad\":\"" + string(length, 'x') + "\"}";
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+/**
+ * The framer on streams split at random points, delimited and length prefixed; then AbstractSensor::readView()
+ * against the old read() over TCP loopback, where the writer coalesces frames.
+ */
+void benchmarkFramer() {
+    vector<string> frames = makeFrames(BENCH_FRAMER_FRAMES, 1);
+    string delimited, prefixed;
+    for (auto &frame : frames) {
+        delimited += frame + "\n";
+        BinaryWriter writer(prefixed);
+        size_t lengthOffset = beginFrame(writer, WIRE_TYPE_UNKNOWN);
+        prefixed += frame;
+        endFrame(writer, lengthOffset);
+    }
+
+    for (int mode = 0; mode < 2; ++mode) {
+        ChunkedStream stream(mode == 0 ? delimited : prefixed, 2);
+        StreamFramer framer;
+        size_t received = 0, wrong = 0;
+        long long allocationsBefore = allocationCount;
+        auto start = benchClock::now();
+        for (;;) {
+            FrameView frame;
+            WireHeader header;
+            bool ok = mode == 0 ? framer.nextDelimited('\n', frame) : framer.nextLengthPrefixed(header, frame) > 0;
+            if (ok) {
+                if (received >= frames.size() || frame.length != frames[received].size() ||
+                    memcmp(frame.data, frames[received].data(), frame.length) != 0) {
+                    wrong++;
+                }
+                received++;
+                continue;
+            }
+            boost::system::error_code ec;
+            framer.fill(stream, ec);
+            if (ec) {
+                break;
+            }
+        }
+        auto end = benchClock::now();
+        long long allocations = allocationCount - allocationsBefore;
+        cout << "framer " << (mode == 0 ? "delimited" : "length prefixed") << ": frames=" << received
+             << " expected=" << frames.size() << " wrong=" << wrong << " "
+             << chrono::duration<double, nano>(end - start).count() / received << "ns/frame "
+             << "allocations=" << allocations << endl;
+    }
+
+    // over TCP: a writer that sends everything as fast as it can, so reads see many frames at once
+    for (int legacy = 0; legacy < 2; ++legacy) {
+        boost::asio::io_context io;
+        tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), BENCH_FRAMER_PORT));
+        boost::thread writer([&]() {
+            tcp::socket socket(io);
+            acceptor.accept(socket);
+            boost::system::error_code ec;
+            boost::asio::write(socket, boost::asio::buffer(delimited), ec);
+        });
+        AbstractSensor sensor;
+        tcp::socket socket(io);
+        socket.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), BENCH_FRAMER_PORT));
+        size_t received = 0, wrong = 0;
+        long long allocationsBefore = allocationCount;
+        auto start = benchClock::now();
+        if (legacy) {
+            for (;;) {
+                // read() as it was: a fresh stringstream per message, delimiter only seen at the end of a read
+                stringstream ss;
+                bool eof = false;
+                for (;;) {
+                    boost::array<char, 1024> buf{};
+                    boost::system::error_code ec;
+                    size_t len = socket.read_some(boost::asio::buffer(buf), ec);
+                    if (ec) {
+                        eof = true;
+                        break;
+                    }
+                    if (buf.data()[len - 1] == '\n') {
+                        ss.write(buf.data(), len - 1);
+                        break;
+                    }
+                    ss.write(buf.data(), len);
+                }
+                string data = ss.str();
+                if (eof && data.empty()) {
+                    break;
+                }
+                if (received >= frames.size() || data != frames[received]) {
+                    wrong++;
+                }
+                received++;
+            }
+        } else {
+            FrameView frame;
+            while (sensor.readView(socket, frame)) {
+                if (received >= frames.size() || frame.length != frames[received].size() ||
+                    memcmp(frame.data, frames[received].data(), frame.length) != 0) {
+                    wrong++;
+                }
+                received++;
+            }
+        }
+        auto end = benchClock::now();
+        long long allocations = allocationCount - allocationsBefore;
+        writer.join();
+        cout << "tcp " << (legacy ? "old read()" : "readView()") << ": frames=" << received
+             << " expected=" << frames.size() << " wrong=" << wrong << " "
+             << received / chrono::duration<double>(end - start).count() << " frames/s "
+             << double(allocations) / max<size_t>(received, 1) << " allocations/frame" << endl;
+    }
+}
+
+/**
+ * IMU task with a history of k values that produces a new filtered sample on every fetch, without a sensor.
+ */
+class SyntheticIMUTask : public DeviceTask<IMUValue> {
+private:
+    long long count = 0;
+
+public:
+    SyntheticIMUTask(const int &samplingFrequency, const unsigned int k) : DeviceTask(samplingFrequency, k) {
+    }
+
+    /**
+     * Fetch and publish one sample without the timer, for benchmarks that drive the task themselves.
+     */
+    void step() {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        fetch();
+        publish();
+    }
+
+protected:
+    void fetch() override {
+        DeviceTask::fetch();
+        auto *value = result->getCurrentValue();
+        double t = 0.001 * count++;
+        value->timestamp = currentMicroSecondsSinceEpoch();
+        value->gyroRaw = Vector3(0.01 * sin(t), -0.02, 0.03);
+        value->accelRaw = Vector3(0.1, 0.2 * cos(t), 9.81);
+        value->compassRaw = Vector3(21.5, -3.25, 40.125);
+        value->gyroAngle = Quaternion(0.99, 0.01 * sin(t), 0.02, 0.03);
+        value->accelAngle = Quaternion(0.98, 0.02, 0.01 * cos(t), 0.04);
+        value->thetaCompFilter = Quaternion(0.99, 0.01 * sin(t), 0.015, 0.035);
+    }
+};
+
+/**
+ * Field, history and decimation selection: round trips of subset frames, then bytes delivered and server CPU for
+ * clients that take everything versus clients that only want the latest filtered attitude.
+ */
+void benchmarkSubscription() {
+    // request round trip
+    Subscription subscription;
+    subscription.parse("100 binary latest fields=thetaCompFilter,gyroRaw decimate=4", IMUValue::fieldNames());
+    Subscription parsed;
+    parsed.parse(subscription.toRequest(IMUValue::fieldNames()), IMUValue::fieldNames());
+    bool requestOk = subscription.frequency == 100 && subscription.format == WireFormat::BINARY &&
+                     subscription.latestOnly && subscription.decimation == 4 &&
+                     subscription.fields == (IMUValue::THETA_COMP_FILTER | IMUValue::GYRO_RAW) &&
+                     parsed.toRequest(IMUValue::fieldNames()) == subscription.toRequest(IMUValue::fieldNames());
+    Subscription plain;
+    plain.parse("10", IMUValue::fieldNames());
+    requestOk = requestOk && plain.toRequest() == "10" && plain.fields == WIRE_ALL_FIELDS && !plain.latestOnly;
+
+    // subset frames against the full frame
+    DeviceData<IMUValue> data(BENCH_SUBSCRIPTION_K);
+    mt19937 rng(7);
+    for (auto *value : data.values) {
+        randomize(*value, rng);
+    }
+    data.currentIndex = 3;
+    IMUValue &latest = *data.getCurrentValue();
+    string frame;
+    data.toJson(frame, IMUValue::THETA_COMP_FILTER, true);
+    json j;
+    j["thetaCompFilter"] = json::parse(latest.toJson().dump())["thetaCompFilter"];
+    j["timestamp"] = latest.timestamp;
+    json expected;
+    expected["currentIndex"] = 0;
+    expected["values"].emplace_back(j);
+    bool jsonOk = frame == expected.dump();
+
+    frame.clear();
+    data.toBinary(frame, IMUValue::THETA_COMP_FILTER, true);
+    WireHeader header;
+    int currentIndex = -1;
+    vector<IMUValue> values;
+    bool binaryOk = header.parse(frame.data()) && header.type == (WIRE_TYPE_IMU | WIRE_TYPE_FIELDS_FLAG) &&
+                    decodeDeviceData(header.type, frame.data() + WIRE_HEADER_SIZE, header.payloadLength,
+                                     currentIndex, values) &&
+                    currentIndex == 0 && values.size() == 1 && values[0].timestamp == latest.timestamp &&
+                    values[0].toJson()["thetaCompFilter"] == latest.toJson()["thetaCompFilter"];
+    string full;
+    data.toBinary(full);
+    cout << "subscription: request " << (requestOk ? "ok" : "FAILED") << ", json subset " << (jsonOk ? "ok" : "FAILED")
+         << ", binary subset " << (binaryOk ? "ok" : "FAILED") << " (" << frame.size() << " of " << full.size()
+         << " bytes)" << endl;
+
+    // a new sample before every frame, as a stream faster than the task sees it
+    SyntheticIMUTask stepped(1000, BENCH_SUBSCRIPTION_K);
+    BaseServer<IMUValue> frameServer("localhost", BENCH_SUBSCRIPTION_PORT, stepped);
+    for (const char *request : {"100", "100 latest fields=thetaCompFilter", "100 binary", "100 binary latest"}) {
+        Subscription selection;
+        selection.parse(request, IMUValue::fieldNames());
+        size_t bytes = 0;
+        long long allocationsBefore = 0;
+        for (int i = 0; i < 2 * BENCH_SUBSCRIPTION_FRAMES; ++i) {
+            if (i == BENCH_SUBSCRIPTION_FRAMES) {
+                // the first half warms up the snapshot and the frame buffers
+                allocationsBefore = allocationCount;
+            }
+            stepped.step();
+            bytes += frameServer.getFrame(selection, true)->size();
+        }
+        long long allocations = allocationCount - allocationsBefore;
+        cout << "  getFrame \"" << request << "\": " << double(allocations) / BENCH_SUBSCRIPTION_FRAMES
+             << " allocations/frame, " << bytes / (2 * BENCH_SUBSCRIPTION_FRAMES) << " bytes/frame" << endl;
+        expect(allocations == 0, string("getFrame \"") + request + "\" without allocations");
+    }
+
+    SyntheticIMUTask task(1000, BENCH_SUBSCRIPTION_K);
+    boost::thread producer(boost::bind(&SyntheticIMUTask::run, &task));
+    const char *requests[] = {"100", "100 latest fields=thetaCompFilter", "100 binary",
+                              "100 binary latest fields=thetaCompFilter", "1000 latest fields=thetaCompFilter decimate=10"};
+    for (const char *request : requests) {
+        boost::asio::io_context serverIO;
+        BaseServer<IMUValue> server("localhost", BENCH_SUBSCRIPTION_PORT, task);
+        server.start(serverIO);
+        double serverCpu = 0.0;
+        boost::thread serverThread([&]() {
+            double start = threadCpuSeconds();
+            serverIO.run();
+            serverCpu = threadCpuSeconds() - start;
+        });
+
+        Subscription clientSubscription;
+        clientSubscription.parse(request, IMUValue::fieldNames());
+        boost::asio::io_context clientIO;
+        vector<unique_ptr<BenchClient>> clients;
+        tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), BENCH_SUBSCRIPTION_PORT);
+        for (int i = 0; i < BENCH_SUBSCRIPTION_CLIENTS; ++i) {
+            clients.emplace_back(new BenchClient(clientIO, clientSubscription, IMUValue::fieldNames()));
+            clients.back()->start(endpoint);
+        }
+        boost::thread clientThread([&]() {
+            clientIO.run();
+        });
+
+        boost::this_thread::sleep_for(boost::chrono::seconds(BENCH_SUBSCRIPTION_SECONDS));
+        server.shutdown();
+        serverThread.join();
+        clientIO.stop();
+        clientThread.join();
+
+        long long bytes = 0;
+        for (auto &client : clients) {
+            bytes += client->bytes;
+        }
+        cout << "  \"" << request << "\" x" << BENCH_SUBSCRIPTION_CLIENTS << ": "
+             << bytes / BENCH_SUBSCRIPTION_SECONDS / 1024 << " KiB/s, server cpu="
+             << 100.0 * serverCpu / BENCH_SUBSCRIPTION_SECONDS << "%" << endl;
+    }
+    task.shutdown();
+    producer.join();
+}
+
+/**
+ * Session counters, read on the server's io_context.
+ */
+template<class T>
+vector<SessionStats> sessionStats(BaseServer<T> &server, boost::asio::io_context &io) {
+    promise<vector<SessionStats>> stats;
+    boost::asio::post(io, [&]() {
+        stats.set_value(server.getSessionStats());
+    });
+    return stats.get_future().get();
+}
+
+/**
+ * Connection that sends a request and then never reads, with a tiny receive window so the server stalls quickly.
+ */
+tcp::socket *stalledClient(boost::asio::io_context &io, const string &request, int port) {
+    auto *socket = new tcp::socket(io);
+    socket->open(tcp::v4());
+    socket->set_option(boost::asio::socket_base::receive_buffer_size(4096));
+    socket->connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), port));
+    boost::asio::write(*socket, boost::asio::buffer(request + "\n"));
+    return socket;
+}
+
+/**
+ * One subscriber that keeps up, stalled subscribers with each backpressure policy and one that hangs up: the
+ * healthy one must get its full rate, slow ones are coalesced, dropped or disconnected, and gone ones are noticed.
+ */
+void benchmarkBackpressure() {
+    SyntheticIMUTask task(1000, BENCH_SUBSCRIPTION_K);
+    boost::thread producer(boost::bind(&SyntheticIMUTask::run, &task));
+    boost::asio::io_context serverIO;
+    BaseServer<IMUValue> server("localhost", BENCH_BACKPRESSURE_PORT, task);
+    server.setWriteTimeout(BENCH_BACKPRESSURE_TIMEOUT);
+    server.start(serverIO);
+    boost::thread serverThread([&]() {
+        serverIO.run();
+    });
+
+    boost::asio::io_context clientIO;
+    BenchClient healthy(clientIO, 200);
+    healthy.start(tcp::endpoint(boost::asio::ip::address_v4::loopback(), BENCH_BACKPRESSURE_PORT));
+    boost::thread clientThread([&]() {
+        clientIO.run();
+    });
+    boost::asio::io_context stalledIO;
+    vector<unique_ptr<tcp::socket>> stalled;
+    for (const char *policy : {"coalesce", "drop-oldest", "disconnect"}) {
+        stalled.emplace_back(stalledClient(stalledIO, string("1000 backpressure=") + policy, BENCH_BACKPRESSURE_PORT));
+    }
+    unique_ptr<tcp::socket> closer(stalledClient(stalledIO, "100", BENCH_BACKPRESSURE_PORT));
+
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(BENCH_BACKPRESSURE_TIMEOUT / 2));
+    cout << "backpressure: after " << BENCH_BACKPRESSURE_TIMEOUT / 2 << "ms" << endl;
+    for (auto &stats : sessionStats(server, serverIO)) {
+        cout << "  " << stats.toString() << endl;
+    }
+
+    // hang up: the pending read should notice without waiting for a write to fail
+    long long closedBefore = server.getClosedSessions();
+    auto hangUp = benchClock::now();
+    closer->close();
+    while (server.getClosedSessions() == closedBefore && benchClock::now() - hangUp < chrono::seconds(1)) {
+        boost::this_thread::sleep_for(boost::chrono::microseconds(100));
+    }
+    cout << "  hang up noticed after " << chrono::duration<double, micro>(benchClock::now() - hangUp).count()
+         << "us" << endl;
+
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(BENCH_BACKPRESSURE_TIMEOUT * 2));
+    long long healthyFrames = healthy.frames;
+    vector<SessionStats> open = sessionStats(server, serverIO);
+    SessionStats closed = server.getClosedStats();
+    cout << "  after write timeout: open sessions=" << open.size() << " closed=" << server.getClosedSessions()
+         << " (sent=" << closed.framesSent << " dropped=" << closed.framesDropped << ")" << endl;
+    double seconds = BENCH_BACKPRESSURE_TIMEOUT / 2000.0 + BENCH_BACKPRESSURE_TIMEOUT * 2 / 1000.0;
+    cout << "  healthy client: " << healthyFrames / seconds << "Hz of 200Hz" << endl;
+
+    server.shutdown();
+    serverThread.join();
+    clientIO.stop();
+    clientThread.join();
+    task.shutdown();
+    producer.join();
+}
+
+/**
+ * Read a flight log back and check that the records are consecutive values of each type, numbered by timestamp.
+ */
+struct RecorderCheck {
+    long long records = 0;
+    long long outOfOrder = 0;
+    long long firstImu = -1;
+    long long lastImu = -1;
+    long long corrupt = 0;
+    long long recovered = 0;
+    bool closedCleanly = false;
+
+    explicit RecorderCheck(const string &path) {
+        FlightLogReader reader(path);
+        if (!reader.open()) {
+            return;
+        }
+        FlightRecord record;
+        long long last[4] = {-1, -1, -1, -1};
+        while (reader.next(record)) {
+            BinaryReader payload(record.payload, record.length);
+            long long timestamp = payload.getI64();
+            uint8_t type = record.type & 3;
+            if (last[type] >= 0 && timestamp != last[type] + 1) {
+                outOfOrder++;
+            }
+            last[type] = timestamp;
+            if (type == WIRE_TYPE_IMU && firstImu < 0) {
+                firstImu = timestamp;
+            }
+            records++;
+        }
+        lastImu = last[WIRE_TYPE_IMU];
+        corrupt = reader.getCorrupt();
+        recovered = reader.getRecovered();
+        closedCleanly = reader.closedCleanly();
+    }
+
+    string toString() const {
+        stringstream ss;
+        ss << "records=" << records << " out of order=" << outOfOrder << " corrupt=" << corrupt << " recovered="
+           << recovered << (closedCleanly ? " closed cleanly" : " NOT closed cleanly");
+        return ss.str();
+    }
+};
+
+/**
+ * Flight recorder: cost of a push on the producer thread at control loop rates, records read back, writer
+ * throughput, wrap around, and a writer process killed mid flight.
+ */
+void benchmarkRecorder() {
+    {
+        FlightRecorder recorder(BENCH_RECORDER_PATH);
+        auto *imu = recorder.addChannel<IMUValue>();
+        auto *gps = recorder.addChannel<GPSValue>();
+        auto *control = recorder.addChannel<ControlValue>();
+        if (!recorder.open()) {
+            return;
+        }
+        recorder.start();
+        IMUValue imuValue;
+        GPSValue gpsValue;
+        ControlValue controlValue;
+        vector<double> nanos;
+        nanos.reserve(BENCH_RECORDER_RATE * BENCH_RECORDER_SECONDS);
+        PeriodicTimer timer(BENCH_RECORDER_RATE);
+        timer.start();
+        long long allocationsBefore = allocationCount;
+        for (int i = 0; i < BENCH_RECORDER_RATE * BENCH_RECORDER_SECONDS; ++i) {
+            imuValue.timestamp = i;
+            auto start = benchClock::now();
+            imu->push(imuValue);
+            if (i % 10 == 0) {
+                controlValue.timestamp = i / 10;
+                control->push(controlValue);
+            }
+            if (i % 100 == 0) {
+                gpsValue.timestamp = i / 100;
+                gps->push(gpsValue);
+            }
+            nanos.push_back(chrono::duration<double, nano>(benchClock::now() - start).count());
+            timer.wait();
+        }
+        long long allocations = allocationCount - allocationsBefore;
+        long long dropped = recorder.getDropped();
+        recorder.shutdown();
+        report("recorder push at " + to_string(BENCH_RECORDER_RATE) + "Hz", nanos);
+        RecorderCheck check(BENCH_RECORDER_PATH);
+        cout << "  dropped=" << dropped << " allocations (any thread)=" << allocations << " read back: "
+             << check.toString() << endl;
+    }
+
+    {
+        // back to back pushes: how fast the writer drains
+        FlightRecorder recorder(BENCH_RECORDER_PATH);
+        auto *imu = recorder.addChannel<IMUValue>(BENCH_RECORDER_BURST);
+        recorder.open();
+        IMUValue imuValue;
+        for (int i = 0; i < BENCH_RECORDER_BURST; ++i) {
+            imuValue.timestamp = i;
+            imu->push(imuValue);
+        }
+        auto start = benchClock::now();
+        recorder.start();
+        while (recorder.getRecordCount() < BENCH_RECORDER_BURST) {
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+        }
+        double seconds = chrono::duration<double>(benchClock::now() - start).count();
+        recorder.shutdown();
+        cout << "recorder writer: " << BENCH_RECORDER_BURST / seconds << " records/s" << endl;
+    }
+
+    {
+        // a small log keeps the most recent records
+        FlightRecorder recorder(BENCH_RECORDER_PATH, FLIGHT_LOG_HEADER_SIZE + 100 * 192);
+        auto *imu = recorder.addChannel<IMUValue>(2048);
+        recorder.open();
+        IMUValue imuValue;
+        for (int i = 0; i < 1000; ++i) {
+            imuValue.timestamp = i;
+            imu->push(imuValue);
+        }
+        recorder.shutdown();
+        RecorderCheck check(BENCH_RECORDER_PATH);
+        cout << "recorder wrap around: imu " << check.firstImu << ".." << check.lastImu << " " << check.toString()
+             << endl;
+    }
+
+    // killed while recording: every record that made it into the page cache must read back valid
+    pid_t child = fork();
+    if (child == 0) {
+        FlightRecorder recorder(BENCH_RECORDER_PATH);
+        auto *imu = recorder.addChannel<IMUValue>();
+        recorder.open();
+        recorder.start();
+        IMUValue imuValue;
+        PeriodicTimer timer(BENCH_RECORDER_RATE * 10);
+        timer.start();
+        for (int i = 0;; ++i) {
+            imuValue.timestamp = i;
+            imu->push(imuValue);
+            if (i == BENCH_RECORDER_RATE * 5) {
+                raise(SIGKILL);
+            }
+            timer.wait();
+        }
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    RecorderCheck check(BENCH_RECORDER_PATH);
+    cout << "recorder killed: " << check.toString() << " last imu=" << check.lastImu << endl;
+    unlink(BENCH_RECORDER_PATH);
+}
+
+/**
+ * Record a live run of IMUSensorTask on a simulated chip and QuadControlTask with a reference change half way, then
+ * replay the log: every filter and controller output must come out bit for bit the same, much faster than real time.
+ */
+void benchmarkReplay() {
+    {
+        SimulatedMPU9250 chip;
+        IMUSensorTask imuTask(BENCH_IMU_RATE, 1, BENCH_IMU_RATE, &chip);
+        TimerEdgeSource dataReady(imuTask.getSampleRate());
+        imuTask.setDataReadySource(&dataReady);
+        QuadControlTask controlTask(BENCH_REPLAY_CONTROL_RATE, 1, imuTask);
+        FlightRecorder recorder(BENCH_RECORDER_PATH);
+        auto *imuChannel = recorder.addChannel<IMUValue>();
+        auto *controlChannel = recorder.addChannel<ControlValue>();
+        if (!recorder.open()) {
+            return;
+        }
+        imuTask.setRecorder(imuChannel);
+        controlTask.setRecorder(controlChannel);
+        recorder.start();
+        boost::thread imuThread(boost::bind(&IMUSensorTask::run, &imuTask));
+        boost::thread controlThread(boost::bind(&QuadControlTask::run, &controlTask));
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(BENCH_REPLAY_SECONDS * 500));
+        controlTask.setReference(0.1, -0.2, 0.05, 1.5);
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(BENCH_REPLAY_SECONDS * 500));
+        controlTask.shutdown();
+        controlThread.join();
+        imuTask.shutdown();
+        imuThread.join();
+        cout << "replay: recorded " << recorder.getRecordCount() << " records, dropped=" << recorder.getDropped()
+             << endl;
+        recorder.shutdown();
+    }
+
+    LogReplay replay(BENCH_RECORDER_PATH);
+    if (!replay.run()) {
+        return;
+    }
+    ReplayStats stats = replay.getStats();
+    cout << "replay: " << stats.toString() << (stats.identical() ? " identical" : " DIFFERENT") << endl;
+    unlink(BENCH_RECORDER_PATH);
+}
+
+/**
+ * Software in the loop: 20 simulated seconds of flight from a 10 degree tilt, with the time each part of the stack
+ * takes per step, and whether the default gains bring the tilt back within the settling band without a crash.
+ */
+void benchmarkSimulator() {
+    QuadSimulatorConfig config;
+    config.initialAttitude = Vector3(10 * DEGREE_TO_RAD, -5 * DEGREE_TO_RAD, 0);
+    QuadSimulator simulator(config);
+    SimulatorStats stats = simulator.run(BENCH_SIMULATOR_SECONDS);
+    cout << "simulator: " << stats.toString() << endl;
+    expect(stats.settled && !stats.crashed && stats.settlingTime < BENCH_SIMULATOR_SETTLING,
+           "simulator settles a 10 degree tilt within " + to_string(BENCH_SIMULATOR_SETTLING) + "s");
+}
+
+/**
+ * Monte Carlo runner: flights per second for 1, 2, 4 and one thread per core, and whether the results are the same
+ * regardless of the thread count.
+ */
+void benchmarkMonteCarlo() {
+    MonteCarloConfig config;
+    config.flights = BENCH_MONTE_CARLO_FLIGHTS;
+    config.seconds = BENCH_MONTE_CARLO_SECONDS;
+    vector<ParameterSet> parameterSets;
+    for (double alpha : {0.995, 0.999, SIM_FILTER_ALPHA}) {
+        parameterSets.push_back(ParameterSet::attitude(PIDGains(SIM_ATTITUDE_KP, SIM_ATTITUDE_KI, SIM_ATTITUDE_KD),
+                                                       alpha));
+    }
+
+    vector<unsigned int> threadCounts{1, 2, 4};
+    unsigned int cores = boost::thread::hardware_concurrency();
+    if (find(threadCounts.begin(), threadCounts.end(), cores) == threadCounts.end()) {
+        threadCounts.push_back(cores);
+    }
+    double baseRate = 0.0;
+    vector<ParameterResult> reference;
+    bool same = true;
+    for (unsigned int threads : threadCounts) {
+        config.threads = threads;
+        MonteCarloRunner runner(config);
+        vector<ParameterResult> results = runner.run(parameterSets);
+        MonteCarloStats stats = runner.getStats();
+        double rate = stats.flights / stats.wallSeconds;
+        if (baseRate == 0.0) {
+            baseRate = rate;
+            reference = results;
+        }
+        for (size_t i = 0; i < results.size(); ++i) {
+            same = same && results[i].meanSettlingTime == reference[i].meanSettlingTime &&
+                   results[i].meanEffort == reference[i].meanEffort && results[i].crashed == reference[i].crashed;
+        }
+        cout << "monteCarlo: " << stats.toString() << " speedup=" << rate / baseRate << " (" << cores << " cores)"
+             << endl;
+    }
+    for (auto &result : reference) {
+        cout << "  " << result.toString() << endl;
+    }
+    cout << "monteCarlo: results " << (same ? "identical" : "DIFFER") << " across thread counts" << endl;
+    expect(same, "monteCarlo results identical across thread counts");
+    // the sweep has to tell parameter sets apart: the simulator's defaults settle every flight, a filter that loses
+    // the tilt in flight does not
+    const ParameterResult &defaults = reference.back();
+    expect(defaults.settled == defaults.flights && defaults.crashed == 0,
+           "monteCarlo: the simulator's defaults settle every flight");
+    expect(reference.front().settled < defaults.settled, "monteCarlo: alpha 0.995 settles fewer flights");
+}
+
+/**
+ * Motor that does nothing, for running the motor loop without pigpio.
+ */
+class NullActuator : public Actuator {
+public:
+    double value = 0.0;
+
+    void set(double v) override {
+        value = v;
+    }
+};
+
+/**
+ * GET a page from a StatsServer on the loopback interface and return the body.
+ */
+string fetchStats(unsigned short port, const string &path) {
+    boost::asio::io_context io;
+    tcp::socket socket(io);
+    socket.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), port));
+    string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    boost::asio::write(socket, boost::asio::buffer(request));
+    string response;
+    boost::system::error_code ec;
+    char data[4096];
+    size_t length;
+    while ((length = socket.read_some(boost::asio::buffer(data), ec)) > 0 && !ec) {
+        response.append(data, length);
+    }
+    size_t body = response.find("\r\n\r\n");
+    return body == string::npos ? response : response.substr(body + 4);
+}
+
+/**
+ * Cost and accuracy of the latency histogram, then the sensor to motor latency of the IMU task on a simulated chip,
+ * the control task and a motor loop, read back through the stats endpoint.
+ */
+void benchmarkLatency() {
+    {
+        LatencyHistogram histogram;
+        mt19937 rng(1);
+        uniform_int_distribution<long long> uniform(1, 10000000);     // up to 10 ms
+        vector<long long> values(BENCH_LATENCY_RECORDS);
+        for (auto &value : values) {
+            value = uniform(rng);
+        }
+        long long allocationsBefore = allocationCount;
+        auto start = benchClock::now();
+        for (long long value : values) {
+            histogram.record(value);
+        }
+        double nanos = chrono::duration<double, nano>(benchClock::now() - start).count();
+        long long allocations = allocationCount - allocationsBefore;
+
+        sort(values.begin(), values.end());
+        double worst = 0.0;
+        for (double fraction : {0.5, 0.9, 0.99, 0.999}) {
+            double exact = values[static_cast<size_t>(fraction * values.size()) - 1];
+            worst = max(worst, fabs(histogram.percentile(fraction) - exact) / exact);
+        }
+        cout << "latencyHistogram.record: " << nanos / BENCH_LATENCY_RECORDS << "ns allocations=" << allocations
+             << " worst percentile error=" << worst * 100 << "%" << endl;
+    }
+
+    SimulatedMPU9250 chip;
+    IMUSensorTask imuTask(BENCH_IMU_RATE, 1, BENCH_IMU_RATE, &chip);
+    TimerEdgeSource dataReady(imuTask.getSampleRate());
+    imuTask.setDataReadySource(&dataReady);
+    QuadControlTask controlTask(BENCH_LATENCY_CONTROL_RATE, 1, imuTask);
+    LatencyTracker latency;
+
+    boost::asio::io_context io;
+    StatsServer statsServer(BENCH_STATS_PORT);
+    statsServer.addPage("/latency", "application/json", [&latency](string &buffer) {
+        latency.writeJson(buffer);
+    });
+    statsServer.start(io);
+    boost::thread serverThread([&io]() {
+        io.run();
+    });
+
+    boost::thread imuThread(boost::bind(&IMUSensorTask::run, &imuTask));
+    boost::thread controlThread(boost::bind(&QuadControlTask::run, &controlTask));
+    NullActuator motorFront, motorLeft, motorBack, motorRight;
+    Actuator *motors[MOTOR_COUNT] = {&motorFront, &motorLeft, &motorBack, &motorRight};
+    MotorMixer mixer;
+    PeriodicTimer timer(BENCH_LATENCY_CONTROL_RATE);
+    for (int i = 0; i < BENCH_LATENCY_CONTROL_RATE * BENCH_LATENCY_SECONDS; ++i) {
+        ControlValue controlValue = controlTask.getData();
+        mixer.apply(controlValue, motors);
+        latency.actuated(controlValue.latency);
+        timer.wait();
+    }
+    controlTask.shutdown();
+    controlThread.join();
+    imuTask.shutdown();
+    imuThread.join();
+
+    cout << "latency (imu " << imuTask.getSampleRate() << "Hz, control and motors " << BENCH_LATENCY_CONTROL_RATE
+         << "Hz):\n" << latency.toString() << endl;
+    string body = fetchStats(BENCH_STATS_PORT, "/latency");
+    json stats = json::parse(body, nullptr, false);
+    bool ok = !stats.is_discarded() && stats["total"]["count"].get<long long>() == latency.getTotal().getCount();
+    cout << "stats endpoint /latency: " << body.size() << " bytes " << (ok ? "ok" : "UNEXPECTED") << endl;
+    cout << "stats endpoint /unknown: " << fetchStats(BENCH_STATS_PORT, "/unknown");
+
+    statsServer.shutdown();
+    io.stop();
+    serverThread.join();
+}
+
+/**
+ * Cost of a metric update, and a scrape of /metrics while the IMU task (data ready driven, on a simulated chip),
+ * the control task, a server with clients and the flight recorder run with metrics.
+ */
+void benchmarkMetrics() {
+    {
+        MetricsRegistry registry;
+        Counter *counter = registry.counter("bench_total", "Benchmark counter.");
+        Gauge *gauge = registry.gauge("bench_value", "Benchmark gauge.");
+        long long allocationsBefore = allocationCount;
+        auto start = benchClock::now();
+        for (int i = 0; i < BENCH_METRICS_UPDATES; ++i) {
+            counter->increment();
+        }
+        auto middle = benchClock::now();
+        for (int i = 0; i < BENCH_METRICS_UPDATES; ++i) {
+            gauge->set(i);
+        }
+        auto end = benchClock::now();
+        cout << "metrics: counter.increment=" << chrono::duration<double, nano>(middle - start).count() /
+                                                 BENCH_METRICS_UPDATES
+             << "ns gauge.set=" << chrono::duration<double, nano>(end - middle).count() / BENCH_METRICS_UPDATES
+             << "ns allocations=" << allocationCount - allocationsBefore << endl;
+    }
+
+    MetricsRegistry registry;
+    SimulatedMPU9250 chip;
+    IMUSensorTask imuTask(BENCH_IMU_RATE, 1, BENCH_IMU_RATE, &chip);
+    TimerEdgeSource dataReady(imuTask.getSampleRate());
+    imuTask.setDataReadySource(&dataReady);
+    QuadControlTask controlTask(BENCH_LATENCY_CONTROL_RATE, 1, imuTask);
+    FlightRecorder recorder(BENCH_RECORDER_PATH);
+    auto *imuChannel = recorder.addChannel<IMUValue>();
+    if (!recorder.open()) {
+        return;
+    }
+    imuTask.setRecorder(imuChannel);
+    recorder.setMetrics(registry);
+    recorder.start();
+    imuTask.setMetrics(registry, "imu");
+    controlTask.setMetrics(registry, "control");
+
+    boost::asio::io_context io;
+    BaseServer<IMUValue> imuServer("localhost", BENCH_SERVER_PORT, imuTask);
+    imuServer.setMetrics(registry, "imu");
+    imuServer.start(io);
+    StatsServer statsServer(BENCH_METRICS_PORT);
+    statsServer.addPage("/metrics", "text/plain; version=0.0.4", [&registry](string &buffer) {
+        registry.writePrometheus(buffer);
+    });
+    statsServer.start(io);
+    boost::thread serverThread([&io]() {
+        io.run();
+    });
+    boost::asio::io_context clientIO;
+    vector<unique_ptr<BenchClient>> clients;
+    for (int frequency : {10, 100}) {
+        clients.emplace_back(new BenchClient(clientIO, frequency));
+        clients.back()->start(tcp::endpoint(boost::asio::ip::address_v4::loopback(), BENCH_SERVER_PORT));
+    }
+    boost::thread clientThread([&clientIO]() {
+        clientIO.run();
+    });
+
+    boost::thread imuThread(boost::bind(&IMUSensorTask::run, &imuTask));
+    boost::thread controlThread(boost::bind(&QuadControlTask::run, &controlTask));
+    boost::this_thread::sleep_for(boost::chrono::seconds(BENCH_METRICS_SECONDS));
+
+    auto start = benchClock::now();
+    string body = fetchStats(BENCH_METRICS_PORT, "/metrics");
+    double scrapeMillis = chrono::duration<double, milli>(benchClock::now() - start).count();
+
+    controlTask.shutdown();
+    controlThread.join();
+    imuTask.shutdown();
+    imuThread.join();
+    imuServer.shutdown();
+    statsServer.shutdown();
+    clientIO.stop();
+    clientThread.join();
+    io.stop();
+    serverThread.join();
+    recorder.shutdown();
+    unlink(BENCH_RECORDER_PATH);
+
+    // every line is a comment or `name{labels} value`
+    int samples = 0, malformed = 0;
+    stringstream lines(body);
+    string line;
+    while (getline(lines, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        size_t space = line.rfind(' ');
+        char *end = nullptr;
+        if (space == string::npos || space == 0) {
+            malformed++;
+            continue;
+        }
+        strtod(line.c_str() + space + 1, &end);
+        if (*end != '\0') {
+            malformed++;
+        }
+        samples++;
+        if (line.find("task_rate_hz") != string::npos || line.find("imu_samples_total") != string::npos ||
+            line.find("imu_fifo_overflows_total") != string::npos || line.find("server_clients") != string::npos ||
+            line.find("recorder_dropped_total") != string::npos) {
+            cout << "  " << line << endl;
+        }
+    }
+    cout << "metrics scrape: " << body.size() << " bytes, " << samples << " samples, malformed=" << malformed
+         << " in " << scrapeMillis << "ms" << endl;
+}
+
+/**
+ * Cost of one call of a micro benchmark case, over BENCH_MICRO_BATCHES batches.
+ */
+struct MicroResult {
+    string name;
+    long long iterations = 0;           // calls per batch
+    double median = 0.0;                // ns per call
+    double min = 0.0;
+    double max = 0.0;
+    double allocations = 0.0;           // heap allocations per call
+};
+
+/**
+ * Keep the compiler from optimizing away a result it can see is never used.
+ */
+template<class T>
+inline void keep(const T &value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+/**
+ * Time body(i) for i = 0, 1, 2, ...: the batch size is grown until a batch takes BENCH_MICRO_BATCH_NANOS, then
+ * BENCH_MICRO_BATCHES batches are timed after a warmup batch. The body is a template parameter so it is inlined
+ * into the loop and a call costs no more than it does in the caller.
+ */
+template<class Body>
+MicroResult runMicro(const string &name, Body body) {
+    long long iterations = 1;
+    int next = 0;
+    auto timeBatch = [&]() {
+        auto start = benchClock::now();
+        for (long long i = 0; i < iterations; ++i) {
+            body(next++);
+        }
+        return chrono::duration<double, nano>(benchClock::now() - start).count();
+    };
+    while (timeBatch() < BENCH_MICRO_BATCH_NANOS / 4 && iterations < (1LL << 30)) {
+        iterations *= 2;
+    }
+    // the fastest of a few batches, so that a preemption does not shrink every batch
+    double nanos = min(timeBatch(), min(timeBatch(), timeBatch()));
+    iterations = max(1LL, static_cast<long long>(iterations * BENCH_MICRO_BATCH_NANOS / max(nanos, 1.0)));
+
+    vector<double> perCall;
+    perCall.reserve(BENCH_MICRO_BATCHES);
+    long long allocationsBefore = allocationCount.load();
+    for (int batch = 0; batch <= BENCH_MICRO_BATCHES; ++batch) {
+        nanos = timeBatch();
+        if (batch == 0) {
+            allocationsBefore = allocationCount.load();     // the first batch is the warmup
+            continue;
+        }
+        perCall.push_back(nanos / iterations);
+    }
+    long long allocations = allocationCount.load() - allocationsBefore;
+
+    sort(perCall.begin(), perCall.end());
+    MicroResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.median = perCall[perCall.size() / 2];
+    result.min = perCall.front();
+    result.max = perCall.back();
+    result.allocations = static_cast<double>(allocations) / (iterations * BENCH_MICRO_BATCHES);
+    return result;
+}
+
+string microJson(const vector<MicroResult> &results, int cpu) {
+    string buffer;
+    JsonWriter writer(buffer);
+    writer.beginObject();
+    writer.field("batches", BENCH_MICRO_BATCHES);
+    const string compiler = __VERSION__;
+    writer.key("compiler");
+    writer.value(compiler.data(), compiler.size());
+    writer.field("cpu", cpu);
+    writer.key("results");
+    writer.beginArray();
+    for (auto &result : results) {
+        writer.beginObject();
+        writer.field("allocations", result.allocations);
+        writer.field("iterations", result.iterations);
+        writer.field("max", result.max);
+        writer.field("median", result.median);
+        writer.field("min", result.min);
+        writer.key("name");
+        writer.value(result.name.data(), result.name.size());
+        writer.endObject();
+    }
+    writer.endArray();
+    writer.field("seed", BENCH_MICRO_SEED);
+    writer.endObject();
+    return buffer;
+}
+
+/**
+ * Medians slower than in a previous run's json by more than BENCH_MICRO_TOLERANCE, printed. Returns the number of
+ * regressions, or -1 if the baseline cannot be read.
+ */
+int compareMicro(const vector<MicroResult> &results, const string &baselinePath) {
+    ifstream file(baselinePath);
+    if (!file) {
+        cerr << "Cannot open baseline " << baselinePath << endl;
+        return -1;
+    }
+    json baseline = json::parse(file, nullptr, false);
+    if (baseline.is_discarded() || !baseline["results"].is_array()) {
+        cerr << "Cannot parse baseline " << baselinePath << endl;
+        return -1;
+    }
+    int regressions = 0;
+    for (auto &result : results) {
+        for (auto &old : baseline["results"]) {
+            if (old["name"] != result.name || !old["median"].is_number()) {
+                continue;
+            }
+            double ratio = result.median / old["median"].get<double>();
+            if (ratio > 1.0 + BENCH_MICRO_TOLERANCE) {
+                cout << "  regression " << result.name << ": " << result.median << "ns, was " << old["median"]
+                     << "ns (" << (ratio - 1.0) * 100 << "% slower)" << endl;
+                regressions++;
+            }
+        }
+    }
+    cout << "micro: " << regressions << " regressions against " << baselinePath << endl;
+    return regressions;
+}
+
+/**
+ * Per call cost of the functions the sensor and control loops run for every sample, on a pinned thread with inputs
+ * from a fixed seed so that runs can be compared:
+ *   benchmark micro [cpu] [output.json] [baseline.json]
+ * A cpu below 0 leaves the thread unpinned. With a baseline, cases whose median got slower by more than
+ * BENCH_MICRO_TOLERANCE are listed and the benchmark fails. Returns false on a regression.
+ */
+bool benchmarkMicro(int cpu, const string &outputPath, const string &baselinePath) {
+    if (cpu >= 0) {
+        ThreadConfigReport report = applyThreadConfig(ThreadConfig("bench-micro", 0, vector<int>{cpu}));
+        if (!report.ok()) {
+            cout << "micro: cannot pin to cpu " << cpu << ": " << report.toString() << endl;
+            cpu = -1;
+        }
+    }
+
+    mt19937 rng(BENCH_MICRO_SEED);
+    uniform_real_distribution<double> angle(-M_PI, M_PI);
+    normal_distribution<double> noise(0.0, 1.0);
+    const int mask = BENCH_MICRO_INPUTS - 1;
+    vector<Quaternion> quaternions(BENCH_MICRO_INPUTS);
+    vector<Vector3> gyro(BENCH_MICRO_INPUTS), accel(BENCH_MICRO_INPUTS), compass(BENCH_MICRO_INPUTS);
+    vector<double> scalars(BENCH_MICRO_INPUTS);
+    for (int i = 0; i < BENCH_MICRO_INPUTS; ++i) {
+        Vector3 euler(angle(rng) / 4, angle(rng) / 4, angle(rng));
+        quaternions[i].fromEuler(euler);
+        gyro[i] = Vector3(0.2 * noise(rng), 0.2 * noise(rng), 0.2 * noise(rng));
+        accel[i] = Vector3(0.05 * noise(rng), 0.05 * noise(rng), 1.0 + 0.05 * noise(rng));
+        compass[i] = Vector3(20 + noise(rng), -5 + noise(rng), 40 + noise(rng));
+        scalars[i] = 10.0 + noise(rng);
+    }
+    // every tenth value of the EWMA input is an outlier
+    for (int i = 0; i < BENCH_MICRO_INPUTS; i += 10) {
+        scalars[i] *= 3;
+    }
+
+    vector<MicroResult> results;
+    results.push_back(runMicro("quaternion.multiply", [&](int i) {
+        Quaternion product = quaternions[i & mask] * quaternions[(i + 1) & mask];
+        keep(product);
+    }));
+    results.push_back(runMicro("quaternion.rotate", [&](int i) {
+        Quaternion rotated = quaternions[i & mask].rotate(accel[i & mask]);
+        keep(rotated);
+    }));
+    results.push_back(runMicro("quaternion.normalize", [&](int i) {
+        Quaternion q = quaternions[i & mask] * 1.5;
+        q.normalize();
+        keep(q);
+    }));
+
+    RateIntegral integral;
+    results.push_back(runMicro("rateIntegral.apply", [&](int i) {
+        Quaternion q = integral.apply(0.001, gyro[i & mask]);
+        keep(q);
+    }));
+
+    SimulatedMPU9250Config chipConfig;
+    chipConfig.realTime = false;
+    SimulatedMPU9250 chip(chipConfig);
+    MPU9250<IMUValue> imu(&chip);
+    IMUValue imuData;
+    results.push_back(runMicro("imu.applyFilters", [&](int i) {
+        double delta_t = 0.001;
+        imuData.gyroRaw = gyro[i & mask];
+        imuData.accelRaw = accel[i & mask];
+        imuData.compassRaw = compass[i & mask];
+        imu.applyFilters(delta_t, &imuData);
+        keep(imuData);
+    }));
+
+    deltat = 0.001f;
+    results.push_back(runMicro("madgwickQuaternionUpdate", [&](int i) {
+        const Vector3 &a = accel[i & mask], &g = gyro[i & mask], &m = compass[i & mask];
+        madgwickQuaternionUpdate(a.x(), a.y(), a.z(), g.x(), g.y(), g.z(), m.x(), m.y(), m.z());
+        keep(q);
+    }));
+    results.push_back(runMicro("mahonyQuaternionUpdate", [&](int i) {
+        const Vector3 &a = accel[i & mask], &g = gyro[i & mask], &m = compass[i & mask];
+        mahonyQuaternionUpdate(a.x(), a.y(), a.z(), g.x(), g.y(), g.z(), m.x(), m.y(), m.z());
+        keep(q);
+    }));
+
+    EWMA ewma;
+    results.push_back(runMicro("ewma.apply", [&](int i) {
+        double value = ewma.apply(scalars[i & mask]);
+        keep(value);
+    }));
+
+    PID pid(1.0f, 0.5f, 0.1f);
+    uint64_t timestamp = 1000000;
+    results.push_back(runMicro("pid.control", [&](int i) {
+        timestamp += 10000;
+        double output = pid.control(0.0, gyro[i & mask].x(), timestamp);
+        keep(output);
+    }));
+
+    DeviceData<IMUValue> imuHistory(1);
+    DeviceData<IMUValue> imuHistory10(10);
+    for (auto *data : {&imuHistory, &imuHistory10}) {
+        for (auto *value : data->values) {
+            // a filtered sample, as the server sends them
+            *value = imuData;
+            imuData.timestamp += 1000;
+        }
+        data->currentIndex = 0;
+    }
+    results.push_back(runMicro("deviceData.toString.k1", [&](int) {
+        const string &text = imuHistory.toString();
+        keep(text);
+    }));
+    results.push_back(runMicro("deviceData.toString.k10", [&](int) {
+        const string &text = imuHistory10.toString();
+        keep(text);
+    }));
+
+    NMEAParser nmea;
+    const string gpsBlock = BENCH_MICRO_GPS_BLOCK;
+    GPSValue gpsData;
+    results.push_back(runMicro("gps.parse", [&](int) {
+        nmea.write(gpsBlock.data(), gpsBlock.size());
+        while (nmea.parse()) {
+        }
+        GPSSensorTask::setGPSData(nmea.getFix(), &gpsData);
+        keep(gpsData);
+    }));
+
+    for (auto &result : results) {
+        cout << "micro " << result.name << ": median=" << result.median << "ns min=" << result.min << "ns max="
+             << result.max << "ns allocations=" << result.allocations << " (" << result.iterations
+             << " calls x " << BENCH_MICRO_BATCHES << ")" << endl;
+    }
+    if (gpsData.numSatellites != 11) {
+        cout << "micro: gps.parse decoded " << gpsData.numSatellites << " satellites, expected 11" << endl;
+    }
+
+    string output = microJson(results, cpu);
+    if (!outputPath.empty()) {
+        ofstream file(outputPath);
+        file << output << endl;
+        if (!file) {
+            cerr << "Cannot write " << outputPath << endl;
+        }
+    }
+    return baselinePath.empty() || compareMicro(results, baselinePath) == 0;
+}
+
+/**
+ * NMEA sentence with its checksum and line end.
+ */
+string nmeaSentence(const string &body) {
+    char checksum[8];
+    snprintf(checksum, sizeof(checksum), "*%02X\r\n", NMEAParser::checksumOf(body.data(), body.size()));
+    return "$" + body + checksum;
+}
+
+/**
+ * A stream as a u-blox receiver sends it at 10 Hz, one epoch of RMC, VTG, GGA, GSA, three GSV and GLL after the
+ * other, with every corruptEvery-th sentence corrupted (none for 0). Returns the stream and the number of epochs
+ * whose GGA and RMC are intact, the corrupted sentences and the last intact position.
+ */
+string nmeaStream(int epochs, int corruptEvery, int &expectedFixes, int &corrupted, double &latitude,
+                  double &longitude) {
+    string stream;
+    expectedFixes = 0;
+    corrupted = 0;
+    int sentenceCount = 0;
+    for (int epoch = 0; epoch < epochs; ++epoch) {
+        int tenths = epoch % 864000;
+        char time[16], lat[16], lon[16];
+        snprintf(time, sizeof(time), "%02d%02d%02d.%d0", tenths / 36000, tenths / 600 % 60, tenths / 10 % 60,
+                 tenths % 10);
+        double latMinutes = 20.61633 + (epoch % 1000) * 0.00001;
+        double lonMinutes = 0.67448 + (epoch % 700) * 0.00001;
+        snprintf(lat, sizeof(lat), "37%08.5f", latMinutes);
+        snprintf(lon, sizeof(lon), "122%08.5f", lonMinutes);
+        string t(time), la(lat), lo(lon);
+        vector<string> bodies{
+            "GPRMC," + t + ",A," + la + ",N," + lo + ",W,0.045,,301018,,,D",
+            "GPVTG,,T,,M,0.045,N,0.083,K,D",
+            "GPGGA," + t + "," + la + ",N," + lo + ",W,2,11,0.86,48.8,M,-30.0,M,,0000",
+            "GPGSA,A,3,05,13,15,18,20,21,24,26,29,,,,1.53,0.86,1.27",
+            "GPGSV,3,1,12,05,39,304,32,13,41,051,39,15,68,066,40,18,11,321,25",
+            "GPGSV,3,2,12,20,51,107,41,21,35,174,36,24,10,040,30,26,06,265,22",
+            "GPGSV,3,3,12,29,54,230,38,46,44,199,33,48,38,194,35,51,49,161,31",
+            "GPGLL," + la + ",N," + lo + ",W," + t + ",A,D"
+        };
+        bool intact = true;
+        for (size_t i = 0; i < bodies.size(); ++i) {
+            string sentence = nmeaSentence(bodies[i]);
+            if (corruptEvery > 0 && ++sentenceCount % corruptEvery == 0) {
+                sentence[7] ^= 0x01;
+                corrupted++;
+                if (i == 0 || i == 2) {
+                    intact = false;
+                }
+            }
+            stream += sentence;
+        }
+        if (intact) {
+            expectedFixes++;
+            latitude = 37 + strtod(lat + 2, nullptr) / 60.0;
+            longitude = 122 + strtod(lon + 3, nullptr) / 60.0;
+        }
+    }
+    return stream;
+}
+
+/**
+ * Throughput of NMEAParser on a recorded stream delivered in chunks of different sizes, from single bytes to whole
+ * reads of the ring, and a check of its fixes, checksum errors and allocations.
+ */
+void benchmarkNmea() {
+    int expectedFixes, corrupted;
+    double latitude = 0.0, longitude = 0.0;
+    const string stream = nmeaStream(BENCH_NMEA_EPOCHS, BENCH_NMEA_CORRUPT_EVERY, expectedFixes, corrupted, latitude,
+                                     longitude);
+
+    for (size_t chunk : {size_t(1), size_t(16), size_t(127), size_t(NMEA_RING_SIZE)}) {
+        NMEAParser parser;
+        GPSValue gpsData;
+        int fixes = 0;
+        long long allocationsBefore = allocationCount.load();
+        auto start = benchClock::now();
+        size_t offset = 0;
+        while (offset < stream.size()) {
+            size_t space;
+            char *buffer = parser.writePointer(space);
+            size_t count = min(min(space, chunk), stream.size() - offset);
+            memcpy(buffer, stream.data() + offset, count);
+            parser.commit(count);
+            offset += count;
+            while (parser.parse()) {
+                GPSSensorTask::setGPSData(parser.getFix(), &gpsData);
+                fixes++;
+            }
+        }
+        double seconds = chrono::duration<double>(benchClock::now() - start).count();
+        long long allocations = allocationCount.load() - allocationsBefore;
+
+        const NMEAFix &fix = parser.getFix();
+        bool positionMatches = fix.latitude == latitude && fix.longitude == longitude;
+        cout << "nmea chunk=" << chunk << ": " << stream.size() / seconds / 1e6 << " MB/s, "
+             << seconds * 1e9 / stream.size() << " ns/byte, fixes=" << fixes << "/" << expectedFixes
+             << " checksumErrors=" << parser.getChecksumErrors() << "/" << corrupted << " malformed="
+             << parser.getMalformed() << " GSV=" << parser.getSentences(NMEAParser::Sentence::OTHER)
+             << " allocations=" << allocations << " position " << (positionMatches ? "matches" : "differs")
+             << " timestamp=" << gpsData.timestamp << endl;
+    }
+}
+
+/**
+ * CPU time a running thread has used so far.
+ */
+double threadCpuSeconds(boost::thread &thread) {
+    clockid_t clock;
+    timespec t{};
+    if (pthread_getcpuclockid(thread.native_handle(), &clock) != 0 || clock_gettime(clock, &t) != 0) {
+        return 0.0;
+    }
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+/**
+ * Write a stream into the master side of a pseudo terminal like a receiver at BENCH_UART_BAUD: one epoch, starting at
+ * each epochStart, every 1 / BENCH_UART_RATE seconds, in chunks of BENCH_UART_CHUNK bytes spaced by their time on
+ * the wire.
+ */
+void writeEpochs(int master, const string &stream, const string &epochStart) {
+    vector<size_t> starts;
+    for (size_t found = stream.find(epochStart); found != string::npos; found = stream.find(epochStart, found + 1)) {
+        starts.push_back(found);
+    }
+    starts.push_back(stream.size());
+    auto chunkTime = boost::chrono::microseconds(BENCH_UART_CHUNK * 10 * 1000000LL / BENCH_UART_BAUD);
+    auto next = boost::chrono::steady_clock::now();
+    for (size_t i = 0; i + 1 < starts.size(); ++i) {
+        boost::this_thread::sleep_until(next);
+        next += boost::chrono::microseconds(1000000 / BENCH_UART_RATE);
+        for (size_t offset = starts[i]; offset < starts[i + 1]; offset += BENCH_UART_CHUNK) {
+            size_t count = min(static_cast<size_t>(BENCH_UART_CHUNK), starts[i + 1] - offset);
+            if (write(master, stream.data() + offset, count) != static_cast<ssize_t>(count)) {
+                cout << "uart: pseudo terminal write failed" << endl;
+                return;
+            }
+            boost::this_thread::sleep_for(chunkTime);
+        }
+    }
+}
+
+/**
+ * GPSSensorTask on a pseudo terminal standing in for the receiver's UART, at BENCH_UART_RATE epochs per second:
+ * the fixes it publishes, how often it wakes up and the CPU it uses, for a few VMIN settings and for a loop that
+ * keeps reading without waiting, as the task used to.
+ */
+void benchmarkUart() {
+    const int epochs = BENCH_UART_RATE * BENCH_UART_SECONDS;
+    int expectedFixes, corrupted;
+    double latitude = 0.0, longitude = 0.0;
+    const string stream = nmeaStream(epochs, 0, expectedFixes, corrupted, latitude, longitude);
+
+    for (int vmin : {0, 1, 64, 255}) {
+        int master, slave;
+        char name[64];
+        if (openpty(&master, &slave, name, nullptr, nullptr) != 0) {
+            cout << "uart: openpty failed: " << strerror(errno) << endl;
+            return;
+        }
+        UARTConfig config;
+        config.baudRate = BENCH_UART_BAUD;
+        config.vmin = static_cast<unsigned char>(vmin);
+        if (vmin == 0) {
+            // with VMIN 0 a read waits at most VTIME
+            config.vtime = 1;
+        }
+        GPSSensorTask task(name, BENCH_UART_RATE, 1, config);
+        close(slave);
+        MetricsRegistry registry;
+        task.setMetrics(registry, "gps");
+        // the same counter the task increments for every fix
+        Counter *fixes = registry.counter("gps_fixes_total", "Fixes decoded.", MetricsRegistry::label("task", "gps"));
+
+        boost::thread taskThread(boost::bind(&GPSSensorTask::run, &task));
+        auto start = benchClock::now();
+        writeEpochs(master, stream, "$GPRMC");
+        // the tail of the last epoch may wait for VMIN bytes until the poll timeout
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(2 * GPS_POLL_TIMEOUT));
+        double seconds = chrono::duration<double>(benchClock::now() - start).count();
+        double cpu = threadCpuSeconds(taskThread);
+        task.shutdown();
+        taskThread.join();
+        close(master);
+
+        GPSValue value = task.getData();
+        bool positionMatches = value.latitude == latitude && value.longitude == longitude;
+        cout << "uart vmin=" << vmin << " vtime=" << static_cast<int>(config.vtime) << ": fixes=" << fixes->get()
+             << "/" << expectedFixes << " reads=" << task.getUART().getReads() << " ("
+             << task.getUART().getReads() / static_cast<double>(epochs) << " per epoch) bytes="
+             << task.getUART().getBytesReceived() << "/" << stream.size() << " cpu=" << cpu / seconds * 100
+             << "% position " << (positionMatches ? "matches" : "differs") << endl;
+    }
+
+    // the old receive loop: read without waiting until an epoch is complete
+    int master, slave;
+    char name[64];
+    if (openpty(&master, &slave, name, nullptr, nullptr) != 0) {
+        return;
+    }
+    UARTConfig config;
+    config.baudRate = BENCH_UART_BAUD;
+    UART uart(name, config);
+    close(slave);
+    atomic<bool> done(false);
+    int fixes = 0;
+    boost::thread busyThread([&]() {
+        NMEAParser parser;
+        while (!done) {
+            size_t space;
+            char *buffer = parser.writePointer(space);
+            ssize_t length = uart.receive(buffer, space);
+            if (length > 0) {
+                parser.commit(static_cast<size_t>(length));
+                while (parser.parse()) {
+                    fixes++;
+                }
+            }
+        }
+    });
+    auto start = benchClock::now();
+    writeEpochs(master, stream, "$GPRMC");
+    double seconds = chrono::duration<double>(benchClock::now() - start).count();
+    double cpu = threadCpuSeconds(busyThread);
+    done = true;
+    busyThread.join();
+    close(master);
+    cout << "uart busy loop: fixes=" << fixes << "/" << expectedFixes << " cpu=" << cpu / seconds * 100 << "%"
+         << endl;
+}
+
+// UBX-NAV-PVT recorded from a NEO-M8N: 2018-10-30 05:01:04.99988 UTC, 3D fix, 11 satellites, 37.3436055 N,
+// 122.0112413 W, 48.8 m above mean sea level
+#define BENCH_UBX_NAV_PVT "\xb5\x62\x01\x07\x5c\x00\xb8\xb8\xd3\x1a\xe2\x07\x0a\x1e\x05\x01\x05\x37\x19\x00\x00\x00" \
+    "\x40\x2b\xfe\xff\x03\x01\xea\x0b\xe3\x8f\x46\xb7\x97\x2e\x42\x16\x70\x49\x00\x00\xa0\xbe\x00\x00\xb0\x04\x00\x00" \
+    "\x34\x08\x00\x00\x0c\x00\x00\x00\xde\xff\xff\xff\x05\x00\x00\x00\x23\x00\x00\x00\x59\xda\x44\x00\x2c\x01\x00\x00" \
+    "\x00\x71\x02\x00\x99\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\xe0\xfd"
+// UBX-NAV-STATUS of the same epoch: 3D fix, time to first fix 31 s
+#define BENCH_UBX_NAV_STATUS "\xb5\x62\x01\x03\x10\x00\xb8\xb8\xd3\x1a\x03\x0d\x00\x08\x18\x79\x00\x00\x87\xd6\x12" \
+    "\x00\x89\x5d"
+// CFG-RATE to 10 Hz and CFG-MSG enabling NAV-PVT, as in the u-blox 8 protocol specification examples
+#define BENCH_UBX_CFG_RATE_10HZ "\xb5\x62\x06\x08\x06\x00\x64\x00\x01\x00\x01\x00\x7a\x12"
+#define BENCH_UBX_CFG_MSG_PVT "\xb5\x62\x06\x01\x03\x00\x01\x07\x01\x13\x51"
+
+/**
+ * A UBX frame as bytes, sizeof a string literal counts its terminating 0.
+ */
+#define BENCH_UBX_BYTES(literal) string(literal, sizeof(literal) - 1)
+
+/**
+ * Decode the recorded frames one byte at a time and all at once, and compare the configuration frames with the
+ * published ones.
+ */
+bool checkUbxRecorded() {
+    const string recorded = BENCH_UBX_BYTES(BENCH_UBX_NAV_PVT) + BENCH_UBX_BYTES(BENCH_UBX_NAV_STATUS);
+    bool ok = true;
+    for (size_t chunk : {size_t(1), recorded.size()}) {
+        UBXParser parser;
+        int fixes = 0;
+        for (size_t offset = 0; offset < recorded.size(); offset += chunk) {
+            parser.write(recorded.data() + offset, min(chunk, recorded.size() - offset));
+            while (parser.parse()) {
+                fixes++;
+            }
+        }
+        GPSValue value;
+        GPSSensorTask::setGPSData(parser.getPVT(), &value);
+        const UBXNavStatus &status = parser.getStatus();
+        bool matches = fixes == 1 && parser.getMessages(UBXParser::Message::NAV_STATUS) == 1 &&
+                       parser.getChecksumErrors() == 0 && value.timestamp == 1540875664999880LL &&
+                       fabs(value.latitude - 37.3436055) < 1e-9 && value.latitudeHemisphere == 'N' &&
+                       fabs(value.longitude - 122.0112413) < 1e-9 && value.longitudeHemisphere == 'W' &&
+                       value.altitude == 48.8 && value.numSatellites == 11 && status.gpsFix == 3 &&
+                       status.ttff == 31000;
+        cout << "ubx recorded chunk=" << chunk << ": " << value.toJson().dump() << " ttff=" << status.ttff
+             << (matches ? " matches" : " differs") << endl;
+        ok = ok && matches;
+    }
+    bool framesMatch = UBXConfig::measurementRate(10) == BENCH_UBX_BYTES(BENCH_UBX_CFG_RATE_10HZ) &&
+                       UBXConfig::messageRate(UBX_CLASS_NAV, UBX_NAV_PVT, 1) == BENCH_UBX_BYTES(BENCH_UBX_CFG_MSG_PVT);
+    cout << "ubx configuration frames " << (framesMatch ? "match" : "differ") << endl;
+    return ok && framesMatch;
+}
+
+/**
+ * A stream of a receiver switched to UBX at 10 Hz: every epoch a NAV-PVT, a NAV-STATUS and a GGA left over from the
+ * NMEA output, with every corruptEvery-th frame corrupted (none for 0). Returns the stream, the number of intact
+ * NAV-PVT, the corrupted frames and the last intact position in 1e-7 degrees.
+ */
+string ubxStream(int epochs, int corruptEvery, int &expectedFixes, int &corrupted, int32_t &latitude,
+                 int32_t &longitude) {
+    string stream;
+    expectedFixes = 0;
+    corrupted = 0;
+    int frameCount = 0;
+    UBXNavPVT pvt{};
+    memcpy(&pvt, BENCH_UBX_BYTES(BENCH_UBX_NAV_PVT).data() + 6, sizeof(pvt));
+    const string status = BENCH_UBX_BYTES(BENCH_UBX_NAV_STATUS);
+    const string gga = nmeaSentence("GPGGA,050104.90,3720.61633,N,12200.67448,W,2,11,0.86,48.8,M,-30.0,M,,0000");
+    for (int epoch = 0; epoch < epochs; ++epoch) {
+        pvt.iTOW += 100;
+        pvt.lat = 373436055 + epoch % 1000;
+        pvt.lon = -1220112413 - epoch % 700;
+        const string payload(reinterpret_cast<char *>(&pvt), sizeof(pvt));
+        const string frame = UBXConfig::frame(UBX_CLASS_NAV, UBX_NAV_PVT, payload);
+        bool intact = true;
+        for (const string *next : {&frame, &status}) {
+            string bytes = *next;
+            if (corruptEvery > 0 && ++frameCount % corruptEvery == 0) {
+                bytes[10] ^= 0x01;
+                corrupted++;
+                intact = intact && next != &frame;
+            }
+            stream += bytes;
+        }
+        stream += gga;
+        if (intact) {
+            expectedFixes++;
+            latitude = pvt.lat;
+            longitude = pvt.lon;
+        }
+    }
+    return stream;
+}
+
+/**
+ * UBXParser on the recorded frames, its throughput on a generated stream delivered in chunks of different sizes, and
+ * GPSSensorTask switching a receiver on a pseudo terminal to UBX and decoding its NAV-PVT epochs.
+ */
+void benchmarkUbx() {
+    checkUbxRecorded();
+
+    int expectedFixes, corrupted;
+    int32_t latitude = 0, longitude = 0;
+    const string stream = ubxStream(BENCH_UBX_EPOCHS, BENCH_UBX_CORRUPT_EVERY, expectedFixes, corrupted, latitude,
+                                    longitude);
+    for (size_t chunk : {size_t(1), size_t(16), size_t(127), size_t(UBX_RING_SIZE)}) {
+        UBXParser parser;
+        GPSValue gpsData;
+        int fixes = 0;
+        long long allocationsBefore = allocationCount.load();
+        auto start = benchClock::now();
+        size_t offset = 0;
+        while (offset < stream.size()) {
+            size_t space;
+            char *buffer = parser.writePointer(space);
+            size_t count = min(min(space, chunk), stream.size() - offset);
+            memcpy(buffer, stream.data() + offset, count);
+            parser.commit(count);
+            offset += count;
+            while (parser.parse()) {
+                GPSSensorTask::setGPSData(parser.getPVT(), &gpsData);
+                fixes++;
+            }
+        }
+        double seconds = chrono::duration<double>(benchClock::now() - start).count();
+        long long allocations = allocationCount.load() - allocationsBefore;
+
+        bool positionMatches = parser.getPVT().lat == latitude && parser.getPVT().lon == longitude;
+        cout << "ubx chunk=" << chunk << ": " << stream.size() / seconds / 1e6 << " MB/s, "
+             << seconds * 1e9 / stream.size() << " ns/byte, fixes=" << fixes << "/" << expectedFixes
+             << " checksumErrors=" << parser.getChecksumErrors() << "/" << corrupted << " malformed="
+             << parser.getMalformed() << " allocations=" << allocations << " position "
+             << (positionMatches ? "matches" : "differs") << endl;
+    }
+
+    // the task switches the receiver over and then decodes NAV-PVT at BENCH_UART_RATE
+    int master, slave;
+    char name[64];
+    if (openpty(&master, &slave, name, nullptr, nullptr) != 0) {
+        cout << "ubx: openpty failed: " << strerror(errno) << endl;
+        return;
+    }
+    GPSSensorTask task(name, BENCH_UART_RATE);
+    close(slave);
+    MetricsRegistry registry;
+    task.setMetrics(registry, "gps");
+    Counter *fixes = registry.counter("gps_fixes_total", "Fixes decoded.", MetricsRegistry::label("task", "gps"));
+    bool configured = task.configureUBX(BENCH_UART_BAUD, BENCH_UART_RATE);
+    string expected;
+    for (const string &message : UBXConfig::binaryOutput(BENCH_UART_BAUD, BENCH_UART_RATE)) {
+        expected += message;
+    }
+    string sent(expected.size(), '\0');
+    ssize_t length = read(master, &sent[0], sent.size());
+    cout << "ubx configure: " << (configured ? "sent " : "failed ") << length << "/" << expected.size() << " bytes "
+         << (sent == expected ? "as expected" : "differing") << ", baud rate " << task.getUART().getConfig().baudRate
+         << endl;
+
+    const int epochs = BENCH_UART_RATE * BENCH_UART_SECONDS;
+    const string epochStream = ubxStream(epochs, 0, expectedFixes, corrupted, latitude, longitude);
+    boost::thread taskThread(boost::bind(&GPSSensorTask::run, &task));
+    auto start = benchClock::now();
+    writeEpochs(master, epochStream, string("\xb5\x62\x01\x07", 4));
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(2 * GPS_POLL_TIMEOUT));
+    double seconds = chrono::duration<double>(benchClock::now() - start).count();
+    double cpu = threadCpuSeconds(taskThread);
+    task.shutdown();
+    taskThread.join();
+    close(master);
+
+    GPSValue value = task.getData();
+    bool positionMatches = fabs(value.latitude - latitude * 1e-7) < 1e-9 &&
+                           fabs(value.longitude + longitude * 1e-7) < 1e-9;
+    cout << "ubx task: fixes=" << fixes->get() << "/" << expectedFixes << " NAV-STATUS="
+         << task.getUBXParser().getMessages(UBXParser::Message::NAV_STATUS) << " reads="
+         << task.getUART().getReads() << " cpu=" << cpu / seconds * 100 << "% position "
+         << (positionMatches ? "matches" : "differs") << endl;
+}
+
+int main(int argc, char *argv[]) {
+    string name = argc > 1 ? string(argv[1]) : "all";
+    if (name == "all" || name == "deviceTask") {
+        benchmarkDeviceTask();
+    }
+    if (name == "all" || name == "scheduler") {
+        benchmarkScheduler();
+    }
+    if (name == "all" || name == "realtime") {
+        benchmarkRealtime();
+    }
+    if (name == "all" || name == "edgeSource") {
+        benchmarkEdgeSource();
+    }
+    if (name == "all" || name == "imu") {
+        benchmarkIMU();
+    }
+    if (name == "all" || name == "i2c") {
+        benchmarkI2C();
+    }
+    if (name == "all" || name == "server") {
+        benchmarkServer();
+        checkAcceptRetry();
+    }
+    if (name == "all" || name == "wire") {
+        benchmarkWire();
+    }
+    if (name == "all" || name == "json") {
+        benchmarkJson();
+    }
+    if (name == "all" || name == "shm") {
+        benchmarkShm();
+    }
+    if (name == "all" || name == "udp") {
+        benchmarkUdp();
+    }
+    if (name == "all" || name == "framer") {
+        benchmarkFramer();
+    }
+    if (name == "all" || name == "subscription") {
+        benchmarkSubscription();
+    }
+    if (name == "all" || name == "backpressure") {
+        benchmarkBackpressure();
+    }
+    if (name == "all" || name == "recorder") {
+        benchmarkRecorder();
+    }
+    if (name == "all" || name == "replay") {
+        benchmarkReplay();
+    }
+    if (name == "all" || name == "simulator") {
+        benchmarkSimulator();
+    }
+    if (name == "all" || name == "montecarlo") {
+        benchmarkMonteCarlo();
+    }
+    if (name == "all" || name == "latency") {
+        benchmarkLatency();
+    }
+    if (name == "all" || name == "metrics") {
+        benchmarkMetrics();
+    }
+    if (name == "all" || name == "nmea") {
+        benchmarkNmea();
+    }
+    if (name == "all" || name == "uart") {
+        benchmarkUart();
+    }
+    if (name == "all" || name == "ubx") {
+        benchmarkUbx();
+    }
+    if (name == "all" || name == "micro") {
+        // benchmark micro [cpu] [output.json] [baseline.json]
+        int cpu = name == "micro" && argc > 2 ? atoi(argv[2]) : 0;
+        string outputPath = name == "micro" && argc > 3 ? string(argv[3]) : "";
+        string baselinePath = name == "micro" && argc > 4 ? string(argv[4]) : "";
+        if (!benchmarkMicro(cpu, outputPath, baselinePath)) {
+            return 1;
+        }
+    }
+    if (benchFailures > 0) {
+        cerr << benchFailures << " check(s) failed" << endl;
+        return 1;
+    }
+    return 0;
+}
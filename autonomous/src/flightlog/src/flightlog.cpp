@@ -0,0 +1,152 @@
+#include <iostream>
+#include <core/flightRecorder.hpp>
+#include <control/flightReplay.hpp>
+#include <control/quadControlTask.hpp>
+#include <sensor/gpsTask.hpp>
+#include <sensor/imuTask.hpp>
+#include <utils/jsonWriter.hpp>
+
+/**
+ * Converts a flight log written by FlightRecorder to json lines or csv, or replays it:
+ *   flightlog <file> [json]           one json object per record
+ *   flightlog <file> csv <type>       one csv row per record of type imu, gps or control
+ *   flightlog <file> replay           run the attitude filter and controllers on the log again and compare
+ */
+
+/**
+ * Decode a record of T and write it as json into buffer. Returns false if the payload does not decode.
+ */
+template<class T>
+bool recordJson(const FlightRecord &record, string &buffer) {
+    BinaryReader reader(record.payload, record.length);
+    T value;
+    value.fromBinary(reader);
+    if (!reader.ok()) {
+        return false;
+    }
+    JsonWriter writer(buffer);
+    value.writeJson(writer);
+    return true;
+}
+
+bool valueJson(const FlightRecord &record, string &buffer) {
+    switch (record.type) {
+        case WIRE_TYPE_IMU:
+            return recordJson<IMUValue>(record, buffer);
+        case WIRE_TYPE_GPS:
+            return recordJson<GPSValue>(record, buffer);
+        case WIRE_TYPE_CONTROL:
+            return recordJson<ControlValue>(record, buffer);
+        default:
+            return false;
+    }
+}
+
+/**
+ * Nested objects become columns like accelAngle.scalar.
+ */
+void flatten(const json &value, const string &prefix, vector<pair<string, string>> &columns) {
+    if (value.is_object()) {
+        for (auto it = value.begin(); it != value.end(); ++it) {
+            flatten(it.value(), prefix.empty() ? it.key() : prefix + "." + it.key(), columns);
+        }
+    } else if (value.is_string()) {
+        columns.emplace_back(prefix, value.get<string>());
+    } else {
+        columns.emplace_back(prefix, value.dump());
+    }
+}
+
+int writeJson(FlightLogReader &reader) {
+    FlightRecord record;
+    string buffer;
+    while (reader.next(record)) {
+        buffer.clear();
+        JsonWriter writer(buffer);
+        writer.beginObject();
+        writer.field("sequence", static_cast<long long>(record.sequence));
+        writer.key("type");
+        writer.value(wireTypeName(record.type), strlen(wireTypeName(record.type)));
+        writer.key("value");
+        string value;
+        if (valueJson(record, value)) {
+            buffer += value;
+        } else {
+            buffer += "null";
+        }
+        writer.endObject();
+        cout << buffer << "\n";
+    }
+    return 0;
+}
+
+int writeCsv(FlightLogReader &reader, const string &type) {
+    FlightRecord record;
+    string value;
+    bool headerWritten = false;
+    vector<pair<string, string>> columns;
+    while (reader.next(record)) {
+        value.clear();
+        if (type != wireTypeName(record.type) || !valueJson(record, value)) {
+            continue;
+        }
+        columns.clear();
+        flatten(json::parse(value), "", columns);
+        if (!headerWritten) {
+            cout << "sequence";
+            for (auto &column : columns) {
+                cout << "," << column.first;
+            }
+            cout << "\n";
+            headerWritten = true;
+        }
+        cout << record.sequence;
+        for (auto &column : columns) {
+            cout << "," << column.second;
+        }
+        cout << "\n";
+    }
+    return 0;
+}
+
+/**
+ * Exits with 1 if any replayed output differs from the recorded one.
+ */
+int replay(const string &path) {
+    LogReplay replay(path);
+    if (!replay.run()) {
+        return 1;
+    }
+    ReplayStats stats = replay.getStats();
+    cout << stats.toString() << endl;
+    return stats.identical() ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0] << " <file> [json | csv <imu|gps|control> | replay]" << endl;
+        return 1;
+    }
+    if (argc > 2 && string(argv[2]) == "replay") {
+        return replay(argv[1]);
+    }
+    FlightLogReader reader(argv[1]);
+    if (!reader.open()) {
+        return 1;
+    }
+    string format = argc > 2 ? string(argv[2]) : "json";
+    int result;
+    if (format == "csv") {
+        result = writeCsv(reader, argc > 3 ? string(argv[3]) : "imu");
+    } else if (format == "json") {
+        result = writeJson(reader);
+    } else {
+        cerr << "Unknown format " << format << endl;
+        return 1;
+    }
+    cout.flush();
+    cerr << argv[1] << ": records=" << reader.getRecordCount() << " dropped=" << reader.getDropped()
+         << " corrupt=" << reader.getCorrupt() << " recovered=" << reader.getRecovered()
+         << (reader.closedCleanly() ? "" : " (not closed cleanly)") << endl;
+    return result;
+}
@@ -12,6 +12,9 @@
 // seeing weird oscillations when NUM_SAMPLES > 1 - possibly because of Nyquist theorem
 #define NUM_SAMPLES                 1               // number of samples in circular buffer to store
 
+#define UBX_BAUD_RATE               115200          // after --ubx, up from the 9600 of NMEA
+#define UBX_RATE                    10              // NAV-PVT per second after --ubx
+
 #define THREAD_POOL_COUNT           2
 #define HOSTNAME                    "localhost"
 
@@ -24,16 +27,18 @@ void launchClient() {
     BaseClient client(io, HOSTNAME, port);
     tcp::socket *socket = client.connect(CLIENT_FREQUENCY);
     if (socket) {
-        auto data = client.read(*socket);
-        while (!data.empty()) {
-            cout << data << endl;
-            data = client.read(*socket);
+        FrameView frame;
+        while (client.readView(*socket, frame)) {
+            cout.write(frame.data, frame.length) << endl;
         }
     }
 }
 
-void launchServer(const string& deviceName) {
+void launchServer(const string& deviceName, bool ubx) {
     GPSSensorTask sensorTask(deviceName, SERVER_FREQUENCY, NUM_SAMPLES);
+    if (ubx && !sensorTask.configureUBX(UBX_BAUD_RATE, UBX_RATE)) {
+        cout << "Unable to switch the GPS to UBX, reading NMEA" << endl;
+    }
     boost::asio::post(threadPool, boost::bind(&GPSSensorTask::run, &sensorTask));
 
     BaseServer<GPSValue> server(HOSTNAME, port, sensorTask);
@@ -46,8 +51,8 @@ int main(int argc, char* argv[]) {
         if (string(argv[1]) == "--client") {
             launchClient();
         } else {
-            // pass deviceName: /dev/serial0
-            launchServer(string(argv[1]));
+            // pass deviceName: /dev/serial0, and --ubx to switch a u-blox receiver to binary output
+            launchServer(string(argv[1]), argc > 2 && string(argv[2]) == "--ubx");
         }
     }
 
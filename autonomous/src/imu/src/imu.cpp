@@ -7,6 +7,7 @@
 #include <core/baseClient.hpp>
 #include <core/baseServer.hpp>
 #include <sensor/imuTask.hpp>
+#include <sensor/mpu9250Sim.hpp>
 
 #define CLIENT_FREQUENCY            20              // frequency in Hz
 #define SERVER_FREQUENCY            100             // frequency in Hz
@@ -16,37 +17,108 @@
 
 #define THREAD_POOL_COUNT           2
 #define HOSTNAME                    "localhost"
+#define IMU_SHM_NAME                "/quadcopter.imu"
+#define IMU_UDP_GROUP               "239.255.0.1"   // multicast group for ground station telemetry
+#define IMU_UDP_BATCH               5               // samples per datagram
 
 boost::asio::thread_pool threadPool(THREAD_POOL_COUNT);
 
 const unsigned short port = 5001;
+const unsigned short udpPort = 5101;
 
-void launchClient() {
+/**
+ * Stream from the server. options are the subscription options after the frequency, e.g. "binary latest
+ * fields=thetaCompFilter".
+ */
+void launchClient(const string &options = "") {
     boost::asio::io_context io;
     BaseClient client(io, HOSTNAME, port);
-    tcp::socket *socket = client.connect(CLIENT_FREQUENCY);
-    if (socket) {
-        auto data = client.read(*socket);
-        while (!data.empty()) {
-            cout << data << endl;
-            data = client.read(*socket);
+    Subscription subscription;
+    subscription.parse(to_string(CLIENT_FREQUENCY) + " " + options, IMUValue::fieldNames());
+    tcp::socket *socket = client.connect(subscription, IMUValue::fieldNames());
+    if (socket && subscription.format == WireFormat::BINARY) {
+        int currentIndex;
+        vector<IMUValue> values;
+        while (client.readValues(*socket, currentIndex, values)) {
+            cout << values[currentIndex].toJson().dump() << endl;
         }
+    } else if (socket) {
+        FrameView frame;
+        while (client.readView(*socket, frame)) {
+            cout.write(frame.data, frame.length) << endl;
+        }
+    }
+}
+
+/**
+ * Receive the multicast telemetry, reporting lost and reordered datagrams.
+ */
+void launchUdpClient() {
+    boost::asio::io_context io;
+    BaseClient client(io, HOSTNAME, port);
+    if (!client.listen(udpPort, IMU_UDP_GROUP)) {
+        return;
+    }
+    vector<IMUValue> values;
+    while (client.receiveValues(values)) {
+        cout << client.getUdpStats().toString() << " " << values.back().toJson().dump() << endl;
     }
 }
 
-void launchServer() {
-    IMUSensorTask sensorTask(SERVER_FREQUENCY, NUM_SAMPLES);
+/**
+ * Read every sample the server publishes through shared memory instead of the socket.
+ */
+void launchShmClient() {
+    ShmRingReader<IMUValue> reader(IMU_SHM_NAME);
+    while (!reader.open()) {
+        cout << "Waiting for " << IMU_SHM_NAME << "..." << endl;
+        sleep(1);
+    }
+    IMUValue value;
+    for (;;) {
+        if (!reader.wait(1000)) {
+            continue;
+        }
+        while (reader.read(value)) {
+            cout << reader.getSequence() - 1 << " dropped=" << reader.getDropped() << " "
+                 << value.toJson().dump() << endl;
+        }
+    }
+}
+
+void launchServer(I2CBus *bus = nullptr) {
+    IMUSensorTask sensorTask(SERVER_FREQUENCY, NUM_SAMPLES, 0, bus);
+    TimerEdgeSource dataReady(sensorTask.getSampleRate());
+    sensorTask.setDataReadySource(&dataReady);
+    ShmRingWriter<IMUValue> ring(IMU_SHM_NAME);
+    if (ring.open()) {
+        sensorTask.setShmRing(&ring);
+    }
     boost::asio::post(threadPool, boost::bind(&IMUSensorTask::run, &sensorTask));
 
     BaseServer<IMUValue> server(HOSTNAME, port, sensorTask);
     boost::asio::io_context io;
+    UdpPublisher<IMUValue> publisher(sensorTask, IMU_UDP_GROUP, udpPort, SERVER_FREQUENCY, IMU_UDP_BATCH);
+    publisher.start(io);
     server.launch(io);
 }
 
 int main(int argc, char *argv[]) {
     if (argc > 1) {
         if (string(argv[1]) == "--client") {
-            launchClient();
+            string options;
+            for (int i = 2; i < argc; ++i) {
+                options += string(argv[i]) + " ";
+            }
+            launchClient(options);
+        } else if (string(argv[1]) == "--shm-client") {
+            launchShmClient();
+        } else if (string(argv[1]) == "--udp-client") {
+            launchUdpClient();
+        } else if (string(argv[1]) == "--simulate") {
+            // serve data from a simulated MPU9250 instead of /dev/i2c-1
+            SimulatedMPU9250 chip;
+            launchServer(&chip);
         }
     } else {
         launchServer();
@@ -0,0 +1,269 @@
+#ifndef CONTROL_FLIGHTREPLAY_HPP
+#define CONTROL_FLIGHTREPLAY_HPP
+
+#include <time.h>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <core/flightRecorder.hpp>
+#include <control/quadControlTask.hpp>
+#include <sensor/imuTask.hpp>
+#include <stream/attitudeFilter.hpp>
+
+/**
+ * Outcome of a replay. A sample or an output matches if every replayed field has the same bits as the recorded one.
+ */
+struct ReplayStats {
+    long long imuSamples = 0;           // samples run through the attitude filter, not counting the seed
+    long long imuMatched = 0;
+    double imuMaxError = 0.0;           // largest difference of a quaternion component
+    long long controlSteps = 0;         // controller outputs computed
+    long long controlMatched = 0;
+    double controlMaxError = 0.0;
+    long long referenceChanges = 0;
+    long long missingImu = 0;           // outputs whose IMU sample is not in the log
+    double flightSeconds = 0.0;         // time spanned by the replayed samples
+    double replaySeconds = 0.0;         // wall clock time of the replay
+
+    bool identical() const {
+        return imuMatched == imuSamples && controlMatched == controlSteps && missingImu == 0;
+    }
+
+    string toString() const {
+        stringstream ss;
+        ss << "imu=" << imuMatched << "/" << imuSamples << " (maxError=" << imuMaxError << ") control="
+           << controlMatched << "/" << controlSteps << " (maxError=" << controlMaxError << ") references="
+           << referenceChanges << " missingImu=" << missingImu << " flight=" << flightSeconds << "s replay="
+           << replaySeconds << "s (" << (replaySeconds > 0 ? flightSeconds / replaySeconds : 0.0) << "x realtime)";
+        return ss.str();
+    }
+};
+
+/**
+ * Stands in for IMUSensorTask during a replay: recorded raw samples go through the same attitude filter as live
+ * ones, with the original timestamps. Like the live task with one value per slot, every sample continues from the
+ * previous one.
+ */
+class ReplayIMUTask : public DeviceTask<IMUValue> {
+private:
+    double filterAlpha = ATTITUDE_FILTER_ALPHA;
+
+public:
+    ReplayIMUTask() : DeviceTask(0, 1) {
+    }
+
+    /**
+     * Replay with a different complementary filter weight than the live task used.
+     */
+    void setFilterAlpha(double alpha) {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        filterAlpha = alpha;
+    }
+
+    /**
+     * Filter the raw fields of a recorded sample and publish the result.
+     */
+    IMUValue step(const IMUValue &recorded) {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        DeviceTask::fetch();
+        auto *imuData = result->getCurrentValue();
+        double delta_t = (recorded.timestamp - imuData->timestamp) / 1000000.0;
+        imuData->timestamp = recorded.timestamp;
+        imuData->gyroRaw = recorded.gyroRaw;
+        imuData->accelRaw = recorded.accelRaw;
+        imuData->compassRaw = recorded.compassRaw;
+        applyAttitudeFilter(delta_t, imuData, filterAlpha);
+        publish();
+        return *imuData;
+    }
+};
+
+/**
+ * Runs a flight log through the attitude filter and QuadControlTask as fast as the CPU allows and compares every
+ * result with the recorded one:
+ * - the IMU records (every sample the live filter saw) are filtered again, seeded from the first one
+ * - each control record is computed again from the IMU sample it names, at its recorded time
+ *
+ * The filter only carries state from one sample to the next, so it matches from the second sample on. The PID
+ * state is not in the log, so the outputs only match if the log holds the flight from its first output on, i.e.
+ * the ring did not wrap and no control record was dropped. By default a mismatching IMU sample is replaced by the
+ * recorded one, so a sample the recorder dropped counts once rather than for the rest of the flight.
+ */
+class LogReplay {
+private:
+    FlightLogReader imuLog;
+    FlightLogReader controlLog;
+    ReplayIMUTask imuTask;
+    QuadControlTask controlTask;
+    bool resynchronize = true;
+
+    IMUValue pendingImu;                // next IMU record, read ahead of the control records
+    bool hasPendingImu = false;
+    IMUValue currentImu;                // the most recently replayed sample
+    bool imuStarted = false;
+    long long firstTimestamp = 0;
+    long long lastTimestamp = 0;
+
+    Vector3 referenceAttitude{};
+    double referenceAltitude = 0.0;
+    long long lastControlTimestamp = 0;
+
+    ReplayStats stats;
+
+public:
+    explicit LogReplay(const string &path) : imuLog(path), controlLog(path), controlTask(0, 1, imuTask) {
+    }
+
+    /**
+     * Keep the replayed IMU samples in step with the log (the default), or let a difference carry on, e.g. to see
+     * how far a changed filter drifts.
+     */
+    void setResynchronize(bool enabled) {
+        resynchronize = enabled;
+    }
+
+    bool run() {
+        if (!imuLog.open() || !controlLog.open()) {
+            return false;
+        }
+        stats = ReplayStats();
+        struct timespec start{}, end{};
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        hasPendingImu = nextValue(imuLog, pendingImu);
+        ControlValue recorded;
+        while (nextValue(controlLog, recorded)) {
+            replayControl(recorded);
+        }
+        while (hasPendingImu) {
+            replayImu();
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        stats.replaySeconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        stats.flightSeconds = (lastTimestamp - firstTimestamp) / 1e6;
+        return true;
+    }
+
+    ReplayStats getStats() const {
+        return stats;
+    }
+
+    ReplayIMUTask &getIMUTask() {
+        return imuTask;
+    }
+
+    QuadControlTask &getControlTask() {
+        return controlTask;
+    }
+
+private:
+    /**
+     * Next record of T's type in the log, skipping other types and payloads that do not decode.
+     */
+    template<class T>
+    static bool nextValue(FlightLogReader &log, T &value) {
+        FlightRecord record;
+        while (log.next(record)) {
+            if (record.type != T::wireType) {
+                continue;
+            }
+            BinaryReader reader(record.payload, record.length);
+            value.fromBinary(reader);
+            if (reader.ok()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void replayImu() {
+        if (!imuStarted) {
+            imuTask.seed(pendingImu);
+            currentImu = pendingImu;
+            firstTimestamp = pendingImu.timestamp;
+            imuStarted = true;
+        } else {
+            currentImu = imuTask.step(pendingImu);
+            stats.imuSamples++;
+            double error = max(difference(currentImu.gyroAngle, pendingImu.gyroAngle),
+                               max(difference(currentImu.accelAngle, pendingImu.accelAngle),
+                                   difference(currentImu.thetaCompFilter, pendingImu.thetaCompFilter)));
+            stats.imuMaxError = max(stats.imuMaxError, error);
+            if (same(currentImu.gyroAngle, pendingImu.gyroAngle) &&
+                same(currentImu.accelAngle, pendingImu.accelAngle) &&
+                same(currentImu.thetaCompFilter, pendingImu.thetaCompFilter)) {
+                stats.imuMatched++;
+            } else if (resynchronize) {
+                imuTask.seed(pendingImu);
+                currentImu = pendingImu;
+            }
+        }
+        lastTimestamp = pendingImu.timestamp;
+        hasPendingImu = nextValue(imuLog, pendingImu);
+    }
+
+    void replayControl(const ControlValue &recorded) {
+        if (!same(recorded.referenceAttitude, referenceAttitude) ||
+            !same(recorded.referenceAltitude, referenceAltitude)) {
+            referenceAttitude = recorded.referenceAttitude;
+            referenceAltitude = recorded.referenceAltitude;
+            controlTask.setReference(referenceAttitude.x(), referenceAttitude.y(), referenceAttitude.z(),
+                                     referenceAltitude);
+            stats.referenceChanges++;
+        }
+        if (lastControlTimestamp != 0 && recorded.timestamp == lastControlTimestamp) {
+            // published by setReference(), not a new output
+            return;
+        }
+        lastControlTimestamp = recorded.timestamp;
+
+        while (hasPendingImu && pendingImu.timestamp <= recorded.imuTimestamp) {
+            replayImu();
+        }
+        IMUValue imuData;
+        if (imuStarted && currentImu.timestamp == recorded.imuTimestamp) {
+            imuData = currentImu;
+        } else {
+            if (imuStarted) {
+                stats.missingImu++;
+            }
+            // before the first sample the live task handed out a default value
+            imuData.timestamp = recorded.imuTimestamp;
+        }
+
+        controlTask.step(imuData, recorded.timestamp);
+        ControlValue replayed = controlTask.getData();
+        stats.controlSteps++;
+        double error = max(difference(replayed.attitudeControl, recorded.attitudeControl),
+                           fabs(replayed.altitudeControl - recorded.altitudeControl));
+        stats.controlMaxError = max(stats.controlMaxError, error);
+        if (same(replayed.attitudeControl, recorded.attitudeControl) &&
+            same(replayed.altitudeControl, recorded.altitudeControl)) {
+            stats.controlMatched++;
+        }
+    }
+
+    static bool same(double a, double b) {
+        return memcmp(&a, &b, sizeof(double)) == 0;
+    }
+
+    static bool same(const Vector3 &a, const Vector3 &b) {
+        return same(a.x(), b.x()) && same(a.y(), b.y()) && same(a.z(), b.z());
+    }
+
+    static bool same(const Quaternion &a, const Quaternion &b) {
+        return same(a.scalar(), b.scalar()) && same(a.x(), b.x()) && same(a.y(), b.y()) && same(a.z(), b.z());
+    }
+
+    static double difference(const Vector3 &a, const Vector3 &b) {
+        return max(fabs(a.x() - b.x()), max(fabs(a.y() - b.y()), fabs(a.z() - b.z())));
+    }
+
+    static double difference(const Quaternion &a, const Quaternion &b) {
+        return max(max(fabs(a.scalar() - b.scalar()), fabs(a.x() - b.x())),
+                   max(fabs(a.y() - b.y()), fabs(a.z() - b.z())));
+    }
+};
+
+#endif // CONTROL_FLIGHTREPLAY_HPP
@@ -7,13 +7,32 @@
 
 #include <utils/misc.hpp>
 
+struct PIDGains {
+    float kp;
+    float ki;
+    float kd;
+
+    PIDGains(float kp = 0.0f, float ki = 0.0f, float kd = 0.0f) : kp(kp), ki(ki), kd(kd) {
+    }
+};
+
 class Controller {
 public:
-    virtual double control(double reference, double sensor) = 0;
+    /**
+     * Control output for a reference and a measurement taken at timestamp (microseconds since epoch).
+     */
+    virtual double control(double reference, double sensor, uint64_t timestamp) = 0;
+
+    double control(double reference, double sensor) {
+        return control(reference, sensor, currentMicroSecondsSinceEpoch());
+    }
 };
 
 /**
  * K(t) = Kp * error + Ki * integral(error * dt) + Kd * d(error)/dt
+ *
+ * Time comes in with every call, so a log replay gets the same outputs as the live loop. The first call has no
+ * previous error to integrate or differentiate and only applies Kp.
  */
 class PID : public Controller {
 private:
@@ -21,7 +40,7 @@ private:
     const float ki;
     const float kd;
 
-    uint64_t lastTimestamp = currentMicroSecondsSinceEpoch();
+    uint64_t lastTimestamp = 0;
     double lastError = 0.0;
     double accumulatedError = 0.0;
 
@@ -29,12 +48,21 @@ public:
     PID(float kp, float ki, float kd) : kp(kp), ki(ki), kd(kd) {
     }
 
-    double control(double reference, double sensor) override {
-        uint64_t currentTimestamp = currentMicroSecondsSinceEpoch();
+    explicit PID(const PIDGains &gains) : PID(gains.kp, gains.ki, gains.kd) {
+    }
+
+    using Controller::control;
+
+    double control(double reference, double sensor, uint64_t currentTimestamp) override {
+        double error = reference - sensor;
+        if (lastTimestamp == 0) {
+            lastTimestamp = currentTimestamp;
+            lastError = error;
+            return kp * error;
+        }
         float delta_t = (currentTimestamp - lastTimestamp) / 1000000.0f;
 
         double output;
-        double error = reference - sensor;
         accumulatedError += error * delta_t;
 
         output = kp * error;
@@ -11,19 +11,39 @@
 #include <control/pid.hpp>
 
 struct ControlValue {
+    static const uint8_t wireType = WIRE_TYPE_CONTROL;
+
     long long timestamp;
+    long long imuTimestamp = 0;         // timestamp of the IMU sample the outputs were computed from
     Vector3 attitudeControl;
-    double altitudeControl;
+    double altitudeControl = 0.0;
     Vector3 referenceAttitude;
-    double referenceAltitude;
+    double referenceAltitude = 0.0;
+    LatencyTrail latency;               // of the IMU sample, not sent or recorded, see latencyTrace.hpp
+
+    // fields a subscriber can select, in alphabetical order; the timestamp is always sent
+    enum Field : uint32_t {
+        ALTITUDE_CONTROL = 1u << 0,
+        ATTITUDE_CONTROL = 1u << 1,
+        IMU_TIMESTAMP = 1u << 2,
+        REFERENCE_ALTITUDE = 1u << 3,
+        REFERENCE_ATTITUDE = 1u << 4
+    };
 
 public:
     ControlValue() : timestamp(currentMicroSecondsSinceEpoch()) {
     }
 
+    static const vector<string> &fieldNames() {
+        static const vector<string> names{"altitudeControl", "attitudeControl", "imuTimestamp",
+                                          "referenceAltitude", "referenceAttitude"};
+        return names;
+    }
+
     json toJson() {
         json j;
         j["timestamp"] = timestamp;
+        j["imuTimestamp"] = imuTimestamp;
         j["attitudeControl"] = {{"yaw",   attitudeControl.x()},
                                 {"pitch", attitudeControl.y()},
                                 {"roll",  attitudeControl.z()}};
@@ -34,23 +54,101 @@ public:
         j["referenceAltitude"] = referenceAltitude;
         return j;
     }
+
+    /**
+     * Same output as toJson().dump(), keys in alphabetical order.
+     */
+    void writeJson(JsonWriter &writer, uint32_t fields = WIRE_ALL_FIELDS) {
+        writer.beginObject();
+        if (fields & ALTITUDE_CONTROL) {
+            writer.field("altitudeControl", altitudeControl);
+        }
+        if (fields & ATTITUDE_CONTROL) {
+            writer.eulerField("attitudeControl", attitudeControl);
+        }
+        if (fields & IMU_TIMESTAMP) {
+            writer.field("imuTimestamp", imuTimestamp);
+        }
+        if (fields & REFERENCE_ALTITUDE) {
+            writer.field("referenceAltitude", referenceAltitude);
+        }
+        if (fields & REFERENCE_ATTITUDE) {
+            writer.eulerField("referenceAttitude", referenceAttitude);
+        }
+        writer.field("timestamp", timestamp);
+        writer.endObject();
+    }
+
+    void toBinary(BinaryWriter &writer, uint32_t fields = WIRE_ALL_FIELDS) {
+        writer.putI64(timestamp);
+        if (fields & ATTITUDE_CONTROL) {
+            writer.putVector3(attitudeControl);
+        }
+        if (fields & ALTITUDE_CONTROL) {
+            writer.putF64(altitudeControl);
+        }
+        if (fields & REFERENCE_ATTITUDE) {
+            writer.putVector3(referenceAttitude);
+        }
+        if (fields & REFERENCE_ALTITUDE) {
+            writer.putF64(referenceAltitude);
+        }
+        if (fields & IMU_TIMESTAMP) {
+            writer.putI64(imuTimestamp);
+        }
+    }
+
+    void fromBinary(BinaryReader &reader, uint32_t fields = WIRE_ALL_FIELDS) {
+        timestamp = reader.getI64();
+        if (fields & ATTITUDE_CONTROL) {
+            attitudeControl = reader.getVector3();
+        }
+        if (fields & ALTITUDE_CONTROL) {
+            altitudeControl = reader.getF64();
+        }
+        if (fields & REFERENCE_ATTITUDE) {
+            referenceAttitude = reader.getVector3();
+        }
+        if (fields & REFERENCE_ALTITUDE) {
+            referenceAltitude = reader.getF64();
+        }
+        if (fields & IMU_TIMESTAMP) {
+            imuTimestamp = reader.getI64();
+        }
+    }
 };
 
+/**
+ * Gains of the four controllers of QuadControlTask.
+ */
+struct QuadControlGains {
+    PIDGains yaw{1.0f, 1.0f, 1.0f};
+    PIDGains pitch{1.0f, 1.0f, 1.0f};
+    PIDGains roll{1.0f, 1.0f, 1.0f};
+    PIDGains altitude{1.0f, 1.0f, 1.0f};
+};
+
+/**
+ * Attitude and altitude controllers driven by the attitude estimate of an IMU task. Every output records the IMU
+ * sample and the time it was computed at, so a flight log can be replayed through step() (see flightReplay.hpp).
+ */
 class QuadControlTask : public DeviceTask<ControlValue> {
 private:
-    IMUSensorTask &imuSensorTask;
+    DeviceTask<IMUValue> &imuSensorTask;
 
     Vector3 referenceAttitude{};
     double referenceAltitude = 0.0;
 
-    PID yawController{1.0, 1.0, 1.0};
-    PID pitchController{1.0, 1.0, 1.0};
-    PID rollController{1.0, 1.0, 1.0};
-    PID altitudeController{1.0, 1.0, 1.0};
+    PID yawController;
+    PID pitchController;
+    PID rollController;
+    PID altitudeController;
 
 public:
-    QuadControlTask(const int &samplingFrequency, const unsigned int k, IMUSensorTask &imuSensorTask)
-        : DeviceTask(samplingFrequency, k), imuSensorTask(imuSensorTask) {
+    QuadControlTask(const int &samplingFrequency, const unsigned int k, DeviceTask<IMUValue> &imuSensorTask,
+                    const QuadControlGains &gains = QuadControlGains())
+        : DeviceTask(samplingFrequency, k), imuSensorTask(imuSensorTask), yawController(gains.yaw),
+          pitchController(gains.pitch), rollController(gains.roll), altitudeController(gains.altitude) {
     }
 
     void setReference(double yaw, double pitch, double roll, double altitude) {
@@ -59,29 +157,51 @@ public:
         referenceAttitude.setY(pitch);
         referenceAttitude.setZ(roll);
         referenceAltitude = altitude;
+        if (result->currentIndex < 0) {
+            // nothing computed yet, the first fetch() picks the reference up
+            return;
+        }
 
         auto *controlData = result->getCurrentValue();
         controlData->referenceAttitude = referenceAttitude;
         controlData->referenceAltitude = altitude;
+        publish();
+    }
+
+    /**
+     * Compute and publish one output from the given IMU sample as if fetch() ran at timestamp (microseconds since
+     * epoch). This is how a replay drives the controllers without the sampling loop.
+     */
+    void step(const IMUValue &imuData, long long timestamp) {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        DeviceTask::fetch();
+        control(imuData, timestamp);
+        publish();
     }
 
 protected:
     void fetch() override {
         DeviceTask::fetch();
-        control();
+        control(imuSensorTask.getData(), currentMicroSecondsSinceEpoch());
     }
 
-    void control() {
+    void control(const IMUValue &imuData, long long timestamp) {
         auto *controlData = result->getCurrentValue();
+        controlData->timestamp = timestamp;
+        controlData->imuTimestamp = imuData.timestamp;
+        controlData->referenceAttitude = referenceAttitude;
+        controlData->referenceAltitude = referenceAltitude;
 
-        IMUValue imuData = imuSensorTask.getData();
         Vector3 eulerAngles;
         imuData.thetaCompFilter.toEuler(eulerAngles);
 
-        controlData->attitudeControl.setX(yawController.control(referenceAttitude.x(), eulerAngles.x()));
-        controlData->attitudeControl.setY(pitchController.control(referenceAttitude.y(), eulerAngles.y()));
-        controlData->attitudeControl.setZ(rollController.control(referenceAttitude.z(), eulerAngles.z()));
-        controlData->altitudeControl = altitudeController.control(referenceAltitude, 0.0);
+        auto now = static_cast<uint64_t>(timestamp);
+        controlData->attitudeControl.setX(yawController.control(referenceAttitude.x(), eulerAngles.x(), now));
+        controlData->attitudeControl.setY(pitchController.control(referenceAttitude.y(), eulerAngles.y(), now));
+        controlData->attitudeControl.setZ(rollController.control(referenceAttitude.z(), eulerAngles.z(), now));
+        controlData->altitudeControl = altitudeController.control(referenceAltitude, 0.0, now);
+        controlData->latency = imuData.latency;
+        controlData->latency.controlled = monotonicNanoSeconds();
     }
 
 };
@@ -8,8 +8,8 @@
 #include <iostream>
 #include <sstream>
 #include <string>
-#include <boost/array.hpp>
 #include <boost/asio.hpp>
+#include <core/streamFramer.hpp>
 
 using namespace std;
 using boost::asio::ip::tcp;
@@ -17,30 +17,60 @@ using boost::asio::ip::tcp;
 class AbstractSensor {
 protected:
     const char delimiter = '\n';
+    StreamFramer framer;        // receive buffer of the stream this sensor reads from
 
 public:
+    /**
+     * Read the next delimited message. Returns an empty string at the end of the stream.
+     */
     string read(tcp::socket& socket) {
-        stringstream ss;
-        for (;;) {
-            boost::array<char, 1024> buf{};
-            boost::system::error_code ec;
+        FrameView frame;
+        readView(socket, frame);
+        return frame.toString();
+    }
 
-            size_t len = socket.read_some(boost::asio::buffer(buf), ec);
+    /**
+     * Read the next delimited message without copying it: the view points into the receive buffer and stays valid
+     * until the next read. Returns false (and an empty view) at the end of the stream.
+     */
+    bool readView(tcp::socket& socket, FrameView &frame) {
+        while (!framer.nextDelimited(delimiter, frame)) {
+            boost::system::error_code ec;
+            framer.fill(socket, ec);
 
             if (ec == boost::asio::error::eof) {
                 cout << "EOF reached..." << endl;
-                break;
+                frame = framer.takeRemaining();
+                return !frame.empty();
             } else if (ec) {
                 throw boost::system::system_error(ec);
             }
-            if (buf.data()[len - 1] == delimiter) {
-                ss.write(buf.data(), len - 1);
-                break;
-            }
+        }
+        return true;
+    }
 
-            ss.write(buf.data(), len);
+    /**
+     * Read the next binary frame (see wireFormat.hpp). The payload view points into the receive buffer and stays
+     * valid until the next read. Returns false at the end of the stream or on a bad header.
+     */
+    bool readFrame(tcp::socket& socket, WireHeader &header, FrameView &payload) {
+        for (;;) {
+            int result = framer.nextLengthPrefixed(header, payload);
+            if (result > 0) {
+                return true;
+            } else if (result < 0) {
+                cerr << "Invalid frame header" << endl;
+                return false;
+            }
+            boost::system::error_code ec;
+            framer.fill(socket, ec);
+            if (ec) {
+                if (ec != boost::asio::error::eof) {
+                    cerr << ec.message() << endl;
+                }
+                return false;
+            }
         }
-        return ss.str();
     }
 
     void write(tcp::socket& socket, const string& s) {
@@ -8,8 +8,14 @@
 #ifndef BASECLIENT_HPP_
 #define BASECLIENT_HPP_
 
+#include <poll.h>
 #include <core/abstractSensor.hpp>
+#include <core/subscription.hpp>
+#include <core/udpTelemetry.hpp>
+#include <core/wireFormat.hpp>
 #include <iostream>
+#include <memory>
+#include <vector>
 
 using namespace std;
 using boost::asio::ip::tcp;
@@ -17,30 +23,52 @@ using boost::asio::ip::tcp;
 /**
  * Protocol is as follows:
  * - client connects to server on a specific port
- * - client writes an integer frequency followed by a delimiter (for example, "10\n")
- * - client starts reading the data in a loop until EOF
+ * - client writes an integer frequency, the requested encoding and optionally a selection of fields, history and
+ *   decimation followed by a delimiter (for example, "10\n", "10 binary\n" or "100 latest fields=thetaCompFilter\n",
+ *   see subscription.hpp)
+ * - client starts reading the data in a loop until EOF, with read() for json and readFrame() for binary frames
+ *
+ * Alternatively the client listens for datagrams from a UdpPublisher with listen() and receiveValues(), which keeps
+ * track of lost and reordered datagrams.
  */
 class BaseClient : public AbstractSensor {
 protected:
     const string hostname;
     const int port;
+    boost::asio::io_context& io;
     tcp::socket socket;
+    WireFormat format = WireFormat::JSON;
+
+    unique_ptr<udp::socket> datagramSocket;
+    vector<char> datagram;
+    SequenceTracker sequenceTracker;
+    UdpStats udpStats;
 
 public:
     BaseClient(boost::asio::io_context& io, string hostname, const int &port)
-        : hostname(std::move(hostname)), port(port), socket(io) {
+        : hostname(std::move(hostname)), port(port), io(io), socket(io) {
     }
 
     virtual ~BaseClient() = default;
 
-    virtual tcp::socket* connect(int frequency = 0) {
+    virtual tcp::socket* connect(int frequency = 0, WireFormat format = WireFormat::JSON) {
+        return connect(Subscription(frequency, format));
+    }
+
+    /**
+     * Connect with a subscription; fieldNames are the selectable fields of the value type, e.g.
+     * IMUValue::fieldNames(), needed only if the subscription selects fields.
+     */
+    virtual tcp::socket* connect(const Subscription &subscription,
+                                 const vector<string> &fieldNames = vector<string>()) {
         try {
-            tcp::resolver resolver(socket.get_io_context());
+            tcp::resolver resolver(io);
             tcp::resolver::results_type endpoints = resolver.resolve(hostname, to_string(port));
 
             boost::asio::connect(socket, endpoints);
 
-            write(socket, to_string(frequency));
+            this->format = subscription.format;
+            write(socket, subscription.toRequest(fieldNames));
             writeDelimiter(socket);
 
             return &socket;
@@ -49,6 +77,91 @@ public:
             return nullptr;
         }
     }
+
+    WireFormat getFormat() {
+        return format;
+    }
+
+    /**
+     * Receive datagrams on a port, joining a multicast group if one is given.
+     */
+    virtual bool listen(const unsigned short &udpPort, const string &group = "") {
+        try {
+            udp::endpoint endpoint(udp::v4(), udpPort);
+            boost::asio::ip::address groupAddress;
+            if (!group.empty()) {
+                groupAddress = boost::asio::ip::make_address(group);
+                endpoint = udp::endpoint(groupAddress.is_v6() ? udp::v6() : udp::v4(), udpPort);
+            }
+            datagramSocket.reset(new udp::socket(io, endpoint.protocol()));
+            datagramSocket->set_option(boost::asio::socket_base::reuse_address(true));
+            datagramSocket->bind(endpoint);
+            if (!group.empty()) {
+                datagramSocket->set_option(boost::asio::ip::multicast::join_group(groupAddress));
+            }
+            datagram.resize(65536);
+            return true;
+        } catch (exception& e) {
+            cerr << e.what() << endl;
+            datagramSocket.reset();
+            return false;
+        }
+    }
+
+    /**
+     * Wait for the next datagram (timeout in milliseconds, -1 for none) and decode its values.
+     * Returns false on timeout or error; datagrams of another type are counted as invalid and skipped.
+     */
+    template<class T>
+    bool receiveValues(vector<T> &values, int timeoutMs = -1) {
+        if (!datagramSocket) {
+            return false;
+        }
+        for (;;) {
+            pollfd pfd{};
+            pfd.fd = datagramSocket->native_handle();
+            pfd.events = POLLIN;
+            if (poll(&pfd, 1, timeoutMs) <= 0) {
+                return false;
+            }
+            boost::system::error_code ec;
+            udp::endpoint sender;
+            size_t length = datagramSocket->receive_from(boost::asio::buffer(datagram), sender, 0, ec);
+            if (ec) {
+                cerr << ec.message() << endl;
+                return false;
+            }
+            DatagramHeader header;
+            if (!decodeDatagram(datagram.data(), length, header, values)) {
+                udpStats.invalid++;
+                continue;
+            }
+            sequenceTracker.receive(header.sequence, udpStats);
+            udpStats.samples += values.size();
+            return true;
+        }
+    }
+
+    UdpStats getUdpStats() {
+        return udpStats;
+    }
+
+    /**
+     * Read and decode one binary frame of T values; values[currentIndex] is the most recent one.
+     */
+    template<class T>
+    bool readValues(tcp::socket& socket, int &currentIndex, vector<T> &values) {
+        WireHeader header;
+        FrameView payload;
+        if (!readFrame(socket, header, payload)) {
+            return false;
+        }
+        if ((header.type & ~WIRE_TYPE_FIELDS_FLAG) != T::wireType) {
+            cerr << "Unexpected frame type " << (int) header.type << endl;
+            return false;
+        }
+        return decodeDeviceData(header.type, payload.data, payload.length, currentIndex, values);
+    }
 };
 
 #endif /* BASECLIENT_HPP_ */
@@ -8,15 +8,291 @@
 #ifndef BASESERVER_HPP_
 #define BASESERVER_HPP_
 
+#include <deque>
 #include <iostream>
 #include <exception>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include <boost/asio/steady_timer.hpp>
 #include <core/abstractSensor.hpp>
 #include <core/deviceTask.hpp>
+#include <core/metrics.hpp>
+#include <core/subscription.hpp>
+#include <core/wireFormat.hpp>
 
 using namespace std;
 using boost::asio::ip::tcp;
 
-template <class T>
+template<class T>
+class BaseServer;
+
+#define SESSION_QUEUE_LIMIT         8               // frames a drop-oldest session keeps waiting
+#define SESSION_WRITE_TIMEOUT_MS    5000            // a write stuck this long means the client is gone
+#define SERVER_ACCEPT_RETRY_MS      100             // wait before accepting again when out of file descriptors
+
+/**
+ * Per subscriber counters. framesDropped counts frames that were due but never written because the client was
+ * behind (frames replaced by a newer one, dropped from the queue, or left when a slow client was disconnected).
+ */
+struct SessionStats {
+    string peer;
+    Backpressure backpressure = Backpressure::COALESCE;
+    long long framesSent = 0;
+    long long framesDropped = 0;
+    long long bytesSent = 0;
+    size_t queued = 0;              // frames waiting behind the write in flight
+    bool open = true;
+    string closeReason;
+
+    string toString() const {
+        stringstream ss;
+        ss << peer << " " << backpressureName(backpressure) << ": sent=" << framesSent << " dropped=" << framesDropped
+           << " bytes=" << bytesSent << " queued=" << queued;
+        if (!open) {
+            ss << " closed (" << closeReason << ")";
+        }
+        return ss.str();
+    }
+};
+
+/**
+ * One subscriber. Reads the subscription, then streams frames on a steady timer with absolute deadlines.
+ * Everything runs as handlers on the server's io_context, so a session costs no thread.
+ *
+ * A client going away is noticed right away: after the request the session keeps a read pending, which completes
+ * with EOF or an error when the connection is closed, and every write error closes the session. A client that stops
+ * reading without closing makes the write in flight stall; frames due in the meantime are handled by the client's
+ * backpressure policy, and a write that does not complete within SESSION_WRITE_TIMEOUT_MS closes the session.
+ */
+template<class T>
+class ServerSession : public enable_shared_from_this<ServerSession<T>> {
+private:
+    BaseServer<T> &server;
+    tcp::socket socket;
+    boost::asio::steady_timer timer;
+    boost::asio::streambuf request;
+    char discard[64];                   // anything the client sends after the request
+
+    Subscription subscription;
+    unsigned int lastSentVersion = 0;   // task version of the last frame sent, for decimation
+    boost::asio::steady_timer::duration period{};
+    boost::asio::steady_timer::time_point deadline;
+    boost::asio::steady_timer::time_point writeStarted;
+    shared_ptr<const string> frame;     // frame being written, shared with other sessions
+    deque<shared_ptr<const string>> queue;  // frames due while the write is in flight
+    bool streaming = false;
+    bool isOpen = true;
+    SessionStats stats;
+
+public:
+    ServerSession(BaseServer<T> &server, tcp::socket socket)
+        : server(server), socket(std::move(socket)), timer(server.getIOContext()) {
+        boost::system::error_code ec;
+        auto endpoint = this->socket.remote_endpoint(ec);
+        stats.peer = ec ? "unknown" : endpoint.address().to_string() + ":" + to_string(endpoint.port());
+    }
+
+    void start() {
+        auto self = this->shared_from_this();
+        boost::asio::async_read_until(socket, request, server.getDelimiter(),
+                                      [self](const boost::system::error_code &ec, size_t length) {
+                                          self->onRequest(ec, length);
+                                      });
+    }
+
+    void close(const string &reason = "shutdown") {
+        if (!isOpen) {
+            return;
+        }
+        isOpen = false;
+        stats.framesDropped += queue.size();
+        queue.clear();
+        stats.queued = 0;
+        stats.open = false;
+        stats.closeReason = reason;
+        boost::system::error_code ec;
+        timer.cancel(ec);
+        socket.shutdown(tcp::socket::shutdown_both, ec);
+        socket.close(ec);
+        server.onSessionClosed(stats);
+    }
+
+    int getFrequency() {
+        return subscription.frequency;
+    }
+
+    WireFormat getFormat() {
+        return subscription.format;
+    }
+
+    const Subscription &getSubscription() {
+        return subscription;
+    }
+
+    SessionStats getStats() {
+        return stats;
+    }
+
+private:
+    void onRequest(const boost::system::error_code &ec, size_t) {
+        if (ec) {
+            close(ec.message());
+            return;
+        }
+        string s;
+        istream is(&request);
+        getline(is, s, server.getDelimiter());
+        subscription.parse(s, T::fieldNames());
+        stats.backpressure = subscription.backpressure;
+
+        int frequency = subscription.frequency;
+        if (frequency <= 0) {
+            // one frame without a delimiter, then close
+            send();
+            return;
+        }
+        streaming = true;
+        watch();
+        period = chrono::duration_cast<boost::asio::steady_timer::duration>(
+            chrono::nanoseconds(1000000000LL / frequency));
+        // the first tick always sends
+        lastSentVersion = server.getTaskVersion() - static_cast<unsigned int>(subscription.decimation);
+        deadline = boost::asio::steady_timer::clock_type::now();
+        onTick(boost::system::error_code());
+    }
+
+    /**
+     * Keep a read pending so that the client closing the connection is seen without waiting for a write to fail.
+     */
+    void watch() {
+        auto self = this->shared_from_this();
+        socket.async_read_some(boost::asio::buffer(discard), [self](const boost::system::error_code &ec, size_t) {
+            if (ec) {
+                self->close(ec == boost::asio::error::eof ? "client closed" : ec.message());
+                return;
+            }
+            if (self->isOpen) {
+                self->watch();
+            }
+        });
+    }
+
+    void onTick(const boost::system::error_code &ec) {
+        if (ec || !isOpen) {
+            return;
+        }
+        auto now = boost::asio::steady_timer::clock_type::now();
+        if (frame && now - writeStarted > server.getWriteTimeout()) {
+            close("write timed out");
+            return;
+        }
+        send();
+        if (!isOpen) {
+            return;
+        }
+
+        // next absolute deadline; skip periods that are already gone to stay in phase
+        deadline += period;
+        if (deadline < now) {
+            deadline += ((now - deadline) / period + 1) * period;
+        }
+        auto self = this->shared_from_this();
+        timer.expires_at(deadline);
+        timer.async_wait([self](const boost::system::error_code &ec) {
+            self->onTick(ec);
+        });
+    }
+
+    void send() {
+        if (streaming && subscription.decimation > 1) {
+            unsigned int version = server.getTaskVersion();
+            if (version - lastSentVersion < static_cast<unsigned int>(subscription.decimation)) {
+                return;
+            }
+            lastSentVersion = version;
+        }
+        shared_ptr<const string> next = server.getFrame(subscription, streaming);
+        if (!frame) {
+            write(next);
+            return;
+        }
+        // the client is behind: the previous frame is still in flight
+        if (next == frame || (!queue.empty() && next == queue.back())) {
+            // no new sample since, nothing is lost by skipping it
+            return;
+        }
+        switch (subscription.backpressure) {
+            case Backpressure::COALESCE:
+                stats.framesDropped += queue.size();
+                queue.clear();
+                queue.push_back(next);
+                break;
+            case Backpressure::DROP_OLDEST:
+                if (queue.size() >= SESSION_QUEUE_LIMIT) {
+                    queue.pop_front();
+                    stats.framesDropped++;
+                }
+                queue.push_back(next);
+                break;
+            case Backpressure::DISCONNECT:
+                if (!queue.empty()) {
+                    stats.framesDropped++;
+                    close("too slow");
+                    return;
+                }
+                queue.push_back(next);
+                break;
+        }
+        stats.queued = queue.size();
+    }
+
+    void write(shared_ptr<const string> next) {
+        frame = std::move(next);
+        writeStarted = boost::asio::steady_timer::clock_type::now();
+        auto self = this->shared_from_this();
+        boost::asio::async_write(socket, boost::asio::buffer(*frame),
+                                 [self](const boost::system::error_code &ec, size_t length) {
+                                     self->onWritten(ec, length);
+                                 });
+    }
+
+    void onWritten(const boost::system::error_code &ec, size_t length) {
+        frame.reset();
+        if (ec) {
+            close(ec.message());
+            return;
+        }
+        stats.framesSent++;
+        stats.bytesSent += length;
+        if (!streaming) {
+            close("done");
+            return;
+        }
+        if (isOpen && !queue.empty()) {
+            shared_ptr<const string> next = queue.front();
+            queue.pop_front();
+            stats.queued = queue.size();
+            write(next);
+        }
+    }
+};
+
+/**
+ * Protocol is as follows:
+ * - server accepts any number of clients on a port
+ * - each client writes an integer frequency, optionally followed by an encoding ("json" or "binary") and a selection
+ *   of fields, history and decimation (see subscription.hpp), and a delimiter (for example, "10\n", "10 binary\n" or
+ *   "100 latest fields=thetaCompFilter\n")
+ * - frequency > 0: the server streams frames at that frequency until the client goes away
+ * - frequency <= 0: the server writes a single frame and closes the connection
+ * - json frames are terminated by the delimiter, binary frames carry their length in a header (see wireFormat.hpp)
+ * - a client that falls behind gets frames coalesced, dropped or is disconnected, as it asked for in the request
+ *
+ * Accepting, streaming and timing of all clients is asynchronous on a single io_context. Counters of every session,
+ * including frames dropped for slow clients, are available from getSessionStats().
+ */
+template<class T>
 class BaseServer : public AbstractSensor {
 protected:
     const string hostname;
@@ -24,7 +300,25 @@ protected:
 
     DeviceTask<T> &sensorTask;
     bool isShutdown = false;
-    int frequency = 0;  // in Hz
+
+    boost::asio::io_context *io = nullptr;
+    unique_ptr<tcp::acceptor> acceptor;
+    unique_ptr<boost::asio::steady_timer> acceptRetry;
+    vector<weak_ptr<ServerSession<T>>> sessions;
+    SessionStats closedTotals;      // summed counters of sessions that are gone
+    long long closedSessions = 0;
+    chrono::milliseconds writeTimeout{SESSION_WRITE_TIMEOUT_MS};
+
+    // most recent frame per encoding and selection, serialized once per new sample and shared by all sessions
+    // asking for the same thing; there are only ever a few distinct selections, so a vector is enough
+    struct CachedFrame {
+        WireFormat format;
+        uint32_t fields;
+        bool latestOnly;
+        unsigned int version;
+        shared_ptr<string> frame;   // reused for the next version once no session holds it
+    };
+    vector<CachedFrame> streamFrames;
 
 public:
     BaseServer(string hostname, const unsigned short &port, DeviceTask<T> &deviceTask)
@@ -33,56 +327,257 @@ public:
 
     virtual ~BaseServer() = default;
 
+    /**
+     * Start accepting clients on the io_context without blocking. Several servers may share one io_context.
+     */
+    virtual void start(boost::asio::io_context &io) {
+        this->io = &io;
+        acceptor.reset(new tcp::acceptor(io, tcp::endpoint(tcp::v4(), port)));
+        acceptRetry.reset(new boost::asio::steady_timer(io));
+        cout << "Server ready..." << endl;
+        accept();
+    }
+
+    /**
+     * Start the server and run the io_context on the calling thread until shutdown.
+     */
     virtual void launch(boost::asio::io_context &io) {
         try {
-            tcp::acceptor acceptor(io, tcp::endpoint(tcp::v4(), port));
-
-            cout << "Server ready..." << endl;
-            while (!isShutdown) {
-                tcp::socket socket(io);
-                acceptor.accept(socket);
-
-                runConnection(&socket);
-            }
+            start(io);
+            io.run();
         } catch (exception &e) {
             cerr << "Exception: " << e.what() << endl;
         }
     }
 
-    virtual void runConnection(tcp::socket *socket) {
-        string s = read(*socket);
-        try {
-            frequency = stoi(s);
-        } catch (exception &e) {
-            cerr << "Invalid frequency " << s << ". using 0 instead..." << endl;
-            frequency = 0;
+    virtual void shutdown() {
+        cout << "Shutting down the server..." << endl;
+        isShutdown = true;
+        if (io) {
+            boost::asio::post(*io, [this]() {
+                boost::system::error_code ec;
+                if (acceptor) {
+                    acceptor->close(ec);
+                }
+                if (acceptRetry) {
+                    acceptRetry->cancel(ec);
+                }
+                for (auto &session : sessions) {
+                    if (auto s = session.lock()) {
+                        s->close();
+                    }
+                }
+                sessions.clear();
+            });
         }
-        if (frequency <= 0) {
-            runTask(*socket);
-        } else {
-            // TODO: break the while loop if the socket is closed on the client side
-            while (frequency > 0) {
-                int microSeconds = 1000000 / frequency;
-                runTask(*socket);
-                writeDelimiter(*socket);
-                boost::this_thread::sleep_for(boost::chrono::microseconds(microSeconds));
+    }
+
+    /**
+     * Number of connected clients. Call from the io_context thread.
+     */
+    size_t getClientCount() {
+        prune();
+        return sessions.size();
+    }
+
+    /**
+     * How long a write may stall before the client is considered gone.
+     */
+    void setWriteTimeout(int milliseconds) {
+        writeTimeout = chrono::milliseconds(milliseconds);
+    }
+
+    chrono::milliseconds getWriteTimeout() {
+        return writeTimeout;
+    }
+
+    /**
+     * Counters of the connected clients. Call from the io_context thread.
+     */
+    vector<SessionStats> getSessionStats() {
+        prune();
+        vector<SessionStats> stats;
+        for (auto &session : sessions) {
+            if (auto s = session.lock()) {
+                stats.push_back(s->getStats());
             }
         }
+        return stats;
     }
 
-    virtual void runTask(tcp::socket &socket) {
-        string result = sensorTask.get();
-        boost::system::error_code ec;
-        boost::asio::write(socket, boost::asio::buffer(result), ec);
+    /**
+     * Frames sent and dropped by sessions that are closed, summed, and how many of them there were.
+     */
+    SessionStats getClosedStats() {
+        return closedTotals;
     }
 
-    void setFrequency(int frequency) {
-        this->frequency = frequency;
+    long long getClosedSessions() {
+        return closedSessions;
     }
 
-    virtual void shutdown() {
-        cout << "Shutting down the server..." << endl;
-        isShutdown = true;
+    /**
+     * Export client count, frames sent and dropped and closed sessions, labelled server=name. The values are
+     * computed from the session counters at scrape time, so the scrape must run on this server's io_context
+     * (e.g. a StatsServer started on it).
+     */
+    void setMetrics(MetricsRegistry &registry, const string &name) {
+        string labels = MetricsRegistry::label("server", name);
+        registry.gaugeFunction("server_clients", "Connected clients.", labels, [this]() {
+            return static_cast<double>(getClientCount());
+        });
+        registry.counterFunction("server_frames_sent_total", "Frames written to clients.", labels, [this]() {
+            return static_cast<double>(getTotals().framesSent);
+        });
+        registry.counterFunction("server_frames_dropped_total", "Frames skipped for slow clients.", labels, [this]() {
+            return static_cast<double>(getTotals().framesDropped);
+        });
+        registry.counterFunction("server_bytes_sent_total", "Bytes written to clients.", labels, [this]() {
+            return static_cast<double>(getTotals().bytesSent);
+        });
+        registry.gaugeFunction("server_queued_frames", "Frames waiting behind a write, all clients.", labels,
+                               [this]() {
+                                   return static_cast<double>(getTotals().queued);
+                               });
+        registry.counterFunction("server_sessions_closed_total", "Client sessions that ended.", labels, [this]() {
+            return static_cast<double>(closedSessions);
+        });
+    }
+
+    /**
+     * Counters of the open and closed sessions, summed. Call from the io_context thread.
+     */
+    SessionStats getTotals() {
+        SessionStats totals = closedTotals;
+        totals.queued = 0;
+        for (auto &stats : getSessionStats()) {
+            totals.framesSent += stats.framesSent;
+            totals.framesDropped += stats.framesDropped;
+            totals.bytesSent += stats.bytesSent;
+            totals.queued += stats.queued;
+        }
+        return totals;
+    }
+
+    void onSessionClosed(const SessionStats &stats) {
+        closedSessions++;
+        closedTotals.framesSent += stats.framesSent;
+        closedTotals.framesDropped += stats.framesDropped;
+        closedTotals.bytesSent += stats.bytesSent;
+        if (stats.framesDropped > 0 || (stats.closeReason != "done" && stats.closeReason != "client closed" &&
+                                        stats.closeReason != "shutdown")) {
+            cerr << "Client " << stats.toString() << endl;
+        }
+    }
+
+    boost::asio::io_context &getIOContext() {
+        return *io;
+    }
+
+    char getDelimiter() {
+        return delimiter;
+    }
+
+    unsigned int getTaskVersion() {
+        return sensorTask.getVersion();
+    }
+
+    /**
+     * Latest data as a frame, serialized only if the task produced a new value since the last call.
+     */
+    virtual shared_ptr<const string> getFrame(const Subscription &subscription, bool streaming) {
+        uint32_t fields = subscription.fields;
+        bool latestOnly = subscription.latestOnly;
+        if (subscription.format == WireFormat::BINARY) {
+            return cachedFrame(subscription, [this, fields, latestOnly](string &frame) {
+                sensorTask.getBinary(frame, fields, latestOnly);
+            });
+        }
+        if (!streaming) {
+            auto frame = make_shared<string>();
+            sensorTask.getJson(*frame, fields, latestOnly);
+            return frame;
+        }
+        return cachedFrame(subscription, [this, fields, latestOnly](string &frame) {
+            sensorTask.getJson(frame, fields, latestOnly);
+            frame.push_back(delimiter);
+        });
+    }
+
+protected:
+    /**
+     * The frame of this selection for the current version, serialized into the buffer of its cache entry. The buffer
+     * is reused when no session still holds the previous frame, so a steady stream does not allocate.
+     */
+    template<class Serializer>
+    shared_ptr<const string> cachedFrame(const Subscription &subscription, Serializer serialize) {
+        unsigned int version = sensorTask.getVersion();
+        for (auto &cached : streamFrames) {
+            if (cached.format == subscription.format && cached.fields == subscription.fields &&
+                cached.latestOnly == subscription.latestOnly) {
+                if (version != cached.version) {
+                    if (cached.frame.use_count() > 1) {
+                        // a write still holds the previous frame
+                        size_t size = cached.frame->size();
+                        cached.frame = make_shared<string>();
+                        cached.frame->reserve(size);
+                    }
+                    cached.frame->clear();
+                    serialize(*cached.frame);
+                    cached.version = version;
+                }
+                return cached.frame;
+            }
+        }
+        CachedFrame cached{subscription.format, subscription.fields, subscription.latestOnly, version,
+                           make_shared<string>()};
+        serialize(*cached.frame);
+        streamFrames.push_back(cached);
+        return cached.frame;
+    }
+
+    /**
+     * Accept the next client. A failed accept (the client reset the connection, no file descriptors left, ...) only
+     * loses that client: the server keeps accepting until it is shut down, after a short wait if the process or the
+     * system is out of file descriptors.
+     */
+    void accept() {
+        acceptor->async_accept([this](const boost::system::error_code &ec, tcp::socket socket) {
+            if (ec) {
+                if (isShutdown || ec == boost::asio::error::operation_aborted) {
+                    return;
+                }
+                cerr << "Accept failed: " << ec.message() << endl;
+                if (ec == boost::system::errc::too_many_files_open ||
+                    ec == boost::system::errc::too_many_files_open_in_system) {
+                    acceptRetry->expires_after(chrono::milliseconds(SERVER_ACCEPT_RETRY_MS));
+                    acceptRetry->async_wait([this](const boost::system::error_code &waitError) {
+                        if (!waitError && !isShutdown) {
+                            accept();
+                        }
+                    });
+                } else {
+                    accept();
+                }
+                return;
+            }
+            auto session = make_shared<ServerSession<T>>(*this, std::move(socket));
+            prune();
+            sessions.push_back(session);
+            session->start();
+            accept();
+        });
+    }
+
+    void prune() {
+        for (size_t i = 0; i < sessions.size();) {
+            if (sessions[i].expired()) {
+                sessions[i] = sessions.back();
+                sessions.pop_back();
+            } else {
+                ++i;
+            }
+        }
     }
 };
 
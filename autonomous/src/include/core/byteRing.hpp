@@ -0,0 +1,70 @@
+#ifndef CORE_BYTERING_HPP
+#define CORE_BYTERING_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+using namespace std;
+
+/**
+ * Fixed ring of received bytes between a reader (a UART) and a streaming parser, on one thread. The reader either
+ * reads straight into writePointer() and commits, or copies with write(); the parser takes bytes with next().
+ */
+template<size_t N>
+class ByteRing {
+private:
+    char ring[N];
+    size_t head = 0;                    // bytes written so far; the ring index is head % N
+    size_t tail = 0;                    // bytes taken so far
+
+public:
+    /**
+     * Contiguous free space in the ring, for a read straight into it; call commit() with the bytes read.
+     */
+    char *writePointer(size_t &space) {
+        size_t index = head % N;
+        space = min(N - (head - tail), N - index);
+        return ring + index;
+    }
+
+    void commit(size_t count) {
+        head += count;
+    }
+
+    /**
+     * Copy bytes into the ring, as many as fit. Returns the number copied.
+     */
+    size_t write(const char *data, size_t count) {
+        size_t written = 0;
+        while (written < count) {
+            size_t space;
+            char *buffer = writePointer(space);
+            if (space == 0) {
+                break;
+            }
+            size_t chunk = min(space, count - written);
+            memcpy(buffer, data + written, chunk);
+            commit(chunk);
+            written += chunk;
+        }
+        return written;
+    }
+
+    bool empty() const {
+        return head == tail;
+    }
+
+    size_t size() const {
+        return head - tail;
+    }
+
+    /**
+     * Take the oldest byte. The ring must not be empty.
+     */
+    char next() {
+        return ring[tail++ % N];
+    }
+};
+
+#endif // CORE_BYTERING_HPP
@@ -8,6 +8,8 @@
 #include <stream/ewma.hpp>
 #include <utils/misc.hpp>
 #include <utils/json.hpp>
+#include <utils/jsonWriter.hpp>
+#include <core/wireFormat.hpp>
 
 using nlohmann::json;
 using namespace std;
@@ -28,6 +30,17 @@ public:
         ewma.apply(value);
     }
 
+    // fields a subscriber can select, in alphabetical order; the timestamp is always sent
+    enum Field : uint32_t {
+        EWMA_VALUE = 1u << 0,
+        RAW_VALUE = 1u << 1
+    };
+
+    static const vector<string> &fieldNames() {
+        static const vector<string> names{"ewmaValue", "rawValue"};
+        return names;
+    }
+
     double getRawValue() {
         return rawValue;
     }
@@ -43,6 +56,21 @@ public:
         j["ewmaValue"] = ewma.get();
         return j;
     }
+
+    /**
+     * Same output as toJson().dump(), keys in alphabetical order.
+     */
+    void writeJson(JsonWriter &writer, uint32_t fields = WIRE_ALL_FIELDS) {
+        writer.beginObject();
+        if (fields & EWMA_VALUE) {
+            writer.field("ewmaValue", ewma.get());
+        }
+        if (fields & RAW_VALUE) {
+            writer.field("rawValue", rawValue);
+        }
+        writer.field("timestamp", timestamp);
+        writer.endObject();
+    }
 };
 
 template<class T>
@@ -51,6 +79,7 @@ public:
     const unsigned int k;           // number of values to store in a circular buffer
     int currentIndex = -1;          // index of most recent value: circular buffer in the reverse direction
     vector<T *> values;             // list of k sensor values
+    string jsonBuffer;              // reused by toString() so that serializing does not allocate once warmed up
 
     explicit DeviceData(unsigned int k) : k(k), values() {
         for (int i = 0; i < k; ++i) {
@@ -68,13 +97,98 @@ public:
         return values[currentIndex];
     }
 
-    virtual string toString() {
-        json j;
-        j["currentIndex"] = currentIndex;
-        for (int i = 0; i < values.size(); ++i) {
-            j["values"].emplace_back(values[i]->toJson());
+    /**
+     * Copy the values and the current index of other, which must hold as many values.
+     */
+    void copyFrom(const DeviceData<T> &other) {
+        currentIndex = other.currentIndex;
+        for (size_t i = 0; i < values.size(); ++i) {
+            *values[i] = *other.values[i];
+        }
+    }
+
+    /**
+     * This data as json. The string is reused by the next call; copy it to keep it.
+     */
+    virtual const string &toString() {
+        jsonBuffer.clear();
+        toJson(jsonBuffer);
+        return jsonBuffer;
+    }
+
+    /**
+     * Append this data as json to buffer, without building a json document. Only the selected fields of each value
+     * are written; with latestOnly the history is left out and the most recent value is sent as the only value.
+     */
+    virtual void toJson(string &buffer, uint32_t fields = WIRE_ALL_FIELDS, bool latestOnly = false) {
+        if (latestOnly && currentIndex >= 0) {
+            latestToJson(buffer, *values[currentIndex], fields);
+            return;
+        }
+        JsonWriter writer(buffer);
+        writer.beginObject();
+        writer.field("currentIndex", currentIndex);
+        if (!values.empty()) {
+            writer.key("values");
+            writer.beginArray();
+            for (size_t i = 0; i < values.size(); ++i) {
+                values[i]->writeJson(writer, fields);
+            }
+            writer.endArray();
+        }
+        writer.endObject();
+    }
+
+    /**
+     * Append value as json the way toJson() writes the most recent value with latestOnly.
+     */
+    static void latestToJson(string &buffer, T &value, uint32_t fields = WIRE_ALL_FIELDS) {
+        JsonWriter writer(buffer);
+        writer.beginObject();
+        writer.field("currentIndex", 0);
+        writer.key("values");
+        writer.beginArray();
+        value.writeJson(writer, fields);
+        writer.endArray();
+        writer.endObject();
+    }
+
+    /**
+     * Append this data as a binary frame (see wireFormat.hpp), with the same field and history selection as toJson().
+     */
+    virtual void toBinary(string &buffer, uint32_t fields = WIRE_ALL_FIELDS, bool latestOnly = false) {
+        if (latestOnly && currentIndex >= 0) {
+            latestToBinary(buffer, *values[currentIndex], fields);
+            return;
+        }
+        BinaryWriter writer(buffer);
+        bool allFields = fields == WIRE_ALL_FIELDS;
+        size_t lengthOffset = beginFrame(writer, allFields ? T::wireType : T::wireType | WIRE_TYPE_FIELDS_FLAG);
+        writer.putI32(currentIndex);
+        writer.putU32(static_cast<uint32_t>(values.size()));
+        if (!allFields) {
+            writer.putU32(fields);
+        }
+        for (size_t i = 0; i < values.size(); ++i) {
+            values[i]->toBinary(writer, fields);
+        }
+        endFrame(writer, lengthOffset);
+    }
+
+    /**
+     * Append value as a binary frame the way toBinary() writes the most recent value with latestOnly.
+     */
+    static void latestToBinary(string &buffer, T &value, uint32_t fields = WIRE_ALL_FIELDS) {
+        BinaryWriter writer(buffer);
+        bool allFields = fields == WIRE_ALL_FIELDS;
+        size_t lengthOffset = beginFrame(writer, allFields ? T::wireType : T::wireType | WIRE_TYPE_FIELDS_FLAG);
+        writer.putI32(0);
+        writer.putU32(1);
+        if (!allFields) {
+            writer.putU32(fields);
         }
-        return j.dump();
+        value.toBinary(writer, fields);
+        endFrame(writer, lengthOffset);
     }
 };
 
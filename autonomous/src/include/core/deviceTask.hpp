@@ -11,6 +11,12 @@
 #include <iostream>
 #include <boost/thread.hpp>
 #include <core/deviceData.hpp>
+#include <core/flightRecorder.hpp>
+#include <core/metrics.hpp>
+#include <core/seqLock.hpp>
+#include <core/periodicTimer.hpp>
+#include <core/realtime.hpp>
+#include <core/shmRing.hpp>
 #include <utils/misc.hpp>
 
 using namespace std;
@@ -23,46 +29,179 @@ protected:
     bool isShutdown;
 
     DeviceData<T> *result;
+    SeqLock<T> latest;          // snapshot of the most recent value for wait-free readers
+    boost::mutex historyMtx;    // guards history only and is never held during fetch()
+    DeviceData<T> *history;     // result as of the last publish(), for the servers
+    boost::mutex snapshotMtx;   // guards snapshot, held while a frame is serialized from it
+    DeviceData<T> *snapshot;    // copy of history the frames are serialized from, allocated once
+    PeriodicTimer timer;
+    ShmRingWriter<T> *shmRing = nullptr;  // optional shared memory transport for local readers
+    RecorderChannel<T> *recorder = nullptr;     // optional flight recorder
+    bool recordOnPublish = true;                // false if the task calls record() for every sample itself
+    Counter *publishedCounter = nullptr;        // optional metrics, see setMetrics()
+    LatencyHistogram *fetchHistogram = nullptr;
 
 public:
     explicit DeviceTask(const int &samplingFrequency, const unsigned int k) :
-        samplingFrequency(samplingFrequency), isShutdown(false) {
+        samplingFrequency(samplingFrequency), isShutdown(false), timer(samplingFrequency) {
         result = new DeviceData<T>(k);
+        history = new DeviceData<T>(k);
+        snapshot = new DeviceData<T>(k);
     }
 
     virtual ~DeviceTask() {
         delete result;
+        delete history;
+        delete snapshot;
     }
 
     /**
-     * Run the sensor sampling task at a given sampling frequency.
+     * Run the sensor sampling task at a given sampling frequency. Sampling instants are fixed relative to the start,
+     * so the time spent in fetch() does not stretch the period.
      */
     virtual void run() {
-        int microSeconds = 1000000 / samplingFrequency;
+        timer.start();
         while (!isShutdown) {
             {
                 boost::lock_guard<boost::mutex> lk(mtx);
+                long long start = fetchHistogram ? monotonicNanoSeconds() : 0;
                 fetch();
+                publish();
+                if (fetchHistogram) {
+                    fetchHistogram->record(monotonicNanoSeconds() - start);
+                }
             }
-            boost::this_thread::sleep_for(boost::chrono::microseconds(microSeconds));
+            waitForNextSample();
         }
     }
 
+    /**
+     * Run the task on its own thread with the given scheduling priority, CPU affinity and memory locking.
+     */
+    boost::thread launch(const ThreadConfig &config) {
+        return launchThread(config, boost::bind(&DeviceTask::run, this));
+    }
+
+    /**
+     * Also publish every new value into a shared memory ring for readers in other processes. Call before run().
+     */
+    void setShmRing(ShmRingWriter<T> *ring) {
+        shmRing = ring;
+    }
+
+    /**
+     * Also hand every new value to a flight recorder channel. Call before run().
+     */
+    void setRecorder(RecorderChannel<T> *channel) {
+        recorder = channel;
+    }
+
+    /**
+     * Count published values and time fetch() into registry, and export the rate, jitter and overruns of the
+     * sampling loop, labelled task=name. Call before run().
+     */
+    virtual void setMetrics(MetricsRegistry &registry, const string &name) {
+        string labels = MetricsRegistry::label("task", name);
+        publishedCounter = registry.counter("task_samples_total", "Values published by the task.", labels);
+        fetchHistogram = registry.histogram("task_fetch_seconds", "Time to fetch and publish a value.", labels);
+        registry.gaugeFunction("task_rate_hz", "Achieved rate of the sampling loop.", labels, [this]() {
+            return getStats().achievedRate;
+        });
+        registry.gaugeFunction("task_jitter_seconds", "Standard deviation of the wakeup lateness.", labels, [this]() {
+            return getStats().jitter / 1e6;
+        });
+        registry.gaugeFunction("task_max_latency_seconds", "Largest wakeup lateness.", labels, [this]() {
+            return getStats().maxLatency / 1e6;
+        });
+        registry.counterFunction("task_overruns_total", "Deadlines missed by the sampling loop.", labels, [this]() {
+            return static_cast<double>(getStats().overruns);
+        });
+        registry.counterFunction("task_missed_periods_total", "Periods skipped to stay in phase.", labels, [this]() {
+            return static_cast<double>(getStats().missedPeriods);
+        });
+    }
+
+    /**
+     * Make value the current one, e.g. to start the filters from a known state in a replay or a simulation.
+     */
+    void seed(const T &value) {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        DeviceTask::fetch();
+        *result->getCurrentValue() = value;
+        publish();
+    }
+
     /**
      * Get the latest result from the sensor.
      */
     virtual string get() {
-        boost::lock_guard<boost::mutex> lk(mtx);
-        return result->toString();
+        string buffer;
+        getJson(buffer);
+        return buffer;
+    }
+
+    /**
+     * Append the latest result as json to buffer, optionally only some fields or only the most recent value. Like
+     * getData(), this never waits on fetch(): the value is serialized from a snapshot.
+     */
+    virtual void getJson(string &buffer, uint32_t fields = WIRE_ALL_FIELDS, bool latestOnly = false) {
+        if (latestOnly && latest.version() > 0) {
+            T value = latest.load();
+            DeviceData<T>::latestToJson(buffer, value, fields);
+            return;
+        }
+        boost::lock_guard<boost::mutex> lk(snapshotMtx);
+        copyHistory();
+        snapshot->toJson(buffer, fields, latestOnly);
+    }
+
+    /**
+     * Append the latest result as a binary frame (see wireFormat.hpp) to buffer, with the same selection as
+     * getJson(). Does not allocate once buffer has grown to the size of a frame.
+     */
+    virtual void getBinary(string &buffer, uint32_t fields = WIRE_ALL_FIELDS, bool latestOnly = false) {
+        if (latestOnly && latest.version() > 0) {
+            T value = latest.load();
+            DeviceData<T>::latestToBinary(buffer, value, fields);
+            return;
+        }
+        boost::lock_guard<boost::mutex> lk(snapshotMtx);
+        copyHistory();
+        snapshot->toBinary(buffer, fields, latestOnly);
+    }
+
+    /**
+     * Get the latest result as a binary frame, see getBinary(string &, uint32_t, bool).
+     */
+    string getBinary(uint32_t fields = WIRE_ALL_FIELDS, bool latestOnly = false) {
+        string buffer;
+        getBinary(buffer, fields, latestOnly);
+        return buffer;
     }
 
+    /**
+     * Get a copy of the latest value. This never waits on fetch(), so it is safe to call from the control loop.
+     */
     virtual T getData() {
-        boost::lock_guard<boost::mutex> lk(mtx);
-        return *result->getCurrentValue();
+        return latest.load();
+    }
+
+    /**
+     * Number of values published so far; changes whenever getData() would return a new value.
+     */
+    unsigned int getVersion() {
+        return latest.version();
+    }
+
+    /**
+     * Achieved rate, overruns and jitter of the sampling loop.
+     */
+    PeriodicStats getStats() const {
+        return timer.getStats();
     }
 
     virtual void shutdown() {
-        cout << "Shutting down the sensor task..." << endl;
+        cout << "Shutting down the sensor task... " << timer.getStats().toString() << endl;
         isShutdown = true;
     }
 
@@ -75,6 +214,55 @@ protected:
         result->currentIndex = (result->currentIndex + 1) % result->k;
     }
 
+    /**
+     * Block until it is time for the next fetch(). Called without holding mtx.
+     */
+    virtual void waitForNextSample() {
+        timer.wait();
+    }
+
+    /**
+     * Copy the history as of the last publish() into snapshot. Call with snapshotMtx held; only the copy holds
+     * historyMtx, the serializing is done after.
+     */
+    void copyHistory() {
+        boost::lock_guard<boost::mutex> lk(historyMtx);
+        snapshot->copyFrom(*history);
+    }
+
+    /**
+     * Make the current value visible to getData() and the servers. Call with mtx held whenever the current value
+     * changes; fetch() only ever changes the current value, so that is all the history needs.
+     */
+    void publish() {
+        {
+            // before the version changes, so a frame built for a new version holds the new value
+            boost::lock_guard<boost::mutex> lk(historyMtx);
+            history->currentIndex = result->currentIndex;
+            *history->getCurrentValue() = *result->getCurrentValue();
+        }
+        latest.store(*result->getCurrentValue());
+        if (publishedCounter) {
+            publishedCounter->increment();
+        }
+        if (shmRing) {
+            shmRing->publish(*result->getCurrentValue());
+        }
+        if (recorder && recordOnPublish) {
+            recorder->push(*result->getCurrentValue());
+        }
+    }
+
+    /**
+     * Hand a value to the flight recorder, for tasks that process several samples per fetch() and want all of them
+     * in the log rather than only the published one.
+     */
+    void record(const T &value) {
+        if (recorder) {
+            recorder->push(value);
+        }
+    }
+
 };
 
 #endif /* DEVICE_TASK_HPP_ */
@@ -0,0 +1,509 @@
+#ifndef CORE_FLIGHTRECORDER_HPP
+#define CORE_FLIGHTRECORDER_HPP
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+#include <core/metrics.hpp>
+#include <core/realtime.hpp>
+#include <core/spscQueue.hpp>
+#include <core/wireFormat.hpp>
+#include <utils/misc.hpp>
+
+using namespace std;
+
+#define FLIGHT_LOG_MAGIC            0x52464451u     // "QDFR"
+#define FLIGHT_LOG_VERSION          1
+#define FLIGHT_LOG_HEADER_SIZE      4096            // header page, records start after it
+#define FLIGHT_LOG_RECORD_HEADER    16              // sequence (8), type (1), reserved (1), length (2), crc32 (4)
+#define FLIGHT_LOG_OPEN             1               // state while recording; still set after a crash
+#define FLIGHT_LOG_CLOSED           2
+
+#define FLIGHT_RECORDER_SIZE        (32 << 20)      // default file size in bytes, preallocated
+#define FLIGHT_RECORDER_QUEUE       1024            // values buffered per channel between producer and writer
+#define FLIGHT_RECORDER_PERIOD_MS   10              // how often the writer drains the queues
+#define FLIGHT_RECORDER_SYNC_MS     1000            // how often written records are flushed to disk
+
+/**
+ * First page of a flight log. The records follow as a ring of capacity fixed size slots: record n goes to slot
+ * n % capacity, so a full log keeps the most recent records.
+ *
+ * A record is only counted in recordCount once it is completely written, and every record carries its sequence
+ * number and a CRC, so a reader can tell valid records from torn or stale ones after a crash or power loss, when
+ * the header on disk may be older or newer than the records.
+ */
+struct FlightLogHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t recordSize;
+    uint64_t capacity;                  // number of record slots
+    int64_t startTime;                  // microseconds since epoch
+    atomic<uint64_t> recordCount;       // records written
+    atomic<uint64_t> dropped;           // values lost because the writer fell behind
+    atomic<uint32_t> state;             // FLIGHT_LOG_OPEN or FLIGHT_LOG_CLOSED
+};
+
+/**
+ * CRC-32 (IEEE 802.3), the same as zlib's crc32(). Pass the previous result as crc to continue a checksum.
+ */
+inline uint32_t crc32(const char *data, size_t length, uint32_t crc = 0) {
+    struct Table {
+        uint32_t entries[256];
+
+        Table() {
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; ++k) {
+                    c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+                }
+                entries[i] = c;
+            }
+        }
+    };
+    static const Table table;
+    crc = ~crc;
+    for (size_t i = 0; i < length; ++i) {
+        crc = table.entries[(crc ^ static_cast<unsigned char>(data[i])) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/**
+ * Everything about a record except the payload, so that the sequence number, type and length are covered by the CRC.
+ */
+inline uint32_t recordCrc(uint64_t sequence, uint8_t type, uint16_t length, const char *payload) {
+    char header[12];
+    memcpy(header, &sequence, 8);
+    header[8] = static_cast<char>(type);
+    header[9] = 0;
+    memcpy(header + 10, &length, 2);
+    return crc32(payload, length, crc32(header, sizeof(header)));
+}
+
+/**
+ * Values of one type on their way from a DeviceTask to the recorder.
+ */
+class RecorderChannelBase {
+public:
+    virtual ~RecorderChannelBase() = default;
+
+    virtual uint8_t getType() = 0;
+
+    /**
+     * Largest payload a value of this type encodes to.
+     */
+    virtual size_t getMaxPayload() = 0;
+
+    /**
+     * Take the next value off the queue and encode it into payload. Returns false if the queue is empty.
+     */
+    virtual bool next(string &payload) = 0;
+
+    virtual long long getDropped() = 0;
+
+    /**
+     * Values waiting for the writer.
+     */
+    virtual size_t getQueued() = 0;
+};
+
+template<class T>
+class RecorderChannel : public RecorderChannelBase {
+private:
+    SpscQueue<T> queue;
+    atomic<long long> dropped;
+    T value;                            // only used by the writer thread
+
+public:
+    explicit RecorderChannel(size_t capacity = FLIGHT_RECORDER_QUEUE) : queue(capacity), dropped(0) {
+    }
+
+    /**
+     * Called by the producer for every new value. Never blocks: if the writer is behind, the value is counted and
+     * dropped.
+     */
+    void push(const T &newValue) {
+        if (!queue.push(newValue)) {
+            dropped.fetch_add(1, memory_order_relaxed);
+        }
+    }
+
+    uint8_t getType() override {
+        return T::wireType;
+    }
+
+    size_t getMaxPayload() override {
+        string payload;
+        BinaryWriter writer(payload);
+        T().toBinary(writer);
+        return payload.size();
+    }
+
+    bool next(string &payload) override {
+        if (!queue.pop(value)) {
+            return false;
+        }
+        payload.clear();
+        BinaryWriter writer(payload);
+        value.toBinary(writer);
+        return true;
+    }
+
+    long long getDropped() override {
+        return dropped.load(memory_order_relaxed);
+    }
+
+    size_t getQueued() override {
+        return queue.size();
+    }
+};
+
+/**
+ * Black box recorder: appends every value of the attached tasks as a fixed size binary record to a preallocated,
+ * memory mapped file.
+ *
+ * Producers (the sensor and control loops) only copy the value into a lock free queue (see DeviceTask::setRecorder);
+ * encoding, writing and flushing happen on the recorder's own thread at normal priority, so disk latency never
+ * reaches a control loop. Use addChannel() for every type before open(), then start() the writer.
+ */
+class FlightRecorder {
+private:
+    const string path;
+    const size_t fileSize;
+    vector<unique_ptr<RecorderChannelBase>> channels;
+
+    char *memory = nullptr;
+    FlightLogHeader *header = nullptr;
+    uint32_t recordSize = 0;
+    uint64_t capacity = 0;
+    string payload;
+
+    boost::thread writer;
+    atomic<bool> isShutdown;
+
+public:
+    explicit FlightRecorder(string path, size_t fileSize = FLIGHT_RECORDER_SIZE)
+        : path(std::move(path)), fileSize(fileSize), isShutdown(false) {
+    }
+
+    ~FlightRecorder() {
+        shutdown();
+    }
+
+    template<class T>
+    RecorderChannel<T> *addChannel(size_t queueCapacity = FLIGHT_RECORDER_QUEUE) {
+        auto *channel = new RecorderChannel<T>(queueCapacity);
+        channels.emplace_back(channel);
+        return channel;
+    }
+
+    /**
+     * Create (or truncate) the log file, allocate all of its blocks up front and map it.
+     */
+    bool open() {
+        size_t maxPayload = 0;
+        for (auto &channel : channels) {
+            maxPayload = max(maxPayload, channel->getMaxPayload());
+        }
+        recordSize = static_cast<uint32_t>((FLIGHT_LOG_RECORD_HEADER + maxPayload + 63) & ~static_cast<size_t>(63));
+        if (fileSize < FLIGHT_LOG_HEADER_SIZE + recordSize) {
+            cerr << "Flight log " << path << " is too small" << endl;
+            return false;
+        }
+        capacity = (fileSize - FLIGHT_LOG_HEADER_SIZE) / recordSize;
+
+        int fd = ::open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+        if (fd < 0) {
+            cerr << "Failed to create flight log " << path << ": " << strerror(errno) << endl;
+            return false;
+        }
+        // reserve the blocks now: running out of space later would be a SIGBUS in the writer
+        int error = posix_fallocate(fd, 0, static_cast<off_t>(fileSize));
+        if (error != 0) {
+            cerr << "Failed to allocate flight log " << path << ": " << strerror(error) << endl;
+            ::close(fd);
+            return false;
+        }
+        void *p = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            cerr << "Failed to map flight log " << path << ": " << strerror(errno) << endl;
+            return false;
+        }
+        memory = static_cast<char *>(p);
+        header = reinterpret_cast<FlightLogHeader *>(memory);
+        header->magic = FLIGHT_LOG_MAGIC;
+        header->version = FLIGHT_LOG_VERSION;
+        header->headerSize = FLIGHT_LOG_HEADER_SIZE;
+        header->recordSize = recordSize;
+        header->capacity = capacity;
+        header->startTime = currentMicroSecondsSinceEpoch();
+        header->recordCount.store(0, memory_order_relaxed);
+        header->dropped.store(0, memory_order_relaxed);
+        header->state.store(FLIGHT_LOG_OPEN, memory_order_release);
+        msync(memory, FLIGHT_LOG_HEADER_SIZE, MS_SYNC);
+        cout << "Recording to " << path << ": " << capacity << " records of " << recordSize << " bytes" << endl;
+        return true;
+    }
+
+    bool isOpen() {
+        return memory != nullptr;
+    }
+
+    /**
+     * Start the writer thread.
+     */
+    void start() {
+        if (memory && !writer.joinable()) {
+            writer = launchThread(ThreadConfig("recorder", 0), boost::bind(&FlightRecorder::run, this));
+        }
+    }
+
+    /**
+     * Write what is still queued, mark the log as closed cleanly and flush it.
+     */
+    void shutdown() {
+        isShutdown = true;
+        if (writer.joinable()) {
+            writer.join();
+        }
+        if (memory) {
+            drain();
+            header->state.store(FLIGHT_LOG_CLOSED, memory_order_release);
+            msync(memory, fileSize, MS_SYNC);
+            munmap(memory, fileSize);
+            memory = nullptr;
+            header = nullptr;
+            cout << "Flight log " << path << " closed" << endl;
+        }
+    }
+
+    uint64_t getRecordCount() {
+        return header ? header->recordCount.load(memory_order_relaxed) : 0;
+    }
+
+    long long getDropped() {
+        long long dropped = 0;
+        for (auto &channel : channels) {
+            dropped += channel->getDropped();
+        }
+        return dropped;
+    }
+
+    /**
+     * Export records written, and values dropped and queued per channel, labelled channel=<type>. Call after
+     * adding the channels.
+     */
+    void setMetrics(MetricsRegistry &registry) {
+        registry.counterFunction("recorder_records_total", "Records written to the flight log.", "", [this]() {
+            return static_cast<double>(getRecordCount());
+        });
+        for (auto &channel : channels) {
+            RecorderChannelBase *c = channel.get();
+            string labels = MetricsRegistry::label("channel", wireTypeName(c->getType()));
+            registry.counterFunction("recorder_dropped_total", "Values dropped because the writer was behind.",
+                                     labels, [c]() {
+                                         return static_cast<double>(c->getDropped());
+                                     });
+            registry.gaugeFunction("recorder_queue_depth", "Values waiting for the writer.", labels, [c]() {
+                return static_cast<double>(c->getQueued());
+            });
+        }
+    }
+
+private:
+    void run() {
+        auto lastSync = chrono::steady_clock::now();
+        while (!isShutdown) {
+            drain();
+            auto now = chrono::steady_clock::now();
+            if (now - lastSync >= chrono::milliseconds(FLIGHT_RECORDER_SYNC_MS)) {
+                msync(memory, fileSize, MS_ASYNC);
+                lastSync = now;
+            }
+            boost::this_thread::sleep_for(boost::chrono::milliseconds(FLIGHT_RECORDER_PERIOD_MS));
+        }
+    }
+
+    void drain() {
+        for (auto &channel : channels) {
+            while (channel->next(payload)) {
+                append(channel->getType(), payload);
+            }
+        }
+        header->dropped.store(static_cast<uint64_t>(getDropped()), memory_order_relaxed);
+    }
+
+    void append(uint8_t type, const string &data) {
+        uint64_t sequence = header->recordCount.load(memory_order_relaxed);
+        char *record = memory + FLIGHT_LOG_HEADER_SIZE + recordSize * (sequence % capacity);
+        uint16_t length = static_cast<uint16_t>(data.size());
+        uint32_t crc = recordCrc(sequence, type, length, data.data());
+        memcpy(record, &sequence, 8);
+        record[8] = static_cast<char>(type);
+        record[9] = 0;
+        memcpy(record + 10, &length, 2);
+        memcpy(record + 12, &crc, 4);
+        memcpy(record + FLIGHT_LOG_RECORD_HEADER, data.data(), length);
+        header->recordCount.store(sequence + 1, memory_order_release);
+    }
+};
+
+/**
+ * One record handed out by FlightLogReader. The payload points into the mapped file.
+ */
+struct FlightRecord {
+    uint64_t sequence = 0;
+    uint8_t type = WIRE_TYPE_UNKNOWN;
+    const char *payload = nullptr;
+    size_t length = 0;
+};
+
+/**
+ * Reads a flight log back, oldest record first, checking every record. Records past the count in the header are
+ * also picked up as long as they are valid, since the header may not have reached the disk before a crash.
+ */
+class FlightLogReader {
+private:
+    const string path;
+    const char *memory = nullptr;
+    size_t size = 0;
+    const FlightLogHeader *header = nullptr;
+    uint64_t nextSequence = 0;
+    uint64_t recordCount = 0;
+    long long corrupt = 0;
+    long long recovered = 0;
+
+public:
+    explicit FlightLogReader(string path) : path(std::move(path)) {
+    }
+
+    ~FlightLogReader() {
+        close();
+    }
+
+    bool open() {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            cerr << "Failed to open flight log " << path << ": " << strerror(errno) << endl;
+            return false;
+        }
+        struct stat st{};
+        if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < FLIGHT_LOG_HEADER_SIZE) {
+            cerr << "Not a flight log: " << path << endl;
+            ::close(fd);
+            return false;
+        }
+        void *p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            cerr << "Failed to map flight log " << path << ": " << strerror(errno) << endl;
+            return false;
+        }
+        memory = static_cast<const char *>(p);
+        size = static_cast<size_t>(st.st_size);
+        header = reinterpret_cast<const FlightLogHeader *>(memory);
+        if (header->magic != FLIGHT_LOG_MAGIC || header->version != FLIGHT_LOG_VERSION ||
+            header->recordSize < FLIGHT_LOG_RECORD_HEADER || header->capacity == 0 ||
+            header->headerSize + header->recordSize * header->capacity > size) {
+            cerr << "Not a flight log: " << path << endl;
+            close();
+            return false;
+        }
+        recordCount = header->recordCount.load(memory_order_acquire);
+        nextSequence = recordCount > header->capacity ? recordCount - header->capacity : 0;
+        return true;
+    }
+
+    void close() {
+        if (memory) {
+            munmap(const_cast<char *>(memory), size);
+            memory = nullptr;
+            header = nullptr;
+        }
+    }
+
+    /**
+     * Next valid record. Returns false at the end of the log.
+     */
+    bool next(FlightRecord &record) {
+        while (memory) {
+            if (nextSequence >= recordCount + header->capacity) {
+                return false;
+            }
+            bool valid = readSlot(nextSequence, record);
+            if (nextSequence >= recordCount) {
+                // past the header's count: only records written just before a crash
+                if (!valid) {
+                    return false;
+                }
+                recovered++;
+            } else if (!valid) {
+                corrupt++;
+                nextSequence++;
+                continue;
+            }
+            nextSequence++;
+            return true;
+        }
+        return false;
+    }
+
+    bool closedCleanly() {
+        return header && header->state.load(memory_order_acquire) == FLIGHT_LOG_CLOSED;
+    }
+
+    int64_t getStartTime() {
+        return header ? header->startTime : 0;
+    }
+
+    uint64_t getRecordCount() {
+        return recordCount;
+    }
+
+    uint64_t getDropped() {
+        return header ? header->dropped.load(memory_order_relaxed) : 0;
+    }
+
+    /**
+     * Records within the header's count that failed their check, and valid records found past it.
+     */
+    long long getCorrupt() {
+        return corrupt;
+    }
+
+    long long getRecovered() {
+        return recovered;
+    }
+
+private:
+    bool readSlot(uint64_t sequence, FlightRecord &record) {
+        const char *slot = memory + header->headerSize + header->recordSize * (sequence % header->capacity);
+        uint16_t length;
+        uint32_t crc;
+        memcpy(&record.sequence, slot, 8);
+        record.type = static_cast<uint8_t>(slot[8]);
+        memcpy(&length, slot + 10, 2);
+        memcpy(&crc, slot + 12, 4);
+        if (record.sequence != sequence ||
+            static_cast<uint32_t>(FLIGHT_LOG_RECORD_HEADER + length) > header->recordSize) {
+            return false;
+        }
+        record.payload = slot + FLIGHT_LOG_RECORD_HEADER;
+        record.length = length;
+        return crc == recordCrc(record.sequence, record.type, length, record.payload);
+    }
+};
+
+#endif // CORE_FLIGHTRECORDER_HPP
@@ -0,0 +1,188 @@
+#ifndef CORE_LATENCYHISTOGRAM_HPP
+#define CORE_LATENCYHISTOGRAM_HPP
+
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <utils/jsonWriter.hpp>
+
+using namespace std;
+
+#define LATENCY_SUB_BUCKET_BITS     7               // 64 buckets per power of two, values within 1.6%
+#define LATENCY_MAX_BITS            40              // largest value tracked, 2^40 ns is about 18 minutes
+
+/**
+ * Percentiles of a LatencyHistogram, in microseconds.
+ */
+struct LatencySummary {
+    long long count = 0;
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p90 = 0.0;
+    double p99 = 0.0;
+    double p999 = 0.0;
+    double max = 0.0;
+
+    string toString() const {
+        stringstream ss;
+        ss << "count=" << count << " mean=" << mean << "us p50=" << p50 << "us p90=" << p90 << "us p99=" << p99
+           << "us p99.9=" << p999 << "us max=" << max << "us";
+        return ss.str();
+    }
+
+    void writeJson(JsonWriter &writer) const {
+        writer.beginObject();
+        writer.field("count", count);
+        writer.field("max", max);
+        writer.field("mean", mean);
+        writer.field("p50", p50);
+        writer.field("p90", p90);
+        writer.field("p99", p99);
+        writer.field("p999", p999);
+        writer.endObject();
+    }
+};
+
+/**
+ * Histogram of durations in nanoseconds with HDR style buckets: exact below 128 ns, then 64 buckets per power of
+ * two, so every percentile is within 1.6% of the recorded value over the whole range.
+ *
+ * record() is a few relaxed atomic adds and never allocates or locks, so it can be called from the control loops
+ * while another thread reads percentiles. A summary taken during a record() may be off by that one value.
+ */
+class LatencyHistogram {
+private:
+    static const int subBuckets = 1 << LATENCY_SUB_BUCKET_BITS;
+    static const int halfSubBuckets = subBuckets / 2;
+    static const int bucketCount = (LATENCY_MAX_BITS - LATENCY_SUB_BUCKET_BITS + 2) * halfSubBuckets;
+
+    atomic<long long> counts[bucketCount];
+    atomic<long long> count;
+    atomic<long long> sum;
+    atomic<long long> largest;
+
+public:
+    LatencyHistogram() : count(0), sum(0), largest(0) {
+        for (auto &c : counts) {
+            c.store(0, memory_order_relaxed);
+        }
+    }
+
+    /**
+     * Add one duration. Negative durations (clocks read in the wrong order) count as 0.
+     */
+    void record(long long nanos) {
+        if (nanos < 0) {
+            nanos = 0;
+        }
+        counts[indexOf(nanos)].fetch_add(1, memory_order_relaxed);
+        count.fetch_add(1, memory_order_relaxed);
+        sum.fetch_add(nanos, memory_order_relaxed);
+        long long previous = largest.load(memory_order_relaxed);
+        while (nanos > previous && !largest.compare_exchange_weak(previous, nanos, memory_order_relaxed)) {
+        }
+    }
+
+    void reset() {
+        for (auto &c : counts) {
+            c.store(0, memory_order_relaxed);
+        }
+        count.store(0, memory_order_relaxed);
+        sum.store(0, memory_order_relaxed);
+        largest.store(0, memory_order_relaxed);
+    }
+
+    long long getCount() const {
+        return count.load(memory_order_relaxed);
+    }
+
+    /**
+     * Sum of the recorded durations, in nanoseconds.
+     */
+    long long getSum() const {
+        return sum.load(memory_order_relaxed);
+    }
+
+    /**
+     * Value at or below which the given fraction (0 to 1) of the recorded durations are, in nanoseconds.
+     */
+    long long percentile(double fraction) const {
+        vector<long long> snapshot(bucketCount);
+        long long total = 0;
+        for (int i = 0; i < bucketCount; ++i) {
+            snapshot[i] = counts[i].load(memory_order_relaxed);
+            total += snapshot[i];
+        }
+        return percentile(snapshot, total, fraction);
+    }
+
+    LatencySummary summary() const {
+        vector<long long> snapshot(bucketCount);
+        long long total = 0;
+        for (int i = 0; i < bucketCount; ++i) {
+            snapshot[i] = counts[i].load(memory_order_relaxed);
+            total += snapshot[i];
+        }
+        LatencySummary s;
+        s.count = total;
+        if (total == 0) {
+            return s;
+        }
+        s.mean = sum.load(memory_order_relaxed) / 1000.0 / total;
+        s.p50 = percentile(snapshot, total, 0.5) / 1000.0;
+        s.p90 = percentile(snapshot, total, 0.9) / 1000.0;
+        s.p99 = percentile(snapshot, total, 0.99) / 1000.0;
+        s.p999 = percentile(snapshot, total, 0.999) / 1000.0;
+        s.max = largest.load(memory_order_relaxed) / 1000.0;
+        return s;
+    }
+
+private:
+    static int indexOf(long long nanos) {
+        auto value = static_cast<unsigned long long>(nanos);
+        if (value >= (1ULL << LATENCY_MAX_BITS)) {
+            value = (1ULL << LATENCY_MAX_BITS) - 1;
+        }
+        if (value < static_cast<unsigned long long>(subBuckets)) {
+            return static_cast<int>(value);
+        }
+        // keep the top LATENCY_SUB_BUCKET_BITS - 1 bits below the leading one
+        int shift = 63 - __builtin_clzll(value) - (LATENCY_SUB_BUCKET_BITS - 1);
+        return shift * halfSubBuckets + static_cast<int>(value >> shift);
+    }
+
+    /**
+     * Largest value that falls into bucket index.
+     */
+    static long long highestValue(int index) {
+        if (index < subBuckets) {
+            return index;
+        }
+        int shift = index / halfSubBuckets - 1;
+        long long mantissa = index - shift * halfSubBuckets;
+        return ((mantissa + 1) << shift) - 1;
+    }
+
+    long long percentile(const vector<long long> &snapshot, long long total, double fraction) const {
+        if (total == 0) {
+            return 0;
+        }
+        auto rank = static_cast<long long>(fraction * total + 0.5);
+        if (rank < 1) {
+            rank = 1;
+        }
+        long long seen = 0;
+        for (int i = 0; i < bucketCount; ++i) {
+            seen += snapshot[i];
+            if (seen >= rank) {
+                long long highest = highestValue(i);
+                long long maxValue = largest.load(memory_order_relaxed);
+                return highest < maxValue ? highest : maxValue;
+            }
+        }
+        return largest.load(memory_order_relaxed);
+    }
+};
+
+#endif // CORE_LATENCYHISTOGRAM_HPP
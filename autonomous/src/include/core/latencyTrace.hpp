@@ -0,0 +1,129 @@
+#ifndef CORE_LATENCYTRACE_HPP
+#define CORE_LATENCYTRACE_HPP
+
+#include <string>
+#include <core/latencyHistogram.hpp>
+#include <core/metrics.hpp>
+#include <utils/jsonWriter.hpp>
+#include <utils/misc.hpp>
+
+using namespace std;
+
+/**
+ * When a sample passed each stage on its way from the sensor to the motors, in monotonicNanoSeconds(); 0 for a
+ * stage it has not reached. The IMU task fills in the first three, the control task copies them into its output
+ * and adds its own, and the motor loop adds the last.
+ *
+ * The trail lives only in process memory: it is not part of the wire formats or the flight log.
+ */
+struct LatencyTrail {
+    long long sampled = 0;              // the IMU took the sample, reconstructed from its FIFO position
+    long long acquired = 0;             // read off the bus
+    long long filtered = 0;             // the attitude filter finished with it
+    long long controlled = 0;           // the controllers finished computing from it
+    long long actuated = 0;             // the motors were set from that output
+};
+
+/**
+ * Latency histograms per stage of the sensor to motor path:
+ * - fifo: sampled to acquired, time the sample waited in the IMU FIFO
+ * - filter: acquired to filtered
+ * - control: filtered to controlled, mostly the wait for the next control period
+ * - actuate: controlled to actuated, the wait for the motor loop
+ * - total: sampled to actuated, how old the attitude behind a motor command is
+ *
+ * record() only touches atomics, so the motor loop can call it every period while a stats request reads the
+ * histograms. actuated() is meant for a single motor loop.
+ */
+class LatencyTracker {
+private:
+    LatencyHistogram fifo;
+    LatencyHistogram filter;
+    LatencyHistogram control;
+    LatencyHistogram actuate;
+    LatencyHistogram total;
+    long long lastControlled = 0;       // output last passed to actuated()
+
+public:
+    /**
+     * Add the stages of a trail that are complete.
+     */
+    void record(const LatencyTrail &trail) {
+        recordStage(fifo, trail.sampled, trail.acquired);
+        recordStage(filter, trail.acquired, trail.filtered);
+        recordStage(control, trail.filtered, trail.controlled);
+        recordStage(actuate, trail.controlled, trail.actuated);
+        recordStage(total, trail.sampled, trail.actuated);
+    }
+
+    /**
+     * Call right after setting the motors from an output with its trail. Only the first time an output reaches the
+     * motors counts; a motor loop faster than the controllers sets the same output again.
+     */
+    void actuated(LatencyTrail trail) {
+        if (trail.controlled == 0 || trail.controlled == lastControlled) {
+            return;
+        }
+        lastControlled = trail.controlled;
+        trail.actuated = monotonicNanoSeconds();
+        record(trail);
+    }
+
+    /**
+     * Export the histograms as latency_seconds{stage=...}.
+     */
+    void setMetrics(MetricsRegistry &registry) {
+        const string help = "Sensor to motor latency per stage.";
+        registry.histogram("latency_seconds", help, MetricsRegistry::label("stage", "fifo"), fifo);
+        registry.histogram("latency_seconds", help, MetricsRegistry::label("stage", "filter"), filter);
+        registry.histogram("latency_seconds", help, MetricsRegistry::label("stage", "control"), control);
+        registry.histogram("latency_seconds", help, MetricsRegistry::label("stage", "actuate"), actuate);
+        registry.histogram("latency_seconds", help, MetricsRegistry::label("stage", "total"), total);
+    }
+
+    void reset() {
+        fifo.reset();
+        filter.reset();
+        control.reset();
+        actuate.reset();
+        total.reset();
+    }
+
+    const LatencyHistogram &getTotal() const {
+        return total;
+    }
+
+    string toString() const {
+        return "fifo: " + fifo.summary().toString() + "\nfilter: " + filter.summary().toString() +
+               "\ncontrol: " + control.summary().toString() + "\nactuate: " + actuate.summary().toString() +
+               "\ntotal: " + total.summary().toString();
+    }
+
+    /**
+     * Append the summaries as a json object keyed by stage, in microseconds.
+     */
+    void writeJson(string &buffer) const {
+        JsonWriter writer(buffer);
+        writer.beginObject();
+        writer.key("actuate");
+        actuate.summary().writeJson(writer);
+        writer.key("control");
+        control.summary().writeJson(writer);
+        writer.key("fifo");
+        fifo.summary().writeJson(writer);
+        writer.key("filter");
+        filter.summary().writeJson(writer);
+        writer.key("total");
+        total.summary().writeJson(writer);
+        writer.endObject();
+    }
+
+private:
+    static void recordStage(LatencyHistogram &histogram, long long from, long long to) {
+        if (from != 0 && to != 0) {
+            histogram.record(to - from);
+        }
+    }
+};
+
+#endif // CORE_LATENCYTRACE_HPP
@@ -0,0 +1,256 @@
+#ifndef CORE_METRICS_HPP
+#define CORE_METRICS_HPP
+
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <boost/thread.hpp>
+#include <core/latencyHistogram.hpp>
+
+using namespace std;
+
+#define METRICS_PREFIX              "quadcopter_"
+
+/**
+ * Monotonically increasing count. increment() is a single relaxed atomic add.
+ */
+class Counter {
+private:
+    atomic<long long> value;
+
+public:
+    Counter() : value(0) {
+    }
+
+    void increment(long long n = 1) {
+        value.fetch_add(n, memory_order_relaxed);
+    }
+
+    long long get() const {
+        return value.load(memory_order_relaxed);
+    }
+};
+
+/**
+ * Value that goes up and down. set() is a single relaxed atomic store.
+ */
+class Gauge {
+private:
+    atomic<double> value;
+
+public:
+    Gauge() : value(0.0) {
+    }
+
+    void set(double v) {
+        value.store(v, memory_order_relaxed);
+    }
+
+    double get() const {
+        return value.load(memory_order_relaxed);
+    }
+};
+
+/**
+ * Named counters, gauges and histograms of the running processes, rendered in the Prometheus text format (see
+ * StatsServer, `curl localhost:5003/metrics`).
+ *
+ * Metrics are created once at setup and then updated through the returned pointer without locking or allocating,
+ * so the sensor and control loops can update them every sample. Histograms are LatencyHistograms of nanoseconds,
+ * exported as summaries in seconds. Values that a class already keeps (e.g. PeriodicStats behind a seqlock) can be
+ * registered as a function instead, which costs nothing until a scrape calls it.
+ *
+ * Every metric of a name shares its help and type and differs by its labels, given as `name="value"` pairs, see
+ * label(). Registering the same name and labels again returns the existing metric.
+ */
+class MetricsRegistry {
+private:
+    enum class Type {
+        COUNTER,
+        GAUGE,
+        SUMMARY
+    };
+
+    struct Series {
+        string labels;
+        Counter *counter = nullptr;
+        Gauge *gauge = nullptr;
+        const LatencyHistogram *histogram = nullptr;     // owned by the registry or registered from outside
+        function<double()> compute;
+    };
+
+    struct Family {
+        string help;
+        Type type;
+        vector<Series> series;
+    };
+
+    boost::mutex mtx;                   // registration and rendering only, never taken by an update
+    map<string, Family> families;
+    deque<Counter> counters;            // a deque never moves what it holds
+    deque<Gauge> gauges;
+    deque<LatencyHistogram> histograms;
+
+public:
+    /**
+     * A label pair, e.g. label("task", "imu") is `task="imu"`. Join several with a comma.
+     */
+    static string label(const string &name, const string &value) {
+        string escaped;
+        for (char c : value) {
+            if (c == '\\' || c == '"') {
+                escaped.push_back('\\');
+                escaped.push_back(c);
+            } else if (c == '\n') {
+                escaped += "\\n";
+            } else {
+                escaped.push_back(c);
+            }
+        }
+        return name + "=\"" + escaped + "\"";
+    }
+
+    Counter *counter(const string &name, const string &help, const string &labels = "") {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        Series *series = find(name, help, Type::COUNTER, labels);
+        if (!series->counter) {
+            counters.emplace_back();
+            series->counter = &counters.back();
+        }
+        return series->counter;
+    }
+
+    Gauge *gauge(const string &name, const string &help, const string &labels = "") {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        Series *series = find(name, help, Type::GAUGE, labels);
+        if (!series->gauge) {
+            gauges.emplace_back();
+            series->gauge = &gauges.back();
+        }
+        return series->gauge;
+    }
+
+    LatencyHistogram *histogram(const string &name, const string &help, const string &labels = "") {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        Series *series = find(name, help, Type::SUMMARY, labels);
+        if (!series->histogram) {
+            histograms.emplace_back();
+            series->histogram = &histograms.back();
+        }
+        return const_cast<LatencyHistogram *>(series->histogram);
+    }
+
+    /**
+     * Export a histogram owned by someone else, which must outlive the registry.
+     */
+    void histogram(const string &name, const string &help, const string &labels, const LatencyHistogram &histogram) {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        find(name, help, Type::SUMMARY, labels)->histogram = &histogram;
+    }
+
+    /**
+     * Counter whose value is computed at every scrape, on the thread serving the scrape.
+     */
+    void counterFunction(const string &name, const string &help, const string &labels, function<double()> compute) {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        find(name, help, Type::COUNTER, labels)->compute = std::move(compute);
+    }
+
+    /**
+     * Gauge whose value is computed at every scrape, on the thread serving the scrape.
+     */
+    void gaugeFunction(const string &name, const string &help, const string &labels, function<double()> compute) {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        find(name, help, Type::GAUGE, labels)->compute = std::move(compute);
+    }
+
+    /**
+     * Append every metric in the Prometheus text exposition format (version 0.0.4).
+     */
+    void writePrometheus(string &buffer) {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        for (auto &entry : families) {
+            const string name = METRICS_PREFIX + entry.first;
+            const Family &family = entry.second;
+            buffer += "# HELP " + name + " " + family.help + "\n";
+            buffer += "# TYPE " + name + " " + typeName(family.type) + "\n";
+            for (auto &series : family.series) {
+                if (family.type == Type::SUMMARY) {
+                    writeSummary(buffer, name, series);
+                    continue;
+                }
+                double value = 0.0;
+                if (series.compute) {
+                    value = series.compute();
+                } else if (series.counter) {
+                    value = series.counter->get();
+                } else if (series.gauge) {
+                    value = series.gauge->get();
+                }
+                writeSample(buffer, name, series.labels, value);
+            }
+        }
+    }
+
+private:
+    Series *find(const string &name, const string &help, Type type, const string &labels) {
+        auto it = families.find(name);
+        if (it == families.end()) {
+            it = families.insert(make_pair(name, Family{help, type, vector<Series>()})).first;
+        } else if (it->second.type != type) {
+            cerr << "Metric " << name << " registered as " << typeName(it->second.type) << " and " << typeName(type)
+                 << endl;
+        }
+        for (auto &series : it->second.series) {
+            if (series.labels == labels) {
+                return &series;
+            }
+        }
+        it->second.series.emplace_back();
+        it->second.series.back().labels = labels;
+        return &it->second.series.back();
+    }
+
+    static const char *typeName(Type type) {
+        switch (type) {
+            case Type::COUNTER:
+                return "counter";
+            case Type::GAUGE:
+                return "gauge";
+            default:
+                return "summary";
+        }
+    }
+
+    static void writeSummary(string &buffer, const string &name, const Series &series) {
+        if (!series.histogram) {
+            return;
+        }
+        const string separator = series.labels.empty() ? "" : ",";
+        for (double quantile : {0.5, 0.9, 0.99, 0.999}) {
+            char q[16];
+            snprintf(q, sizeof(q), "%g", quantile);
+            writeSample(buffer, name, series.labels + separator + label("quantile", q),
+                        series.histogram->percentile(quantile) / 1e9);
+        }
+        writeSample(buffer, name + "_sum", series.labels, series.histogram->getSum() / 1e9);
+        writeSample(buffer, name + "_count", series.labels, series.histogram->getCount());
+    }
+
+    static void writeSample(string &buffer, const string &name, const string &labels, double value) {
+        buffer += name;
+        if (!labels.empty()) {
+            buffer += "{" + labels + "}";
+        }
+        char data[32];
+        int length = snprintf(data, sizeof(data), " %.17g\n", value);
+        buffer.append(data, static_cast<size_t>(length));
+    }
+};
+
+#endif // CORE_METRICS_HPP
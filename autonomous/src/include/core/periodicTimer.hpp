@@ -0,0 +1,142 @@
+#ifndef CORE_PERIODICTIMER_HPP
+#define CORE_PERIODICTIMER_HPP
+
+#include <time.h>
+#include <errno.h>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <core/seqLock.hpp>
+
+using namespace std;
+
+struct PeriodicStats {
+    long long iterations = 0;
+    long long overruns = 0;             // deadlines that had already passed when the work finished
+    long long missedPeriods = 0;        // whole periods skipped to get back in phase
+    double achievedRate = 0.0;          // in Hz, since start()
+    double meanLatency = 0.0;           // mean wakeup lateness relative to the deadline, in microseconds
+    double jitter = 0.0;                // standard deviation of the wakeup lateness, in microseconds
+    double maxLatency = 0.0;            // in microseconds
+
+    string toString() const {
+        stringstream ss;
+        ss << "iterations=" << iterations << " overruns=" << overruns << " missedPeriods=" << missedPeriods
+           << " rate=" << achievedRate << "Hz latency=" << meanLatency << "us jitter=" << jitter
+           << "us maxLatency=" << maxLatency << "us";
+        return ss.str();
+    }
+};
+
+/**
+ * Fixed rate scheduler on CLOCK_MONOTONIC. Deadlines are absolute (start + n * period), so the time spent doing the
+ * work does not add to the period and the loop does not drift. If the work overruns one or more deadlines, the
+ * missed periods are skipped rather than run back to back, which keeps the original phase.
+ *
+ * wait() must be called from a single thread; getStats() may be called from any thread.
+ */
+class PeriodicTimer {
+private:
+    const long long periodNanos;
+
+    timespec startTime{};
+    timespec deadline{};
+
+    PeriodicStats stats;
+    double latencySum2 = 0.0;
+    SeqLock<PeriodicStats> published;
+
+public:
+    explicit PeriodicTimer(int frequency) : periodNanos(frequency > 0 ? 1000000000LL / frequency : 0) {
+        start();
+    }
+
+    /**
+     * Reset the phase so that the first deadline is one period from now.
+     */
+    void start() {
+        clock_gettime(CLOCK_MONOTONIC, &startTime);
+        deadline = startTime;
+        stats = PeriodicStats();
+        latencySum2 = 0.0;
+        published.store(stats);
+    }
+
+    /**
+     * Sleep until the next deadline. Returns false if the deadline had already passed (an overrun).
+     */
+    bool wait() {
+        if (periodNanos <= 0) {
+            return true;
+        }
+        timespec now{};
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        advance(deadline, periodNanos);
+
+        bool onTime = true;
+        long long late = difference(now, deadline);
+        if (late > 0) {
+            // skip whole periods that are already gone so we stay in phase
+            long long missed = late / periodNanos;
+            advance(deadline, missed * periodNanos);
+            stats.overruns++;
+            stats.missedPeriods += missed;
+            onTime = false;
+        }
+
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        update(difference(now, deadline) / 1000.0, difference(now, startTime));
+        return onTime;
+    }
+
+    /**
+     * Count an iteration of a loop that is paced by something else, e.g. a data ready edge, so getStats() still
+     * reports the achieved rate. Latency and jitter are relative to deadlines and stay untouched.
+     */
+    void tick() {
+        timespec now{};
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        stats.iterations++;
+        long long elapsedNanos = difference(now, startTime);
+        stats.achievedRate = elapsedNanos > 0 ? stats.iterations * 1e9 / elapsedNanos : 0.0;
+        published.store(stats);
+    }
+
+    long long getPeriodNanos() const {
+        return periodNanos;
+    }
+
+    PeriodicStats getStats() const {
+        return published.load();
+    }
+
+private:
+    void update(double latency, long long elapsedNanos) {
+        stats.iterations++;
+        if (latency > stats.maxLatency) {
+            stats.maxLatency = latency;
+        }
+        double n = stats.iterations;
+        stats.meanLatency += (latency - stats.meanLatency) / n;
+        latencySum2 += latency * latency;
+        double variance = latencySum2 / n - stats.meanLatency * stats.meanLatency;
+        stats.jitter = variance > 0 ? sqrt(variance) : 0.0;
+        stats.achievedRate = elapsedNanos > 0 ? stats.iterations * 1e9 / elapsedNanos : 0.0;
+        published.store(stats);
+    }
+
+    static void advance(timespec &t, long long nanos) {
+        long long total = t.tv_nsec + nanos;
+        t.tv_sec += total / 1000000000LL;
+        t.tv_nsec = total % 1000000000LL;
+    }
+
+    static long long difference(const timespec &a, const timespec &b) {
+        return (a.tv_sec - b.tv_sec) * 1000000000LL + (a.tv_nsec - b.tv_nsec);
+    }
+};
+
+#endif // CORE_PERIODICTIMER_HPP
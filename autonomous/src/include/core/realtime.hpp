@@ -0,0 +1,129 @@
+#ifndef CORE_REALTIME_HPP
+#define CORE_REALTIME_HPP
+
+#include <pthread.h>
+#include <sched.h>
+#include <errno.h>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+/**
+ * Scheduling setup for a dedicated thread.
+ *  - priority: SCHED_FIFO priority (1-99), 0 keeps the default time sharing scheduler
+ *  - cpus: cores the thread may run on, empty keeps the inherited affinity
+ *  - lockMemory: mlockall() the process so page faults cannot stall the thread
+ */
+struct ThreadConfig {
+    string name;
+    int priority = 0;
+    vector<int> cpus;
+    bool lockMemory = false;
+
+    ThreadConfig() = default;
+
+    ThreadConfig(string name, int priority, vector<int> cpus = vector<int>(), bool lockMemory = false)
+        : name(std::move(name)), priority(priority), cpus(std::move(cpus)), lockMemory(lockMemory) {
+    }
+};
+
+/**
+ * What actually got applied. Missing privileges (CAP_SYS_NICE, RLIMIT_MEMLOCK) are reported, not fatal, so the
+ * same binary runs unprivileged on a dev box or in a container.
+ */
+struct ThreadConfigReport {
+    bool priorityApplied = true;
+    bool affinityApplied = true;
+    bool memoryLocked = true;
+    string errors;
+
+    bool ok() const {
+        return priorityApplied && affinityApplied && memoryLocked;
+    }
+
+    string toString() const {
+        stringstream ss;
+        ss << "priority " << (priorityApplied ? "ok" : "fallback") << ", affinity "
+           << (affinityApplied ? "ok" : "fallback") << ", memory lock " << (memoryLocked ? "ok" : "fallback");
+        if (!errors.empty()) {
+            ss << " (" << errors << ")";
+        }
+        return ss.str();
+    }
+};
+
+/**
+ * Apply the configuration to the calling thread.
+ */
+ThreadConfigReport applyThreadConfig(const ThreadConfig &config) {
+    ThreadConfigReport report;
+    stringstream errors;
+
+#ifdef __linux__
+    if (!config.name.empty()) {
+        // names are limited to 15 characters plus the terminator
+        pthread_setname_np(pthread_self(), config.name.substr(0, 15).c_str());
+    }
+
+    if (!config.cpus.empty()) {
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        for (int cpu : config.cpus) {
+            CPU_SET(cpu, &cpuSet);
+        }
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet);
+        if (error != 0) {
+            report.affinityApplied = false;
+            errors << "affinity: " << strerror(error) << "; ";
+        }
+    }
+#else
+    if (!config.cpus.empty()) {
+        report.affinityApplied = false;
+        errors << "affinity: not supported; ";
+    }
+#endif
+
+    if (config.priority > 0) {
+        sched_param param{};
+        param.sched_priority = config.priority;
+        int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (error != 0) {
+            report.priorityApplied = false;
+            errors << "SCHED_FIFO " << config.priority << ": " << strerror(error) << "; ";
+        }
+    }
+
+    if (config.lockMemory) {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+            report.memoryLocked = false;
+            errors << "mlockall: " << strerror(errno) << "; ";
+        }
+    }
+
+    report.errors = errors.str();
+    if (report.errors.size() >= 2) {
+        report.errors.resize(report.errors.size() - 2);
+    }
+    return report;
+}
+
+/**
+ * Start a dedicated thread that applies the configuration before running the job.
+ */
+boost::thread launchThread(const ThreadConfig &config, const boost::function<void()> &job) {
+    return boost::thread([config, job]() {
+        ThreadConfigReport report = applyThreadConfig(config);
+        cout << "Thread " << config.name << ": " << report.toString() << endl;
+        job();
+    });
+}
+
+#endif // CORE_REALTIME_HPP
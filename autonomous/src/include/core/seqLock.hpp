@@ -0,0 +1,65 @@
+#ifndef CORE_SEQLOCK_HPP
+#define CORE_SEQLOCK_HPP
+
+#include <atomic>
+
+/**
+ * Single writer, multiple reader sequence lock.
+ *
+ * The writer never waits and readers never block the writer: a reader copies the value and retries only if the
+ * writer touched it in the meantime. The sequence is odd while a write is in progress.
+ * T must be a plain value type (no pointers to owned memory) so that a torn copy is harmless before it is discarded.
+ */
+template<class T>
+class SeqLock {
+private:
+    std::atomic<unsigned int> sequence;
+    T value;
+
+public:
+    SeqLock() : sequence(0), value() {
+    }
+
+    /**
+     * Publish a new value. Must only be called from one thread at a time.
+     */
+    void store(const T &newValue) {
+        unsigned int seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        value = newValue;
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    /**
+     * Copy the most recently published value. Never blocks, retries while a write is in progress.
+     */
+    T load() const {
+        T copy;
+        while (!tryLoad(copy)) {
+        }
+        return copy;
+    }
+
+    /**
+     * Single attempt at copying the value. Returns false if the copy raced with a write.
+     */
+    bool tryLoad(T &copy) const {
+        unsigned int before = sequence.load(std::memory_order_acquire);
+        if (before & 1u) {
+            return false;
+        }
+        copy = value;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return before == sequence.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Number of values published so far.
+     */
+    unsigned int version() const {
+        return sequence.load(std::memory_order_acquire) / 2;
+    }
+};
+
+#endif // CORE_SEQLOCK_HPP
@@ -0,0 +1,388 @@
+#ifndef CORE_SHMRING_HPP
+#define CORE_SHMRING_HPP
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <climits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <atomic>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <core/wireFormat.hpp>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace std;
+
+#define SHM_RING_MAGIC              0x51445348u     // "QDSH"
+#define SHM_RING_VERSION            2
+#define SHM_RING_CAPACITY           256             // default number of slots, about a quarter second of IMU data
+#define SHM_RING_POLL_MS            1               // wait() of a reader that cannot register as a waiter
+
+/**
+ * Layout of the start of the shared memory object. The slots follow, each an 8 byte sequence, a 4 byte length
+ * (and 4 bytes of padding) and slotSize bytes of data.
+ *
+ * Values are stored in the binary wire format (see wireFormat.hpp) rather than as raw structs, so readers in other
+ * processes do not depend on the writer's memory layout.
+ */
+struct ShmRingHeader {
+    atomic<uint32_t> magic;         // written last, once the header is valid
+    uint32_t version;
+    uint32_t type;                  // WIRE_TYPE_* of the values
+    uint32_t slotSize;
+    uint32_t capacity;
+    atomic<uint32_t> futexWord;     // changes on every publish, readers block on it
+    atomic<uint32_t> waiters;       // readers blocked on futexWord; publish() only wakes when there are any
+    atomic<uint64_t> writeSequence; // number of values published
+};
+
+#define SHM_RING_SLOT_HEADER        16
+
+inline size_t shmRingSize(uint32_t slotSize, uint32_t capacity) {
+    return sizeof(ShmRingHeader) + static_cast<size_t>(SHM_RING_SLOT_HEADER + slotSize) * capacity;
+}
+
+/**
+ * Publishes values of T into a POSIX shared memory ring, e.g. /dev/shm/quadcopter.imu. Single writer; any number
+ * of processes can map the ring read only with ShmRingReader.
+ *
+ * Value n goes to slot n % capacity. The slot sequence is 2n + 1 while it is written and 2n + 2 once it is complete,
+ * so a reader can tell a complete value from one that is being overwritten, and detect values it missed.
+ */
+template<class T>
+class ShmRingWriter {
+private:
+    const string name;
+    const uint32_t capacity;
+    uint32_t slotSize = 0;
+    size_t size = 0;
+    char *memory = nullptr;
+    ShmRingHeader *header = nullptr;
+    string encoded;
+    long long wakeups = 0;
+
+public:
+    explicit ShmRingWriter(string name, uint32_t capacity = SHM_RING_CAPACITY)
+        : name(std::move(name)), capacity(capacity) {
+    }
+
+    ~ShmRingWriter() {
+        close();
+    }
+
+    /**
+     * Create the shared memory object, replacing any ring left over by a previous run.
+     */
+    bool open() {
+        T value;
+        BinaryWriter writer(encoded);
+        value.toBinary(writer);
+        slotSize = static_cast<uint32_t>((encoded.size() + 7) & ~static_cast<size_t>(7));
+        size = shmRingSize(slotSize, capacity);
+
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        if (fd < 0) {
+            cerr << "Failed to create shared memory " << name << ": " << strerror(errno) << endl;
+            return false;
+        }
+        if (ftruncate(fd, static_cast<off_t>(size)) < 0) {
+            cerr << "Failed to size shared memory " << name << ": " << strerror(errno) << endl;
+            ::close(fd);
+            return false;
+        }
+        void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            cerr << "Failed to map shared memory " << name << ": " << strerror(errno) << endl;
+            return false;
+        }
+        memory = static_cast<char *>(p);
+        header = reinterpret_cast<ShmRingHeader *>(memory);
+        header->version = SHM_RING_VERSION;
+        header->type = T::wireType;
+        header->slotSize = slotSize;
+        header->capacity = capacity;
+        header->futexWord.store(0, memory_order_relaxed);
+        header->waiters.store(0, memory_order_relaxed);
+        header->writeSequence.store(0, memory_order_relaxed);
+        header->magic.store(SHM_RING_MAGIC, memory_order_release);
+        return true;
+    }
+
+    void close() {
+        if (memory) {
+            munmap(memory, size);
+            shm_unlink(name.c_str());
+            memory = nullptr;
+            header = nullptr;
+        }
+    }
+
+    bool isOpen() {
+        return memory != nullptr;
+    }
+
+    /**
+     * Append a value and wake blocked readers, if there are any. Never waits on readers.
+     */
+    void publish(T &value) {
+        if (!memory) {
+            return;
+        }
+        encoded.clear();
+        BinaryWriter writer(encoded);
+        value.toBinary(writer);
+        if (encoded.size() > slotSize) {
+            return;
+        }
+
+        uint64_t sequence = header->writeSequence.load(memory_order_relaxed);
+        char *slot = slotAt(sequence);
+        auto *slotSequence = reinterpret_cast<atomic<uint64_t> *>(slot);
+        slotSequence->store(2 * sequence + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        uint32_t length = static_cast<uint32_t>(encoded.size());
+        memcpy(slot + 8, &length, sizeof(length));
+        memcpy(slot + SHM_RING_SLOT_HEADER, encoded.data(), length);
+        slotSequence->store(2 * sequence + 2, memory_order_release);
+        header->writeSequence.store(sequence + 1, memory_order_release);
+
+        // sequentially consistent against the waiter count: either this sees a reader that is about to block, or
+        // that reader's FUTEX_WAIT sees the new futexWord and returns right away
+        header->futexWord.fetch_add(1, memory_order_seq_cst);
+        if (header->waiters.load(memory_order_seq_cst) == 0) {
+            return;
+        }
+        wakeups++;
+#ifdef __linux__
+        syscall(SYS_futex, &header->futexWord, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif
+    }
+
+    uint64_t getSequence() {
+        return header ? header->writeSequence.load(memory_order_relaxed) : 0;
+    }
+
+    /**
+     * Number of publish() calls that found a blocked reader and made the FUTEX_WAKE system call.
+     */
+    long long getWakeups() {
+        return wakeups;
+    }
+
+private:
+    char *slotAt(uint64_t sequence) {
+        return memory + sizeof(ShmRingHeader) + (SHM_RING_SLOT_HEADER + slotSize) * (sequence % capacity);
+    }
+};
+
+/**
+ * Maps a ring created by ShmRingWriter and hands out every value in order, counting the ones that were overwritten
+ * before this reader got to them. The only thing a reader writes is the waiter count in the header; a process that
+ * may not write the ring maps it read only and polls in wait() instead.
+ */
+template<class T>
+class ShmRingReader {
+private:
+    const string name;
+    size_t size = 0;
+    const char *memory = nullptr;
+    ShmRingHeader *header = nullptr;
+    bool canBlock = false;          // mapped writable, so wait() can register as a waiter and sleep on the futex
+    uint64_t nextSequence = 0;      // sequence number of the next value to hand out
+    long long received = 0;
+    long long dropped = 0;
+    string slotCopy;
+
+public:
+    explicit ShmRingReader(string name) : name(std::move(name)) {
+    }
+
+    ~ShmRingReader() {
+        close();
+    }
+
+    /**
+     * Map the ring. Fails if it does not exist yet or holds a different type. Reading starts at the newest value.
+     */
+    bool open() {
+        canBlock = true;
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0 && errno == EACCES) {
+            canBlock = false;
+            fd = shm_open(name.c_str(), O_RDONLY, 0);
+        }
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st{};
+        if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < sizeof(ShmRingHeader)) {
+            ::close(fd);
+            return false;
+        }
+        void *p = mmap(nullptr, static_cast<size_t>(st.st_size), canBlock ? PROT_READ | PROT_WRITE : PROT_READ,
+                       MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+        memory = static_cast<const char *>(p);
+        size = static_cast<size_t>(st.st_size);
+        header = reinterpret_cast<ShmRingHeader *>(const_cast<char *>(memory));
+        if (header->magic.load(memory_order_acquire) != SHM_RING_MAGIC || header->version != SHM_RING_VERSION ||
+            header->type != T::wireType || header->capacity == 0 ||
+            shmRingSize(header->slotSize, header->capacity) > size) {
+            cerr << "Incompatible shared memory ring " << name << endl;
+            close();
+            return false;
+        }
+        uint64_t written = header->writeSequence.load(memory_order_acquire);
+        nextSequence = written > 0 ? written - 1 : 0;
+        return true;
+    }
+
+    void close() {
+        if (memory) {
+            munmap(const_cast<char *>(memory), size);
+            memory = nullptr;
+            header = nullptr;
+        }
+    }
+
+    bool isOpen() {
+        return memory != nullptr;
+    }
+
+    /**
+     * Copy out the next value in sequence. Returns false if there is no new value yet.
+     */
+    bool read(T &value) {
+        if (!memory) {
+            return false;
+        }
+        for (;;) {
+            uint64_t written = header->writeSequence.load(memory_order_acquire);
+            if (nextSequence >= written) {
+                return false;
+            }
+            if (written - nextSequence > header->capacity) {
+                // lapped by the writer
+                dropped += written - header->capacity - nextSequence;
+                nextSequence = written - header->capacity;
+            }
+            if (copySlot(nextSequence, value)) {
+                nextSequence++;
+                received++;
+                return true;
+            }
+            // overwritten while copying, skip it
+            dropped++;
+            nextSequence++;
+        }
+    }
+
+    /**
+     * Skip to the newest value. Returns false if nothing was published yet.
+     */
+    bool readLatest(T &value) {
+        if (!memory) {
+            return false;
+        }
+        uint64_t written = header->writeSequence.load(memory_order_acquire);
+        if (written > nextSequence + 1) {
+            dropped += written - 1 - nextSequence;
+            nextSequence = written - 1;
+        }
+        return read(value);
+    }
+
+    /**
+     * Block until the writer publishes past what this reader has seen, or the timeout expires.
+     * Returns true if a value is ready to read.
+     */
+    bool wait(int timeoutMs) {
+        if (!memory) {
+            return false;
+        }
+        if (header->writeSequence.load(memory_order_acquire) > nextSequence) {
+            return true;
+        }
+#ifdef __linux__
+        if (canBlock) {
+            uint32_t futexWord = header->futexWord.load(memory_order_acquire);
+            header->waiters.fetch_add(1, memory_order_seq_cst);
+            if (header->writeSequence.load(memory_order_seq_cst) <= nextSequence) {
+                timespec timeout{};
+                timeout.tv_sec = timeoutMs / 1000;
+                timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+                syscall(SYS_futex, &header->futexWord, FUTEX_WAIT, futexWord, timeoutMs < 0 ? nullptr : &timeout,
+                        nullptr, 0);
+            }
+            header->waiters.fetch_sub(1, memory_order_relaxed);
+            return header->writeSequence.load(memory_order_acquire) > nextSequence;
+        }
+#endif
+        // nobody wakes this reader, check again every SHM_RING_POLL_MS
+        for (int waited = 0; timeoutMs < 0 || waited < timeoutMs; waited += SHM_RING_POLL_MS) {
+            usleep(1000 * SHM_RING_POLL_MS);
+            if (header->writeSequence.load(memory_order_acquire) > nextSequence) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Sequence number of the next value read() will return.
+     */
+    uint64_t getSequence() {
+        return nextSequence;
+    }
+
+    long long getReceived() {
+        return received;
+    }
+
+    /**
+     * Values that were overwritten before this reader got to them.
+     */
+    long long getDropped() {
+        return dropped;
+    }
+
+private:
+    bool copySlot(uint64_t sequence, T &value) {
+        const char *slot = memory + sizeof(ShmRingHeader) +
+                           (SHM_RING_SLOT_HEADER + header->slotSize) * (sequence % header->capacity);
+        auto *slotSequence = reinterpret_cast<const atomic<uint64_t> *>(slot);
+        uint64_t before = slotSequence->load(memory_order_acquire);
+        if (before != 2 * sequence + 2) {
+            return false;
+        }
+        uint32_t length;
+        memcpy(&length, slot + 8, sizeof(length));
+        if (length > header->slotSize) {
+            return false;
+        }
+        slotCopy.resize(length);
+        memcpy(&slotCopy[0], slot + SHM_RING_SLOT_HEADER, length);
+        atomic_thread_fence(memory_order_acquire);
+        if (slotSequence->load(memory_order_relaxed) != before) {
+            return false;
+        }
+        BinaryReader reader(slotCopy.data(), slotCopy.size());
+        value.fromBinary(reader);
+        return reader.ok();
+    }
+};
+
+#endif // CORE_SHMRING_HPP
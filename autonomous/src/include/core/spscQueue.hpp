@@ -0,0 +1,73 @@
+#ifndef CORE_SPSCQUEUE_HPP
+#define CORE_SPSCQUEUE_HPP
+
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Bounded single producer, single consumer queue. push() and pop() never block, never allocate and never make a
+ * system call, so a real-time thread can hand values to a slower thread: when the consumer falls behind, push()
+ * fails and the producer carries on.
+ *
+ * The capacity is rounded up to a power of two. T is copied in and out, so it should be a plain value type.
+ */
+template<class T>
+class SpscQueue {
+private:
+    vector<T> slots;
+    const size_t mask;
+    atomic<size_t> tail;                // next slot to write, only written by the producer
+    char padding[64];                   // keep the producer's and the consumer's index on separate cache lines
+    atomic<size_t> head;                // next slot to read, only written by the consumer
+
+    static size_t roundUp(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        return size;
+    }
+
+public:
+    explicit SpscQueue(size_t capacity) : slots(roundUp(capacity)), mask(slots.size() - 1), tail(0), head(0) {
+    }
+
+    /**
+     * Producer side. Returns false if the queue is full.
+     */
+    bool push(const T &value) {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t - head.load(memory_order_acquire) == slots.size()) {
+            return false;
+        }
+        slots[t & mask] = value;
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+
+    /**
+     * Consumer side. Returns false if the queue is empty.
+     */
+    bool pop(T &value) {
+        size_t h = head.load(memory_order_relaxed);
+        if (h == tail.load(memory_order_acquire)) {
+            return false;
+        }
+        value = slots[h & mask];
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+
+    size_t size() const {
+        return tail.load(memory_order_acquire) - head.load(memory_order_acquire);
+    }
+
+    size_t capacity() const {
+        return slots.size();
+    }
+};
+
+#endif // CORE_SPSCQUEUE_HPP
@@ -0,0 +1,201 @@
+#ifndef CORE_STATSSERVER_HPP
+#define CORE_STATSSERVER_HPP
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <boost/asio.hpp>
+
+using namespace std;
+using boost::asio::ip::tcp;
+
+#define STATS_REQUEST_LIMIT         8192            // bytes of request line and headers read at most
+
+/**
+ * Writes the body of the page at a path into the buffer.
+ */
+typedef function<void(string &)> StatsHandler;
+
+class StatsServer;
+
+/**
+ * One request: read the request line (and the headers, for HTTP/1.x), write the page and close.
+ */
+class StatsSession : public enable_shared_from_this<StatsSession> {
+private:
+    StatsServer &server;
+    tcp::socket socket;
+    boost::asio::streambuf request;
+    string response;
+
+public:
+    StatsSession(StatsServer &server, tcp::socket socket)
+        : server(server), socket(std::move(socket)), request(STATS_REQUEST_LIMIT) {
+    }
+
+    void start() {
+        auto self = shared_from_this();
+        boost::asio::async_read_until(socket, request, &StatsSession::requestComplete,
+                                      [self](const boost::system::error_code &ec, size_t) {
+                                          self->onRequest(ec);
+                                      });
+    }
+
+private:
+    typedef boost::asio::buffers_iterator<boost::asio::streambuf::const_buffers_type> iterator;
+
+    /**
+     * A request is complete after its first line if that has no version, otherwise after the empty line that ends
+     * the headers. Reading the headers as well means closing does not reset the connection under the client.
+     */
+    static pair<iterator, bool> requestComplete(iterator begin, iterator end) {
+        iterator lineEnd = find(begin, end, '\n');
+        if (lineEnd == end) {
+            return make_pair(begin, false);
+        }
+        if (string(begin, lineEnd).find(" HTTP/") == string::npos) {
+            return make_pair(lineEnd + 1, true);
+        }
+        while (lineEnd != end) {
+            iterator next = find(lineEnd + 1, end, '\n');
+            if (next == end) {
+                break;
+            }
+            if (next - lineEnd == 1 || (next - lineEnd == 2 && *(lineEnd + 1) == '\r')) {
+                return make_pair(next + 1, true);
+            }
+            lineEnd = next;
+        }
+        return make_pair(begin, false);
+    }
+
+    void onRequest(const boost::system::error_code &ec);
+
+    void respond(const string &requestLine);
+
+    void close() {
+        boost::system::error_code ec;
+        socket.shutdown(tcp::socket::shutdown_both, ec);
+        socket.close(ec);
+    }
+};
+
+/**
+ * Minimal HTTP server for diagnostics, e.g. `curl localhost:5003/latency`. Pages are registered by path and
+ * rendered on the io_context thread for every request, so a handler must only read state that is safe to read from
+ * another thread (atomics, seqlocks). Unknown paths get a 404 listing the known ones.
+ *
+ * Requests without a version ("GET /latency\n", handy with nc) are answered right away; HTTP/1.x requests after
+ * their headers. Every response closes the connection.
+ */
+class StatsServer {
+private:
+    struct Page {
+        string contentType;
+        StatsHandler handler;
+    };
+
+    const unsigned short port;
+    map<string, Page> pages;
+    boost::asio::io_context *io = nullptr;
+    unique_ptr<tcp::acceptor> acceptor;
+    bool isShutdown = false;
+
+public:
+    explicit StatsServer(const unsigned short &port) : port(port) {
+    }
+
+    /**
+     * Serve the output of handler at path. Call before start().
+     */
+    void addPage(const string &path, const string &contentType, StatsHandler handler) {
+        pages[path] = Page{contentType, std::move(handler)};
+    }
+
+    void start(boost::asio::io_context &io) {
+        this->io = &io;
+        acceptor.reset(new tcp::acceptor(io, tcp::endpoint(tcp::v4(), port)));
+        accept();
+    }
+
+    void shutdown() {
+        isShutdown = true;
+        if (io) {
+            boost::asio::post(*io, [this]() {
+                boost::system::error_code ec;
+                if (acceptor) {
+                    acceptor->close(ec);
+                }
+            });
+        }
+    }
+
+    /**
+     * Status line, headers and body for a GET of path.
+     */
+    string render(const string &path) {
+        string body;
+        auto page = pages.find(path);
+        if (page == pages.end()) {
+            body = "not found, try:";
+            for (auto &known : pages) {
+                body += " " + known.first;
+            }
+            body += "\n";
+            return header("404 Not Found", "text/plain", body.size()) + body;
+        }
+        page->second.handler(body);
+        return header("200 OK", page->second.contentType, body.size()) + body;
+    }
+
+private:
+    void accept() {
+        acceptor->async_accept([this](const boost::system::error_code &ec, tcp::socket socket) {
+            if (ec) {
+                if (!isShutdown) {
+                    cerr << "Stats accept failed: " << ec.message() << endl;
+                }
+                return;
+            }
+            make_shared<StatsSession>(*this, std::move(socket))->start();
+            accept();
+        });
+    }
+
+    static string header(const string &status, const string &contentType, size_t length) {
+        return "HTTP/1.0 " + status + "\r\nContent-Type: " + contentType + "\r\nContent-Length: " +
+               to_string(length) + "\r\nConnection: close\r\n\r\n";
+    }
+};
+
+inline void StatsSession::onRequest(const boost::system::error_code &ec) {
+    if (ec) {
+        close();
+        return;
+    }
+    string requestLine;
+    istream is(&request);
+    getline(is, requestLine);
+    respond(requestLine);
+}
+
+inline void StatsSession::respond(const string &requestLine) {
+    // "GET /path HTTP/1.1", query strings are ignored
+    string path = "/";
+    size_t start = requestLine.find(' ');
+    if (start != string::npos) {
+        size_t end = requestLine.find_first_of(" ?\r", start + 1);
+        path = requestLine.substr(start + 1, end == string::npos ? string::npos : end - start - 1);
+    }
+    response = server.render(path);
+    auto self = shared_from_this();
+    boost::asio::async_write(socket, boost::asio::buffer(response),
+                             [self](const boost::system::error_code &, size_t) {
+                                 self->close();
+                             });
+}
+
+#endif // CORE_STATSSERVER_HPP
@@ -0,0 +1,151 @@
+#ifndef CORE_STREAMFRAMER_HPP
+#define CORE_STREAMFRAMER_HPP
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <core/wireFormat.hpp>
+
+using namespace std;
+
+#define FRAMER_INITIAL_CAPACITY     4096
+#define FRAMER_MAX_CAPACITY         (WIRE_HEADER_SIZE + WIRE_MAX_PAYLOAD)
+
+/**
+ * A frame inside the framer's buffer. Valid until the next call to StreamFramer::fill().
+ */
+struct FrameView {
+    const char *data = nullptr;
+    size_t length = 0;
+
+    bool empty() const {
+        return length == 0;
+    }
+
+    string toString() const {
+        return string(data, length);
+    }
+};
+
+/**
+ * Splits a byte stream into frames, either terminated by a delimiter or prefixed by a wire format header.
+ *
+ * Bytes are read into one buffer that lives as long as the stream, and frames are handed out as views into it, so
+ * several frames arriving in one read and frames split across reads are both handled without copying.
+ * The buffer only grows if a single frame does not fit.
+ */
+class StreamFramer {
+private:
+    vector<char> buffer;
+    size_t begin = 0;       // start of the first byte not yet handed out
+    size_t end = 0;         // end of the bytes read so far
+    size_t scanned = 0;     // bytes after begin known not to contain the delimiter
+
+public:
+    explicit StreamFramer(size_t capacity = FRAMER_INITIAL_CAPACITY) : buffer(capacity) {
+    }
+
+    /**
+     * Next frame up to (and without) the delimiter. Returns false if no complete frame is buffered.
+     */
+    bool nextDelimited(char delimiter, FrameView &frame) {
+        const char *start = buffer.data() + begin;
+        const void *found = memchr(start + scanned, delimiter, end - begin - scanned);
+        if (!found) {
+            scanned = end - begin;
+            if (end - begin == FRAMER_MAX_CAPACITY) {
+                // no delimiter in sight, hand out the whole buffer rather than stall
+                frame.data = start;
+                frame.length = end - begin;
+                consume(end - begin);
+                return true;
+            }
+            return false;
+        }
+        frame.data = start;
+        frame.length = static_cast<const char *>(found) - start;
+        consume(frame.length + 1);
+        return true;
+    }
+
+    /**
+     * Next frame with a wire format header. Returns 1 and the payload if a complete frame is buffered, 0 if more
+     * bytes are needed and -1 if the stream does not start with a valid header.
+     */
+    int nextLengthPrefixed(WireHeader &header, FrameView &payload) {
+        if (end - begin < WIRE_HEADER_SIZE) {
+            return 0;
+        }
+        const char *start = buffer.data() + begin;
+        if (!header.parse(start)) {
+            return -1;
+        }
+        if (end - begin < WIRE_HEADER_SIZE + header.payloadLength) {
+            reserve(WIRE_HEADER_SIZE + header.payloadLength);
+            return 0;
+        }
+        payload.data = start + WIRE_HEADER_SIZE;
+        payload.length = header.payloadLength;
+        consume(WIRE_HEADER_SIZE + header.payloadLength);
+        return 1;
+    }
+
+    /**
+     * Whatever is left, e.g. an unterminated last frame at end of stream.
+     */
+    FrameView takeRemaining() {
+        FrameView frame;
+        frame.data = buffer.data() + begin;
+        frame.length = end - begin;
+        consume(end - begin);
+        return frame;
+    }
+
+    size_t buffered() {
+        return end - begin;
+    }
+
+    /**
+     * Read whatever the stream has (at least one byte, blocking) after the buffered bytes.
+     * Invalidates frames handed out before.
+     */
+    template<class SyncReadStream>
+    size_t fill(SyncReadStream &stream, boost::system::error_code &ec) {
+        if (begin == end) {
+            begin = end = scanned = 0;
+        } else if (end == buffer.size() || begin > buffer.size() / 2) {
+            // move the partial frame to the front, or grow if it already fills the buffer
+            if (begin > 0) {
+                memmove(buffer.data(), buffer.data() + begin, end - begin);
+                end -= begin;
+                begin = 0;
+            } else {
+                reserve(buffer.size() * 2);
+            }
+        }
+        size_t length = stream.read_some(boost::asio::buffer(buffer.data() + end, buffer.size() - end), ec);
+        end += length;
+        return length;
+    }
+
+private:
+    void consume(size_t length) {
+        begin += length;
+        scanned = 0;
+        if (begin == end) {
+            begin = end = 0;
+        }
+    }
+
+    void reserve(size_t capacity) {
+        if (capacity > FRAMER_MAX_CAPACITY) {
+            capacity = FRAMER_MAX_CAPACITY;
+        }
+        if (capacity > buffer.size()) {
+            buffer.resize(capacity);
+        }
+    }
+};
+
+#endif // CORE_STREAMFRAMER_HPP
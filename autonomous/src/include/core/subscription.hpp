@@ -0,0 +1,168 @@
+#ifndef CORE_SUBSCRIPTION_HPP
+#define CORE_SUBSCRIPTION_HPP
+
+#include <stdint.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <core/wireFormat.hpp>
+
+using namespace std;
+
+/**
+ * What a server session does when its client reads slower than frames are due, i.e. a write is still in flight when
+ * the next frame is ready.
+ */
+enum class Backpressure {
+    COALESCE,       // keep only the newest waiting frame and send it once the client catches up
+    DROP_OLDEST,    // queue a few frames, dropping the oldest when the queue is full
+    DISCONNECT      // close the connection once more than one frame is waiting
+};
+
+inline const char *backpressureName(Backpressure backpressure) {
+    switch (backpressure) {
+        case Backpressure::DROP_OLDEST:
+            return "drop-oldest";
+        case Backpressure::DISCONNECT:
+            return "disconnect";
+        default:
+            return "coalesce";
+    }
+}
+
+/**
+ * What a client asks for in the connect handshake. The request is a frequency followed by optional tokens in any
+ * order, for example "10", "10 binary" or "100 json latest fields=thetaCompFilter decimate=4":
+ * - json / binary: encoding of the frames
+ * - history / latest: all k values of the task, or only the most recent one
+ * - fields=a,b,...: only these fields of each value (names as in the json output); the timestamp is always sent
+ * - decimate=N: send a frame only once N new samples have been produced since the last one
+ * - backpressure=coalesce|drop-oldest|disconnect: what to do when the client falls behind (see Backpressure)
+ *
+ * Unknown tokens and field names are reported and ignored, so a newer client still gets data from an older server.
+ */
+struct Subscription {
+    int frequency = 0;                      // in Hz, <= 0 for a single frame
+    WireFormat format = WireFormat::JSON;
+    uint32_t fields = WIRE_ALL_FIELDS;      // bit i selects fieldNames[i] of the value type
+    bool latestOnly = false;
+    int decimation = 1;
+    Backpressure backpressure = Backpressure::COALESCE;
+
+    Subscription() = default;
+
+    explicit Subscription(int frequency, WireFormat format = WireFormat::JSON)
+        : frequency(frequency), format(format) {
+    }
+
+    /**
+     * Parse a request line. fieldNames are the selectable fields of the value type, in bit order.
+     */
+    void parse(const string &request, const vector<string> &fieldNames) {
+        stringstream ss(request);
+        string token;
+        if (!(ss >> token)) {
+            cerr << "Empty request. using frequency 0 instead..." << endl;
+            frequency = 0;
+            return;
+        }
+        try {
+            frequency = stoi(token);
+        } catch (exception &e) {
+            cerr << "Invalid frequency " << token << ". using 0 instead..." << endl;
+            frequency = 0;
+        }
+        while (ss >> token) {
+            if (token == wireFormatName(WireFormat::JSON)) {
+                format = WireFormat::JSON;
+            } else if (token == wireFormatName(WireFormat::BINARY)) {
+                format = WireFormat::BINARY;
+            } else if (token == "latest") {
+                latestOnly = true;
+            } else if (token == "history") {
+                latestOnly = false;
+            } else if (token.compare(0, 7, "fields=") == 0) {
+                fields = parseFields(token.substr(7), fieldNames);
+            } else if (token.compare(0, 9, "decimate=") == 0) {
+                try {
+                    decimation = stoi(token.substr(9));
+                } catch (exception &e) {
+                    decimation = 1;
+                }
+                if (decimation < 1) {
+                    cerr << "Invalid decimation " << token.substr(9) << ". using 1 instead..." << endl;
+                    decimation = 1;
+                }
+            } else if (token.compare(0, 13, "backpressure=") == 0) {
+                backpressure = parseBackpressure(token.substr(13));
+            } else {
+                cerr << "Ignoring unknown request option " << token << endl;
+            }
+        }
+    }
+
+    /**
+     * The request line for this subscription, without the delimiter. Only options that differ from the defaults are
+     * written, so a plain subscription is understood by servers that predate them.
+     */
+    string toRequest(const vector<string> &fieldNames = vector<string>()) const {
+        string request = to_string(frequency);
+        if (format != WireFormat::JSON) {
+            request += string(" ") + wireFormatName(format);
+        }
+        if (latestOnly) {
+            request += " latest";
+        }
+        if (fields != WIRE_ALL_FIELDS) {
+            string names;
+            for (size_t i = 0; i < fieldNames.size() && i < 32; ++i) {
+                if (fields & (1u << i)) {
+                    names += (names.empty() ? "" : ",") + fieldNames[i];
+                }
+            }
+            request += " fields=" + names;
+        }
+        if (decimation > 1) {
+            request += " decimate=" + to_string(decimation);
+        }
+        if (backpressure != Backpressure::COALESCE) {
+            request += string(" backpressure=") + backpressureName(backpressure);
+        }
+        return request;
+    }
+
+private:
+    static Backpressure parseBackpressure(const string &name) {
+        for (Backpressure backpressure : {Backpressure::DROP_OLDEST, Backpressure::DISCONNECT}) {
+            if (name == backpressureName(backpressure)) {
+                return backpressure;
+            }
+        }
+        if (name == backpressureName(Backpressure::COALESCE)) {
+            return Backpressure::COALESCE;
+        }
+        cerr << "Unknown backpressure policy " << name << ". using coalesce instead..." << endl;
+        return Backpressure::COALESCE;
+    }
+
+    static uint32_t parseFields(const string &list, const vector<string> &fieldNames) {
+        uint32_t mask = 0;
+        stringstream ss(list);
+        string name;
+        while (getline(ss, name, ',')) {
+            size_t i = 0;
+            while (i < fieldNames.size() && fieldNames[i] != name) {
+                ++i;
+            }
+            if (i < fieldNames.size() && i < 32) {
+                mask |= 1u << i;
+            } else if (!name.empty()) {
+                cerr << "Ignoring unknown field " << name << endl;
+            }
+        }
+        return mask;
+    }
+};
+
+#endif // CORE_SUBSCRIPTION_HPP
@@ -0,0 +1,299 @@
+#ifndef CORE_UDPTELEMETRY_HPP
+#define CORE_UDPTELEMETRY_HPP
+
+#include <stdint.h>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <core/deviceTask.hpp>
+#include <core/wireFormat.hpp>
+
+using namespace std;
+using boost::asio::ip::udp;
+
+#define DATAGRAM_MAGIC_0            'Q'
+#define DATAGRAM_MAGIC_1            'U'
+#define DATAGRAM_VERSION            1
+#define DATAGRAM_HEADER_SIZE        16          // magic (2), version (1), type (1), sequence (8), sample count (4)
+#define DATAGRAM_MAX_SIZE           1400        // stay below a typical Wi-Fi/Ethernet MTU to avoid fragmentation
+
+/**
+ * Datagram header: every datagram carries its own sequence number so receivers can measure loss and reordering,
+ * followed by count values in the binary wire format.
+ */
+struct DatagramHeader {
+    uint8_t version = DATAGRAM_VERSION;
+    uint8_t type = WIRE_TYPE_UNKNOWN;
+    uint64_t sequence = 0;
+    uint32_t count = 0;
+
+    bool parse(BinaryReader &reader) {
+        if (reader.getU8() != DATAGRAM_MAGIC_0 || reader.getU8() != DATAGRAM_MAGIC_1) {
+            return false;
+        }
+        version = reader.getU8();
+        type = reader.getU8();
+        sequence = static_cast<uint64_t>(reader.getI64());
+        count = reader.getU32();
+        return reader.ok() && version == DATAGRAM_VERSION;
+    }
+};
+
+/**
+ * Loss, reordering and duplicates seen by a receiver, from datagram sequence numbers.
+ */
+struct UdpStats {
+    long long datagrams = 0;
+    long long samples = 0;
+    long long lost = 0;             // sequence numbers never received (so far), see SequenceTracker
+    long long reordered = 0;        // arrived after a later sequence number
+    long long duplicates = 0;
+    long long invalid = 0;          // not a datagram of the expected type
+
+    string toString() const {
+        stringstream ss;
+        ss << "datagrams=" << datagrams << " samples=" << samples << " lost=" << lost
+           << " reordered=" << reordered << " duplicates=" << duplicates << " invalid=" << invalid;
+        return ss.str();
+    }
+};
+
+/**
+ * Tracks which of the last 64 sequence numbers arrived, so that late datagrams are counted as reordered (and no
+ * longer as lost) and repeats as duplicates. A datagram 64 or more sequence numbers behind the highest one cannot be
+ * told apart from a duplicate: it is counted as reordered and stays counted as lost.
+ */
+class SequenceTracker {
+private:
+    bool started = false;
+    uint64_t first = 0;             // gaps are only counted as lost after this one
+    uint64_t highest = 0;
+    uint64_t window = 0;            // bit i set: highest - i was received
+
+public:
+    void receive(uint64_t sequence, UdpStats &stats) {
+        stats.datagrams++;
+        if (!started) {
+            started = true;
+            first = sequence;
+            highest = sequence;
+            window = 1;
+            return;
+        }
+        if (sequence > highest) {
+            uint64_t gap = sequence - highest;
+            stats.lost += gap - 1;
+            window = gap >= 64 ? 0 : window << gap;
+            window |= 1;
+            highest = sequence;
+            return;
+        }
+        uint64_t age = highest - sequence;
+        if (age >= 64) {
+            // too old to tell apart from a duplicate, so it is not taken off lost either
+            stats.reordered++;
+            return;
+        }
+        uint64_t bit = 1ULL << age;
+        if (window & bit) {
+            stats.duplicates++;
+        } else {
+            window |= bit;
+            stats.reordered++;
+            if (sequence > first) {
+                stats.lost--;
+            }
+        }
+    }
+};
+
+/**
+ * Start a datagram; the sample count is patched in by endDatagram().
+ */
+inline void beginDatagram(BinaryWriter &writer, uint8_t type, uint64_t sequence) {
+    writer.putU8(DATAGRAM_MAGIC_0);
+    writer.putU8(DATAGRAM_MAGIC_1);
+    writer.putU8(DATAGRAM_VERSION);
+    writer.putU8(type);
+    writer.putI64(static_cast<int64_t>(sequence));
+    writer.putU32(0);
+}
+
+inline void endDatagram(BinaryWriter &writer, uint32_t count) {
+    writer.patchU32(DATAGRAM_HEADER_SIZE - 4, count);
+}
+
+/**
+ * Decode a datagram of T values. Returns false if it is not a valid datagram of this type.
+ */
+template<class T>
+bool decodeDatagram(const char *data, size_t length, DatagramHeader &header, vector<T> &values) {
+    BinaryReader reader(data, length);
+    if (!header.parse(reader) || header.type != T::wireType) {
+        return false;
+    }
+    values.clear();
+    for (uint32_t i = 0; i < header.count && reader.ok(); ++i) {
+        values.emplace_back();
+        values.back().fromBinary(reader);
+    }
+    return reader.ok() && values.size() == header.count;
+}
+
+/**
+ * Publishes the samples of a DeviceTask as sequence numbered UDP datagrams, to a unicast or multicast address.
+ * At every tick the newest sample is queued if it changed since the last tick, and up to batchSize samples are
+ * packed into one datagram; a tick without a new sample sends a partial batch, so no sample waits longer than one
+ * period after the task stops publishing. A slow or lossy link only loses datagrams, it never holds up the task or other
+ * receivers: a datagram that does not fit in the socket buffer is dropped.
+ */
+template<class T>
+class UdpPublisher {
+private:
+    DeviceTask<T> &sensorTask;
+    const string address;
+    const unsigned short port;
+    const int frequency;            // in Hz, how often to check for new samples
+    const int batchSize;
+
+    unique_ptr<udp::socket> socket;
+    unique_ptr<boost::asio::steady_timer> timer;
+    udp::endpoint destination;
+    boost::asio::io_context *io = nullptr;
+    boost::asio::steady_timer::duration period{};
+    boost::asio::steady_timer::time_point deadline;
+
+    unsigned int lastVersion = 0;
+    uint64_t sequence = 0;
+    uint32_t pending = 0;           // samples in the datagram being built
+    string datagram;
+    long long sent = 0;
+    long long dropped = 0;
+
+public:
+    UdpPublisher(DeviceTask<T> &deviceTask, string address, const unsigned short &port, int frequency,
+                 int batchSize = 1)
+        : sensorTask(deviceTask), address(std::move(address)), port(port), frequency(frequency),
+          batchSize(batchSize < 1 ? 1 : batchSize) {
+        datagram.reserve(DATAGRAM_MAX_SIZE);
+    }
+
+    /**
+     * Start publishing on the io_context without blocking. Returns false if the address is not usable.
+     */
+    bool start(boost::asio::io_context &io) {
+        this->io = &io;
+        try {
+            boost::asio::ip::address ip = boost::asio::ip::make_address(address);
+            destination = udp::endpoint(ip, port);
+            socket.reset(new udp::socket(io, ip.is_v6() ? udp::v6() : udp::v4()));
+            if (ip.is_multicast()) {
+                socket->set_option(boost::asio::ip::multicast::hops(1));
+                socket->set_option(boost::asio::ip::multicast::enable_loopback(true));
+            }
+            socket->non_blocking(true);
+        } catch (exception &e) {
+            cerr << "Failed to publish to " << address << ":" << port << ": " << e.what() << endl;
+            return false;
+        }
+        timer.reset(new boost::asio::steady_timer(io));
+        period = chrono::duration_cast<boost::asio::steady_timer::duration>(
+            chrono::nanoseconds(1000000000LL / (frequency > 0 ? frequency : 1)));
+        deadline = boost::asio::steady_timer::clock_type::now();
+        cout << "Publishing to " << address << ":" << port << "..." << endl;
+        onTick(boost::system::error_code());
+        return true;
+    }
+
+    void shutdown() {
+        if (io) {
+            boost::asio::post(*io, [this]() {
+                boost::system::error_code ec;
+                if (timer) {
+                    timer->cancel(ec);
+                }
+                if (socket) {
+                    socket->close(ec);
+                }
+            });
+        }
+    }
+
+    /**
+     * Datagrams handed to the kernel and datagrams dropped because the socket buffer was full.
+     */
+    long long getSent() {
+        return sent;
+    }
+
+    long long getDropped() {
+        return dropped;
+    }
+
+private:
+    void onTick(const boost::system::error_code &ec) {
+        if (ec || !socket->is_open()) {
+            return;
+        }
+        unsigned int version = sensorTask.getVersion();
+        if (version != lastVersion) {
+            lastVersion = version;
+            T value = sensorTask.getData();
+            add(value);
+        } else if (pending > 0) {
+            flush();
+        }
+
+        auto now = boost::asio::steady_timer::clock_type::now();
+        deadline += period;
+        if (deadline < now) {
+            deadline += ((now - deadline) / period + 1) * period;
+        }
+        timer->expires_at(deadline);
+        timer->async_wait([this](const boost::system::error_code &ec) {
+            onTick(ec);
+        });
+    }
+
+    void add(T &value) {
+        size_t before = datagram.size();
+        BinaryWriter writer(datagram);
+        if (pending == 0) {
+            datagram.clear();
+            beginDatagram(writer, T::wireType, sequence);
+            before = datagram.size();
+        }
+        value.toBinary(writer);
+        if (datagram.size() > DATAGRAM_MAX_SIZE && pending > 0) {
+            // does not fit: send what we have and start over with this sample
+            datagram.resize(before);
+            flush();
+            add(value);
+            return;
+        }
+        pending++;
+        if (pending >= static_cast<uint32_t>(batchSize)) {
+            flush();
+        }
+    }
+
+    void flush() {
+        BinaryWriter writer(datagram);
+        endDatagram(writer, pending);
+        boost::system::error_code ec;
+        socket->send_to(boost::asio::buffer(datagram), destination, 0, ec);
+        if (ec) {
+            dropped++;
+        } else {
+            sent++;
+        }
+        sequence++;
+        pending = 0;
+    }
+};
+
+#endif // CORE_UDPTELEMETRY_HPP
@@ -0,0 +1,259 @@
+#ifndef CORE_WIREFORMAT_HPP
+#define CORE_WIREFORMAT_HPP
+
+#include <stdint.h>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <utils/math.hpp>
+
+using namespace std;
+
+#define WIRE_MAGIC_0                'Q'
+#define WIRE_MAGIC_1                'D'
+#define WIRE_VERSION                1
+#define WIRE_HEADER_SIZE            8           // magic (2), version (1), type (1), payload length (4)
+#define WIRE_MAX_PAYLOAD            (1 << 20)
+
+// value types carried in the header
+#define WIRE_TYPE_UNKNOWN           0
+#define WIRE_TYPE_IMU               1
+#define WIRE_TYPE_GPS               2
+#define WIRE_TYPE_CONTROL           3
+#define WIRE_TYPE_FIELDS_FLAG       0x80        // or'ed into the type when only some fields are sent
+
+#define WIRE_ALL_FIELDS             0xffffffffu // field mask selecting every field of a value
+
+/**
+ * Encoding a client can ask for in the connect handshake.
+ */
+enum class WireFormat {
+    JSON,
+    BINARY
+};
+
+inline const char *wireFormatName(WireFormat format) {
+    return format == WireFormat::BINARY ? "binary" : "json";
+}
+
+inline const char *wireTypeName(uint8_t type) {
+    switch (type & ~WIRE_TYPE_FIELDS_FLAG) {
+        case WIRE_TYPE_IMU:
+            return "imu";
+        case WIRE_TYPE_GPS:
+            return "gps";
+        case WIRE_TYPE_CONTROL:
+            return "control";
+        default:
+            return "unknown";
+    }
+}
+
+/**
+ * Appends fixed size little endian fields to a buffer. Doubles are sent as their IEEE 754 bit pattern.
+ */
+class BinaryWriter {
+private:
+    string &buffer;
+
+public:
+    explicit BinaryWriter(string &buffer) : buffer(buffer) {
+    }
+
+    void putU8(uint8_t value) {
+        buffer.push_back(static_cast<char>(value));
+    }
+
+    void putU16(uint16_t value) {
+        putLittleEndian(value, 2);
+    }
+
+    void putU32(uint32_t value) {
+        putLittleEndian(value, 4);
+    }
+
+    void putI32(int32_t value) {
+        putLittleEndian(static_cast<uint32_t>(value), 4);
+    }
+
+    void putI64(int64_t value) {
+        putLittleEndian(static_cast<uint64_t>(value), 8);
+    }
+
+    void putF64(double value) {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        putLittleEndian(bits, 8);
+    }
+
+    void putVector3(const Vector3 &vec) {
+        putF64(vec.x());
+        putF64(vec.y());
+        putF64(vec.z());
+    }
+
+    void putQuaternion(const Quaternion &quat) {
+        putF64(quat.scalar());
+        putF64(quat.x());
+        putF64(quat.y());
+        putF64(quat.z());
+    }
+
+    size_t size() {
+        return buffer.size();
+    }
+
+    /**
+     * Overwrite a 32 bit field written earlier, e.g. a length that is only known at the end.
+     */
+    void patchU32(size_t offset, uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            buffer[offset + i] = static_cast<char>((value >> (8 * i)) & 0xff);
+        }
+    }
+
+private:
+    void putLittleEndian(uint64_t value, int bytes) {
+        char data[8];
+        for (int i = 0; i < bytes; ++i) {
+            data[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+        }
+        buffer.append(data, static_cast<size_t>(bytes));
+    }
+};
+
+/**
+ * Reads fields written by BinaryWriter. Reading past the end marks the reader as failed and yields zeros.
+ */
+class BinaryReader {
+private:
+    const unsigned char *data;
+    size_t length;
+    size_t position = 0;
+    bool failed = false;
+
+public:
+    BinaryReader(const char *data, size_t length)
+        : data(reinterpret_cast<const unsigned char *>(data)), length(length) {
+    }
+
+    bool ok() {
+        return !failed;
+    }
+
+    size_t remaining() {
+        return length - position;
+    }
+
+    uint8_t getU8() {
+        return static_cast<uint8_t>(getLittleEndian(1));
+    }
+
+    uint32_t getU32() {
+        return static_cast<uint32_t>(getLittleEndian(4));
+    }
+
+    int32_t getI32() {
+        return static_cast<int32_t>(getLittleEndian(4));
+    }
+
+    int64_t getI64() {
+        return static_cast<int64_t>(getLittleEndian(8));
+    }
+
+    double getF64() {
+        uint64_t bits = getLittleEndian(8);
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    Vector3 getVector3() {
+        double x = getF64();
+        double y = getF64();
+        double z = getF64();
+        return Vector3(x, y, z);
+    }
+
+    Quaternion getQuaternion() {
+        double scalar = getF64();
+        double x = getF64();
+        double y = getF64();
+        double z = getF64();
+        return Quaternion(scalar, x, y, z);
+    }
+
+private:
+    uint64_t getLittleEndian(int bytes) {
+        if (failed || remaining() < static_cast<size_t>(bytes)) {
+            failed = true;
+            return 0;
+        }
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; ++i) {
+            value |= static_cast<uint64_t>(data[position + i]) << (8 * i);
+        }
+        position += bytes;
+        return value;
+    }
+};
+
+/**
+ * Frame header: magic "QD", format version, value type and the length of the payload that follows.
+ */
+struct WireHeader {
+    uint8_t version = WIRE_VERSION;
+    uint8_t type = WIRE_TYPE_UNKNOWN;
+    uint32_t payloadLength = 0;
+
+    /**
+     * Parse the first WIRE_HEADER_SIZE bytes of a frame. Returns false if this is not a frame we understand.
+     */
+    bool parse(const char *data) {
+        BinaryReader reader(data, WIRE_HEADER_SIZE);
+        if (reader.getU8() != WIRE_MAGIC_0 || reader.getU8() != WIRE_MAGIC_1) {
+            return false;
+        }
+        version = reader.getU8();
+        type = reader.getU8();
+        payloadLength = reader.getU32();
+        return version == WIRE_VERSION && payloadLength <= WIRE_MAX_PAYLOAD;
+    }
+};
+
+/**
+ * Start a frame; returns the offset of the length field to patch with endFrame().
+ */
+inline size_t beginFrame(BinaryWriter &writer, uint8_t type) {
+    writer.putU8(WIRE_MAGIC_0);
+    writer.putU8(WIRE_MAGIC_1);
+    writer.putU8(WIRE_VERSION);
+    writer.putU8(type);
+    size_t lengthOffset = writer.size();
+    writer.putU32(0);
+    return lengthOffset;
+}
+
+inline void endFrame(BinaryWriter &writer, size_t lengthOffset) {
+    writer.patchU32(lengthOffset, static_cast<uint32_t>(writer.size() - lengthOffset - 4));
+}
+
+/**
+ * Decode the payload of a DeviceData frame: the index of the most recent value, the number of values, the field
+ * mask if the type has WIRE_TYPE_FIELDS_FLAG set, and the values. Fields that were not sent keep their defaults.
+ */
+template<class T>
+bool decodeDeviceData(uint8_t type, const char *payload, size_t length, int &currentIndex, vector<T> &values) {
+    BinaryReader reader(payload, length);
+    currentIndex = reader.getI32();
+    uint32_t count = reader.getU32();
+    uint32_t fields = (type & WIRE_TYPE_FIELDS_FLAG) ? reader.getU32() : WIRE_ALL_FIELDS;
+    values.clear();
+    for (uint32_t i = 0; i < count && reader.ok(); ++i) {
+        values.emplace_back();
+        values.back().fromBinary(reader, fields);
+    }
+    return reader.ok() && values.size() == count;
+}
+
+#endif // CORE_WIREFORMAT_HPP
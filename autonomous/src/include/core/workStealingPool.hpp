@@ -0,0 +1,172 @@
+#ifndef CORE_WORKSTEALINGPOOL_HPP
+#define CORE_WORKSTEALINGPOOL_HPP
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <boost/thread.hpp>
+
+using namespace std;
+
+/**
+ * Fixed set of worker threads for batches of independent jobs of uneven length, e.g. simulated flights.
+ *
+ * Every worker has its own deque. Jobs submitted from outside are dealt round robin; a job submitted from a worker
+ * goes to that worker's deque. A worker takes its newest job first and, once its deque is empty, steals the oldest
+ * job of another worker, so the load evens out without a shared queue every worker contends on.
+ */
+class WorkStealingPool {
+private:
+    struct Worker {
+        boost::mutex mtx;
+        deque<function<void()>> jobs;
+    };
+
+    vector<unique_ptr<Worker>> workers;
+    vector<boost::thread> threads;
+
+    boost::mutex mtx;                       // guards the waits below
+    boost::condition_variable jobsQueued;
+    boost::condition_variable allDone;
+    atomic<long long> queued;               // jobs in the deques
+    atomic<long long> pending;              // jobs submitted and not finished
+    atomic<long long> steals;
+    atomic<unsigned long> nextWorker;
+    bool isShutdown = false;
+
+    static WorkStealingPool *&currentPool() {
+        static thread_local WorkStealingPool *pool = nullptr;
+        return pool;
+    }
+
+    static size_t &currentWorker() {
+        static thread_local size_t index = 0;
+        return index;
+    }
+
+public:
+    /**
+     * Start threadCount workers, one per core by default.
+     */
+    explicit WorkStealingPool(unsigned int threadCount = 0) : queued(0), pending(0), steals(0), nextWorker(0) {
+        if (threadCount == 0) {
+            threadCount = max(1u, boost::thread::hardware_concurrency());
+        }
+        for (unsigned int i = 0; i < threadCount; ++i) {
+            workers.emplace_back(new Worker());
+        }
+        for (unsigned int i = 0; i < threadCount; ++i) {
+            threads.emplace_back(boost::bind(&WorkStealingPool::work, this, i));
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            boost::lock_guard<boost::mutex> lk(mtx);
+            isShutdown = true;
+        }
+        jobsQueued.notify_all();
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+
+    void submit(function<void()> job) {
+        size_t index = currentPool() == this ? currentWorker() : nextWorker++ % workers.size();
+        pending++;
+        {
+            // counted first, so a worker that takes the job never sees the count go negative
+            boost::lock_guard<boost::mutex> lk(mtx);
+            queued++;
+        }
+        {
+            boost::lock_guard<boost::mutex> lk(workers[index]->mtx);
+            workers[index]->jobs.push_back(std::move(job));
+        }
+        jobsQueued.notify_one();
+    }
+
+    /**
+     * Block until every submitted job has finished. Do not call from a job.
+     */
+    void wait() {
+        boost::unique_lock<boost::mutex> lk(mtx);
+        while (pending > 0) {
+            allDone.wait(lk);
+        }
+    }
+
+    size_t size() const {
+        return workers.size();
+    }
+
+    /**
+     * Jobs run by another worker than the one they were queued on.
+     */
+    long long getSteals() const {
+        return steals;
+    }
+
+private:
+    void work(size_t index) {
+        currentPool() = this;
+        currentWorker() = index;
+        function<void()> job;
+        while (true) {
+            if (take(index, job) || steal(index, job)) {
+                try {
+                    job();
+                } catch (exception &e) {
+                    cerr << "Job failed: " << e.what() << endl;
+                }
+                job = nullptr;
+                if (--pending == 0) {
+                    boost::lock_guard<boost::mutex> lk(mtx);
+                    allDone.notify_all();
+                }
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lk(mtx);
+            while (queued == 0 && !isShutdown) {
+                jobsQueued.wait(lk);
+            }
+            if (queued == 0 && isShutdown) {
+                return;
+            }
+        }
+    }
+
+    bool take(size_t index, function<void()> &job) {
+        Worker &worker = *workers[index];
+        boost::lock_guard<boost::mutex> lk(worker.mtx);
+        if (worker.jobs.empty()) {
+            return false;
+        }
+        job = std::move(worker.jobs.back());
+        worker.jobs.pop_back();
+        queued--;
+        return true;
+    }
+
+    bool steal(size_t index, function<void()> &job) {
+        for (size_t i = 1; i < workers.size(); ++i) {
+            Worker &victim = *workers[(index + i) % workers.size()];
+            boost::lock_guard<boost::mutex> lk(victim.mtx);
+            if (victim.jobs.empty()) {
+                continue;
+            }
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            queued--;
+            steals++;
+            return true;
+        }
+        return false;
+    }
+};
+
+#endif // CORE_WORKSTEALINGPOOL_HPP
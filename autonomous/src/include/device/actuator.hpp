@@ -0,0 +1,17 @@
+#ifndef DEVICE_ACTUATOR_HPP
+#define DEVICE_ACTUATOR_HPP
+
+/**
+ * Something the control loop drives with a voltage, e.g. a motor ESC on a PWM pin or a simulated motor.
+ */
+class Actuator {
+public:
+    virtual ~Actuator() = default;
+
+    /**
+     * Drive the actuator with value volts; values outside its range are clamped.
+     */
+    virtual void set(double value) = 0;
+};
+
+#endif // DEVICE_ACTUATOR_HPP
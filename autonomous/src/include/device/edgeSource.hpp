@@ -0,0 +1,204 @@
+#ifndef DEVICE_EDGESOURCE_HPP
+#define DEVICE_EDGESOURCE_HPP
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+
+using namespace std;
+
+/**
+ * Something a task can block on until new data is ready, instead of polling the device.
+ */
+class EdgeSource {
+public:
+    virtual ~EdgeSource() = default;
+
+    /**
+     * Block until at least one edge arrives or the timeout (in milliseconds, -1 for none) expires.
+     * Returns the number of edges seen since the last call, 0 on timeout and -1 on error.
+     */
+    virtual int wait(int timeoutMs) = 0;
+
+protected:
+    static int pollReadable(int fd, short events, int timeoutMs) {
+        pollfd pfd{};
+        pfd.fd = fd;
+        pfd.events = events;
+        int result;
+        do {
+            result = poll(&pfd, 1, timeoutMs);
+        } while (result < 0 && errno == EINTR);
+        return result;
+    }
+};
+
+/**
+ * Interrupt line on a GPIO pin through the sysfs interface, e.g. the MPU9250 INT pin which pulses on every new
+ * sample (raw data ready interrupt). The MPU9250 is configured with an active low INT pin, hence a falling edge.
+ */
+class GPIOEdgeSource : public EdgeSource {
+private:
+    const unsigned int pin;
+    int valueFd = -1;
+
+public:
+    explicit GPIOEdgeSource(unsigned int pin, const string &edge = "falling") : pin(pin) {
+        char path[64];
+        writeFile("/sys/class/gpio/export", to_string(pin));
+        sprintf(path, "/sys/class/gpio/gpio%u/direction", pin);
+        writeFile(path, "in");
+        sprintf(path, "/sys/class/gpio/gpio%u/edge", pin);
+        if (!writeFile(path, edge)) {
+            cerr << "Failed to set edge " << edge << " on GPIO " << pin << endl;
+        }
+        sprintf(path, "/sys/class/gpio/gpio%u/value", pin);
+        valueFd = open(path, O_RDONLY | O_NONBLOCK);
+        if (valueFd < 0) {
+            cerr << "Failed to open GPIO " << pin << " value" << endl;
+            return;
+        }
+        clear();
+    }
+
+    ~GPIOEdgeSource() override {
+        if (valueFd >= 0) {
+            close(valueFd);
+        }
+    }
+
+    bool isOpen() {
+        return valueFd >= 0;
+    }
+
+    int wait(int timeoutMs) override {
+        if (valueFd < 0) {
+            return -1;
+        }
+        int result = pollReadable(valueFd, POLLPRI | POLLERR, timeoutMs);
+        if (result <= 0) {
+            return result;
+        }
+        clear();
+        return 1;
+    }
+
+private:
+    void clear() {
+        char value[4];
+        lseek(valueFd, 0, SEEK_SET);
+        ssize_t length = read(valueFd, value, sizeof(value));
+        (void) length;
+    }
+
+    static bool writeFile(const string &path, const string &value) {
+        int fd = open(path.c_str(), O_WRONLY);
+        if (fd < 0) {
+            return false;
+        }
+        ssize_t length = write(fd, value.data(), value.size());
+        close(fd);
+        return length == (ssize_t) value.size();
+    }
+};
+
+#ifdef __linux__
+
+/**
+ * Periodic edges from a timerfd on CLOCK_MONOTONIC, aligned to the sample rate of the device.
+ * Use when the interrupt line is not wired.
+ */
+class TimerEdgeSource : public EdgeSource {
+private:
+    int timerFd;
+
+public:
+    explicit TimerEdgeSource(int frequency) {
+        timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        if (timerFd < 0 || frequency <= 0) {
+            cerr << "Failed to create timer edge source" << endl;
+            return;
+        }
+        long long periodNanos = 1000000000LL / frequency;
+        itimerspec spec{};
+        spec.it_interval.tv_sec = periodNanos / 1000000000LL;
+        spec.it_interval.tv_nsec = periodNanos % 1000000000LL;
+        spec.it_value = spec.it_interval;
+        timerfd_settime(timerFd, 0, &spec, nullptr);
+    }
+
+    ~TimerEdgeSource() override {
+        if (timerFd >= 0) {
+            close(timerFd);
+        }
+    }
+
+    int wait(int timeoutMs) override {
+        if (timerFd < 0) {
+            return -1;
+        }
+        int result = pollReadable(timerFd, POLLIN, timeoutMs);
+        if (result <= 0) {
+            return result;
+        }
+        uint64_t expirations = 0;
+        if (read(timerFd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+            return -1;
+        }
+        return static_cast<int>(expirations);
+    }
+};
+
+/**
+ * Edges raised by software through an eventfd, to drive an event driven task without hardware.
+ */
+class FakeEdgeSource : public EdgeSource {
+private:
+    int eventFd;
+
+public:
+    FakeEdgeSource() : eventFd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
+    }
+
+    ~FakeEdgeSource() override {
+        if (eventFd >= 0) {
+            close(eventFd);
+        }
+    }
+
+    /**
+     * Raise edges, callable from any thread.
+     */
+    void trigger(uint64_t count = 1) {
+        if (write(eventFd, &count, sizeof(count)) != sizeof(count)) {
+            cerr << "Failed to trigger fake edge" << endl;
+        }
+    }
+
+    int wait(int timeoutMs) override {
+        int result = pollReadable(eventFd, POLLIN, timeoutMs);
+        if (result <= 0) {
+            return result;
+        }
+        uint64_t count = 0;
+        if (read(eventFd, &count, sizeof(count)) != sizeof(count)) {
+            return 0;
+        }
+        return static_cast<int>(count);
+    }
+};
+
+#endif
+
+#endif // DEVICE_EDGESOURCE_HPP
@@ -10,34 +10,39 @@
 #include <iostream>
 #include <sys/ioctl.h>
 #include <cstring>
+#include <device/i2cBus.hpp>
 
 #ifdef __linux__
+#include <linux/i2c.h>
 #include <linux/i2c-dev.h>
 #else
 #define I2C_SLAVE	        0x0703	/* Use this slave address - from linux/i2c-dev.h */
 #endif
 
 #define MAX_WRITE_LEN       255
+#define MAX_BATCH_READS     21      // I2C_RDWR takes at most 42 messages, two per register read
 
 using namespace std;
 
-class I2CDevice {
+class I2CDevice : public I2CBus {
 private:
     int i2C;
     unsigned char currentSlaveAddr;
+    bool combinedSupported;         // adapter supports I2C_RDWR (repeated start) transfers
+    I2CStats stats;
 
 public:
     unsigned char i2CBus;   // I2C bus of the imu (eg 1 for Raspberry Pi usually: /dev/i2c-1)
 
 public:
-    I2CDevice() : i2C(-1), currentSlaveAddr(255), i2CBus(255) {
+    I2CDevice() : i2C(-1), currentSlaveAddr(255), combinedSupported(false), i2CBus(255) {
     }
 
-    virtual ~I2CDevice() {
+    ~I2CDevice() override {
         deviceClose();
     }
 
-    bool deviceOpen() {
+    bool deviceOpen() override {
         char buf[32];
         if (i2C >= 0) {
             return true;
@@ -54,10 +59,18 @@ public:
             i2C = -1;
             return false;
         }
+        combinedSupported = false;
+#ifdef __linux__
+        unsigned long functions = 0;
+        stats.syscalls++;
+        if (ioctl(i2C, I2C_FUNCS, &functions) == 0) {
+            combinedSupported = (functions & I2C_FUNC_I2C) != 0;
+        }
+#endif
         return true;
     }
 
-    void deviceClose() {
+    void deviceClose() override {
         if (i2C >= 0) {
             close(i2C);
             i2C = -1;
@@ -65,12 +78,10 @@ public:
         }
     }
 
-    bool deviceWrite(unsigned char slaveAddr, unsigned char regAddr, unsigned char const data, const char *errorMsg) {
-        return deviceWrite(slaveAddr, regAddr, &data, errorMsg, 1);
-    }
+    using I2CBus::deviceWrite;
 
     bool deviceWrite(unsigned char slaveAddr, unsigned char regAddr, unsigned char const *data, const char *errorMsg,
-                     unsigned char length) {
+                     unsigned char length) override {
         ssize_t result;
         unsigned char txBuff[MAX_WRITE_LEN + 1];
 
@@ -80,8 +91,11 @@ public:
 
         if (length == 0) {
             result = write(i2C, &regAddr, 1);
+            stats.syscalls++;
+            stats.transactions++;
 
             if (result < 0) {
+                stats.errors++;
                 if (strlen(errorMsg) > 0) {
                     cerr << "I2C write of regAddr failed - " << errorMsg << endl;
                 }
@@ -97,8 +111,11 @@ public:
             memcpy(txBuff + 1, data, length);
 
             result = write(i2C, txBuff, length + 1);
+            stats.syscalls++;
+            stats.transactions++;
 
             if (result < 0) {
+                stats.errors++;
                 if (strlen(errorMsg) > 0) {
                     cerr << "I2C data write of " << length << " bytes failed - " << errorMsg << endl;
                 }
@@ -114,14 +131,53 @@ public:
         return true;
     }
 
+    /**
+     * Read length bytes starting at register regAddr. Uses a single combined transaction (register write, repeated
+     * start, read) when the adapter supports it, otherwise a write of the register followed by a read.
+     */
     bool deviceRead(unsigned char slaveAddr, unsigned char regAddr, unsigned char *data, const char *errorMsg,
-                    unsigned char length) {
+                    unsigned char length) override {
+        if (!deviceOpen()) {
+            return false;
+        }
+        if (combinedSupported) {
+            I2CReadRequest request{slaveAddr, regAddr, data, length};
+            return transfer(&request, 1, errorMsg);
+        }
         if (!deviceWrite(slaveAddr, regAddr, nullptr, errorMsg, 0)) {
             return false;
         }
         return readData(slaveAddr, regAddr, data, errorMsg, length);
     }
 
+    /**
+     * Read several registers, possibly from different slaves, in one ioctl: each read is a register write followed
+     * by a repeated start and the read, and only the last one ends with a STOP.
+     */
+    bool deviceReadBatch(I2CReadRequest *requests, int count, const char *errorMsg) override {
+        if (!deviceOpen()) {
+            return false;
+        }
+        if (!combinedSupported) {
+            return I2CBus::deviceReadBatch(requests, count, errorMsg);
+        }
+        for (int i = 0; i < count; i += MAX_BATCH_READS) {
+            int batch = count - i < MAX_BATCH_READS ? count - i : MAX_BATCH_READS;
+            if (!transfer(requests + i, batch, errorMsg)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool isCombinedSupported() {
+        return combinedSupported;
+    }
+
+    I2CStats getStats() override {
+        return stats;
+    }
+
     bool deviceRead(unsigned char slaveAddr, unsigned char *data, const char *errorMsg, unsigned char length) {
         if (!i2CSelectSlave(slaveAddr, errorMsg)) {
             return false;
@@ -139,6 +195,7 @@ public:
             return false;
         }
 
+        stats.syscalls++;
         if (ioctl(i2C, I2C_SLAVE, slaveAddr) < 0) {
             cerr << "I2C slave select " << slaveAddr << " failed - " << errorMsg << endl;
             return false;
@@ -148,11 +205,39 @@ public:
         return true;
     }
 
-    void delayMs(unsigned int milliSeconds) {
-        usleep(1000 * milliSeconds);
+private:
+    bool transfer(I2CReadRequest *requests, int count, const char *errorMsg) {
+#ifdef __linux__
+        i2c_msg messages[2 * MAX_BATCH_READS];
+        for (int i = 0; i < count; ++i) {
+            messages[2 * i].addr = requests[i].slaveAddr;
+            messages[2 * i].flags = 0;
+            messages[2 * i].len = 1;
+            messages[2 * i].buf = &requests[i].regAddr;
+            messages[2 * i + 1].addr = requests[i].slaveAddr;
+            messages[2 * i + 1].flags = I2C_M_RD;
+            messages[2 * i + 1].len = requests[i].length;
+            messages[2 * i + 1].buf = requests[i].data;
+        }
+        i2c_rdwr_ioctl_data transaction{};
+        transaction.msgs = messages;
+        transaction.nmsgs = static_cast<__u32>(2 * count);
+
+        stats.syscalls++;
+        stats.transactions++;
+        if (ioctl(i2C, I2C_RDWR, &transaction) < 0) {
+            stats.errors++;
+            if (strlen(errorMsg) > 0) {
+                cerr << "I2C combined read of " << count << " registers failed - " << errorMsg << endl;
+            }
+            return false;
+        }
+        return true;
+#else
+        return false;
+#endif
     }
 
-private:
     bool readData(unsigned char slaveAddr, unsigned char regAddr, unsigned char *data, const char *errorMsg,
                   unsigned char length) {
         ssize_t result;
@@ -160,8 +245,11 @@ private:
         int tries = 0;
         while ((total < length) && (tries < 5)) {
             result = read(i2C, data + total, length - total);
+            stats.syscalls++;
+            stats.transactions++;
 
             if (result < 0) {
+                stats.errors++;
                 if (strlen(errorMsg) > 0) {
                     cerr << "I2C read error from " << slaveAddr << ", " << regAddr << " - " << errorMsg << endl;
                 }
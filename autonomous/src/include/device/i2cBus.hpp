@@ -0,0 +1,73 @@
+#ifndef I2CBUS_HPP_
+#define I2CBUS_HPP_
+
+#include <unistd.h>
+#include <utils/misc.hpp>
+
+/**
+ * One register read in a batch: length bytes starting at regAddr of slaveAddr are read into data.
+ */
+struct I2CReadRequest {
+    unsigned char slaveAddr;
+    unsigned char regAddr;
+    unsigned char *data;
+    unsigned char length;
+};
+
+/**
+ * System calls and bus transactions issued so far, to compare the combined and split read paths.
+ */
+struct I2CStats {
+    long long syscalls = 0;         // read, write and ioctl calls on the bus device
+    long long transactions = 0;     // START ... STOP sequences on the bus
+    long long errors = 0;
+};
+
+/**
+ * Register level access to devices on an I2C bus. I2CDevice talks to /dev/i2c-N; simulated devices implement the
+ * same interface so the sensor drivers run without hardware.
+ */
+class I2CBus {
+public:
+    virtual ~I2CBus() = default;
+
+    virtual bool deviceOpen() = 0;
+
+    virtual void deviceClose() = 0;
+
+    virtual bool deviceWrite(unsigned char slaveAddr, unsigned char regAddr, unsigned char const *data,
+                             const char *errorMsg, unsigned char length) = 0;
+
+    bool deviceWrite(unsigned char slaveAddr, unsigned char regAddr, unsigned char const data, const char *errorMsg) {
+        return deviceWrite(slaveAddr, regAddr, &data, errorMsg, 1);
+    }
+
+    virtual bool deviceRead(unsigned char slaveAddr, unsigned char regAddr, unsigned char *data,
+                            const char *errorMsg, unsigned char length) = 0;
+
+    virtual bool deviceReadBatch(I2CReadRequest *requests, int count, const char *errorMsg) {
+        for (int i = 0; i < count; ++i) {
+            if (!deviceRead(requests[i].slaveAddr, requests[i].regAddr, requests[i].data, errorMsg,
+                            requests[i].length)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    virtual I2CStats getStats() = 0;
+
+    virtual void delayMs(unsigned int milliSeconds) {
+        usleep(1000 * milliSeconds);
+    }
+
+    /**
+     * Time (microseconds since epoch) at which data read from the bus now was sampled. Real devices sample in wall
+     * clock time; a simulated device may run on its own clock.
+     */
+    virtual long long timestamp() {
+        return currentMicroSecondsSinceEpoch();
+    }
+};
+
+#endif /* I2CBUS_HPP_ */
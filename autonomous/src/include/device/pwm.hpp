@@ -7,10 +7,11 @@
 
 #include <iostream>
 #include <pigpio.h>
+#include <device/actuator.hpp>
 
 using namespace std;
 
-class PWM {
+class PWM : public Actuator {
 private:
     const float minValue;                   // min voltage generated by this PWM (0V)
     const float maxValue;                   // max voltage generated by this PWM (3.3V)
@@ -26,11 +27,11 @@ public:
         setup();
     }
 
-    virtual ~PWM() {
+    ~PWM() override {
         gpioTerminate();
     }
 
-    void set(double value) {
+    void set(double value) override {
         if (value < minValue) {
             value = minValue;
         } else if (value > maxValue) {
@@ -5,20 +5,71 @@
 #ifndef UART_HPP_
 #define UART_HPP_
 
+#include <atomic>
 #include <iostream>
+#include <poll.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <termios.h>
+#include <cerrno>
+#include <cstring>
 #include <string>
 
 using namespace std;
 
+/**
+ * Line settings of a UART. VMIN and VTIME are the termios read thresholds: with VTIME 0, poll() only reports the
+ * port readable once VMIN bytes are queued, so a larger VMIN wakes the reader fewer times per burst. With VTIME
+ * above 0 poll() reports every byte. receive() reads whatever is queued when its timeout expires either way.
+ */
+struct UARTConfig {
+    int baudRate = 9600;                // 1200 to 921600
+    unsigned char vmin = 1;             // bytes queued before the port is readable, up to 255
+    unsigned char vtime = 0;            // tenths of a second
+};
+
 class UART {
 
 private:
     const string deviceName;
+    UARTConfig config;
     int uart0Filestream = -1;
     bool isOpen = false;
+    atomic<long long> reads{0};         // reads that returned data
+    atomic<long long> bytesReceived{0};
+
+    static speed_t speedOf(int baudRate) {
+        switch (baudRate) {
+            case 1200:
+                return B1200;
+            case 2400:
+                return B2400;
+            case 4800:
+                return B4800;
+            case 9600:
+                return B9600;
+            case 19200:
+                return B19200;
+            case 38400:
+                return B38400;
+            case 57600:
+                return B57600;
+            case 115200:
+                return B115200;
+            case 230400:
+                return B230400;
+#ifdef B460800
+            case 460800:
+                return B460800;
+#endif
+#ifdef B921600
+            case 921600:
+                return B921600;
+#endif
+            default:
+                return B0;
+        }
+    }
 
     void setup() {
         // OPEN THE UART
@@ -31,10 +82,16 @@ private:
         //         - Enables nonblocking mode. When set read requests on the file can return immediately with a failure
         //           status if there is no input immediately available (instead of blocking). Likewise, write requests
         //           can also return immediately with a failure status if the output can't be written immediately.
+        //           receive() waits in poll() instead.
         //     O_NOCTTY
         //         - When set and path identifies a terminal device, open() shall not cause the terminal device to
         //           become the controlling terminal for the process.
-        uart0Filestream = open(deviceName.data(), O_RDWR | O_NOCTTY | O_NDELAY);
+        speed_t speed = speedOf(config.baudRate);
+        if (speed == B0) {
+            cout << "Error - Unsupported UART baud rate " << config.baudRate << endl;
+            return;
+        }
+        uart0Filestream = open(deviceName.data(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
         if (uart0Filestream == -1) {
             cout << "Error - Unable to open UART. Ensure it is not in use by another application" << endl;
             isOpen = false;
@@ -44,47 +101,151 @@ private:
         // CONFIGURE THE UART
         // The flags defined in /usr/include/termios.h
         //      (see http://pubs.opengroup.org/onlinepubs/007908799/xsh/termios.h.html):
-        //      Baud rate: B1200, B2400, B4800, B9600, B19200, B38400, B57600, B115200, B230400, B460800, B500000, etc
         //      CSIZE - CS5, CS6, CS7, CS8
         //      CLOCAL - Ignore modem status lines
         //      CREAD - Enable receiver
         //      IGNPAR - Ignore characters with parity errors
         struct termios options{};
-        tcgetattr(uart0Filestream, &options);
-        options.c_cflag = B9600 | CS8 | CLOCAL | CREAD; // Set baud rate
+        if (tcgetattr(uart0Filestream, &options) != 0) {
+            cout << "Error - " << deviceName << " is not a terminal: " << strerror(errno) << endl;
+            close(uart0Filestream);
+            uart0Filestream = -1;
+            return;
+        }
+        options.c_cflag = CS8 | CLOCAL | CREAD;
         options.c_iflag = IGNPAR;
         options.c_oflag = 0;
         options.c_lflag = 0;
+        options.c_cc[VMIN] = config.vmin;
+        options.c_cc[VTIME] = config.vtime;
+        cfsetispeed(&options, speed);
+        cfsetospeed(&options, speed);
         tcflush(uart0Filestream, TCIFLUSH);
-        tcsetattr(uart0Filestream, TCSANOW, &options);
+        if (tcsetattr(uart0Filestream, TCSANOW, &options) != 0) {
+            cout << "Error - Unable to configure UART: " << strerror(errno) << endl;
+            close(uart0Filestream);
+            uart0Filestream = -1;
+            return;
+        }
         isOpen = true;
     }
 
 public:
-    explicit UART(string deviceName) : deviceName(std::move(deviceName)) {
+    explicit UART(string deviceName, const UARTConfig &config = UARTConfig())
+        : deviceName(std::move(deviceName)), config(config) {
         setup();
     }
 
-    virtual ~UART() = default;
+    virtual ~UART() {
+        if (uart0Filestream != -1) {
+            close(uart0Filestream);
+        }
+    }
 
     bool isDeviceOpen() {
         return isOpen;
     }
 
-    void transmit(const string &message) {
-        if (uart0Filestream != -1) {
-            ssize_t count = write(uart0Filestream, message.data(), message.length());
-            if (count < 0) {
-                cout << "UART Tx error" << endl;
+    const UARTConfig &getConfig() const {
+        return config;
+    }
+
+    /**
+     * Write all of message, waiting in poll() while the output queue is full. Returns false on an error.
+     */
+    bool transmit(const string &message) {
+        if (uart0Filestream == -1) {
+            return false;
+        }
+        size_t written = 0;
+        while (written < message.length()) {
+            ssize_t count = write(uart0Filestream, message.data() + written, message.length() - written);
+            if (count >= 0) {
+                written += count;
+                continue;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                cout << "UART Tx error: " << strerror(errno) << endl;
+                return false;
+            }
+            pollfd pfd{};
+            pfd.fd = uart0Filestream;
+            pfd.events = POLLOUT;
+            if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+                cout << "UART Tx error: " << strerror(errno) << endl;
+                return false;
             }
         }
+        return true;
     }
 
-    ssize_t receive(char *buffer, size_t buffer_size) {
-        if (uart0Filestream != -1) {
-            return read(uart0Filestream, (void *) buffer, buffer_size);
+    /**
+     * Change the baud rate of the open port, once everything transmitted so far has been sent.
+     */
+    bool setBaudRate(int baudRate) {
+        speed_t speed = speedOf(baudRate);
+        if (uart0Filestream == -1 || speed == B0) {
+            cout << "Error - Unable to set UART baud rate " << baudRate << endl;
+            return false;
+        }
+        struct termios options{};
+        tcdrain(uart0Filestream);
+        if (tcgetattr(uart0Filestream, &options) != 0) {
+            cout << "Error - Unable to read UART settings: " << strerror(errno) << endl;
+            return false;
+        }
+        cfsetispeed(&options, speed);
+        cfsetospeed(&options, speed);
+        if (tcsetattr(uart0Filestream, TCSANOW, &options) != 0) {
+            cout << "Error - Unable to set UART baud rate: " << strerror(errno) << endl;
+            return false;
+        }
+        config.baudRate = baudRate;
+        return true;
+    }
+
+    /**
+     * Wait up to timeoutMs (0 to not wait, -1 for ever) for the port to become readable, then read what is queued,
+     * at most bufferSize bytes. Returns the bytes read, 0 if there were none and -1 on an error or a hangup.
+     */
+    ssize_t receive(char *buffer, size_t bufferSize, int timeoutMs = 0) {
+        if (uart0Filestream == -1) {
+            return -1;
+        }
+        if (timeoutMs != 0) {
+            pollfd pfd{};
+            pfd.fd = uart0Filestream;
+            pfd.events = POLLIN;
+            int result;
+            do {
+                result = poll(&pfd, 1, timeoutMs);
+            } while (result < 0 && errno == EINTR);
+            if (result < 0) {
+                return -1;
+            }
+        }
+        ssize_t length = read(uart0Filestream, (void *) buffer, bufferSize);
+        if (length <= 0) {
+            // nothing queued; a read with VMIN 0 returns 0 rather than failing
+            return length == 0 || errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
         }
-        return -1;
+        reads.fetch_add(1, memory_order_relaxed);
+        bytesReceived.fetch_add(length, memory_order_relaxed);
+        return length;
+    }
+
+    /**
+     * Reads that returned data, i.e. the wakeups of the reader, and the bytes they returned.
+     */
+    long long getReads() const {
+        return reads.load(memory_order_relaxed);
+    }
+
+    long long getBytesReceived() const {
+        return bytesReceived.load(memory_order_relaxed);
     }
 
 };
@@ -5,14 +5,23 @@
 #ifndef SENSOR_GPSTASK_HPP
 #define SENSOR_GPSTASK_HPP
 
+#include <cmath>
 #include <device/uart.hpp>
 #include <core/deviceTask.hpp>
+#include <sensor/nmea.hpp>
+#include <sensor/ubx.hpp>
 #include <utils/misc.hpp>
 #include <utils/json.hpp>
 
 using nlohmann::json;
 
+#define GPS_MAX_EPOCH_BYTES         4096            // bytes read without a complete epoch before giving up
+#define GPS_POLL_TIMEOUT            100             // ms in poll() between checks for shutdown
+#define GPS_READ_SIZE               256             // bytes per read, fits in the rings of both parsers
+
 struct GPSValue {
+    static const uint8_t wireType = WIRE_TYPE_GPS;
+
     long long timestamp = currentMicroSecondsSinceEpoch();          // from epoch
     double latitude = 0.0;                                          // degrees
     char latitudeHemisphere = 'N';                                  // N/S
@@ -21,17 +30,20 @@ struct GPSValue {
     int numSatellites = 0;
     double altitude = 0;                                            // in meters
 
+    // fields a subscriber can select, in alphabetical order; the timestamp is always sent
+    enum Field : uint32_t {
+        ALTITUDE = 1u << 0,
+        LATITUDE = 1u << 1,
+        LONGITUDE = 1u << 2,
+        NUM_SATELLITES = 1u << 3
+    };
+
 public:
     virtual ~GPSValue() = default;
 
-    /**
-     * Convert degrees and minutes to degrees.
-     */
-    double toLocation(const string &data) {
-        double value = stod(data);
-        value = value / 100;
-        double decimal = 100 * (value - int(value)) / 60;
-        return int(value) + decimal;
+    static const vector<string> &fieldNames() {
+        static const vector<string> names{"altitude", "latitude", "longitude", "numSatellites"};
+        return names;
     }
 
     json toJson() {
@@ -44,6 +56,27 @@ public:
         return j;
     }
 
+    /**
+     * Same output as toJson().dump(), keys in alphabetical order.
+     */
+    void writeJson(JsonWriter &writer, uint32_t fields = WIRE_ALL_FIELDS) {
+        writer.beginObject();
+        if (fields & ALTITUDE) {
+            writer.field("altitude", altitude);
+        }
+        if (fields & LATITUDE) {
+            writer.fixedField("latitude", latitude, latitudeHemisphere);
+        }
+        if (fields & LONGITUDE) {
+            writer.fixedField("longitude", longitude, longitudeHemisphere);
+        }
+        if (fields & NUM_SATELLITES) {
+            writer.field("numSatellites", numSatellites);
+        }
+        writer.field("timestamp", timestamp);
+        writer.endObject();
+    }
+
     static GPSValue fromJson(string &value) {
         json j = json::parse(value);
 
@@ -64,116 +97,216 @@ public:
         return data;
     }
 
+    void toBinary(BinaryWriter &writer, uint32_t fields = WIRE_ALL_FIELDS) {
+        writer.putI64(timestamp);
+        if (fields & LATITUDE) {
+            writer.putF64(latitude);
+            writer.putU8(static_cast<uint8_t>(latitudeHemisphere));
+        }
+        if (fields & LONGITUDE) {
+            writer.putF64(longitude);
+            writer.putU8(static_cast<uint8_t>(longitudeHemisphere));
+        }
+        if (fields & NUM_SATELLITES) {
+            writer.putI32(numSatellites);
+        }
+        if (fields & ALTITUDE) {
+            writer.putF64(altitude);
+        }
+    }
+
+    void fromBinary(BinaryReader &reader, uint32_t fields = WIRE_ALL_FIELDS) {
+        timestamp = reader.getI64();
+        if (fields & LATITUDE) {
+            latitude = reader.getF64();
+            latitudeHemisphere = static_cast<char>(reader.getU8());
+        }
+        if (fields & LONGITUDE) {
+            longitude = reader.getF64();
+            longitudeHemisphere = static_cast<char>(reader.getU8());
+        }
+        if (fields & NUM_SATELLITES) {
+            numSatellites = reader.getI32();
+        }
+        if (fields & ALTITUDE) {
+            altitude = reader.getF64();
+        }
+    }
 };
 
+/**
+ * Reads the UART into an NMEAParser and a UBXParser and publishes every complete epoch as a GPSValue: the GGA and
+ * RMC of the same time, or a UBX NAV-PVT. Once a NAV-PVT has arrived the receiver is taken to send UBX, and the NMEA
+ * parser is no longer fed; configureUBX() switches a u-blox receiver over.
+ *
+ * The task sleeps in poll() on the UART until bytes arrive, outside the task mutex, and fetch() only copies the
+ * parsed fix, so a receiver at 10 to 20 Hz costs a few wakeups per epoch. If the UART is not open or fails, the task
+ * falls back to republishing the last fix at the sampling frequency.
+ */
 class GPSSensorTask : public DeviceTask<GPSValue> {
 private:
     UART uart;
-    string lastState;
+    NMEAParser parser;
+    UBXParser ubxParser;
+    GPSValue latestFix;                         // the last epoch decoded
+    bool readFailed = false;                    // reported once until a read succeeds again
+
+    Counter *bytesCounter = nullptr;            // optional metrics, see setMetrics()
+    Counter *fixCounter = nullptr;
 
 public:
-    GPSSensorTask(string deviceName, const int &samplingFrequency, const unsigned int k = 1)
-        : DeviceTask(samplingFrequency, k), uart(std::move(deviceName)), lastState("") {
+    GPSSensorTask(string deviceName, const int &samplingFrequency, const unsigned int k = 1,
+                  const UARTConfig &uartConfig = UARTConfig())
+        : DeviceTask(samplingFrequency, k), uart(std::move(deviceName), uartConfig) {
     }
 
-protected:
-    void fetch() override {
-        DeviceTask::fetch();
-        receive();
+    /**
+     * The first value published is the first fix rather than an empty value.
+     */
+    void run() override {
+        waitForEpoch();
+        DeviceTask::run();
     }
 
-    void receive() {
+    /**
+     * The task metrics, bytes received, UART reads and fixes decoded, and the message counts of both parsers.
+     */
+    void setMetrics(MetricsRegistry &registry, const string &name) override {
+        DeviceTask::setMetrics(registry, name);
+        string labels = MetricsRegistry::label("task", name);
+        bytesCounter = registry.counter("gps_bytes_total", "Bytes received from the GPS.", labels);
+        fixCounter = registry.counter("gps_fixes_total", "Fixes decoded.", labels);
+        registry.counterFunction("gps_uart_reads_total", "Reads of the GPS UART that returned data.", labels,
+                                 [this]() {
+                                     return uart.getReads();
+                                 });
+        parser.setMetrics(registry, labels);
+        ubxParser.setMetrics(registry, labels);
+    }
+
+    /**
+     * Switch a u-blox receiver, talking at the configured baud rate, to UBX NAV-PVT and NAV-STATUS at rateHz and UBX
+     * only output at baudRate, then follow it to baudRate. Call before run(). The receiver keeps the setting until
+     * it is power cycled.
+     */
+    bool configureUBX(int baudRate, int rateHz) {
         if (!uart.isDeviceOpen()) {
-            return;
+            return false;
         }
-        auto *gpsData = result->getCurrentValue();
-        string block(lastState);
-        string key("$GPGLL");
-        while (true) {
-            char buffer[128];
-            ssize_t length = uart.receive(buffer, 127);
-            if (length > 0) {
-                string row(buffer, static_cast<unsigned long>(length));
-                block += row;
-                size_t found = block.find(key, 1); // search after the first character to find second occurrence
-                if (found != string::npos) {
-                    lastState = block.substr(found);
-                    block = block.substr(0, found);
-                    getGPSData(block, gpsData);
-                    return;
-                }
-                if (block.size() >= 1024) {
-                    cout << "Too large GPS block" << endl;
-                    break;
-                }
+        for (const string &message : UBXConfig::binaryOutput(baudRate, rateHz)) {
+            if (!uart.transmit(message)) {
+                return false;
             }
         }
+        return uart.setBaudRate(baudRate);
     }
 
-private:
-    void getGPSData(string &block, GPSValue *data) {
-        string gpsMinSpecRow = getGPSRow(block, "$GPRMC");
-        vector<string> gpsMinSpecRowParts = split(gpsMinSpecRow, ',');
-        if (gpsMinSpecRowParts.size() < 10) {
-            return;
-        }
-        time_t timestamp = timeSinceEpoch(gpsMinSpecRowParts[9], gpsMinSpecRowParts[1]);
+    const UART &getUART() const {
+        return uart;
+    }
+
+    const UBXParser &getUBXParser() const {
+        return ubxParser;
+    }
 
-        string gpsFixRow = getGPSRow(block, "$GPGGA");
+    /**
+     * Copy the position of a fix into data. The timestamp is the fix time, or now before the GPS knows the date.
+     */
+    static void setGPSData(const NMEAFix &fix, GPSValue *data) {
+        long long timestamp = fix.timestamp();
+        data->timestamp = timestamp >= 0 ? timestamp : currentMicroSecondsSinceEpoch();
+        data->latitude = fix.latitude;
+        data->latitudeHemisphere = fix.latitudeHemisphere;
+        data->longitude = fix.longitude;
+        data->longitudeHemisphere = fix.longitudeHemisphere;
+        data->numSatellites = fix.numSatellites;
+        data->altitude = fix.altitude;
+    }
 
-        // $GPGGA,050105.00,3720.61633,N,12200.67448,W,2,11,0.86,48.8,M,-30.0,M,,0000*57
-        //      label,utc:hhmmss.ss,latitude:dddmm.mm,N/S,longitude:dddmm.mm,E/W,quality,numSatellites,
-        //      horizontalDilutionPrecision,altitude,altitudeUnits,referenceFrequencyOffset,geoidAltitudeUnits,
-        //      ageDifferentialGPS,differentialStationID,checkSum
-        vector<string> gpsFixRowParts = split(gpsFixRow, ',');
-        if (gpsFixRowParts.size() < 10) {
+    /**
+     * Copy a NAV-PVT into data. The position is only taken from a valid fix, so data keeps the last one meanwhile.
+     */
+    static void setGPSData(const UBXNavPVT &pvt, GPSValue *data) {
+        data->timestamp = pvt.hasTime() ? pvt.timestamp() : currentMicroSecondsSinceEpoch();
+        data->numSatellites = pvt.numSV;
+        if (!pvt.fixOK()) {
             return;
         }
+        data->latitude = fabs(pvt.lat * 1e-7);
+        data->latitudeHemisphere = pvt.lat < 0 ? 'S' : 'N';
+        data->longitude = fabs(pvt.lon * 1e-7);
+        data->longitudeHemisphere = pvt.lon < 0 ? 'W' : 'E';
+        data->altitude = pvt.hMSL / 1000.0;
+    }
 
-        data->timestamp = timestamp;
-        data->latitude = data->toLocation(gpsFixRowParts[2]);
-        data->latitudeHemisphere = gpsFixRowParts[3][0];
-        data->longitude = data->toLocation(gpsFixRowParts[4]);
-        data->longitudeHemisphere = gpsFixRowParts[5][0];
-        data->numSatellites = stoi(gpsFixRowParts[7]);
-        data->altitude = stoi(gpsFixRowParts[9]);
+protected:
+    void fetch() override {
+        DeviceTask::fetch();
+        *result->getCurrentValue() = latestFix;
     }
 
-    string getGPSRow(string &block, const char *gpsKey) {
-        size_t found = block.find(gpsKey);
-        if (found != string::npos) {
-            size_t nextline_begin = block.find("$GP", found + 1);
-            if (nextline_begin != string::npos) {
-                return block.substr(found, nextline_begin);
-            } else {
-                return block.substr(found);
-            }
-        } else {
-            return "";
+    void waitForNextSample() override {
+        if (waitForEpoch()) {
+            timer.tick();
+        } else if (!isShutdown) {
+            DeviceTask::waitForNextSample();
         }
     }
 
-    time_t timeSinceEpoch(string &gpsDate, string &gpsTime) {
-        int gpsDateValue = stoi(gpsDate); // ddmmyy
-        double gpsTimeValue = stod(gpsTime); // hhmmss.ss
-        double decimal = gpsTimeValue - int(gpsTimeValue);
-        if (decimal > 0) {
-            cout << "GPS time in milliseconds = " << decimal * 1000 << endl;
+    /**
+     * Read until a parser has the next epoch and copy it to latestFix; bytes past it stay in the parser's ring for
+     * the next call. Returns false on shutdown, if the UART is not usable, or after GPS_MAX_EPOCH_BYTES without an
+     * epoch.
+     */
+    bool waitForEpoch() {
+        if (!uart.isDeviceOpen()) {
+            return false;
         }
-
-        struct tm t{};
-        t.tm_year = 100 + gpsDateValue % 100;
-        t.tm_mon = ((gpsDateValue / 100) % 100) - 1;
-        t.tm_mday = gpsDateValue / 10000;
-        t.tm_hour = int(gpsTimeValue) / 10000;
-        t.tm_min = (int(gpsTimeValue) / 100) % 100;
-        t.tm_sec = int(gpsTimeValue) % 100;
-        t.tm_wday = t.tm_yday = t.tm_isdst = 0;
-
-        setenv("TZ", "UTC", 1);
-        return mktime(&t);
+        size_t received = 0;
+        while (!isShutdown) {
+            bool epoch = false;
+            if (ubxParser.parse()) {
+                setGPSData(ubxParser.getPVT(), &latestFix);
+                epoch = true;
+            } else if (parser.parse() && !ubxParser.receivedPVT()) {
+                setGPSData(parser.getFix(), &latestFix);
+                epoch = true;
+            }
+            if (epoch) {
+                if (fixCounter) {
+                    fixCounter->increment();
+                }
+                return true;
+            }
+            if (!parser.empty()) {
+                continue;
+            }
+            // both rings are empty here, so a read of GPS_READ_SIZE fits in either
+            char buffer[GPS_READ_SIZE];
+            ssize_t length = uart.receive(buffer, sizeof(buffer), GPS_POLL_TIMEOUT);
+            if (length < 0) {
+                if (!readFailed) {
+                    cout << "GPS UART read failed" << endl;
+                    readFailed = true;
+                }
+                return false;
+            }
+            readFailed = false;
+            ubxParser.write(buffer, static_cast<size_t>(length));
+            if (!ubxParser.receivedPVT()) {
+                parser.write(buffer, static_cast<size_t>(length));
+            }
+            if (bytesCounter) {
+                bytesCounter->increment(length);
+            }
+            received += length;
+            if (received >= GPS_MAX_EPOCH_BYTES) {
+                cout << "No GPS fix in " << received << " bytes" << endl;
+                return false;
+            }
+        }
+        return false;
     }
-
 };
 
 #endif // SENSOR_GPSTASK_HPP
@@ -7,14 +7,17 @@
 
 #include <sstream>
 #include <sensor/imuDefs.h>
+#include <core/metrics.hpp>
 #include <device/i2c.hpp>
+#include <stream/attitudeFilter.hpp>
 #include <utils/math.hpp>
 
 template<class T>
 class IMU {
 
 protected:
-    I2CDevice i2CDevice;
+    I2CDevice defaultBus;                           // /dev/i2c-1, used unless another bus is passed in
+    I2CBus &i2CDevice;
     unsigned char i2CSlaveAddress;                  // I2C slave address of the imu
 
     int gyroAccelSampleRate;
@@ -33,9 +36,16 @@ protected:
     double accelScale;
     double compassScale;
 
+    double filterAlpha = ATTITUDE_FILTER_ALPHA;     // weight of the gyro in the complementary filter
+
+    Counter *samplesCounter = nullptr;              // optional metrics, see setMetrics()
+    Counter *overflowCounter = nullptr;
+    Counter *busErrorCounter = nullptr;
+    Gauge *fifoDepthGauge = nullptr;
+
 public:
-    IMU() {
-        i2CDevice.i2CBus = 1;
+    explicit IMU(I2CBus *bus = nullptr) : i2CDevice(bus ? *bus : defaultBus) {
+        defaultBus.i2CBus = 1;
     }
 
     bool discover() {
@@ -60,38 +70,44 @@ public:
         return false;
     }
 
+    int getGyroAccelSampleRate() {
+        return gyroAccelSampleRate;
+    }
+
     virtual bool imuInit() = 0;                          // set up the IMU
     virtual int getPollInterval() = 0;                   // returns the recommended poll interval in mS
     virtual bool read(double &delta_t, T *imuData) = 0;  // get a sample
 
+    virtual int getPendingSamples() {                    // samples already fetched from the device, not yet read
+        return 0;
+    }
+
+    /**
+     * Request a gyro and accel sample rate in Hz. Takes effect in imuInit().
+     */
+    void setSampleRate(int rate) {
+        gyroAccelSampleRate = rate;
+    }
+
+    /**
+     * Weight of the gyro against the accelerometer in the complementary filter, between 0 and 1.
+     */
+    void setFilterAlpha(double alpha) {
+        filterAlpha = alpha;
+    }
+
+    /**
+     * Count samples, FIFO overflows and failed bus reads into registry, with the given labels.
+     */
+    void setMetrics(MetricsRegistry &registry, const string &labels) {
+        samplesCounter = registry.counter("imu_samples_total", "Samples read from the IMU.", labels);
+        overflowCounter = registry.counter("imu_fifo_overflows_total", "Times the IMU FIFO overflowed.", labels);
+        busErrorCounter = registry.counter("imu_i2c_errors_total", "Failed I2C reads of samples.", labels);
+        fifoDepthGauge = registry.gauge("imu_fifo_depth", "Samples queued in the IMU FIFO at the last read.", labels);
+    }
+
     virtual void applyFilters(double &delta_t, T *imuData) {
-        // compute integral of gyro to get angle
-        // q_omega(t + 1) = q_omega(t) * q(delta_t * || omega_t ||, omega_t / || omega_t ||)
-        imuData->gyroAngle = imuData->rateIntegral.apply(delta_t, imuData->gyroRaw, &imuData->thetaCompFilter);
-
-        // use accelerometer to correct for the tilt
-        // q(t) = q(phi, n / || n ||)
-        //      gravity = (0, 0, 1)
-        //      qa_world = q_omega(t + 1) * accel_t * inverse(q_omega(t + 1))
-        //      v = vector(normalize(qa_world))
-        //      n = v x gravity: cross product
-        //      phi = acos(v . gravity): dot product
-        Vector3 gravity(0, 0, 1);
-        Quaternion qaWorld = imuData->gyroAngle.rotate(imuData->accelRaw);
-        qaWorld.normalize();
-        Vector3 v = qaWorld.vector();
-        Vector3 n;
-        Vector3::crossProduct(v, gravity, n);
-        n.normalize();
-        double phi = acos(Vector3::dotProduct(v, gravity));
-        imuData->accelAngle.fromAngleVector(phi, n);
-
-        // complementary filter
-        // q_c(t) = q((1 - alpha) * phi, n) * q_omega(t + 1)
-        double alpha = 0.9;
-        Quaternion q_alpha;
-        q_alpha.fromAngleVector((1.0 - alpha) * phi, n);
-        imuData->thetaCompFilter = q_alpha * imuData->gyroAngle;
+        applyAttitudeFilter(delta_t, imuData, filterAlpha);
     }
 
     void calibrate(Vector3 &gyroMean, Vector3 &gyroVariance, Vector3 &accelMean, Vector3 &accelVariance) {
@@ -6,12 +6,16 @@
 #define IMU_TASK_HPP_
 
 #include <core/deviceTask.hpp>
+#include <core/latencyTrace.hpp>
 #include <sensor/mpu9250.hpp>
+#include <device/edgeSource.hpp>
 #include <utils/json.hpp>
 #include <stream/rateIntegral.hpp>
 #include <stream/complementaryFilter.hpp>
 
 struct IMUValue {
+    static const uint8_t wireType = WIRE_TYPE_IMU;
+
     long long timestamp;
     Vector3 gyroRaw;
     Vector3 accelRaw;
@@ -21,11 +25,28 @@ struct IMUValue {
     Quaternion thetaCompFilter{1, 0, 0, 0};     // complementary filter
 
     RateIntegral rateIntegral;
+    LatencyTrail latency;                       // not sent or recorded, see latencyTrace.hpp
+
+    // fields a subscriber can select, in alphabetical order; the timestamp is always sent
+    enum Field : uint32_t {
+        ACCEL_ANGLE = 1u << 0,
+        ACCEL_RAW = 1u << 1,
+        COMPASS_RAW = 1u << 2,
+        GYRO_ANGLE = 1u << 3,
+        GYRO_RAW = 1u << 4,
+        THETA_COMP_FILTER = 1u << 5
+    };
 
 public:
     IMUValue() : timestamp(currentMicroSecondsSinceEpoch()), rateIntegral() {
     }
 
+    static const vector<string> &fieldNames() {
+        static const vector<string> names{"accelAngle", "accelRaw", "compassRaw", "gyroAngle", "gyroRaw",
+                                          "thetaCompFilter"};
+        return names;
+    }
+
     json toJson() {
         json j;
         j["timestamp"] = timestamp;
@@ -52,14 +73,96 @@ public:
                                 {"z",      thetaCompFilter.z()}};
         return j;
     }
+
+    /**
+     * Same output as toJson().dump(), keys in alphabetical order.
+     */
+    void writeJson(JsonWriter &writer, uint32_t fields = WIRE_ALL_FIELDS) {
+        writer.beginObject();
+        if (fields & ACCEL_ANGLE) {
+            writer.field("accelAngle", accelAngle);
+        }
+        if (fields & ACCEL_RAW) {
+            writer.field("accelRaw", accelRaw);
+        }
+        if (fields & COMPASS_RAW) {
+            writer.field("compassRaw", compassRaw);
+        }
+        if (fields & GYRO_ANGLE) {
+            writer.field("gyroAngle", gyroAngle);
+        }
+        if (fields & GYRO_RAW) {
+            writer.field("gyroRaw", gyroRaw);
+        }
+        if (fields & THETA_COMP_FILTER) {
+            writer.field("thetaCompFilter", thetaCompFilter);
+        }
+        writer.field("timestamp", timestamp);
+        writer.endObject();
+    }
+
+    void toBinary(BinaryWriter &writer, uint32_t fields = WIRE_ALL_FIELDS) {
+        writer.putI64(timestamp);
+        if (fields & GYRO_RAW) {
+            writer.putVector3(gyroRaw);
+        }
+        if (fields & ACCEL_RAW) {
+            writer.putVector3(accelRaw);
+        }
+        if (fields & COMPASS_RAW) {
+            writer.putVector3(compassRaw);
+        }
+        if (fields & GYRO_ANGLE) {
+            writer.putQuaternion(gyroAngle);
+        }
+        if (fields & ACCEL_ANGLE) {
+            writer.putQuaternion(accelAngle);
+        }
+        if (fields & THETA_COMP_FILTER) {
+            writer.putQuaternion(thetaCompFilter);
+        }
+    }
+
+    void fromBinary(BinaryReader &reader, uint32_t fields = WIRE_ALL_FIELDS) {
+        timestamp = reader.getI64();
+        if (fields & GYRO_RAW) {
+            gyroRaw = reader.getVector3();
+        }
+        if (fields & ACCEL_RAW) {
+            accelRaw = reader.getVector3();
+        }
+        if (fields & COMPASS_RAW) {
+            compassRaw = reader.getVector3();
+        }
+        if (fields & GYRO_ANGLE) {
+            gyroAngle = reader.getQuaternion();
+        }
+        if (fields & ACCEL_ANGLE) {
+            accelAngle = reader.getQuaternion();
+        }
+        if (fields & THETA_COMP_FILTER) {
+            thetaCompFilter = reader.getQuaternion();
+        }
+    }
 };
 
 class IMUSensorTask : public DeviceTask<IMUValue> {
 private:
-    MPU9250<IMUValue> imu{};
+    MPU9250<IMUValue> imu;
+    EdgeSource *dataReady = nullptr;
 
 public:
-    IMUSensorTask(const int &samplingFrequency, const unsigned int k) : DeviceTask(samplingFrequency, k) {
+    /**
+     * Pass a bus to talk to something other than the MPU9250 on /dev/i2c-1, e.g. a SimulatedMPU9250.
+     */
+    IMUSensorTask(const int &samplingFrequency, const unsigned int k, const int imuSampleRate = 0,
+                  I2CBus *bus = nullptr)
+        : DeviceTask(samplingFrequency, k), imu(bus) {
+        // the log gets every sample the filters see, so a replay can run them again (see flightReplay.hpp)
+        recordOnPublish = false;
+        if (imuSampleRate > 0) {
+            imu.setSampleRate(imuSampleRate);
+        }
         if (!imu.discover()) {
             cout << "No IMU found" << endl;
             exit(1);
@@ -67,7 +170,55 @@ public:
         imu.imuInit();
     }
 
+    /**
+     * Switch to event driven acquisition: block on the data ready source (INT pin or a timer at the IMU sample
+     * rate) instead of sleeping and polling the FIFO count. The task then runs at the IMU sample rate.
+     */
+    void setDataReadySource(EdgeSource *source) {
+        dataReady = source;
+    }
+
+    int getSampleRate() {
+        return imu.getGyroAccelSampleRate();
+    }
+
+    /**
+     * The task metrics and those of the IMU: samples, FIFO overflows and depth, I2C errors.
+     */
+    void setMetrics(MetricsRegistry &registry, const string &name) override {
+        DeviceTask::setMetrics(registry, name);
+        imu.setMetrics(registry, MetricsRegistry::label("task", name));
+    }
+
+    void setFilterAlpha(double alpha) {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        imu.setFilterAlpha(alpha);
+    }
+
+    /**
+     * Fetch and publish the samples queued in the IMU now, without waiting for the sampling period. A lock step
+     * simulation calls this right after pushing samples into a SimulatedMPU9250.
+     */
+    void step() {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        fetch();
+        publish();
+    }
+
 protected:
+    void waitForNextSample() override {
+        if (!dataReady) {
+            DeviceTask::waitForNextSample();
+            return;
+        }
+        if (dataReady->wait(dataReadyTimeout()) < 0) {
+            // broken source, fall back to polling at the sampling frequency
+            DeviceTask::waitForNextSample();
+        } else {
+            timer.tick();
+        }
+    }
+
     void fetch() override {
         DeviceTask::fetch();
         receive();
@@ -78,9 +229,27 @@ protected:
         double delta_t = 0.0;
         // wait till you can read
         while (!imu.read(delta_t, imuData)) {
-            usleep(static_cast<useconds_t>(imu.getPollInterval() * 1000));
+            if (!dataReady || dataReady->wait(dataReadyTimeout()) < 0) {
+                usleep(static_cast<useconds_t>(imu.getPollInterval() * 1000));
+            }
         }
         imu.applyFilters(delta_t, imuData);
+        imuData->latency.filtered = monotonicNanoSeconds();
+        record(*imuData);
+
+        // the rest of the burst already read from the FIFO, so the filters see every sample
+        while (imu.getPendingSamples() > 0 && imu.read(delta_t, imuData)) {
+            imu.applyFilters(delta_t, imuData);
+            imuData->latency.filtered = monotonicNanoSeconds();
+            record(*imuData);
+        }
+    }
+
+    /**
+     * Wait at most a couple of sample intervals so a missed edge only delays one sample.
+     */
+    int dataReadyTimeout() {
+        return 2000 / imu.getGyroAccelSampleRate() + 1;
     }
 
 };
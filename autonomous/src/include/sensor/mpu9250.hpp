@@ -11,6 +11,7 @@
 #include <utils/math.hpp>
 
 #define MPU9250_FIFO_CHUNK_SIZE     12      // gyro and accels take 12 bytes
+#define MPU9250_FIFO_BURST_SAMPLES  21      // 252 bytes, the most a single I2C read can return
 
 template<class T>
 class MPU9250 : public IMU<T> {
@@ -20,8 +21,16 @@ private:
     Vector3 accelBias{0.0160525, 0.0497671, -0.00852};                      // accelerometer bias
     Vector3 accelNoiseVariance{1.19585e-06, 1.3439e-06, 3.41964e-06};       // accelerometer noise variance
 
+    unsigned char fifoData[MPU9250_FIFO_CHUNK_SIZE * MPU9250_FIFO_BURST_SAMPLES];
+    unsigned char compassData[8];
+    int burstSamples = 0;                   // number of samples in fifoData
+    int nextSample = 0;                     // next sample in fifoData to hand out
+    long long burstTimestamp = 0;           // timestamp of the last sample in fifoData
+    long long burstReadTimestamp = 0;       // bus clock when fifoData was read
+    long long burstAcquired = 0;            // monotonicNanoSeconds() when fifoData was read
+
 public:
-    MPU9250() : IMU<T>() {
+    explicit MPU9250(I2CBus *bus = nullptr) : IMU<T>(bus) {
         setDefaults();
     }
 
@@ -86,15 +95,80 @@ public:
         }
     }
 
+    /**
+     * Get the next sample. Samples are drained from the FIFO in bursts: one I2C transaction reads up to
+     * MPU9250_FIFO_BURST_SAMPLES samples, which are then handed out one per call with timestamps reconstructed
+     * from the sample interval.
+     */
     bool read(double &delta_t, T *imuData) override {
+        if (nextSample >= burstSamples && !readBurst()) {
+            return false;
+        }
+
+        long long previousTimestamp = imuData->timestamp;
+        long long samplesAfter = burstSamples - 1 - nextSample;
+        imuData->timestamp = burstTimestamp - samplesAfter * (long long) this->gyroAccelSampleInterval;
+        if (imuData->timestamp < previousTimestamp + (long long) this->gyroAccelSampleInterval / 2) {
+            // clock jitter between bursts, keep the timestamps monotonic
+            imuData->timestamp = previousTimestamp + this->gyroAccelSampleInterval;
+        }
+        delta_t = (imuData->timestamp - previousTimestamp) / 1000000.0;
+        imuData->latency.acquired = burstAcquired;
+        imuData->latency.sampled = burstAcquired - (burstReadTimestamp - imuData->timestamp) * 1000;
+
+        decode(fifoData + nextSample * MPU9250_FIFO_CHUNK_SIZE, imuData);
+        nextSample++;
+        if (this->samplesCounter) {
+            this->samplesCounter->increment();
+        }
+        return true;
+    }
+
+    int getPendingSamples() override {
+        return burstSamples - nextSample;
+    }
+
+protected:
+    void setDefaults() override {
+        IMU<T>::setDefaults();
+
+        this->gyroLowPassFilter = MPU9250_GYRO_LPF_41;
+        this->accelLowPassFilter = MPU9250_ACCEL_LPF_41;
+
+        this->gyroFullScaleRange = MPU9250_GYROFSR_1000;
+        this->accelFullScaleRange = MPU9250_ACCELFSR_8;
+        this->compassFullScaleRange = AK8963_FSR_16BITS;
+    }
+
+    bool configureParameters() {
+        //  configure IMU parameters
+        if (!setGyroAccelSampleRate(this->gyroAccelSampleRate, this->gyroAccelSampleInterval,
+                                    this->gyroAccelSampleRate) ||
+            !setCompassSampleRate(this->compassSampleRate)) {
+            return false;
+        }
+
+        return setGyroLowPassFilter(this->gyroLowPassFilter) &&
+               setAccelLowPassFilter(this->accelLowPassFilter) &&
+               setGyroFullScaleRange(this->gyroFullScaleRange) &&
+               setAccelFullScaleRange(this->accelFullScaleRange) &&
+               setCompassFullScaleRange(this->compassFullScaleRange);
+    }
+
+private:
+    /**
+     * Read as many whole samples as are queued (up to MPU9250_FIFO_BURST_SAMPLES) plus the compass in one go.
+     * The newest sample in the FIFO was taken about now; older samples are one sample interval apart.
+     */
+    bool readBurst() {
         unsigned char fifoCount[2];
         unsigned int count;
-        unsigned char fifoData[12];
-        unsigned char compassData[8];
-        bool slowSampling = false;
 
+        burstSamples = 0;
+        nextSample = 0;
         if (!this->i2CDevice.deviceRead(this->i2CSlaveAddress, MPU9250_FIFO_COUNT_H, fifoCount,
                                         "Failed to read fifo count", 2)) {
+            countBusError();
             return false;
         }
 
@@ -102,43 +176,49 @@ public:
 
         if (count == 512) {
             cout << "MPU-9250 fifo has overflowed" << endl;
+            if (this->overflowCounter) {
+                this->overflowCounter->increment();
+            }
             resetFifo();
-            imuData->timestamp += this->gyroAccelSampleInterval * (512 / MPU9250_FIFO_CHUNK_SIZE + 1);
             return false;
         }
 
-        if (count > MPU9250_FIFO_CHUNK_SIZE * 40) {
-            // more than 40 samples behind - going too slowly so discard some samples but maintain timestamp correctly
-            while (count >= MPU9250_FIFO_CHUNK_SIZE * 2) {
-                if (!this->i2CDevice.deviceRead(this->i2CSlaveAddress, MPU9250_FIFO_R_W, fifoData,
-                                                "Failed to read fifo data", MPU9250_FIFO_CHUNK_SIZE)) {
-                    return false;
-                }
-                count -= MPU9250_FIFO_CHUNK_SIZE;
-                imuData->timestamp += this->gyroAccelSampleInterval;
-            }
-            cout << "MPU-9250 discarding samples... " << count << endl;
-            slowSampling = true;
+        int queued = count / MPU9250_FIFO_CHUNK_SIZE;
+        if (this->fifoDepthGauge) {
+            this->fifoDepthGauge->set(queued);
         }
-
-        if (count < MPU9250_FIFO_CHUNK_SIZE) {
+        if (queued == 0) {
             return false;
         }
+        int samples = queued < MPU9250_FIFO_BURST_SAMPLES ? queued : MPU9250_FIFO_BURST_SAMPLES;
+        long long now = this->i2CDevice.timestamp();
 
-        if (!this->i2CDevice.deviceRead(this->i2CSlaveAddress, MPU9250_FIFO_R_W, fifoData,
-                                        "Failed to read fifo data", MPU9250_FIFO_CHUNK_SIZE) ||
-            !this->i2CDevice.deviceRead(this->i2CSlaveAddress, MPU9250_EXT_SENS_DATA_00, compassData,
-                                        "Failed to read compass data", 8)) {
+        // fifo data and compass in a single combined transaction
+        I2CReadRequest requests[2] = {
+            {this->i2CSlaveAddress, MPU9250_FIFO_R_W, fifoData, (unsigned char) (samples * MPU9250_FIFO_CHUNK_SIZE)},
+            {this->i2CSlaveAddress, MPU9250_EXT_SENS_DATA_00, compassData, 8}
+        };
+        if (!this->i2CDevice.deviceReadBatch(requests, 2, "Failed to read fifo and compass data")) {
+            countBusError();
             return false;
         }
-        long long previousTimestamp = imuData->timestamp;
-        if (!slowSampling) {
-            imuData->timestamp = currentMicroSecondsSinceEpoch();
+
+        burstSamples = samples;
+        burstReadTimestamp = now;
+        burstAcquired = monotonicNanoSeconds();
+        burstTimestamp = now - (long long) (queued - samples) * this->gyroAccelSampleInterval;
+        return true;
+    }
+
+    void countBusError() {
+        if (this->busErrorCounter) {
+            this->busErrorCounter->increment();
         }
-        delta_t = (imuData->timestamp - previousTimestamp) / 1000000.0;
+    }
 
-        convertToVector(fifoData, imuData->accelRaw, this->accelScale, true);
-        convertToVector(fifoData + 6, imuData->gyroRaw, this->gyroScale, true);
+    void decode(const unsigned char *sample, T *imuData) {
+        convertToVector(sample, imuData->accelRaw, this->accelScale, true);
+        convertToVector(sample + 6, imuData->gyroRaw, this->gyroScale, true);
         convertToVector(compassData + 1, imuData->compassRaw, 0.6f, false);
 
         //  sort out gyro axes
@@ -162,38 +242,8 @@ public:
         // remove bias
         imuData->gyroRaw -= gyroBias;
         imuData->accelRaw -= accelBias;
-
-        return true;
     }
 
-protected:
-    void setDefaults() override {
-        IMU<T>::setDefaults();
-
-        this->gyroLowPassFilter = MPU9250_GYRO_LPF_41;
-        this->accelLowPassFilter = MPU9250_ACCEL_LPF_41;
-
-        this->gyroFullScaleRange = MPU9250_GYROFSR_1000;
-        this->accelFullScaleRange = MPU9250_ACCELFSR_8;
-        this->compassFullScaleRange = AK8963_FSR_16BITS;
-    }
-
-    bool configureParameters() {
-        //  configure IMU parameters
-        if (!setGyroAccelSampleRate(this->gyroAccelSampleRate, this->gyroAccelSampleInterval,
-                                    this->gyroAccelSampleRate) ||
-            !setCompassSampleRate(this->compassSampleRate)) {
-            return false;
-        }
-
-        return setGyroLowPassFilter(this->gyroLowPassFilter) &&
-               setAccelLowPassFilter(this->accelLowPassFilter) &&
-               setGyroFullScaleRange(this->gyroFullScaleRange) &&
-               setAccelFullScaleRange(this->accelFullScaleRange) &&
-               setCompassFullScaleRange(this->compassFullScaleRange);
-    }
-
-private:
     bool setGyroAccelSampleRate(int &sampleRate, uint64_t &sampleInterval, int rate) {
         if ((rate < MPU9250_SAMPLERATE_MIN) || (rate > MPU9250_SAMPLERATE_MAX)) {
             cerr << "Illegal sample rate " << rate << endl;
@@ -447,6 +497,8 @@ private:
     }
 
     bool resetFifo() {
+        burstSamples = 0;
+        nextSample = 0;
         if (!this->i2CDevice.deviceWrite(this->i2CSlaveAddress, MPU9250_INT_ENABLE, 0, "Writing int enable") ||
             !this->i2CDevice.deviceWrite(this->i2CSlaveAddress, MPU9250_FIFO_EN, 0, "Writing fifo enable") ||
             !this->i2CDevice.deviceWrite(this->i2CSlaveAddress, MPU9250_USER_CTRL, 0, "Writing user control") ||
@@ -0,0 +1,352 @@
+#ifndef SENSOR_MPU9250SIM_HPP
+#define SENSOR_MPU9250SIM_HPP
+
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <boost/thread.hpp>
+#include <device/i2cBus.hpp>
+#include <sensor/imuDefs.h>
+#include <utils/math.hpp>
+
+#define MPU9250_SIM_FIFO_SIZE       512
+
+struct SimulatedMPU9250Config {
+    unsigned char address = MPU9250_ADDRESS0;
+    bool realTime = true;
+    int samplesPerPoll = 1;                                         // when not real time
+    unsigned int seed = 42;
+    Vector3 gyroBias{0.000928911, -0.00910854, -0.00138218};        // rad/s, matches the MPU9250 calibration
+    Vector3 accelBias{0.0160525, 0.0497671, -0.00852};              // g, matches the MPU9250 calibration
+    double gyroNoise = 7e-4;                                        // standard deviation in rad/s
+    double accelNoise = 1.5e-3;                                     // standard deviation in g
+    double compassNoise = 2.0;                                      // standard deviation in milliGauss
+    unsigned char compassAdjust[3] = {128, 128, 128};               // fuse ROM, 128 = no adjustment
+};
+
+struct SimulatedMPU9250Counters {
+    long long samplesGenerated = 0;
+    long long samplesRead = 0;
+    long long overflows = 0;
+};
+
+/**
+ * Register level model of an MPU9250 with its AK8963 compass, to run the IMU driver and everything above it on a
+ * machine without the chip.
+ *
+ * Modeled: WHO_AM_I, reset, sample rate divider, gyro and accel full scale ranges, FIFO enable/reset/count/read
+ * with overflow at 512 bytes, and the compass data the MPU9250 mirrors into EXT_SENS_DATA. Other registers just
+ * keep what was written.
+ *
+ * Samples are the true angular rate, specific force and magnetic field (set with setTruth()) plus a sensor bias and
+ * gaussian noise. In real time mode, samples accrue in the FIFO at the configured sample rate as wall clock time
+ * passes. Otherwise each FIFO count read finds samplesPerPoll new samples, or samples are added explicitly with
+ * generate(), which lets benchmarks and simulations run faster than real time. The chip then keeps its own clock,
+ * advanced by one sample interval per sample, and timestamp() reports it, so the driver's timestamps do not depend
+ * on how fast the simulation runs.
+ */
+class SimulatedMPU9250 : public I2CBus {
+private:
+    typedef std::chrono::steady_clock simClock;
+
+    SimulatedMPU9250Config config;
+    boost::mutex mtx;
+
+    unsigned char registers[128];
+    unsigned char compassRegisters[32];
+    deque<unsigned char> fifo;
+
+    Vector3 angularRate;                    // rad/s in the sensor frame
+    Vector3 acceleration{0, 0, 1};          // specific force in g in the sensor frame
+    Vector3 magneticField{200, 0, 400};     // milliGauss in the sensor frame
+
+    std::mt19937 generator;
+    std::normal_distribution<double> normal{0.0, 1.0};
+
+    simClock::time_point lastSampleTime;
+    long long sampleClock;                  // microseconds since epoch of the last generated sample
+    bool isOpen = false;
+    I2CStats stats;
+    SimulatedMPU9250Counters counters;
+
+public:
+    explicit SimulatedMPU9250(const SimulatedMPU9250Config &config = SimulatedMPU9250Config())
+        : config(config), generator(config.seed), sampleClock(currentMicroSecondsSinceEpoch()) {
+        reset();
+    }
+
+    bool deviceOpen() override {
+        isOpen = true;
+        return true;
+    }
+
+    void deviceClose() override {
+        isOpen = false;
+    }
+
+    using I2CBus::deviceWrite;
+
+    bool deviceWrite(unsigned char slaveAddr, unsigned char regAddr, unsigned char const *data,
+                     const char *errorMsg, unsigned char length) override {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        stats.syscalls++;
+        stats.transactions++;
+        if (slaveAddr == AK8963_ADDRESS) {
+            for (int i = 0; i < length; ++i) {
+                compassRegisters[(regAddr + i) & 31] = data[i];
+            }
+            return true;
+        }
+        if (slaveAddr != config.address) {
+            stats.errors++;
+            return false;
+        }
+        for (int i = 0; i < length; ++i) {
+            writeRegister(static_cast<unsigned char>(regAddr + i), data[i]);
+        }
+        return true;
+    }
+
+    bool deviceRead(unsigned char slaveAddr, unsigned char regAddr, unsigned char *data,
+                    const char *errorMsg, unsigned char length) override {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        stats.syscalls++;
+        stats.transactions++;
+        return readRegisters(slaveAddr, regAddr, data, length);
+    }
+
+    /**
+     * Same as one combined I2C_RDWR transfer: one syscall and one transaction for the whole batch.
+     */
+    bool deviceReadBatch(I2CReadRequest *requests, int count, const char *errorMsg) override {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        stats.syscalls++;
+        stats.transactions++;
+        for (int i = 0; i < count; ++i) {
+            if (!readRegisters(requests[i].slaveAddr, requests[i].regAddr, requests[i].data, requests[i].length)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    I2CStats getStats() override {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        return stats;
+    }
+
+    void delayMs(unsigned int milliSeconds) override {
+    }
+
+    long long timestamp() override {
+        if (config.realTime) {
+            return I2CBus::timestamp();
+        }
+        boost::lock_guard<boost::mutex> lk(mtx);
+        return sampleClock;
+    }
+
+    /**
+     * Set the motion the sensor experiences, in the sensor frame.
+     */
+    void setTruth(const Vector3 &angularRate, const Vector3 &acceleration, const Vector3 &magneticField) {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        this->angularRate = angularRate;
+        this->acceleration = acceleration;
+        this->magneticField = magneticField;
+    }
+
+    /**
+     * Push samples into the FIFO now, e.g. once per physics step of a lock step simulation.
+     */
+    void generate(int samples) {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        pushSamples(samples);
+    }
+
+    int getSampleRate() {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        return sampleRate();
+    }
+
+    SimulatedMPU9250Counters getCounters() {
+        boost::lock_guard<boost::mutex> lk(mtx);
+        return counters;
+    }
+
+private:
+    void reset() {
+        memset(registers, 0, sizeof(registers));
+        memset(compassRegisters, 0, sizeof(compassRegisters));
+        registers[MPU9250_WHO_AM_I] = MPU9250_ID;
+        registers[MPU9250_PWR_MGMT_1] = 0x01;
+        compassRegisters[0] = AK8963_ID;
+        compassRegisters[AK8963_ASAX] = config.compassAdjust[0];
+        compassRegisters[AK8963_ASAY] = config.compassAdjust[1];
+        compassRegisters[AK8963_ASAZ] = config.compassAdjust[2];
+        fifo.clear();
+        lastSampleTime = simClock::now();
+    }
+
+    void writeRegister(unsigned char regAddr, unsigned char value) {
+        regAddr &= 127;
+        if (regAddr == MPU9250_PWR_MGMT_1 && (value & 0x80)) {
+            reset();
+            return;
+        }
+        if (regAddr == MPU9250_USER_CTRL && (value & 0x04)) {
+            fifo.clear();
+            lastSampleTime = simClock::now();
+            value &= ~0x04;
+        }
+        if (regAddr == MPU9250_FIFO_R_W || regAddr == MPU9250_WHO_AM_I) {
+            return;
+        }
+        registers[regAddr] = value;
+    }
+
+    bool readRegisters(unsigned char slaveAddr, unsigned char regAddr, unsigned char *data, unsigned char length) {
+        if (!isOpen) {
+            stats.errors++;
+            return false;
+        }
+        if (slaveAddr == AK8963_ADDRESS) {
+            for (int i = 0; i < length; ++i) {
+                data[i] = compassRegisters[(regAddr + i) & 31];
+            }
+            return true;
+        }
+        if (slaveAddr != config.address) {
+            // nobody acknowledges this address
+            stats.errors++;
+            return false;
+        }
+
+        if (regAddr == MPU9250_FIFO_COUNT_H) {
+            accrue();
+            registers[MPU9250_FIFO_COUNT_H] = static_cast<unsigned char>(fifo.size() >> 8);
+            registers[MPU9250_FIFO_COUNT_L] = static_cast<unsigned char>(fifo.size() & 0xff);
+        } else if (regAddr == MPU9250_FIFO_R_W) {
+            for (int i = 0; i < length; ++i) {
+                if (fifo.empty()) {
+                    data[i] = 0;
+                } else {
+                    data[i] = fifo.front();
+                    fifo.pop_front();
+                }
+            }
+            counters.samplesRead += length / 12;
+            return true;
+        } else if (regAddr == MPU9250_EXT_SENS_DATA_00) {
+            writeCompass();
+        }
+        for (int i = 0; i < length; ++i) {
+            data[i] = registers[(regAddr + i) & 127];
+        }
+        return true;
+    }
+
+    int sampleRate() {
+        return 1000 / (1 + registers[MPU9250_SMPRT_DIV]);
+    }
+
+    bool fifoEnabled() {
+        return (registers[MPU9250_USER_CTRL] & 0x40) && (registers[MPU9250_FIFO_EN] & 0x78) == 0x78;
+    }
+
+    /**
+     * Add the samples that became due since the last FIFO count read.
+     */
+    void accrue() {
+        if (!config.realTime) {
+            pushSamples(config.samplesPerPoll);
+            return;
+        }
+        simClock::time_point now = simClock::now();
+        std::chrono::nanoseconds period(1000000000LL / sampleRate());
+        long long due = (now - lastSampleTime) / period;
+        if (due > 0) {
+            lastSampleTime += period * due;
+            pushSamples(due > MPU9250_SIM_FIFO_SIZE ? MPU9250_SIM_FIFO_SIZE : static_cast<int>(due));
+        }
+    }
+
+    void pushSamples(int samples) {
+        if (!fifoEnabled()) {
+            return;
+        }
+        double gyroScale = M_PI * (250 << ((registers[MPU9250_GYRO_CONFIG] >> 3) & 3)) / (32768.0 * 180.0);
+        double accelScale = (2 << ((registers[MPU9250_ACCEL_CONFIG] >> 3) & 3)) / 32768.0;
+        for (int i = 0; i < samples; ++i) {
+            sampleClock += 1000000 / sampleRate();
+            Vector3 accel = acceleration + config.accelBias + noise(config.accelNoise);
+            Vector3 gyro = angularRate + config.gyroBias + noise(config.gyroNoise);
+
+            // the driver flips accel x and z, and gyro y and z
+            unsigned char sample[12];
+            toBigEndian(-accel.x() / accelScale, sample);
+            toBigEndian(accel.y() / accelScale, sample + 2);
+            toBigEndian(-accel.z() / accelScale, sample + 4);
+            toBigEndian(gyro.x() / gyroScale, sample + 6);
+            toBigEndian(-gyro.y() / gyroScale, sample + 8);
+            toBigEndian(-gyro.z() / gyroScale, sample + 10);
+
+            if (fifo.size() + 12 > MPU9250_SIM_FIFO_SIZE) {
+                // the real FIFO keeps accepting data and reports a full count until it is reset
+                counters.overflows++;
+                while (fifo.size() < MPU9250_SIM_FIFO_SIZE) {
+                    fifo.push_back(0);
+                }
+                return;
+            }
+            fifo.insert(fifo.end(), sample, sample + 12);
+            counters.samplesGenerated++;
+        }
+    }
+
+    /**
+     * Mirror of the AK8963 measurement as read by slave 0: ST1, X, Y, Z (little endian) and ST2.
+     */
+    void writeCompass() {
+        // the driver scales by 0.6 and the fuse adjustment, then maps (x, y) to (y, -x)
+        Vector3 field = magneticField + noise(config.compassNoise);
+        double adjust[3];
+        for (int i = 0; i < 3; ++i) {
+            adjust[i] = (config.compassAdjust[i] - 128.0) / 256.0 + 1.0;
+        }
+        unsigned char *data = registers + MPU9250_EXT_SENS_DATA_00;
+        data[0] = 0x01;
+        toLittleEndian(-field.y() / (0.6 * adjust[0]), data + 1);
+        toLittleEndian(field.x() / (0.6 * adjust[1]), data + 3);
+        toLittleEndian(field.z() / (0.6 * adjust[2]), data + 5);
+        data[7] = 0x10;
+    }
+
+    Vector3 noise(double sigma) {
+        return Vector3(sigma * normal(generator), sigma * normal(generator), sigma * normal(generator));
+    }
+
+    static int16_t saturate(double value) {
+        if (value > 32767) {
+            return 32767;
+        } else if (value < -32768) {
+            return -32768;
+        }
+        return static_cast<int16_t>(lround(value));
+    }
+
+    static void toBigEndian(double value, unsigned char *data) {
+        auto raw = static_cast<uint16_t>(saturate(value));
+        data[0] = static_cast<unsigned char>(raw >> 8);
+        data[1] = static_cast<unsigned char>(raw & 0xff);
+    }
+
+    static void toLittleEndian(double value, unsigned char *data) {
+        auto raw = static_cast<uint16_t>(saturate(value));
+        data[0] = static_cast<unsigned char>(raw & 0xff);
+        data[1] = static_cast<unsigned char>(raw >> 8);
+    }
+};
+
+#endif // SENSOR_MPU9250SIM_HPP
@@ -0,0 +1,573 @@
+#ifndef SENSOR_NMEA_HPP
+#define SENSOR_NMEA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <core/byteRing.hpp>
+#include <core/metrics.hpp>
+#include <utils/misc.hpp>
+
+using namespace std;
+
+#define NMEA_RING_SIZE              1024            // bytes buffered between the UART and the parser, a power of two
+#define NMEA_MAX_SENTENCE           128             // longest sentence kept, between '$' and '*'
+#define NMEA_MAX_FIELDS             32              // fields of a sentence, counting the address
+
+/**
+ * What the sentences of the latest epoch say about the fix. A field keeps its value until a sentence carrying it
+ * arrives again; the position only changes with a sentence that reports a valid fix.
+ */
+struct NMEAFix {
+    long long timeOfDay = -1;           // UTC in microseconds since midnight, -1 until a sentence had a time
+    long long day = -1;                 // days since 1970-01-01 from RMC, -1 until known
+    double latitude = 0.0;              // degrees
+    char latitudeHemisphere = 'N';      // N/S
+    double longitude = 0.0;             // degrees
+    char longitudeHemisphere = 'W';     // E/W
+    double altitude = 0.0;              // meters above mean sea level, GGA
+    int quality = 0;                    // GGA: 0 no fix, 1 GPS, 2 differential, ...
+    int numSatellites = 0;              // GGA: satellites used
+    bool valid = false;                 // RMC and GLL status
+    double speed = 0.0;                 // knots over ground, RMC and VTG
+    double course = 0.0;                // degrees from true north, RMC and VTG
+    int fixType = 1;                    // GSA: 1 none, 2 2D, 3 3D
+    double pdop = 0.0;                  // GSA dilutions of precision; GGA has the horizontal one too
+    double hdop = 0.0;
+    double vdop = 0.0;
+
+    /**
+     * UTC microseconds since epoch, or -1 before RMC gave the date.
+     */
+    long long timestamp() const {
+        if (day < 0 || timeOfDay < 0) {
+            return -1;
+        }
+        return day * 86400000000LL + timeOfDay;
+    }
+};
+
+/**
+ * Streaming NMEA 0183 parser. Bytes from the UART go into its ByteRing (writePointer() and commit(), or write())
+ * and parse() runs them through a state machine one at a time, so sentences may be split across reads in any way.
+ * A sentence counts only if its `*hh` checksum matches; GGA, RMC, GLL, VTG and GSA from any talker (GP, GN, GL, ...)
+ * update the fix and other sentences are skipped. Nothing is allocated after construction.
+ *
+ * An epoch is complete once its GGA and RMC, which carry the same UTC time, have both arrived, in either order:
+ * parse() then returns true and leaves the bytes after that sentence in the ring for the next call.
+ *
+ * The counters are atomic, so a metrics scrape can read them while the GPS task parses.
+ */
+class NMEAParser : public ByteRing<NMEA_RING_SIZE> {
+public:
+    enum class Sentence {
+        GGA,
+        RMC,
+        GLL,
+        VTG,
+        GSA,
+        OTHER,
+        COUNT
+    };
+
+private:
+    enum class State {
+        START,                          // waiting for '$'
+        BODY,                           // address and fields, up to '*'
+        CHECKSUM_HIGH,
+        CHECKSUM_LOW
+    };
+
+    struct Field {
+        const char *data;
+        size_t length;
+
+        bool empty() const {
+            return length == 0;
+        }
+    };
+
+    State state = State::START;
+    char sentence[NMEA_MAX_SENTENCE];
+    size_t length = 0;
+    uint8_t checksum = 0;
+    uint8_t expected = 0;
+    Field fields[NMEA_MAX_FIELDS];
+    int fieldCount = 0;
+
+    NMEAFix fix;
+    long long ggaTime = -1;             // time of the latest GGA and RMC, an epoch is complete when they agree
+    long long rmcTime = -1;
+    long long epochTime = -1;           // time of the last complete epoch
+
+    Counter sentences[static_cast<int>(Sentence::COUNT)];
+    Counter checksumErrors;
+    Counter malformed;
+
+public:
+    /**
+     * Parse the buffered bytes until an epoch is complete. Returns false once the ring is empty without one.
+     */
+    bool parse() {
+        while (!empty()) {
+            if (consume(next())) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const NMEAFix &getFix() const {
+        return fix;
+    }
+
+    long long getSentences(Sentence type) const {
+        return sentences[static_cast<int>(type)].get();
+    }
+
+    long long getChecksumErrors() const {
+        return checksumErrors.get();
+    }
+
+    /**
+     * Sentences cut off, too long, or with fields that do not parse.
+     */
+    long long getMalformed() const {
+        return malformed.get();
+    }
+
+    /**
+     * Export the sentence counts by type, checksum errors and malformed sentences, with the given labels.
+     */
+    void setMetrics(MetricsRegistry &registry, const string &labels) {
+        static const char *names[] = {"GGA", "RMC", "GLL", "VTG", "GSA", "other"};
+        const string separator = labels.empty() ? "" : ",";
+        for (int i = 0; i < static_cast<int>(Sentence::COUNT); ++i) {
+            const Counter *counter = &sentences[i];
+            registry.counterFunction("gps_sentences_total", "NMEA sentences with a valid checksum.",
+                                     labels + separator + MetricsRegistry::label("type", names[i]),
+                                     [counter]() {
+                                         return counter->get();
+                                     });
+        }
+        registry.counterFunction("gps_checksum_errors_total", "NMEA sentences with a wrong checksum.", labels,
+                                 [this]() {
+                                     return checksumErrors.get();
+                                 });
+        registry.counterFunction("gps_parse_errors_total", "NMEA sentences cut off, too long or malformed.", labels,
+                                 [this]() {
+                                     return malformed.get();
+                                 });
+    }
+
+    /**
+     * Checksum of the characters between '$' and '*', to write a sentence.
+     */
+    static uint8_t checksumOf(const char *data, size_t count) {
+        uint8_t sum = 0;
+        for (size_t i = 0; i < count; ++i) {
+            sum ^= static_cast<uint8_t>(data[i]);
+        }
+        return sum;
+    }
+
+private:
+    bool consume(char c) {
+        switch (state) {
+            case State::START:
+                if (c == '$') {
+                    begin();
+                }
+                return false;
+            case State::BODY:
+                if (c == '*') {
+                    state = State::CHECKSUM_HIGH;
+                } else if (c < 0x20 || c > 0x7e || c == '$' || length == NMEA_MAX_SENTENCE) {
+                    // a line end before the checksum, or the next sentence started
+                    restart(c);
+                } else {
+                    sentence[length++] = c;
+                    checksum ^= static_cast<uint8_t>(c);
+                }
+                return false;
+            case State::CHECKSUM_HIGH: {
+                int value = hexValue(c);
+                if (value < 0) {
+                    restart(c);
+                    return false;
+                }
+                expected = static_cast<uint8_t>(value << 4);
+                state = State::CHECKSUM_LOW;
+                return false;
+            }
+            case State::CHECKSUM_LOW: {
+                int value = hexValue(c);
+                if (value < 0) {
+                    restart(c);
+                    return false;
+                }
+                state = State::START;
+                if ((expected | value) != checksum) {
+                    checksumErrors.increment();
+                    return false;
+                }
+                return dispatch();
+            }
+            default:
+                return false;
+        }
+    }
+
+    void begin() {
+        state = State::BODY;
+        length = 0;
+        checksum = 0;
+    }
+
+    void restart(char c) {
+        malformed.increment();
+        if (c == '$') {
+            begin();
+        } else {
+            state = State::START;
+        }
+    }
+
+    static int hexValue(char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        }
+        if (c >= 'A' && c <= 'F') {
+            return c - 'A' + 10;
+        }
+        if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        return -1;
+    }
+
+    /**
+     * Split the sentence at the commas and apply it. Returns true if it completed an epoch.
+     */
+    bool dispatch() {
+        fieldCount = 0;
+        size_t start = 0;
+        for (size_t i = 0; i <= length; ++i) {
+            if (i == length || sentence[i] == ',') {
+                if (fieldCount == NMEA_MAX_FIELDS) {
+                    malformed.increment();
+                    return false;
+                }
+                fields[fieldCount++] = Field{sentence + start, i - start};
+                start = i + 1;
+            }
+        }
+
+        Sentence type = typeOf(fields[0]);
+        bool ok;
+        switch (type) {
+            case Sentence::GGA:
+                ok = applyGGA();
+                break;
+            case Sentence::RMC:
+                ok = applyRMC();
+                break;
+            case Sentence::GLL:
+                ok = applyGLL();
+                break;
+            case Sentence::VTG:
+                ok = applyVTG();
+                break;
+            case Sentence::GSA:
+                ok = applyGSA();
+                break;
+            default:
+                ok = true;
+                break;
+        }
+        if (!ok) {
+            malformed.increment();
+            return false;
+        }
+        sentences[static_cast<int>(type)].increment();
+        if ((type == Sentence::GGA || type == Sentence::RMC) && ggaTime >= 0 && ggaTime == rmcTime &&
+            ggaTime != epochTime) {
+            epochTime = ggaTime;
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * Two letter talker and three letter type, e.g. GPGGA or GNRMC. Proprietary sentences (P...) are OTHER.
+     */
+    static Sentence typeOf(const Field &address) {
+        if (address.length != 5 || address.data[0] == 'P') {
+            return Sentence::OTHER;
+        }
+        const char *type = address.data + 2;
+        if (memcmp(type, "GGA", 3) == 0) {
+            return Sentence::GGA;
+        }
+        if (memcmp(type, "RMC", 3) == 0) {
+            return Sentence::RMC;
+        }
+        if (memcmp(type, "GLL", 3) == 0) {
+            return Sentence::GLL;
+        }
+        if (memcmp(type, "VTG", 3) == 0) {
+            return Sentence::VTG;
+        }
+        if (memcmp(type, "GSA", 3) == 0) {
+            return Sentence::GSA;
+        }
+        return Sentence::OTHER;
+    }
+
+    // $GPGGA,050105.00,3720.61633,N,12200.67448,W,2,11,0.86,48.8,M,-30.0,M,,0000*57
+    //      time hhmmss.ss, latitude ddmm.mm, N/S, longitude dddmm.mm, E/W, quality, satellites, hdop, altitude, M,
+    //      geoid separation, M, age of differential corrections, station
+    bool applyGGA() {
+        long long time;
+        double latitude, longitude;
+        int quality, satellites = fix.numSatellites;
+        double hdop = fix.hdop, altitude = fix.altitude;
+        if (fieldCount < 10 || !toTime(fields[1], time) || !toInt(fields[6], quality) ||
+            !optionalInt(fields[7], satellites) || !optionalDouble(fields[8], hdop) ||
+            !optionalDouble(fields[9], altitude)) {
+            return false;
+        }
+        if (quality > 0) {
+            if (!toDegrees(fields[2], latitude) || !toHemisphere(fields[3], "NS") ||
+                !toDegrees(fields[4], longitude) || !toHemisphere(fields[5], "EW")) {
+                return false;
+            }
+            setPosition(latitude, fields[3].data[0], longitude, fields[5].data[0]);
+            fix.altitude = altitude;
+        }
+        fix.timeOfDay = ggaTime = time;
+        fix.quality = quality;
+        fix.numSatellites = satellites;
+        fix.hdop = hdop;
+        return true;
+    }
+
+    // $GPRMC,050105.00,A,3720.61633,N,12200.67448,W,0.045,,301018,,,D*63
+    //      time, status A/V, latitude, N/S, longitude, E/W, speed in knots, course, date ddmmyy, magnetic variation,
+    //      E/W, mode
+    bool applyRMC() {
+        long long time, day = fix.day;
+        double latitude, longitude;
+        double speed = fix.speed, course = fix.course;
+        if (fieldCount < 10 || !toTime(fields[1], time) || fields[2].length != 1 ||
+            !optionalDouble(fields[7], speed) || !optionalDouble(fields[8], course) ||
+            (!fields[9].empty() && !toDay(fields[9], day))) {
+            return false;
+        }
+        bool valid = fields[2].data[0] == 'A';
+        if (valid) {
+            if (!toDegrees(fields[3], latitude) || !toHemisphere(fields[4], "NS") ||
+                !toDegrees(fields[5], longitude) || !toHemisphere(fields[6], "EW")) {
+                return false;
+            }
+            setPosition(latitude, fields[4].data[0], longitude, fields[6].data[0]);
+        }
+        fix.timeOfDay = rmcTime = time;
+        fix.day = day;
+        fix.valid = valid;
+        fix.speed = speed;
+        fix.course = course;
+        return true;
+    }
+
+    // $GPGLL,3720.61633,N,12200.67448,W,050105.00,A,D*70
+    //      latitude, N/S, longitude, E/W, time, status A/V, mode
+    bool applyGLL() {
+        long long time;
+        double latitude, longitude;
+        if (fieldCount < 7 || !toTime(fields[5], time) || fields[6].length != 1) {
+            return false;
+        }
+        bool valid = fields[6].data[0] == 'A';
+        if (valid) {
+            if (!toDegrees(fields[1], latitude) || !toHemisphere(fields[2], "NS") ||
+                !toDegrees(fields[3], longitude) || !toHemisphere(fields[4], "EW")) {
+                return false;
+            }
+            setPosition(latitude, fields[2].data[0], longitude, fields[4].data[0]);
+        }
+        fix.timeOfDay = time;
+        fix.valid = valid;
+        return true;
+    }
+
+    // $GPVTG,,T,,M,0.045,N,0.083,K,D*2C
+    //      course true, T, course magnetic, M, speed in knots, N, speed in km/h, K, mode
+    bool applyVTG() {
+        double course = fix.course, speed = fix.speed;
+        if (fieldCount < 8 || !optionalDouble(fields[1], course) || !optionalDouble(fields[5], speed)) {
+            return false;
+        }
+        fix.course = course;
+        fix.speed = speed;
+        return true;
+    }
+
+    // $GPGSA,A,3,05,13,15,18,20,21,24,26,29,,,,1.53,0.86,1.27*0D
+    //      mode M/A, fix type, 12 satellite ids, pdop, hdop, vdop
+    bool applyGSA() {
+        int fixType;
+        double pdop = fix.pdop, hdop = fix.hdop, vdop = fix.vdop;
+        if (fieldCount < 18 || !toInt(fields[2], fixType) || !optionalDouble(fields[15], pdop) ||
+            !optionalDouble(fields[16], hdop) || !optionalDouble(fields[17], vdop)) {
+            return false;
+        }
+        fix.fixType = fixType;
+        fix.pdop = pdop;
+        fix.hdop = hdop;
+        fix.vdop = vdop;
+        return true;
+    }
+
+    void setPosition(double latitude, char latitudeHemisphere, double longitude, char longitudeHemisphere) {
+        fix.latitude = latitude;
+        fix.latitudeHemisphere = latitudeHemisphere;
+        fix.longitude = longitude;
+        fix.longitudeHemisphere = longitudeHemisphere;
+    }
+
+    static long long power10(int exponent) {
+        static const long long powers[] = {1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL, 10000000LL,
+                                           100000000LL, 1000000000LL, 10000000000LL, 100000000000LL,
+                                           1000000000000LL, 10000000000000LL, 100000000000000LL,
+                                           1000000000000000LL, 10000000000000000LL, 100000000000000000LL};
+        return powers[exponent];
+    }
+
+    /**
+     * A decimal number [-]digits[.digits] as mantissa / 10^decimals, exactly. At most 17 digits.
+     */
+    static bool toDecimal(const Field &field, long long &mantissa, int &decimals) {
+        size_t i = 0;
+        bool negative = field.length > 0 && field.data[0] == '-';
+        if (negative) {
+            i++;
+        }
+        mantissa = 0;
+        decimals = -1;
+        int digits = 0;
+        for (; i < field.length; ++i) {
+            char c = field.data[i];
+            if (c == '.' && decimals < 0) {
+                decimals = 0;
+            } else if (c >= '0' && c <= '9' && digits < 17) {
+                mantissa = mantissa * 10 + (c - '0');
+                digits++;
+                if (decimals >= 0) {
+                    decimals++;
+                }
+            } else {
+                return false;
+            }
+        }
+        if (decimals < 0) {
+            decimals = 0;
+        }
+        if (negative) {
+            mantissa = -mantissa;
+        }
+        return digits > 0;
+    }
+
+    /**
+     * Both parts are exact and the division rounds once, so this gives the same double as strtod.
+     */
+    static bool toDouble(const Field &field, double &value) {
+        long long mantissa;
+        int decimals;
+        if (!toDecimal(field, mantissa, decimals)) {
+            return false;
+        }
+        value = static_cast<double>(mantissa) / power10(decimals);
+        return true;
+    }
+
+    static bool toInt(const Field &field, int &value) {
+        long long mantissa;
+        int decimals;
+        if (!toDecimal(field, mantissa, decimals) || decimals != 0 || mantissa > INT32_MAX || mantissa < INT32_MIN) {
+            return false;
+        }
+        value = static_cast<int>(mantissa);
+        return true;
+    }
+
+    /**
+     * An empty field leaves value as it is.
+     */
+    static bool optionalDouble(const Field &field, double &value) {
+        return field.empty() || toDouble(field, value);
+    }
+
+    static bool optionalInt(const Field &field, int &value) {
+        return field.empty() || toInt(field, value);
+    }
+
+    /**
+     * Degrees from (d)ddmm.mmmm.
+     */
+    static bool toDegrees(const Field &field, double &degrees) {
+        long long mantissa;
+        int decimals;
+        if (!toDecimal(field, mantissa, decimals) || mantissa < 0) {
+            return false;
+        }
+        long long scale = power10(decimals);
+        long long wholeDegrees = mantissa / scale / 100;
+        double minutes = static_cast<double>(mantissa - wholeDegrees * 100 * scale) / scale;
+        degrees = wholeDegrees + minutes / 60.0;
+        return true;
+    }
+
+    static bool toHemisphere(const Field &field, const char *allowed) {
+        return field.length == 1 && (field.data[0] == allowed[0] || field.data[0] == allowed[1]);
+    }
+
+    /**
+     * Microseconds since midnight from hhmmss[.sss].
+     */
+    static bool toTime(const Field &field, long long &time) {
+        long long mantissa;
+        int decimals;
+        if (!toDecimal(field, mantissa, decimals) || mantissa < 0 || decimals > 6) {
+            return false;
+        }
+        long long scale = power10(decimals);
+        long long whole = mantissa / scale;
+        long long hours = whole / 10000, minutes = whole / 100 % 100, seconds = whole % 100;
+        if (hours > 23 || minutes > 59 || seconds > 60) {
+            return false;
+        }
+        time = ((hours * 60 + minutes) * 60 + seconds) * 1000000 + (mantissa % scale) * (1000000 / scale);
+        return true;
+    }
+
+    /**
+     * Days since 1970-01-01 from ddmmyy, in the years 2000 to 2099.
+     */
+    static bool toDay(const Field &field, long long &day) {
+        int date;
+        if (field.length != 6 || !toInt(field, date)) {
+            return false;
+        }
+        long long d = date / 10000, m = date / 100 % 100, y = 2000 + date % 100;
+        if (d < 1 || d > 31 || m < 1 || m > 12) {
+            return false;
+        }
+        day = daysSinceEpoch(y, m, d);
+        return true;
+    }
+};
+
+#endif // SENSOR_NMEA_HPP
@@ -0,0 +1,413 @@
+#ifndef SENSOR_UBX_HPP
+#define SENSOR_UBX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <core/byteRing.hpp>
+#include <core/metrics.hpp>
+#include <core/wireFormat.hpp>
+#include <utils/misc.hpp>
+
+using namespace std;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "UBX payloads are copied into packed structs and need a little endian host"
+#endif
+
+#define UBX_RING_SIZE               1024            // bytes buffered between the UART and the parser
+#define UBX_MAX_PAYLOAD             512             // payloads kept, longer ones are only checksummed
+#define UBX_MAX_LENGTH              8192            // a longer length field is taken as a false sync
+
+#define UBX_SYNC_1                  0xB5
+#define UBX_SYNC_2                  0x62
+#define UBX_CLASS_NAV               0x01
+#define UBX_CLASS_ACK               0x05
+#define UBX_CLASS_CFG               0x06
+#define UBX_NAV_STATUS              0x03
+#define UBX_NAV_PVT                 0x07
+#define UBX_ACK_NAK                 0x00
+#define UBX_ACK_ACK                 0x01
+#define UBX_CFG_PRT                 0x00
+#define UBX_CFG_MSG                 0x01
+#define UBX_CFG_RATE                0x08
+
+/**
+ * UBX-NAV-PVT payload: position, velocity and time of one navigation epoch, as the receiver sends it.
+ */
+struct UBXNavPVT {
+    uint32_t iTOW;                      // GPS time of week of the epoch, ms
+    uint16_t year;                      // UTC
+    uint8_t month;
+    uint8_t day;
+    uint8_t hour;
+    uint8_t min;
+    uint8_t sec;
+    uint8_t valid;                      // bit 0 date valid, bit 1 time valid
+    uint32_t tAcc;                      // time accuracy, ns
+    int32_t nano;                       // fraction of the second, -1e9 to 1e9 ns
+    uint8_t fixType;                    // 0 none, 1 dead reckoning, 2 2D, 3 3D, 4 GNSS + dead reckoning, 5 time only
+    uint8_t flags;                      // bit 0 gnssFixOK
+    uint8_t flags2;
+    uint8_t numSV;                      // satellites used
+    int32_t lon;                        // 1e-7 degrees
+    int32_t lat;                        // 1e-7 degrees
+    int32_t height;                     // above the ellipsoid, mm
+    int32_t hMSL;                       // above mean sea level, mm
+    uint32_t hAcc;                      // mm
+    uint32_t vAcc;                      // mm
+    int32_t velN;                       // mm/s
+    int32_t velE;
+    int32_t velD;
+    int32_t gSpeed;                     // ground speed, mm/s
+    int32_t headMot;                    // heading of motion, 1e-5 degrees
+    uint32_t sAcc;                      // mm/s
+    uint32_t headAcc;                   // 1e-5 degrees
+    uint16_t pDOP;                      // 0.01
+    uint8_t flags3;
+    uint8_t reserved1[5];
+    int32_t headVeh;                    // 1e-5 degrees
+    int16_t magDec;                     // 1e-2 degrees
+    uint16_t magAcc;
+
+    bool hasTime() const {
+        return (valid & 0x03) == 0x03;
+    }
+
+    bool fixOK() const {
+        return (flags & 0x01) != 0 && fixType >= 2 && fixType <= 4;
+    }
+
+    /**
+     * UTC microseconds since epoch; only meaningful if hasTime().
+     */
+    long long timestamp() const {
+        long long seconds = daysSinceEpoch(year, month, day) * 86400LL + hour * 3600LL + min * 60LL + sec;
+        return seconds * 1000000LL + nano / 1000;
+    }
+} __attribute__((packed));
+
+static_assert(sizeof(UBXNavPVT) == 92, "UBX-NAV-PVT payload is 92 bytes");
+
+/**
+ * UBX-NAV-STATUS payload: fix state and time to first fix.
+ */
+struct UBXNavStatus {
+    uint32_t iTOW;                      // ms
+    uint8_t gpsFix;                     // as UBXNavPVT::fixType
+    uint8_t flags;                      // bit 0 gpsFixOk, bit 1 differential corrections applied
+    uint8_t fixStat;
+    uint8_t flags2;
+    uint32_t ttff;                      // time to first fix, ms
+    uint32_t msss;                      // ms since startup or reset
+} __attribute__((packed));
+
+static_assert(sizeof(UBXNavStatus) == 16, "UBX-NAV-STATUS payload is 16 bytes");
+
+/**
+ * Streaming decoder of u-blox UBX frames: sync bytes B5 62, class, id, little endian length, payload and a Fletcher
+ * checksum. Like NMEAParser, bytes go into its ByteRing and parse() runs them through a state machine, so frames may
+ * be split across reads, and text between frames (NMEA on the same port) is skipped. Nothing is allocated after
+ * construction.
+ *
+ * A frame counts only if its checksum matches. NAV-PVT and NAV-STATUS payloads are copied into their packed structs;
+ * a NAV-PVT completes an epoch, so parse() returns true after each one and leaves the bytes after it in the ring.
+ * ACK-ACK and ACK-NAK answers to configuration messages are counted.
+ */
+class UBXParser : public ByteRing<UBX_RING_SIZE> {
+public:
+    enum class Message {
+        NAV_PVT,
+        NAV_STATUS,
+        ACK,
+        NAK,
+        OTHER,
+        COUNT
+    };
+
+private:
+    enum class State {
+        SYNC_1,
+        SYNC_2,
+        CLASS,
+        ID,
+        LENGTH_LOW,
+        LENGTH_HIGH,
+        PAYLOAD,
+        CHECKSUM_A,
+        CHECKSUM_B
+    };
+
+    State state = State::SYNC_1;
+    uint8_t msgClass = 0;
+    uint8_t msgId = 0;
+    size_t length = 0;
+    size_t received = 0;                // payload bytes so far
+    uint8_t checksumA = 0;
+    uint8_t checksumB = 0;
+    uint8_t payload[UBX_MAX_PAYLOAD];
+
+    UBXNavPVT pvt{};
+    UBXNavStatus status{};
+    bool hasPVT = false;
+
+    Counter messages[static_cast<int>(Message::COUNT)];
+    Counter checksumErrors;
+    Counter malformed;
+
+public:
+    /**
+     * Parse the buffered bytes until a NAV-PVT arrives. Returns false once the ring is empty without one.
+     */
+    bool parse() {
+        while (!empty()) {
+            if (consume(static_cast<uint8_t>(next()))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * The latest NAV-PVT, all zero before the first one.
+     */
+    const UBXNavPVT &getPVT() const {
+        return pvt;
+    }
+
+    bool receivedPVT() const {
+        return hasPVT;
+    }
+
+    const UBXNavStatus &getStatus() const {
+        return status;
+    }
+
+    long long getMessages(Message type) const {
+        return messages[static_cast<int>(type)].get();
+    }
+
+    long long getChecksumErrors() const {
+        return checksumErrors.get();
+    }
+
+    /**
+     * Frames with an impossible length, or a NAV payload of the wrong size.
+     */
+    long long getMalformed() const {
+        return malformed.get();
+    }
+
+    /**
+     * Export the frame counts by message, checksum errors and malformed frames, with the given labels.
+     */
+    void setMetrics(MetricsRegistry &registry, const string &labels) {
+        static const char *names[] = {"NAV-PVT", "NAV-STATUS", "ACK-ACK", "ACK-NAK", "other"};
+        const string separator = labels.empty() ? "" : ",";
+        for (int i = 0; i < static_cast<int>(Message::COUNT); ++i) {
+            const Counter *counter = &messages[i];
+            registry.counterFunction("gps_ubx_messages_total", "UBX frames with a valid checksum.",
+                                     labels + separator + MetricsRegistry::label("message", names[i]),
+                                     [counter]() {
+                                         return counter->get();
+                                     });
+        }
+        registry.counterFunction("gps_ubx_checksum_errors_total", "UBX frames with a wrong checksum.", labels,
+                                 [this]() {
+                                     return checksumErrors.get();
+                                 });
+        registry.counterFunction("gps_ubx_parse_errors_total", "UBX frames with a bad length.", labels, [this]() {
+            return malformed.get();
+        });
+    }
+
+private:
+    bool consume(uint8_t c) {
+        switch (state) {
+            case State::SYNC_1:
+                if (c == UBX_SYNC_1) {
+                    state = State::SYNC_2;
+                }
+                return false;
+            case State::SYNC_2:
+                state = c == UBX_SYNC_2 ? State::CLASS : c == UBX_SYNC_1 ? State::SYNC_2 : State::SYNC_1;
+                checksumA = checksumB = 0;
+                return false;
+            case State::CLASS:
+                msgClass = c;
+                addToChecksum(c);
+                state = State::ID;
+                return false;
+            case State::ID:
+                msgId = c;
+                addToChecksum(c);
+                state = State::LENGTH_LOW;
+                return false;
+            case State::LENGTH_LOW:
+                length = c;
+                addToChecksum(c);
+                state = State::LENGTH_HIGH;
+                return false;
+            case State::LENGTH_HIGH:
+                length |= static_cast<size_t>(c) << 8;
+                addToChecksum(c);
+                received = 0;
+                if (length > UBX_MAX_LENGTH) {
+                    malformed.increment();
+                    state = State::SYNC_1;
+                } else {
+                    state = length == 0 ? State::CHECKSUM_A : State::PAYLOAD;
+                }
+                return false;
+            case State::PAYLOAD:
+                if (received < UBX_MAX_PAYLOAD) {
+                    payload[received] = c;
+                }
+                received++;
+                addToChecksum(c);
+                if (received == length) {
+                    state = State::CHECKSUM_A;
+                }
+                return false;
+            case State::CHECKSUM_A:
+                state = c == checksumA ? State::CHECKSUM_B : State::SYNC_1;
+                if (c != checksumA) {
+                    checksumErrors.increment();
+                }
+                return false;
+            case State::CHECKSUM_B:
+                state = State::SYNC_1;
+                if (c != checksumB) {
+                    checksumErrors.increment();
+                    return false;
+                }
+                return dispatch();
+            default:
+                return false;
+        }
+    }
+
+    void addToChecksum(uint8_t c) {
+        checksumA += c;
+        checksumB += checksumA;
+    }
+
+    /**
+     * Apply a frame whose checksum matched. Returns true for a NAV-PVT.
+     */
+    bool dispatch() {
+        if (msgClass == UBX_CLASS_NAV && msgId == UBX_NAV_PVT) {
+            if (length != sizeof(UBXNavPVT)) {
+                malformed.increment();
+                return false;
+            }
+            memcpy(&pvt, payload, sizeof(pvt));
+            hasPVT = true;
+            messages[static_cast<int>(Message::NAV_PVT)].increment();
+            return true;
+        }
+        if (msgClass == UBX_CLASS_NAV && msgId == UBX_NAV_STATUS) {
+            if (length != sizeof(UBXNavStatus)) {
+                malformed.increment();
+                return false;
+            }
+            memcpy(&status, payload, sizeof(status));
+            messages[static_cast<int>(Message::NAV_STATUS)].increment();
+        } else if (msgClass == UBX_CLASS_ACK && msgId == UBX_ACK_ACK) {
+            messages[static_cast<int>(Message::ACK)].increment();
+        } else if (msgClass == UBX_CLASS_ACK && msgId == UBX_ACK_NAK) {
+            messages[static_cast<int>(Message::NAK)].increment();
+        } else {
+            messages[static_cast<int>(Message::OTHER)].increment();
+        }
+        return false;
+    }
+};
+
+/**
+ * Configuration messages for u-blox receivers, as complete frames to write to the UART. These are the CFG-PRT,
+ * CFG-MSG and CFG-RATE messages of the u-blox 6, 7 and 8 generations; the M9 and M10 replace them with CFG-VALSET.
+ */
+class UBXConfig {
+public:
+    /**
+     * A UBX frame around payload, with its checksum.
+     */
+    static string frame(uint8_t msgClass, uint8_t msgId, const string &payload) {
+        string buffer;
+        BinaryWriter writer(buffer);
+        writer.putU8(UBX_SYNC_1);
+        writer.putU8(UBX_SYNC_2);
+        writer.putU8(msgClass);
+        writer.putU8(msgId);
+        writer.putU16(static_cast<uint16_t>(payload.size()));
+        buffer += payload;
+        uint8_t checksumA = 0, checksumB = 0;
+        for (size_t i = 2; i < buffer.size(); ++i) {
+            checksumA += static_cast<uint8_t>(buffer[i]);
+            checksumB += checksumA;
+        }
+        writer.putU8(checksumA);
+        writer.putU8(checksumB);
+        return buffer;
+    }
+
+    /**
+     * CFG-MSG: send a message once every rate navigation epochs on the port the command arrives on, 0 to stop it.
+     */
+    static string messageRate(uint8_t msgClass, uint8_t msgId, uint8_t rate) {
+        string payload;
+        BinaryWriter writer(payload);
+        writer.putU8(msgClass);
+        writer.putU8(msgId);
+        writer.putU8(rate);
+        return frame(UBX_CLASS_CFG, UBX_CFG_MSG, payload);
+    }
+
+    /**
+     * CFG-RATE: navigation epochs per second, aligned to GPS time.
+     */
+    static string measurementRate(int rateHz) {
+        string payload;
+        BinaryWriter writer(payload);
+        writer.putU16(static_cast<uint16_t>(1000 / rateHz));     // measurement period, ms
+        writer.putU16(1);                                       // one navigation solution per measurement
+        writer.putU16(1);                                       // GPS time
+        return frame(UBX_CLASS_CFG, UBX_CFG_RATE, payload);
+    }
+
+    /**
+     * CFG-PRT for UART1: 8N1 at baudRate, accepting UBX and NMEA, sending UBX and NMEA only if nmeaOutput.
+     */
+    static string uartPort(int baudRate, bool nmeaOutput) {
+        string payload;
+        BinaryWriter writer(payload);
+        writer.putU8(1);                                        // UART1
+        writer.putU8(0);
+        writer.putU16(0);                                       // no TX ready pin
+        writer.putU32(0x08D0);                                  // 8 bits, no parity, 1 stop bit
+        writer.putU32(static_cast<uint32_t>(baudRate));
+        writer.putU16(0x0003);                                  // in: UBX and NMEA
+        writer.putU16(nmeaOutput ? 0x0003 : 0x0001);            // out: UBX, and NMEA if asked
+        writer.putU16(0);
+        writer.putU16(0);
+        return frame(UBX_CLASS_CFG, UBX_CFG_PRT, payload);
+    }
+
+    /**
+     * Switch the receiver to NAV-PVT and NAV-STATUS every epoch at rateHz and UBX only output at baudRate. The port
+     * change comes last: the receiver answers it, and everything after, at the new baud rate.
+     */
+    static vector<string> binaryOutput(int baudRate, int rateHz) {
+        return vector<string>{
+            messageRate(UBX_CLASS_NAV, UBX_NAV_PVT, 1),
+            messageRate(UBX_CLASS_NAV, UBX_NAV_STATUS, 1),
+            measurementRate(rateHz),
+            uartPort(baudRate, false)
+        };
+    }
+};
+
+#endif // SENSOR_UBX_HPP
@@ -0,0 +1,241 @@
+#ifndef SIM_MONTECARLO_HPP
+#define SIM_MONTECARLO_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <streambuf>
+#include <vector>
+#include <core/workStealingPool.hpp>
+#include <sim/quadSimulator.hpp>
+
+#define MONTE_CARLO_SECONDS         10              // simulated time per flight
+#define MONTE_CARLO_MAX_TILT        (20.0 * DEGREE_TO_RAD)
+#define MONTE_CARLO_MAX_RATE        0.5             // rad/s per axis at the start
+#define MONTE_CARLO_MAX_YAW         (30.0 * DEGREE_TO_RAD)
+#define MONTE_CARLO_MAX_WIND        3.0             // m/s, horizontal
+#define MONTE_CARLO_NOISE_SCALE     2.0             // sensor noise between 1 / scale and scale times the default
+
+/**
+ * How many flights per parameter set and how the scenarios are drawn. Flight i gets the same scenario (initial
+ * attitude and rate, wind, sensor noise and seed) for every parameter set, so parameter sets are compared on the
+ * same flights, and the results do not depend on the number of threads.
+ */
+struct MonteCarloConfig {
+    int flights = 100;
+    double seconds = MONTE_CARLO_SECONDS;
+    double maxInitialTilt = MONTE_CARLO_MAX_TILT;   // radians, in a random direction
+    double maxInitialRate = MONTE_CARLO_MAX_RATE;
+    double maxInitialYaw = MONTE_CARLO_MAX_YAW;
+    double maxWind = MONTE_CARLO_MAX_WIND;
+    double noiseScale = MONTE_CARLO_NOISE_SCALE;
+    unsigned int seed = 1;
+    unsigned int threads = 0;                       // 0 for one per core
+    QuadSimulatorConfig base;                       // everything that is not drawn or swept
+};
+
+/**
+ * Controller gains and filter weight under test.
+ */
+struct ParameterSet {
+    QuadControlGains gains;
+    double filterAlpha = ATTITUDE_FILTER_ALPHA;
+
+    /**
+     * The same gains on all three attitude controllers.
+     */
+    static ParameterSet attitude(const PIDGains &gains, double filterAlpha) {
+        ParameterSet parameters;
+        parameters.gains.yaw = gains;
+        parameters.gains.pitch = gains;
+        parameters.gains.roll = gains;
+        parameters.filterAlpha = filterAlpha;
+        return parameters;
+    }
+
+    string toString() const {
+        stringstream ss;
+        ss << "pitch=" << gains.pitch.kp << "/" << gains.pitch.ki << "/" << gains.pitch.kd << " roll="
+           << gains.roll.kp << "/" << gains.roll.ki << "/" << gains.roll.kd << " yaw=" << gains.yaw.kp << "/"
+           << gains.yaw.ki << "/" << gains.yaw.kd << " alpha=" << filterAlpha;
+        return ss.str();
+    }
+};
+
+/**
+ * Metrics of all flights of one parameter set. Settling times count flights that never settled at the flight time.
+ */
+struct ParameterResult {
+    ParameterSet parameters;
+    int flights = 0;
+    int crashed = 0;
+    int settled = 0;
+    double meanSettlingTime = 0.0;
+    double p95SettlingTime = 0.0;
+    double meanOvershoot = 0.0;
+    double maxTilt = 0.0;               // radians, over all flights
+    double meanEffort = 0.0;            // V^2 s per flight
+
+    string toString() const {
+        stringstream ss;
+        ss << parameters.toString() << ": settled=" << settled << "/" << flights << " crashed=" << crashed
+           << " settling mean=" << meanSettlingTime << "s p95=" << p95SettlingTime << "s overshoot="
+           << meanOvershoot << " maxTilt=" << maxTilt * RAD_TO_DEGREE << "deg effort=" << meanEffort << "V^2s";
+        return ss.str();
+    }
+};
+
+struct MonteCarloStats {
+    long long flights = 0;
+    unsigned int threads = 0;
+    double wallSeconds = 0.0;
+    double simulatedSeconds = 0.0;
+    long long steals = 0;
+
+    string toString() const {
+        stringstream ss;
+        ss << "flights=" << flights << " threads=" << threads << " wall=" << wallSeconds << "s ("
+           << (wallSeconds > 0 ? flights / wallSeconds : 0.0) << " flights/s, "
+           << (wallSeconds > 0 ? simulatedSeconds / wallSeconds : 0.0) << "x realtime) steals=" << steals;
+        return ss.str();
+    }
+};
+
+/**
+ * Fans simulated flights (see QuadSimulator) of every parameter set over a WorkStealingPool and collects settling
+ * time, overshoot and motor effort per parameter set. Each flight is one job and shares nothing with the others,
+ * so throughput grows with the number of cores.
+ *
+ * The IMU driver of every simulated flight prints its setup to cout. A batch would bury its own output in those
+ * lines, so cout is muted while flights run and the simulators are set up one at a time.
+ */
+class MonteCarloRunner {
+private:
+    /**
+     * Swallows everything written to it.
+     */
+    class NullBuffer : public streambuf {
+    protected:
+        int overflow(int c) override {
+            return c;
+        }
+    };
+
+    const MonteCarloConfig config;
+    WorkStealingPool pool;
+    boost::mutex setupMutex;
+    MonteCarloStats stats;
+
+public:
+    explicit MonteCarloRunner(const MonteCarloConfig &config = MonteCarloConfig())
+        : config(config), pool(config.threads) {
+    }
+
+    vector<ParameterResult> run(const vector<ParameterSet> &parameterSets) {
+        const int flights = config.flights;
+        vector<SimulatorStats> results(parameterSets.size() * flights);
+        long long stealsBefore = pool.getSteals();
+        NullBuffer nullBuffer;
+        streambuf *coutBuffer = cout.rdbuf(&nullBuffer);
+        auto start = chrono::steady_clock::now();
+
+        for (size_t set = 0; set < parameterSets.size(); ++set) {
+            for (int flight = 0; flight < flights; ++flight) {
+                SimulatorStats *result = &results[set * flights + flight];
+                const ParameterSet *parameters = &parameterSets[set];
+                pool.submit([this, result, parameters, flight]() {
+                    *result = fly(*parameters, flight);
+                });
+            }
+        }
+        pool.wait();
+
+        cout.rdbuf(coutBuffer);
+        stats.flights = static_cast<long long>(results.size());
+        stats.threads = static_cast<unsigned int>(pool.size());
+        stats.wallSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        stats.simulatedSeconds = results.size() * config.seconds;
+        stats.steals = pool.getSteals() - stealsBefore;
+
+        vector<ParameterResult> summary;
+        for (size_t set = 0; set < parameterSets.size(); ++set) {
+            summary.push_back(summarize(parameterSets[set], &results[set * flights], flights));
+        }
+        return summary;
+    }
+
+    MonteCarloStats getStats() const {
+        return stats;
+    }
+
+    /**
+     * The simulator configuration of flight number flight with the given parameters.
+     */
+    QuadSimulatorConfig scenario(const ParameterSet &parameters, int flight) const {
+        seed_seq seeds{config.seed, static_cast<unsigned int>(flight)};
+        mt19937 rng(seeds);
+        uniform_real_distribution<double> unit(0.0, 1.0);
+        auto symmetric = [&](double limit) {
+            return limit * (2.0 * unit(rng) - 1.0);
+        };
+
+        QuadSimulatorConfig simulator = config.base;
+        double tilt = config.maxInitialTilt * unit(rng);
+        double direction = 2.0 * M_PI * unit(rng);
+        simulator.initialAttitude = Vector3(tilt * cos(direction), tilt * sin(direction),
+                                            symmetric(config.maxInitialYaw));
+        simulator.initialAngularRate = Vector3(symmetric(config.maxInitialRate), symmetric(config.maxInitialRate),
+                                               symmetric(config.maxInitialRate));
+        double wind = config.maxWind * unit(rng);
+        double windDirection = 2.0 * M_PI * unit(rng);
+        simulator.physics.wind = Vector3(wind * cos(windDirection), wind * sin(windDirection), 0);
+        double noise = exp(symmetric(log(config.noiseScale)));
+        simulator.sensor.gyroNoise *= noise;
+        simulator.sensor.accelNoise *= noise;
+        simulator.sensor.compassNoise *= noise;
+        simulator.sensor.seed = static_cast<unsigned int>(rng());
+
+        simulator.gains = parameters.gains;
+        simulator.filterAlpha = parameters.filterAlpha;
+        return simulator;
+    }
+
+private:
+    SimulatorStats fly(const ParameterSet &parameters, int flight) {
+        unique_ptr<QuadSimulator> simulator;
+        {
+            boost::lock_guard<boost::mutex> lk(setupMutex);
+            simulator.reset(new QuadSimulator(scenario(parameters, flight)));
+        }
+        return simulator->run(config.seconds);
+    }
+
+    static ParameterResult summarize(const ParameterSet &parameters, const SimulatorStats *results, int flights) {
+        ParameterResult result;
+        result.parameters = parameters;
+        result.flights = flights;
+        vector<double> settlingTimes;
+        for (int i = 0; i < flights; ++i) {
+            const SimulatorStats &flight = results[i];
+            result.crashed += flight.crashed ? 1 : 0;
+            result.settled += flight.settled ? 1 : 0;
+            result.meanSettlingTime += flight.settlingTime;
+            result.meanOvershoot += flight.overshoot;
+            result.meanEffort += flight.effort;
+            result.maxTilt = max(result.maxTilt, flight.maxTilt);
+            settlingTimes.push_back(flight.settlingTime);
+        }
+        if (flights > 0) {
+            result.meanSettlingTime /= flights;
+            result.meanOvershoot /= flights;
+            result.meanEffort /= flights;
+            sort(settlingTimes.begin(), settlingTimes.end());
+            result.p95SettlingTime = settlingTimes[min(flights - 1, static_cast<int>(0.95 * flights))];
+        }
+        return result;
+    }
+};
+
+#endif // SIM_MONTECARLO_HPP
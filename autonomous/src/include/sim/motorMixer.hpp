@@ -0,0 +1,74 @@
+#ifndef SIM_MOTORMIXER_HPP
+#define SIM_MOTORMIXER_HPP
+
+#include <device/actuator.hpp>
+#include <control/quadControlTask.hpp>
+
+#define MOTOR_COUNT                 4
+#define MOTOR_HOVER_VOLTAGE         1.8             // throttle of the simulated motors for a zero altitude command, volts
+#define MOTOR_MAX_VOLTAGE           3.3
+
+/**
+ * Motors of the plus configuration, in the order they are passed around.
+ */
+enum class Motor {
+    FRONT,
+    LEFT,
+    BACK,
+    RIGHT
+};
+
+/**
+ * Turns a ControlValue into motor voltages for a quad in plus configuration: body x points at the front motor, y at
+ * the left motor and z up; front and back spin one way, left and right the other.
+ *
+ * attitudeControl is taken as a torque demand about body x, y and z, the axes of the euler angles the controllers
+ * correct (see Quaternion::toEuler()), and altitudeControl as a change in throttle around the hover voltage.
+ *
+ * Only the simulator uses it, with the hover voltage of its motor model; the vehicle still drives each motor from one
+ * controller output until a mix has been tested in flight.
+ */
+class MotorMixer {
+private:
+    const double hoverVoltage;
+    const double maxVoltage;
+
+public:
+    explicit MotorMixer(double hoverVoltage = MOTOR_HOVER_VOLTAGE, double maxVoltage = MOTOR_MAX_VOLTAGE)
+        : hoverVoltage(hoverVoltage), maxVoltage(maxVoltage) {
+    }
+
+    void mix(const ControlValue &control, double voltages[MOTOR_COUNT]) const {
+        double throttle = hoverVoltage + control.altitudeControl;
+        double x = control.attitudeControl.x();
+        double y = control.attitudeControl.y();
+        double z = control.attitudeControl.z();
+        voltages[static_cast<int>(Motor::FRONT)] = clamp(throttle - y + z);
+        voltages[static_cast<int>(Motor::LEFT)] = clamp(throttle + x - z);
+        voltages[static_cast<int>(Motor::BACK)] = clamp(throttle + y + z);
+        voltages[static_cast<int>(Motor::RIGHT)] = clamp(throttle - x - z);
+    }
+
+    /**
+     * Mix and drive the motors, given in Motor order.
+     */
+    void apply(const ControlValue &control, Actuator *const motors[MOTOR_COUNT]) const {
+        double voltages[MOTOR_COUNT];
+        mix(control, voltages);
+        for (int i = 0; i < MOTOR_COUNT; ++i) {
+            motors[i]->set(voltages[i]);
+        }
+    }
+
+private:
+    double clamp(double value) const {
+        if (value < 0.0) {
+            return 0.0;
+        } else if (value > maxVoltage) {
+            return maxVoltage;
+        }
+        return value;
+    }
+};
+
+#endif // SIM_MOTORMIXER_HPP
@@ -0,0 +1,203 @@
+#ifndef SIM_QUADPHYSICS_HPP
+#define SIM_QUADPHYSICS_HPP
+
+#include <cmath>
+#include <sim/motorMixer.hpp>
+#include <device/actuator.hpp>
+#include <utils/math.hpp>
+
+struct QuadPhysicsConfig {
+    double mass = 1.0;                              // kg
+    double armLength = 0.23;                        // m, from the centre to each motor
+    Vector3 inertia{0.0075, 0.0075, 0.013};         // kg m^2 about body x, y and z
+    double maxThrust = 8.0;                         // N per motor at full voltage
+    double torqueCoefficient = 0.016;               // m, reaction torque about z per N of thrust
+    double motorTimeConstant = 0.03;                // s, for the thrust to follow a voltage step
+    double maxVoltage = MOTOR_MAX_VOLTAGE;
+    double linearDrag = 0.3;                        // N per m/s of air speed
+    double angularDrag = 0.002;                     // N m per rad/s
+    double gravity = 9.81;                          // m/s^2
+    Vector3 wind;                                   // m/s in the world frame
+    Vector3 magneticField{200, 0, 400};             // milliGauss in the world frame
+};
+
+/**
+ * Position and velocity in the world frame (z up), attitude as the rotation from the body to the world frame and
+ * angular rate in the body frame.
+ */
+struct QuadState {
+    Vector3 position;
+    Vector3 velocity;
+    Quaternion attitude{1, 0, 0, 0};
+    Vector3 angularRate;
+    Vector3 specificForce{0, 0, 9.81};              // what an accelerometer measures, m/s^2 in the body frame
+    bool onGround = false;
+};
+
+/**
+ * A motor of the simulated quad: remembers the voltage the control loop asked for.
+ */
+class SimulatedMotor : public Actuator {
+private:
+    double voltage = 0.0;
+    double maxVoltage = MOTOR_MAX_VOLTAGE;
+
+public:
+    void set(double value) override {
+        voltage = value < 0.0 ? 0.0 : (value > maxVoltage ? maxVoltage : value);
+    }
+
+    double get() const {
+        return voltage;
+    }
+
+    void setMaxVoltage(double value) {
+        maxVoltage = value;
+    }
+};
+
+/**
+ * Rigid body model of a quad in plus configuration (see MotorMixer for the layout). Each motor's thrust follows
+ * maxThrust * (voltage / maxVoltage)^2 with a first order lag and makes a reaction torque about z; the body sees
+ * gravity, linear drag against the wind and angular drag. The ground at z = 0 stops it.
+ *
+ * step() uses semi-implicit Euler integration, which is stable at IMU rate time steps.
+ */
+class QuadPhysics {
+private:
+    QuadPhysicsConfig config;
+    QuadState state;
+    SimulatedMotor motors[MOTOR_COUNT];
+    Actuator *actuators[MOTOR_COUNT];
+    double thrust[MOTOR_COUNT] = {0.0, 0.0, 0.0, 0.0};
+
+public:
+    explicit QuadPhysics(const QuadPhysicsConfig &config = QuadPhysicsConfig()) : config(config) {
+        for (int i = 0; i < MOTOR_COUNT; ++i) {
+            motors[i].setMaxVoltage(config.maxVoltage);
+            actuators[i] = &motors[i];
+        }
+        state.specificForce = Vector3(0, 0, config.gravity);
+    }
+
+    /**
+     * Start from the given state with the motors spun up to hover, so a flight does not begin with a drop.
+     */
+    void reset(const QuadState &initial) {
+        state = initial;
+        double hover = config.mass * config.gravity / MOTOR_COUNT;
+        for (int i = 0; i < MOTOR_COUNT; ++i) {
+            motors[i].set(hoverVoltage());
+            thrust[i] = hover;
+        }
+        state.specificForce = rotateToBody(Vector3(0, 0, config.gravity));
+    }
+
+    void step(double dt) {
+        double lag = dt >= config.motorTimeConstant ? 1.0 : dt / config.motorTimeConstant;
+        for (int i = 0; i < MOTOR_COUNT; ++i) {
+            double duty = motors[i].get() / config.maxVoltage;
+            thrust[i] += (config.maxThrust * duty * duty - thrust[i]) * lag;
+        }
+        double front = thrust[static_cast<int>(Motor::FRONT)];
+        double left = thrust[static_cast<int>(Motor::LEFT)];
+        double back = thrust[static_cast<int>(Motor::BACK)];
+        double right = thrust[static_cast<int>(Motor::RIGHT)];
+
+        // rotation: euler's equations in the body frame
+        Vector3 &omega = state.angularRate;
+        Vector3 torque(config.armLength * (left - right), config.armLength * (back - front),
+                       config.torqueCoefficient * (front + back - left - right));
+        torque -= omega * config.angularDrag;
+        Vector3 momentum = omega * config.inertia;
+        Vector3 gyroscopic;
+        Vector3::crossProduct(omega, momentum, gyroscopic);
+        Vector3 angularAcceleration = torque - gyroscopic;
+        omega += Vector3(angularAcceleration.x() / config.inertia.x(), angularAcceleration.y() / config.inertia.y(),
+                         angularAcceleration.z() / config.inertia.z()) * dt;
+        Quaternion delta;
+        delta.fromAngleVector(omega.length() * dt, omega);
+        state.attitude = state.attitude * delta;
+        state.attitude.normalize();
+
+        // translation in the world frame
+        Vector3 thrustWorld = rotateToWorld(Vector3(0, 0, front + left + back + right));
+        Vector3 contact = thrustWorld - (state.velocity - config.wind) * config.linearDrag;
+        Vector3 acceleration = contact * (1.0 / config.mass) - Vector3(0, 0, config.gravity);
+        state.velocity += acceleration * dt;
+        state.position += state.velocity * dt;
+        state.onGround = state.position.z() <= 0.0;
+        if (state.onGround) {
+            // the ground takes whatever the motors do not
+            state.position.setZ(0.0);
+            state.velocity.zero();
+            acceleration.zero();
+        }
+        state.specificForce = rotateToBody(acceleration + Vector3(0, 0, config.gravity));
+    }
+
+    const QuadState &getState() const {
+        return state;
+    }
+
+    const QuadPhysicsConfig &getConfig() const {
+        return config;
+    }
+
+    /**
+     * Motors in Motor order, for MotorMixer::apply().
+     */
+    Actuator *const *getMotors() {
+        return actuators;
+    }
+
+    /**
+     * Voltage at which the four motors together carry the weight.
+     */
+    double hoverVoltage() const {
+        return config.maxVoltage * sqrt(config.mass * config.gravity / (MOTOR_COUNT * config.maxThrust));
+    }
+
+    /**
+     * Electrical power proxy: sum of the squared motor voltages.
+     */
+    double motorEffort() const {
+        double effort = 0.0;
+        for (int i = 0; i < MOTOR_COUNT; ++i) {
+            effort += motors[i].get() * motors[i].get();
+        }
+        return effort;
+    }
+
+    /**
+     * Angle between body z and world z, in radians.
+     */
+    double tilt() const {
+        Vector3 up = rotateToWorld(Vector3(0, 0, 1));
+        double cosine = up.z() > 1.0 ? 1.0 : (up.z() < -1.0 ? -1.0 : up.z());
+        return acos(cosine);
+    }
+
+    /**
+     * What an IMU fixed to the body measures: angular rate (rad/s), specific force (g) and magnetic field
+     * (milliGauss), in the body frame. These go to SimulatedMPU9250::setTruth().
+     */
+    Vector3 sensorAcceleration() const {
+        return state.specificForce * (1.0 / config.gravity);
+    }
+
+    Vector3 sensorMagneticField() const {
+        return rotateToBody(config.magneticField);
+    }
+
+private:
+    Vector3 rotateToWorld(Vector3 vec) const {
+        return state.attitude.rotate(vec).vector();
+    }
+
+    Vector3 rotateToBody(Vector3 vec) const {
+        return state.attitude.inverse().rotate(vec).vector();
+    }
+};
+
+#endif // SIM_QUADPHYSICS_HPP
@@ -0,0 +1,212 @@
+#ifndef SIM_QUADSIMULATOR_HPP
+#define SIM_QUADSIMULATOR_HPP
+
+#include <chrono>
+#include <sstream>
+#include <sim/motorMixer.hpp>
+#include <control/quadControlTask.hpp>
+#include <sensor/imuTask.hpp>
+#include <sensor/mpu9250Sim.hpp>
+#include <sim/quadPhysics.hpp>
+
+#define SIM_IMU_RATE                1000            // IMU samples and physics steps per simulated second
+#define SIM_CONTROL_RATE            20              // same as the flight controller's QUAD_CONTROL_FREQUENCY
+#define SIM_INITIAL_ALTITUDE        10.0            // m
+#define SIM_SETTLING_BAND           (2.0 * DEGREE_TO_RAD)   // settled once the tilt stays within this
+#define SIM_ATTITUDE_KP             0.1f            // V/rad, attitude gains that settle the model's tilt
+#define SIM_ATTITUDE_KI             0.01f
+#define SIM_ATTITUDE_KD             0.02f           // V s/rad; much more oscillates against the 30 ms motor lag
+#define SIM_FILTER_ALPHA            0.9995          // in flight the accelerometer sees thrust, not gravity
+
+struct QuadSimulatorConfig {
+    int imuRate = SIM_IMU_RATE;
+    int controlRate = SIM_CONTROL_RATE;
+    QuadPhysicsConfig physics;
+    SimulatedMPU9250Config sensor;                  // noise, bias and seed of the simulated IMU
+    Vector3 initialAttitude;                        // euler angles in radians, as Quaternion::fromEuler()
+    Vector3 initialAngularRate;                     // rad/s in the body frame
+    double initialAltitude = SIM_INITIAL_ALTITUDE;
+    Vector3 referenceAttitude;                      // handed to QuadControlTask::setReference()
+    QuadControlGains gains;                         // the vehicle's gains, with SIM_ATTITUDE_* on the attitude
+    double filterAlpha = SIM_FILTER_ALPHA;
+    double settlingBand = SIM_SETTLING_BAND;        // radians
+
+    QuadSimulatorConfig() {
+        gains.yaw = gains.pitch = gains.roll = PIDGains(SIM_ATTITUDE_KP, SIM_ATTITUDE_KI, SIM_ATTITUDE_KD);
+    }
+};
+
+/**
+ * Timing of the software under test per step, and how the flight went.
+ */
+struct SimulatorStats {
+    double simulatedSeconds = 0.0;
+    double wallSeconds = 0.0;
+    long long physicsSteps = 0;
+    long long controlSteps = 0;
+    double physicsNanos = 0.0;          // mean per physics step
+    double imuNanos = 0.0;              // mean per IMUSensorTask step (driver, filters, publish)
+    double controlNanos = 0.0;          // mean per QuadControlTask step and mix
+    double maxControlNanos = 0.0;
+    double maxTilt = 0.0;               // radians
+    double finalTilt = 0.0;
+    double finalAltitude = 0.0;
+    bool crashed = false;               // touched the ground
+    bool settled = false;               // the tilt ended within the settling band
+    double settlingTime = 0.0;          // seconds until the tilt stayed within the band; the flight time if never
+    double overshoot = 0.0;             // peak tilt after first reaching the band, relative to the initial tilt
+    double effort = 0.0;                // sum of the squared motor voltages over time, V^2 s
+
+    string toString() const {
+        stringstream ss;
+        ss << "simulated=" << simulatedSeconds << "s wall=" << wallSeconds << "s ("
+           << (wallSeconds > 0 ? simulatedSeconds / wallSeconds : 0.0) << "x realtime) physics=" << physicsNanos
+           << "ns imu=" << imuNanos << "ns control=" << controlNanos << "ns (max " << maxControlNanos
+           << "ns) maxTilt=" << maxTilt * RAD_TO_DEGREE << "deg finalTilt=" << finalTilt * RAD_TO_DEGREE
+           << "deg altitude=" << finalAltitude << "m settling=" << settlingTime << "s" << (settled ? "" : " (never)")
+           << " overshoot=" << overshoot << " effort=" << effort << "V^2s" << (crashed ? " CRASHED" : "");
+        return ss.str();
+    }
+};
+
+/**
+ * Software in the loop: the flight code runs unchanged between a physics model and simulated hardware. The quad's
+ * motion drives a SimulatedMPU9250 under the real IMUSensorTask, QuadControlTask computes outputs from its attitude
+ * estimate, and MotorMixer drives the model's motors through the same Actuator interface as the PWM pins.
+ *
+ * The attitude estimate starts at the model's initial attitude, as if the quad had been flying in it: in flight the
+ * accelerometer only sees the thrust along body z, so the filter could not find an initial tilt by itself.
+ *
+ * Everything runs in lock step on the calling thread, as fast as the CPU allows: one physics step and one IMU
+ * sample per 1 / imuRate simulated seconds, and a control step every imuRate / controlRate of those. Time is the
+ * simulated chip's clock, so a flight comes out the same however fast or slow it runs.
+ */
+class QuadSimulator {
+private:
+    typedef std::chrono::steady_clock simClock;
+
+    const QuadSimulatorConfig config;
+    SimulatedMPU9250 chip;
+    IMUSensorTask imuTask;
+    QuadControlTask controlTask;
+    QuadPhysics physics;
+    MotorMixer mixer;
+
+public:
+    explicit QuadSimulator(const QuadSimulatorConfig &config = QuadSimulatorConfig())
+        : config(config), chip(lockStep(config.sensor)), imuTask(config.imuRate, 1, config.imuRate, &chip),
+          controlTask(config.controlRate, 1, imuTask, config.gains), physics(config.physics),
+          mixer(physics.hoverVoltage(), config.physics.maxVoltage) {
+        QuadState initial;
+        Vector3 euler = config.initialAttitude;
+        initial.attitude.fromEuler(euler);
+        initial.angularRate = config.initialAngularRate;
+        initial.position.setZ(config.initialAltitude);
+        physics.reset(initial);
+        imuTask.setFilterAlpha(config.filterAlpha);
+        IMUValue start;
+        start.timestamp = chip.timestamp();
+        start.gyroAngle = initial.attitude;
+        start.thetaCompFilter = initial.attitude;
+        imuTask.seed(start);
+        const Vector3 &reference = config.referenceAttitude;
+        controlTask.setReference(reference.x(), reference.y(), reference.z(), 0.0);
+    }
+
+    /**
+     * Fly for the given number of simulated seconds. Can be called again to continue the flight.
+     */
+    SimulatorStats run(double seconds) {
+        SimulatorStats stats;
+        double dt = 1.0 / config.imuRate;
+        int controlEvery = config.controlRate > 0 && config.controlRate < config.imuRate
+                           ? config.imuRate / config.controlRate : 1;
+        auto steps = static_cast<long long>(seconds * config.imuRate);
+        double initialTilt = physics.tilt();
+        bool reachedBand = false;
+        double peakAfterBand = 0.0;
+        long long outsideBand = -1;     // last step with the tilt outside the band
+        auto start = simClock::now();
+        for (long long i = 0; i < steps; ++i) {
+            auto before = simClock::now();
+            physics.step(dt);
+            const QuadState &state = physics.getState();
+            chip.setTruth(state.angularRate, physics.sensorAcceleration(), physics.sensorMagneticField());
+            chip.generate(1);
+            auto afterPhysics = simClock::now();
+            imuTask.step();
+            auto afterImu = simClock::now();
+            stats.physicsNanos += std::chrono::duration<double, std::nano>(afterPhysics - before).count();
+            stats.imuNanos += std::chrono::duration<double, std::nano>(afterImu - afterPhysics).count();
+
+            if (i % controlEvery == 0) {
+                controlTask.step(imuTask.getData(), chip.timestamp());
+                mixer.apply(controlTask.getData(), physics.getMotors());
+                double nanos = std::chrono::duration<double, std::nano>(simClock::now() - afterImu).count();
+                stats.controlNanos += nanos;
+                stats.maxControlNanos = max(stats.maxControlNanos, nanos);
+                stats.controlSteps++;
+            }
+
+            double tilt = physics.tilt();
+            stats.maxTilt = max(stats.maxTilt, tilt);
+            if (tilt > config.settlingBand) {
+                outsideBand = i;
+            } else {
+                reachedBand = true;
+            }
+            if (reachedBand) {
+                peakAfterBand = max(peakAfterBand, tilt);
+            }
+            stats.effort += physics.motorEffort() * dt;
+            stats.crashed = stats.crashed || state.onGround;
+            stats.physicsSteps++;
+        }
+        stats.wallSeconds = std::chrono::duration<double>(simClock::now() - start).count();
+        stats.simulatedSeconds = steps * dt;
+        if (stats.physicsSteps > 0) {
+            stats.physicsNanos /= stats.physicsSteps;
+            stats.imuNanos /= stats.physicsSteps;
+        }
+        if (stats.controlSteps > 0) {
+            stats.controlNanos /= stats.controlSteps;
+        }
+        stats.settled = outsideBand < steps - 1;
+        stats.settlingTime = stats.settled ? (outsideBand + 1) * dt : stats.simulatedSeconds;
+        stats.overshoot = initialTilt > 0 ? (reachedBand ? peakAfterBand : stats.maxTilt) / initialTilt : 0.0;
+        stats.finalTilt = physics.tilt();
+        stats.finalAltitude = physics.getState().position.z();
+        return stats;
+    }
+
+    QuadPhysics &getPhysics() {
+        return physics;
+    }
+
+    IMUSensorTask &getIMUTask() {
+        return imuTask;
+    }
+
+    QuadControlTask &getControlTask() {
+        return controlTask;
+    }
+
+    /**
+     * Microseconds since epoch on the simulated clock.
+     */
+    long long getSimulatedTime() {
+        return chip.timestamp();
+    }
+
+private:
+    /**
+     * Samples only enter the FIFO when the simulation generates them.
+     */
+    static SimulatedMPU9250Config lockStep(SimulatedMPU9250Config sensor) {
+        sensor.realTime = false;
+        sensor.samplesPerPoll = 0;
+        return sensor;
+    }
+};
+
+#endif // SIM_QUADSIMULATOR_HPP
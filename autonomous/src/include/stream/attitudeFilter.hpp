@@ -0,0 +1,46 @@
+#ifndef SENSOR_ATTITUDEFILTER_HPP
+#define SENSOR_ATTITUDEFILTER_HPP
+
+#include <cmath>
+#include <utils/math.hpp>
+
+#define ATTITUDE_FILTER_ALPHA       0.9             // weight of the gyro in the complementary filter
+
+/**
+ * Attitude estimate for one IMU sample: integrate the gyro, correct the tilt with the accelerometer and blend the two
+ * with a complementary filter, alpha being the weight of the gyro. T needs gyroRaw, accelRaw, rateIntegral, gyroAngle, accelAngle and thetaCompFilter;
+ * thetaCompFilter holds the estimate of the previous sample on entry.
+ *
+ * This does not touch the device, so live acquisition (IMU::applyFilters()) and log replay run the same code.
+ */
+template<class T>
+void applyAttitudeFilter(double delta_t, T *imuData, double alpha = ATTITUDE_FILTER_ALPHA) {
+    // compute integral of gyro to get angle
+    // q_omega(t + 1) = q_omega(t) * q(delta_t * || omega_t ||, omega_t / || omega_t ||)
+    imuData->gyroAngle = imuData->rateIntegral.apply(delta_t, imuData->gyroRaw, &imuData->thetaCompFilter);
+
+    // use accelerometer to correct for the tilt
+    // q(t) = q(phi, n / || n ||)
+    //      gravity = (0, 0, 1)
+    //      qa_world = q_omega(t + 1) * accel_t * inverse(q_omega(t + 1))
+    //      v = vector(normalize(qa_world))
+    //      n = v x gravity: cross product
+    //      phi = acos(v . gravity): dot product
+    Vector3 gravity(0, 0, 1);
+    Quaternion qaWorld = imuData->gyroAngle.rotate(imuData->accelRaw);
+    qaWorld.normalize();
+    Vector3 v = qaWorld.vector();
+    Vector3 n;
+    Vector3::crossProduct(v, gravity, n);
+    n.normalize();
+    double phi = acos(Vector3::dotProduct(v, gravity));
+    imuData->accelAngle.fromAngleVector(phi, n);
+
+    // complementary filter
+    // q_c(t) = q((1 - alpha) * phi, n) * q_omega(t + 1)
+    Quaternion q_alpha;
+    q_alpha.fromAngleVector((1.0 - alpha) * phi, n);
+    imuData->thetaCompFilter = q_alpha * imuData->gyroAngle;
+}
+
+#endif //SENSOR_ATTITUDEFILTER_HPP
@@ -0,0 +1,189 @@
+#ifndef UTILS_JSONWRITER_HPP_
+#define UTILS_JSONWRITER_HPP_
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <utils/json.hpp>
+#include <utils/math.hpp>
+
+using namespace std;
+
+/**
+ * Streams json into a caller owned buffer without building a DOM. Once the buffer has grown to the size of a frame,
+ * writing does not allocate.
+ *
+ * The output is byte identical to json::dump() as long as the keys of every object are written in alphabetical
+ * order, which is the order in which json stores them.
+ */
+class JsonWriter {
+private:
+    string &buffer;
+    bool needComma = false;
+
+public:
+    explicit JsonWriter(string &buffer) : buffer(buffer) {
+    }
+
+    void beginObject() {
+        separate();
+        buffer.push_back('{');
+        needComma = false;
+    }
+
+    void endObject() {
+        buffer.push_back('}');
+        needComma = true;
+    }
+
+    void beginArray() {
+        separate();
+        buffer.push_back('[');
+        needComma = false;
+    }
+
+    void endArray() {
+        buffer.push_back(']');
+        needComma = true;
+    }
+
+    void key(const char *name) {
+        separate();
+        writeString(name, strlen(name));
+        buffer.push_back(':');
+        needComma = false;
+    }
+
+    void value(long long value) {
+        separate();
+        char data[24];
+        int length = snprintf(data, sizeof(data), "%lld", value);
+        buffer.append(data, static_cast<size_t>(length));
+        needComma = true;
+    }
+
+    void value(int value) {
+        this->value(static_cast<long long>(value));
+    }
+
+    void value(double value) {
+        separate();
+        if (!std::isfinite(value)) {
+            buffer.append("null", 4);
+        } else {
+            char data[64];
+            char *end = nlohmann::detail::to_chars(data, data + sizeof(data), value);
+            buffer.append(data, static_cast<size_t>(end - data));
+        }
+        needComma = true;
+    }
+
+    void value(const char *value, size_t length) {
+        separate();
+        writeString(value, length);
+        needComma = true;
+    }
+
+    template<class V>
+    void field(const char *name, V value) {
+        key(name);
+        this->value(value);
+    }
+
+    /**
+     * A vector as {"x", "y", "z"}.
+     */
+    void field(const char *name, const Vector3 &vec) {
+        key(name);
+        beginObject();
+        field("x", vec.x());
+        field("y", vec.y());
+        field("z", vec.z());
+        endObject();
+    }
+
+    /**
+     * A vector of Euler angles (yaw, pitch, roll) as {"pitch", "roll", "yaw"}.
+     */
+    void eulerField(const char *name, const Vector3 &angles) {
+        key(name);
+        beginObject();
+        field("pitch", angles.y());
+        field("roll", angles.z());
+        field("yaw", angles.x());
+        endObject();
+    }
+
+    void field(const char *name, const Quaternion &quat) {
+        key(name);
+        beginObject();
+        field("scalar", quat.scalar());
+        field("x", quat.x());
+        field("y", quat.y());
+        field("z", quat.z());
+        endObject();
+    }
+
+    /**
+     * A double printed like to_string() followed by a suffix, e.g. "37.386921N".
+     */
+    void fixedField(const char *name, double value, char suffix) {
+        char data[384];
+        int length = snprintf(data, sizeof(data) - 1, "%f", value);
+        if (length < 0 || length >= static_cast<int>(sizeof(data)) - 1) {
+            length = 0;
+        }
+        data[length++] = suffix;
+        key(name);
+        this->value(data, static_cast<size_t>(length));
+    }
+
+private:
+    void separate() {
+        if (needComma) {
+            buffer.push_back(',');
+        }
+    }
+
+    void writeString(const char *value, size_t length) {
+        static const char *hex = "0123456789abcdef";
+        buffer.push_back('"');
+        for (size_t i = 0; i < length; ++i) {
+            char c = value[i];
+            switch (c) {
+                case '\b':
+                    buffer.append("\\b", 2);
+                    break;
+                case '\t':
+                    buffer.append("\\t", 2);
+                    break;
+                case '\n':
+                    buffer.append("\\n", 2);
+                    break;
+                case '\f':
+                    buffer.append("\\f", 2);
+                    break;
+                case '\r':
+                    buffer.append("\\r", 2);
+                    break;
+                case '"':
+                    buffer.append("\\\"", 2);
+                    break;
+                case '\\':
+                    buffer.append("\\\\", 2);
+                    break;
+                default:
+                    if (static_cast<unsigned char>(c) <= 0x1f) {
+                        char escaped[6] = {'\\', 'u', '0', '0', hex[(c >> 4) & 0xf], hex[c & 0xf]};
+                        buffer.append(escaped, 6);
+                    } else {
+                        buffer.push_back(c);
+                    }
+            }
+        }
+        buffer.push_back('"');
+    }
+};
+
+#endif // UTILS_JSONWRITER_HPP_
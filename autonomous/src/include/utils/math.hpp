@@ -351,7 +351,7 @@ public:
         return q * vec * q.inverse();
     }
 
-    void toEuler(Vector3 &vec) {
+    void toEuler(Vector3 &vec) const {
         vec.setX(atan2(2.0 * (value[2] * value[3] + value[0] * value[1]),
                        1 - 2.0 * (value[1] * value[1] + value[2] * value[2])));
         vec.setY(asin(2.0 * (value[0] * value[2] - value[1] * value[3])));
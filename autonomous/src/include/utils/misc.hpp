@@ -10,6 +10,7 @@
 #include <sstream>
 #include <string>
 #include <sys/time.h>
+#include <time.h>
 
 using namespace std;
 
@@ -47,4 +48,27 @@ uint64_t currentMicroSecondsSinceEpoch() {
     return (uint64_t)tv.tv_sec * 1000000 + (uint64_t)tv.tv_usec;
 }
 
+/**
+ * CLOCK_MONOTONIC in nanoseconds, for measuring intervals across threads: unlike the wall clock it never jumps.
+ */
+long long monotonicNanoSeconds() {
+    struct timespec ts{};
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * Days from 1970-01-01 to a date of the proleptic Gregorian calendar, without mktime() and the time zone.
+ */
+long long daysSinceEpoch(long long year, long long month, long long day) {
+    // years start in March, so the leap day is the last day of a year
+    year -= month <= 2;
+    long long era = (year >= 0 ? year : year - 399) / 400;
+    long long yearOfEra = year - era * 400;
+    long long dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    long long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
 #endif /* UTIL_HPP_ */
@@ -0,0 +1,45 @@
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <sim/monteCarlo.hpp>
+
+#define MONTE_CARLO_FLIGHTS         20              // flights per parameter set
+
+/**
+ * Sweep the attitude controller gains and the complementary filter weight over randomized simulated flights:
+ *   montecarlo [flights per parameter set] [threads]
+ * Parameter sets are listed best first: fewest crashes, most settled flights, then shortest settling time.
+ */
+int main(int argc, char *argv[]) {
+    MonteCarloConfig config;
+    config.flights = argc > 1 ? stoi(argv[1]) : MONTE_CARLO_FLIGHTS;
+    config.threads = argc > 2 ? static_cast<unsigned int>(stoi(argv[2])) : 0;
+
+    // around the simulator's defaults (SIM_ATTITUDE_*, SIM_FILTER_ALPHA): kd stays well below 0.1 V s/rad for the
+    // 30 ms motor lag, and alpha spans filters that lose the tilt in flight to ones that keep it
+    vector<ParameterSet> parameterSets;
+    for (float kp : {0.05f, 0.1f, 0.2f}) {
+        for (float kd : {0.01f, 0.02f, 0.05f}) {
+            for (double alpha : {0.995, 0.999, 0.9995}) {
+                parameterSets.push_back(ParameterSet::attitude(PIDGains(kp, 0.1f * kp, kd), alpha));
+            }
+        }
+    }
+
+    MonteCarloRunner runner(config);
+    vector<ParameterResult> results = runner.run(parameterSets);
+    sort(results.begin(), results.end(), [](const ParameterResult &a, const ParameterResult &b) {
+        if (a.crashed != b.crashed) {
+            return a.crashed < b.crashed;
+        }
+        if (a.settled != b.settled) {
+            return a.settled > b.settled;
+        }
+        return a.meanSettlingTime < b.meanSettlingTime;
+    });
+    for (auto &result : results) {
+        cout << result.toString() << endl;
+    }
+    cout << runner.getStats().toString() << endl;
+    return 0;
+}
@@ -8,6 +8,13 @@
 #include <device/pwm.hpp>
 #include <control/pid.hpp>
 #include <core/baseServer.hpp>
+#include <core/flightRecorder.hpp>
+#include <core/udpTelemetry.hpp>
+#include <core/periodicTimer.hpp>
+#include <core/latencyTrace.hpp>
+#include <core/metrics.hpp>
+#include <core/statsServer.hpp>
+#include <core/realtime.hpp>
 #include <control/quadControlTask.hpp>
 
 #define MOTOR_FRONT                     19
@@ -15,7 +22,7 @@
 #define MOTOR_BACK                      20
 #define MOTOR_RIGHT                     16
 
-#define THREAD_POOL_COUNT               7
+#define THREAD_POOL_COUNT               1               // all servers share one io_context thread
 
 #define GPS_DEVICE_NAME                 "/dev/serial0"
 #define GPS_SERVER_FREQUENCY            10              // frequency in Hz
@@ -28,9 +35,33 @@
 
 #define HOSTNAME                        "localhost"
 
+// shared memory rings for consumers on the vehicle (loggers, autonomy), see core/shmRing.hpp
+#define GPS_SHM_NAME                    "/quadcopter.gps"
+#define IMU_SHM_NAME                    "/quadcopter.imu"
+#define CONTROL_SHM_NAME                "/quadcopter.control"
+
+// multicast telemetry for the ground station, see core/udpTelemetry.hpp
+#define TELEMETRY_GROUP                 "239.255.0.1"
+#define TELEMETRY_IMU_BATCH             5               // IMU samples per datagram
+
+// black box: every GPS, IMU and control value, read back with the flightlog tool, see core/flightRecorder.hpp
+#define FLIGHT_LOG_DIR                  "flightlogs"
+
+// SCHED_FIFO priorities (0 = default scheduler) and cores: the IMU and control loops share core 3, away from
+// the servers and the rest of the system
+#define IMU_THREAD_PRIORITY             80
+#define CONTROL_THREAD_PRIORITY         70
+#define MOTOR_THREAD_PRIORITY           60
+#define GPS_THREAD_PRIORITY             0
+#define REALTIME_CPU                    3
+
 const unsigned short gpsPort = 5000;
 const unsigned short imuPort = 5001;
 const unsigned short controlPort = 5002;
+const unsigned short statsPort = 5003;
+const unsigned short gpsTelemetryPort = 5100;
+const unsigned short imuTelemetryPort = 5101;
+const unsigned short controlTelemetryPort = 5102;
 
 boost::asio::thread_pool threadPool(THREAD_POOL_COUNT);
 
@@ -40,35 +71,119 @@ public:
 
     GPSSensorTask gpsSensorTask;
     IMUSensorTask imuSensorTask;
+    TimerEdgeSource imuDataReady;       // replace with GPIOEdgeSource once the MPU9250 INT pin is wired
     QuadControlTask quadControlTask;
 
+    ShmRingWriter<GPSValue> gpsRing;
+    ShmRingWriter<IMUValue> imuRing;
+    ShmRingWriter<ControlValue> controlRing;
+    FlightRecorder recorder;
+
     PWM motorFront;
     PWM motorLeft;
     PWM motorBack;
     PWM motorRight;
+    LatencyTracker latency;             // IMU sample to motor command, per stage
+    MetricsRegistry metrics;            // served at /metrics
+
+    boost::thread gpsThread;
+    boost::thread imuThread;
+    boost::thread controlThread;
+
+    boost::asio::io_context serverIO;
+    BaseServer<GPSValue> gpsServer;
+    BaseServer<IMUValue> imuServer;
+    BaseServer<ControlValue> controlServer;
+    UdpPublisher<GPSValue> gpsPublisher;
+    UdpPublisher<IMUValue> imuPublisher;
+    UdpPublisher<ControlValue> controlPublisher;
+    StatsServer statsServer;
 
 public:
     Quadcopter() : gpsSensorTask(GPS_DEVICE_NAME, GPS_SERVER_FREQUENCY, NUM_SAMPLES),
                    imuSensorTask(IMU_SERVER_FREQUENCY, NUM_SAMPLES),
+                   imuDataReady(imuSensorTask.getSampleRate()),
                    quadControlTask(QUAD_CONTROL_FREQUENCY, NUM_SAMPLES, imuSensorTask),
+                   gpsRing(GPS_SHM_NAME),
+                   imuRing(IMU_SHM_NAME),
+                   controlRing(CONTROL_SHM_NAME),
+                   recorder(flightLogPath()),
                    motorFront(MOTOR_FRONT, MOTOR_PWM_FREQUENCY),
                    motorLeft(MOTOR_LEFT, MOTOR_PWM_FREQUENCY),
                    motorBack(MOTOR_BACK, MOTOR_PWM_FREQUENCY),
-                   motorRight(MOTOR_RIGHT, MOTOR_PWM_FREQUENCY) {
-        boost::asio::post(threadPool, boost::bind(&GPSSensorTask::run, &gpsSensorTask));
-        boost::asio::post(threadPool, boost::bind(&IMUSensorTask::run, &imuSensorTask));
-        boost::asio::post(threadPool, boost::bind(&QuadControlTask::run, &quadControlTask));
+                   motorRight(MOTOR_RIGHT, MOTOR_PWM_FREQUENCY),
+                   gpsServer(HOSTNAME, gpsPort, gpsSensorTask),
+                   imuServer(HOSTNAME, imuPort, imuSensorTask),
+                   controlServer(HOSTNAME, controlPort, quadControlTask),
+                   gpsPublisher(gpsSensorTask, TELEMETRY_GROUP, gpsTelemetryPort, GPS_SERVER_FREQUENCY),
+                   imuPublisher(imuSensorTask, TELEMETRY_GROUP, imuTelemetryPort, IMU_SERVER_FREQUENCY,
+                                TELEMETRY_IMU_BATCH),
+                   controlPublisher(quadControlTask, TELEMETRY_GROUP, controlTelemetryPort,
+                                    QUAD_CONTROL_FREQUENCY),
+                   statsServer(statsPort) {
+        imuSensorTask.setDataReadySource(&imuDataReady);
+        if (gpsRing.open()) {
+            gpsSensorTask.setShmRing(&gpsRing);
+        }
+        if (imuRing.open()) {
+            imuSensorTask.setShmRing(&imuRing);
+        }
+        if (controlRing.open()) {
+            quadControlTask.setShmRing(&controlRing);
+        }
+        auto *gpsChannel = recorder.addChannel<GPSValue>();
+        auto *imuChannel = recorder.addChannel<IMUValue>();
+        auto *controlChannel = recorder.addChannel<ControlValue>();
+        if (recorder.open()) {
+            gpsSensorTask.setRecorder(gpsChannel);
+            imuSensorTask.setRecorder(imuChannel);
+            quadControlTask.setRecorder(controlChannel);
+            recorder.setMetrics(metrics);
+            recorder.start();
+        }
+        gpsSensorTask.setMetrics(metrics, "gps");
+        imuSensorTask.setMetrics(metrics, "imu");
+        quadControlTask.setMetrics(metrics, "control");
+        gpsServer.setMetrics(metrics, "gps");
+        imuServer.setMetrics(metrics, "imu");
+        controlServer.setMetrics(metrics, "control");
+        latency.setMetrics(metrics);
+
+        vector<int> realtimeCpu{REALTIME_CPU};
+        gpsThread = gpsSensorTask.launch(ThreadConfig("gps", GPS_THREAD_PRIORITY));
+        imuThread = imuSensorTask.launch(ThreadConfig("imu", IMU_THREAD_PRIORITY, realtimeCpu, true));
+        controlThread = quadControlTask.launch(ThreadConfig("control", CONTROL_THREAD_PRIORITY, realtimeCpu, true));
     }
 
     void setup() {
-        boost::asio::post(threadPool, boost::bind(&Quadcopter::launchGPSServer, this));
-        boost::asio::post(threadPool, boost::bind(&Quadcopter::launchIMUServer, this));
-        boost::asio::post(threadPool, boost::bind(&Quadcopter::launchControlServer, this));
+        cout << "Launching GPS Server on port " << gpsPort << endl;
+        gpsServer.start(serverIO);
+        cout << "Launching IMU Server on port " << imuPort << endl;
+        imuServer.start(serverIO);
+        cout << "Launching Control Server on port " << controlPort << endl;
+        controlServer.start(serverIO);
+        cout << "Launching telemetry on " << TELEMETRY_GROUP << endl;
+        gpsPublisher.start(serverIO);
+        imuPublisher.start(serverIO);
+        controlPublisher.start(serverIO);
+        cout << "Launching Stats Server on port " << statsPort << endl;
+        statsServer.addPage("/latency", "application/json", [this](string &buffer) {
+            latency.writeJson(buffer);
+        });
+        statsServer.addPage("/metrics", "text/plain; version=0.0.4", [this](string &buffer) {
+            metrics.writePrometheus(buffer);
+        });
+        statsServer.start(serverIO);
+        boost::asio::post(threadPool, [this]() {
+            serverIO.run();
+        });
     }
 
     void control() {
-        cout << "Starting controller..." << endl;
-        unsigned int microSeconds = 1000000 / QUAD_CONTROL_FREQUENCY;
+        ThreadConfigReport report = applyThreadConfig(
+            ThreadConfig("motors", MOTOR_THREAD_PRIORITY, vector<int>{REALTIME_CPU}, true));
+        cout << "Starting controller... " << report.toString() << endl;
+        PeriodicTimer timer(QUAD_CONTROL_FREQUENCY);
         while (!isShutdown) {
             ControlValue controlValue = quadControlTask.getData();
 
@@ -76,35 +191,39 @@ public:
             motorLeft.set(controlValue.attitudeControl.y());
             motorBack.set(controlValue.attitudeControl.z());
             motorRight.set(controlValue.altitudeControl);
+            latency.actuated(controlValue.latency);
 
-            usleep(microSeconds);
+            timer.wait();
         }
+        cout << "Controller stopped... " << timer.getStats().toString() << endl;
+        cout << "Sensor to motor latency:\n" << latency.toString() << endl;
     }
 
     void shutdown() {
         isShutdown = true;
+        // the loops publish to the servers, rings and recorder, so they stop first
+        quadControlTask.shutdown();
+        imuSensorTask.shutdown();
+        gpsSensorTask.shutdown();
+        controlThread.join();
+        imuThread.join();
+        gpsThread.join();
+        gpsServer.shutdown();
+        imuServer.shutdown();
+        controlServer.shutdown();
+        gpsPublisher.shutdown();
+        imuPublisher.shutdown();
+        controlPublisher.shutdown();
+        statsServer.shutdown();
+        recorder.shutdown();
     }
 
-private:
-    void launchGPSServer() {
-        BaseServer<GPSValue> server(HOSTNAME, gpsPort, gpsSensorTask);
-        boost::asio::io_context io;
-        cout << "Launching GPS Server on port " << gpsPort << endl;
-        server.launch(io);
-    }
-
-    void launchIMUServer() {
-        BaseServer <IMUValue> server(HOSTNAME, imuPort, imuSensorTask);
-        boost::asio::io_context io;
-        cout << "Launching IMU Server on port " << imuPort << endl;
-        server.launch(io);
-    }
-
-    void launchControlServer() {
-        BaseServer <ControlValue> server(HOSTNAME, controlPort, quadControlTask);
-        boost::asio::io_context io;
-        cout << "Launching Control Server on port " << controlPort << endl;
-        server.launch(io);
+    /**
+     * A new log file per run, named after the start time.
+     */
+    static string flightLogPath() {
+        mkdir(FLIGHT_LOG_DIR, 0755);
+        return string(FLIGHT_LOG_DIR) + "/flight-" + to_string(currentMicroSecondsSinceEpoch() / 1000000) + ".qdr";
     }
 
 };
@@ -0,0 +1,31 @@
+#include <iostream>
+#include <string>
+#include <sim/quadSimulator.hpp>
+
+#define SIMULATOR_SECONDS           10              // simulated flight time
+#define SIMULATOR_REPORT_SECONDS    1               // one line of stats per this many simulated seconds
+
+/**
+ * Fly the control stack against the physics model, faster than real time:
+ *   simulator [seconds] [x y z]       initial euler angles in degrees, default a 10 degree tilt about x
+ * Exits with 1 if the quad hit the ground.
+ */
+int main(int argc, char *argv[]) {
+    double seconds = argc > 1 ? stod(argv[1]) : SIMULATOR_SECONDS;
+    QuadSimulatorConfig config;
+    config.initialAttitude = Vector3(10 * DEGREE_TO_RAD, 0, 0);
+    if (argc > 4) {
+        config.initialAttitude = Vector3(stod(argv[2]) * DEGREE_TO_RAD, stod(argv[3]) * DEGREE_TO_RAD,
+                                         stod(argv[4]) * DEGREE_TO_RAD);
+    }
+
+    QuadSimulator simulator(config);
+    cout << "Hover voltage " << simulator.getPhysics().hoverVoltage() << "V" << endl;
+    bool crashed = false;
+    for (double t = 0; t < seconds; t += SIMULATOR_REPORT_SECONDS) {
+        SimulatorStats stats = simulator.run(min<double>(SIMULATOR_REPORT_SECONDS, seconds - t));
+        cout << "t=" << t + stats.simulatedSeconds << "s " << stats.toString() << endl;
+        crashed = crashed || stats.crashed;
+    }
+    return crashed ? 1 : 0;
+}